@@ -0,0 +1,639 @@
+/*
+ * Japacker benchmark
+ *
+ * Packs reproducible synthetic sets of rectangles with every japacker_sort_type, with rotation on and off and with
+ * options.reduce_image_size on and off, and prints one CSV line per run.
+ *
+ * Usage: japacker_bench [options]
+ *
+ * --corpus NAME        Only use this corpus. Can be repeated. The corpora are: uniform, powerlaw, glyphs, tiles and
+ *                      aspect. Defaults to all of them.
+ * --rects N[,N...]     The number of rectangles of each corpus. Defaults to 1000,10000,100000.
+ * --search NAME        The search method, which can be list, tree or scan. Defaults to list, like options.search_by.
+ * --algorithm NAME     The packing algorithm, which can be guillotine or skyline. Defaults to guillotine.
+ * --repeat N           Pack each configuration N times and keep the fastest time. Defaults to 1.
+ * --no-verify          Don't check that the packed rects are inside their images and don't overlap.
+ *
+ * The columns are:
+ * corpus, rects, sort, rotation, reduce, search,
+ * algorithm                                     - The configuration of the run
+ * packed                                        - The number of packed rects, as returned by japacker_pack()
+ * images, last_width, last_height               - The number of images and the size of the last one
+ * seconds, rects_per_second                     - The time spent in japacker_pack()
+ * peak_bytes                                    - The most memory allocated by the packer at any time, rects included
+ * empty_areas                                   - The most empty area slots used at the same time by any image,
+ *                                                 from japacker_stats.max_empty_area_index of an untimed pack
+ * efficiency                                    - The area of the packed rects divided by the area of the images
+ * layout_hash                                   - A hash of every rect's output, which only changes if the layout does
+ * valid                                         - 1 if the layout is correct, 0 if not, - if it wasn't verified
+ *
+ * The program returns 1 if any layout is not valid, so it can be used to catch regressions.
+ *
+ * The empty_areas column comes from packing each run once more in japacker_bench_stats.c, the only file built with
+ * JAPACKER_STATS, so the times don't include the cost of the counters.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/**
+ * The allocations are prefixed with their size, using a block large enough to keep the alignment of malloc().
+ */
+#define BENCH_ALLOCATION_HEADER 16
+
+static size_t bench_current_bytes;
+static size_t bench_peak_bytes;
+
+static void *bench_malloc(size_t size)
+{
+    unsigned char *block = (unsigned char *) malloc(size + BENCH_ALLOCATION_HEADER);
+    if (!block) {
+        return 0;
+    }
+    memcpy(block, &size, sizeof(size_t));
+    bench_current_bytes += size;
+    if (bench_current_bytes > bench_peak_bytes) {
+        bench_peak_bytes = bench_current_bytes;
+    }
+    return block + BENCH_ALLOCATION_HEADER;
+}
+
+static void bench_free(void *pointer)
+{
+    if (!pointer) {
+        return;
+    }
+    unsigned char *block = (unsigned char *) pointer - BENCH_ALLOCATION_HEADER;
+    size_t size;
+    memcpy(&size, block, sizeof(size_t));
+    bench_current_bytes -= size;
+    free(block);
+}
+
+static void *bench_realloc(void *pointer, size_t size)
+{
+    if (!pointer) {
+        return bench_malloc(size);
+    }
+    unsigned char *block = (unsigned char *) pointer - BENCH_ALLOCATION_HEADER;
+    size_t old_size;
+    memcpy(&old_size, block, sizeof(size_t));
+    block = (unsigned char *) realloc(block, size + BENCH_ALLOCATION_HEADER);
+    if (!block) {
+        return 0;
+    }
+    memcpy(block, &size, sizeof(size_t));
+    bench_current_bytes += size - old_size;
+    if (bench_current_bytes > bench_peak_bytes) {
+        bench_peak_bytes = bench_current_bytes;
+    }
+    return block + BENCH_ALLOCATION_HEADER;
+}
+
+#define JAPACKER_MALLOC(size) bench_malloc(size)
+#define JAPACKER_REALLOC(pointer, size) bench_realloc(pointer, size)
+#define JAPACKER_FREE(pointer) bench_free(pointer)
+
+#include "japacker.h"
+
+/**
+ * The bitmap used to verify a layout is never larger than this many bits, so huge images are not verified.
+ */
+#define BENCH_MAX_VERIFY_BITS (1ull << 31)
+
+/**
+ * How much larger than the total area of the rects the destination image is, so most runs need a single image.
+ */
+#define BENCH_IMAGE_SLACK 1.25
+
+unsigned long long bench_count_empty_areas(const unsigned int *sizes, unsigned int num_rects, unsigned int image_size,
+    int sort_by, int allow_rotation, int reduce_image_size, int search_by, int algorithm);
+
+
+/*
+ * Corpus related functions
+ */
+
+/**
+ * @brief A small, fast and portable random number generator, so every corpus is the same on every platform.
+ */
+typedef struct bench_random {
+    unsigned long long state;
+} bench_random;
+
+static unsigned int bench_random_next(bench_random *random)
+{
+    // splitmix64
+    unsigned long long z = (random->state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return (unsigned int) ((z ^ (z >> 31)) >> 32);
+}
+
+/**
+ * @brief Gets a random number between min and max, both included.
+ */
+static unsigned int bench_random_range(bench_random *random, unsigned int min, unsigned int max)
+{
+    return min + bench_random_next(random) % (max - min + 1);
+}
+
+/**
+ * @brief Gets a random number in the ]0, 1] interval.
+ */
+static double bench_random_unit(bench_random *random)
+{
+    return (bench_random_next(random) + 1.0) / 4294967296.0;
+}
+
+/**
+ * @brief Sizes between 1 and 64, with every size equally likely.
+ */
+static void bench_generate_uniform(bench_random *random, unsigned int *width, unsigned int *height)
+{
+    *width = bench_random_range(random, 1, 64);
+    *height = bench_random_range(random, 1, 64);
+}
+
+/**
+ * @brief Mostly small sizes, with a few large ones, like the sprites of a game.
+ */
+static void bench_generate_powerlaw(bench_random *random, unsigned int *width, unsigned int *height)
+{
+    // Pareto distribution with an alpha of 2, capped to 256
+    double size = 4 / sqrt(bench_random_unit(random));
+    if (size > 256) {
+        size = 256;
+    }
+    double aspect = 0.5 + bench_random_unit(random);
+    *width = (unsigned int) (size * aspect);
+    *height = (unsigned int) (size / aspect);
+    if (!*width) {
+        *width = 1;
+    }
+    if (!*height) {
+        *height = 1;
+    }
+}
+
+/**
+ * @brief The glyphs of a font rendered at a few common sizes.
+ */
+static void bench_generate_glyphs(bench_random *random, unsigned int *width, unsigned int *height)
+{
+    static const unsigned int font_sizes[] = { 12, 16, 24, 32, 48 };
+    unsigned int font_size = font_sizes[bench_random_range(random, 0, 4)];
+
+    // Glyphs range from punctuation marks to letters with both ascenders and descenders
+    *height = font_size * bench_random_range(random, 20, 120) / 100 + 1;
+    *width = font_size * bench_random_range(random, 20, 90) / 100 + 1;
+}
+
+/**
+ * @brief Many identical tiles, with a few half-size and double-size ones.
+ */
+static void bench_generate_tiles(bench_random *random, unsigned int *width, unsigned int *height)
+{
+    unsigned int kind = bench_random_range(random, 0, 99);
+    unsigned int size = kind < 90 ? 32 : (kind < 95 ? 16 : 64);
+    *width = size;
+    *height = size;
+}
+
+/**
+ * @brief Long and thin rects, half of them horizontal and half of them vertical.
+ */
+static void bench_generate_aspect(bench_random *random, unsigned int *width, unsigned int *height)
+{
+    unsigned int thin = bench_random_range(random, 1, 4);
+    unsigned int tall = bench_random_range(random, 64, 512);
+    if (bench_random_next(random) & 1) {
+        *width = thin;
+        *height = tall;
+    } else {
+        *width = tall;
+        *height = thin;
+    }
+}
+
+typedef void (*bench_generator)(bench_random *random, unsigned int *width, unsigned int *height);
+
+/**
+ * @brief A synthetic set of rects.
+ */
+typedef struct bench_corpus {
+    const char *name;
+    bench_generator generate;
+} bench_corpus;
+
+static const bench_corpus bench_corpora[] = {
+    { "uniform", bench_generate_uniform },
+    { "powerlaw", bench_generate_powerlaw },
+    { "glyphs", bench_generate_glyphs },
+    { "tiles", bench_generate_tiles },
+    { "aspect", bench_generate_aspect }
+};
+
+#define BENCH_NUM_CORPORA (sizeof(bench_corpora) / sizeof(bench_corpora[0]))
+
+/**
+ * @brief Fills a list of rect sizes with a corpus. The same corpus and number of rects always give the same sizes.
+ *
+ * @param corpus The corpus to use.
+ * @param corpus_index The index of the corpus, used to seed the random number generator.
+ * @param sizes Where to store the width and height of each rect.
+ * @param num_rects The number of rects.
+ */
+static void bench_fill_corpus(const bench_corpus *corpus, unsigned int corpus_index, unsigned int *sizes,
+    unsigned int num_rects)
+{
+    bench_random random;
+    random.state = 0x6a617061636b6572ull ^ ((unsigned long long) corpus_index << 32) ^ num_rects;
+    for (unsigned int i = 0; i < num_rects; i++) {
+        corpus->generate(&random, &sizes[i * 2], &sizes[i * 2 + 1]);
+    }
+}
+
+
+/*
+ * Measurement related functions
+ */
+
+/**
+ * @brief Gets a monotonic time in seconds.
+ */
+static double bench_get_time(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart / frequency.QuadPart;
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+#endif
+}
+
+/**
+ * @brief Hashes the output of every rect with FNV-1a, so any change to the layout changes the hash.
+ */
+static unsigned long long bench_hash_layout(const japacker_t *packer, unsigned int num_rects)
+{
+    unsigned long long hash = 0xcbf29ce484222325ull;
+    for (unsigned int i = 0; i < num_rects; i++) {
+        const japacker_rect *rect = &packer->rects[i];
+        unsigned int values[5] = {
+            rect->output.x, rect->output.y, (unsigned int) rect->output.image_index,
+            (unsigned int) rect->output.rotated, (unsigned int) rect->output.packed
+        };
+        for (unsigned int j = 0; j < 5; j++) {
+            for (unsigned int byte = 0; byte < 4; byte++) {
+                hash ^= (values[j] >> (byte * 8)) & 0xff;
+                hash *= 0x100000001b3ull;
+            }
+        }
+    }
+    return hash;
+}
+
+/**
+ * @brief Checks that every packed rect is inside its image and that no two packed rects overlap.
+ *
+ * Each image is drawn to a bitmap, one image at a time.
+ *
+ * @return 1 if the layout is valid, 0 if it isn't, -1 if the images are too large to be verified.
+ */
+static int bench_verify_layout(const japacker_t *packer, unsigned int num_rects, unsigned int image_width,
+    unsigned int image_height)
+{
+    unsigned long long bits = (unsigned long long) image_width * image_height;
+    if (bits > BENCH_MAX_VERIFY_BITS) {
+        return -1;
+    }
+    unsigned char *bitmap = (unsigned char *) malloc((size_t) (bits / 8 + 1));
+    if (!bitmap) {
+        return -1;
+    }
+
+    int valid = 1;
+    for (unsigned int image = 0; image < packer->result.images_needed && valid; image++) {
+        unsigned int width = image_width;
+        unsigned int height = image_height;
+        if (packer->options.reduce_image_size == 1 && image == packer->result.images_needed - 1) {
+            width = packer->result.last_image_width;
+            height = packer->result.last_image_height;
+        }
+        memset(bitmap, 0, (size_t) (bits / 8 + 1));
+
+        for (unsigned int i = 0; i < num_rects && valid; i++) {
+            const japacker_rect *rect = &packer->rects[i];
+            if (!rect->output.packed || rect->output.image_index != (int) image) {
+                continue;
+            }
+            unsigned int rect_width = rect->output.rotated ? rect->input.height : rect->input.width;
+            unsigned int rect_height = rect->output.rotated ? rect->input.width : rect->input.height;
+            if (rect->output.x + rect_width > width || rect->output.y + rect_height > height) {
+                valid = 0;
+                break;
+            }
+            for (unsigned int y = rect->output.y; y < rect->output.y + rect_height && valid; y++) {
+                unsigned long long row = (unsigned long long) y * width;
+                for (unsigned int x = rect->output.x; x < rect->output.x + rect_width; x++) {
+                    unsigned long long bit = row + x;
+                    if (bitmap[bit / 8] & (1 << (bit % 8))) {
+                        valid = 0;
+                        break;
+                    }
+                    bitmap[bit / 8] |= (unsigned char) (1 << (bit % 8));
+                }
+            }
+        }
+    }
+
+    free(bitmap);
+    return valid;
+}
+
+/**
+ * @brief The configuration and results of a single run.
+ */
+typedef struct bench_run {
+    const char *corpus;
+    unsigned int num_rects;
+    japacker_sort_type sort_by;
+    int allow_rotation;
+    int reduce_image_size;
+    japacker_search_type search_by;
+    japacker_algorithm algorithm;
+
+    int packed;
+    unsigned int images_needed;
+    unsigned int last_image_width;
+    unsigned int last_image_height;
+    double seconds;
+    size_t peak_bytes;
+    unsigned long long empty_areas;
+    double efficiency;
+    unsigned long long layout_hash;
+    int valid;
+} bench_run;
+
+/**
+ * @brief Packs a corpus with the configuration of a run, storing the results in the run.
+ *
+ * @param run The run.
+ * @param sizes The width and height of each rect.
+ * @param image_size The width and height of the destination image.
+ * @param repeat How many times to pack, keeping the fastest time.
+ * @param verify Whether to verify the layout.
+ */
+static void bench_pack(bench_run *run, const unsigned int *sizes, unsigned int image_size, unsigned int repeat,
+    int verify)
+{
+    run->seconds = -1;
+
+    for (unsigned int attempt = 0; attempt < repeat; attempt++) {
+        bench_peak_bytes = bench_current_bytes;
+
+        japacker_t packer;
+        if (japacker_init(&packer, run->num_rects, image_size, image_size) != JAPACKER_OK) {
+            run->packed = JAPACKER_ERROR_NO_MEMORY;
+            if (packer.internal_data) {
+                japacker_free(&packer);
+            }
+            return;
+        }
+        packer.options.sort_by = run->sort_by;
+        packer.options.allow_rotation = run->allow_rotation;
+        packer.options.reduce_image_size = run->reduce_image_size;
+        packer.options.search_by = run->search_by;
+        packer.options.algorithm = run->algorithm;
+        packer.options.fail_policy = JAPACKER_NEW_IMAGE;
+        for (unsigned int i = 0; i < run->num_rects; i++) {
+            packer.rects[i].input.width = sizes[i * 2];
+            packer.rects[i].input.height = sizes[i * 2 + 1];
+        }
+
+        double start = bench_get_time();
+        run->packed = japacker_pack(&packer);
+        double seconds = bench_get_time() - start;
+
+        if (run->seconds < 0 || seconds < run->seconds) {
+            run->seconds = seconds;
+        }
+        run->peak_bytes = bench_peak_bytes;
+
+        // Only the last attempt is checked, since all attempts give the same layout
+        if (attempt == repeat - 1) {
+            run->images_needed = packer.result.images_needed;
+            run->last_image_width = packer.result.last_image_width;
+            run->last_image_height = packer.result.last_image_height;
+            run->layout_hash = bench_hash_layout(&packer, run->num_rects);
+
+            double packed_area = 0;
+            for (unsigned int i = 0; i < run->num_rects; i++) {
+                if (packer.rects[i].output.packed) {
+                    packed_area += (double) packer.rects[i].input.width * packer.rects[i].input.height;
+                }
+            }
+            double images_area = 0;
+            if (run->images_needed) {
+                images_area = (double) (run->images_needed - 1) * image_size * image_size +
+                    (double) run->last_image_width * run->last_image_height;
+            }
+            run->efficiency = images_area ? packed_area / images_area : 0;
+
+            run->valid = verify ? bench_verify_layout(&packer, run->num_rects, image_size, image_size) : -1;
+        }
+
+        japacker_free(&packer);
+    }
+
+    // The counters are read from a pack that isn't timed, and whose memory isn't counted in peak_bytes
+    run->empty_areas = bench_count_empty_areas(sizes, run->num_rects, image_size, run->sort_by, run->allow_rotation,
+        run->reduce_image_size, run->search_by, run->algorithm);
+}
+
+
+/*
+ * Command line related functions
+ */
+
+static const char *bench_sort_names[] = { "perimeter", "area", "height", "width" };
+
+static const char *bench_search_names[] = { "list", "tree", "scan" };
+
+static const char *bench_algorithm_names[] = { "guillotine", "skyline" };
+
+static void bench_print_usage(void)
+{
+    fprintf(stderr, "Usage: japacker_bench [--corpus NAME]... [--rects N[,N...]] [--search list|tree|scan] "
+        "[--algorithm guillotine|skyline] [--repeat N] [--no-verify]\n");
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int rect_counts[64] = { 1000, 10000, 100000 };
+    unsigned int num_rect_counts = 3;
+    int use_corpus[BENCH_NUM_CORPORA];
+    int any_corpus = 0;
+    japacker_search_type search_by = JAPACKER_SEARCH_LIST;
+    japacker_algorithm algorithm = JAPACKER_ALGORITHM_GUILLOTINE;
+    unsigned int repeat = 1;
+    int verify = 1;
+
+    memset(use_corpus, 0, sizeof(use_corpus));
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--corpus") && i + 1 < argc) {
+            const char *name = argv[++i];
+            unsigned int corpus;
+            for (corpus = 0; corpus < BENCH_NUM_CORPORA; corpus++) {
+                if (!strcmp(name, bench_corpora[corpus].name)) {
+                    break;
+                }
+            }
+            if (corpus == BENCH_NUM_CORPORA) {
+                fprintf(stderr, "Unknown corpus: %s\n", name);
+                return 2;
+            }
+            use_corpus[corpus] = 1;
+            any_corpus = 1;
+        } else if (!strcmp(argv[i], "--rects") && i + 1 < argc) {
+            char *list = argv[++i];
+            num_rect_counts = 0;
+            while (*list && num_rect_counts < 64) {
+                char *end;
+                unsigned long count = strtoul(list, &end, 10);
+                if (end == list || !count) {
+                    bench_print_usage();
+                    return 2;
+                }
+                rect_counts[num_rect_counts++] = (unsigned int) count;
+                list = *end == ',' ? end + 1 : end;
+            }
+        } else if (!strcmp(argv[i], "--search") && i + 1 < argc) {
+            const char *name = argv[++i];
+            int search;
+            for (search = 0; search < 3; search++) {
+                if (!strcmp(name, bench_search_names[search])) {
+                    break;
+                }
+            }
+            if (search == 3) {
+                fprintf(stderr, "Unknown search method: %s\n", name);
+                return 2;
+            }
+            search_by = (japacker_search_type) search;
+        } else if (!strcmp(argv[i], "--algorithm") && i + 1 < argc) {
+            const char *name = argv[++i];
+            int index;
+            for (index = 0; index < 2; index++) {
+                if (!strcmp(name, bench_algorithm_names[index])) {
+                    break;
+                }
+            }
+            if (index == 2) {
+                fprintf(stderr, "Unknown algorithm: %s\n", name);
+                return 2;
+            }
+            algorithm = (japacker_algorithm) index;
+        } else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) {
+            repeat = (unsigned int) strtoul(argv[++i], 0, 10);
+            if (!repeat) {
+                repeat = 1;
+            }
+        } else if (!strcmp(argv[i], "--no-verify")) {
+            verify = 0;
+        } else {
+            bench_print_usage();
+            return 2;
+        }
+    }
+
+    printf("corpus,rects,sort,rotation,reduce,search,algorithm,"
+        "packed,images,last_width,last_height,seconds,rects_per_second,"
+        "peak_bytes,empty_areas,efficiency,layout_hash,valid\n");
+
+    int all_valid = 1;
+
+    for (unsigned int corpus = 0; corpus < BENCH_NUM_CORPORA; corpus++) {
+        if (any_corpus && !use_corpus[corpus]) {
+            continue;
+        }
+        for (unsigned int count = 0; count < num_rect_counts; count++) {
+            unsigned int num_rects = rect_counts[count];
+            unsigned int *sizes = (unsigned int *) malloc(num_rects * 2 * sizeof(unsigned int));
+            if (!sizes) {
+                fprintf(stderr, "Not enough memory for %u rects\n", num_rects);
+                return 2;
+            }
+            bench_fill_corpus(&bench_corpora[corpus], corpus, sizes, num_rects);
+
+            // The image is square and large enough for the largest rect in any orientation
+            double rects_area = 0;
+            unsigned int image_size = 1;
+            for (unsigned int i = 0; i < num_rects * 2; i += 2) {
+                rects_area += (double) sizes[i] * sizes[i + 1];
+                if (sizes[i] > image_size) {
+                    image_size = sizes[i];
+                }
+                if (sizes[i + 1] > image_size) {
+                    image_size = sizes[i + 1];
+                }
+            }
+            unsigned int slack_size = (unsigned int) ceil(sqrt(rects_area * BENCH_IMAGE_SLACK));
+            if (slack_size > image_size) {
+                image_size = slack_size;
+            }
+
+            for (int sort_by = 0; sort_by < 4; sort_by++) {
+                for (int allow_rotation = 0; allow_rotation < 2; allow_rotation++) {
+                    for (int reduce_image_size = 0; reduce_image_size < 2; reduce_image_size++) {
+                        bench_run run;
+                        memset(&run, 0, sizeof(run));
+                        run.corpus = bench_corpora[corpus].name;
+                        run.num_rects = num_rects;
+                        run.sort_by = (japacker_sort_type) sort_by;
+                        run.allow_rotation = allow_rotation;
+                        run.reduce_image_size = reduce_image_size;
+                        run.search_by = search_by;
+                        run.algorithm = algorithm;
+
+                        bench_pack(&run, sizes, image_size, repeat, verify);
+
+                        if (run.packed < 0 || run.valid == 0) {
+                            all_valid = 0;
+                        }
+
+                        printf("%s,%u,%s,%d,%d,%s,%s,%d,%u,%u,%u,%.6f,%.0f,%lu,%llu,%.4f,%016llx,%s\n",
+                            run.corpus, run.num_rects, bench_sort_names[sort_by], allow_rotation,
+                            reduce_image_size, bench_search_names[search_by], bench_algorithm_names[algorithm],
+                            run.packed, run.images_needed,
+                            run.last_image_width, run.last_image_height, run.seconds,
+                            run.seconds > 0 ? run.num_rects / run.seconds : 0, (unsigned long) run.peak_bytes,
+                            run.empty_areas, run.efficiency, run.layout_hash,
+                            run.valid < 0 ? "-" : (run.valid ? "1" : "0"));
+                        fflush(stdout);
+                    }
+                }
+            }
+
+            free(sizes);
+        }
+    }
+
+    return all_valid ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+/*
+ * Japacker benchmark counters
+ *
+ * Packs a run again with JAPACKER_STATS defined, to read the counters without making the timed packs of
+ * japacker_bench.c pay for them. The functions of japacker.h are static, so this file has its own copy of the packer.
+ */
+
+#define JAPACKER_STATS
+
+#include "japacker.h"
+
+/**
+ * @brief Packs the rects with the options of a run and gets the most empty area slots used at the same time.
+ *
+ * @param sizes The width and height of each rect.
+ * @param num_rects The number of rects.
+ * @param image_size The width and height of the destination image.
+ * @param sort_by The japacker_sort_type of the run.
+ * @param allow_rotation Whether the rects can be rotated.
+ * @param reduce_image_size The options.reduce_image_size of the run.
+ * @param search_by The japacker_search_type of the run.
+ * @param algorithm The japacker_algorithm of the run.
+ * @return japacker_stats.max_empty_area_index + 1, or 0 if the rects couldn't be packed.
+ */
+unsigned long long bench_count_empty_areas(const unsigned int *sizes, unsigned int num_rects, unsigned int image_size,
+    int sort_by, int allow_rotation, int reduce_image_size, int search_by, int algorithm)
+{
+    japacker_t packer;
+    if (japacker_init(&packer, num_rects, image_size, image_size) != JAPACKER_OK) {
+        if (packer.internal_data) {
+            japacker_free(&packer);
+        }
+        return 0;
+    }
+    packer.options.sort_by = (japacker_sort_type) sort_by;
+    packer.options.allow_rotation = allow_rotation;
+    packer.options.reduce_image_size = reduce_image_size;
+    packer.options.search_by = (japacker_search_type) search_by;
+    packer.options.algorithm = (japacker_algorithm) algorithm;
+    packer.options.fail_policy = JAPACKER_NEW_IMAGE;
+    for (unsigned int i = 0; i < num_rects; i++) {
+        packer.rects[i].input.width = sizes[i * 2];
+        packer.rects[i].input.height = sizes[i * 2 + 1];
+    }
+
+    unsigned long long empty_areas = 0;
+    japacker_stats stats;
+    if (japacker_pack(&packer) >= JAPACKER_OK && japacker_get_stats(&packer, &stats) == JAPACKER_OK) {
+        empty_areas = stats.max_empty_area_index + 1;
+    }
+
+    japacker_free(&packer);
+    return empty_areas;
+}
@@ -56,9 +56,18 @@ empty area's array only needs, at most, to be as large as the total number of im
 This knowledge allows setting the full memory block for the empty areas in advance, preventing constant array
 increases and memory reallocations, thus improving performance.
 
+When packing a large number of rectangles, walking the list to find an empty area becomes slow. Setting
+options.search_by to JAPACKER_SEARCH_TREE also keeps the empty areas in a balanced search tree, which finds the same
+kind of empty area in logarithmic time. Setting it to JAPACKER_SEARCH_SCAN instead keeps the sizes of the empty areas in
+separate arrays which are scanned with SIMD instructions, without sorting the empty areas at all.
+
 The code is thread safe: you can use two different japacker_t structs in two different threads. However, you should NOT
 use the same japacker_t struct in two different threads, as that will cause problems.
 
+If you define JAPACKER_THREADS, japacker_pack_best() can also try several packing strategies at the same time. It does
+so with private copies of the packer on each thread, so the rule above still applies to the japacker_t you pass to it.
+Likewise, when the rects need many destination images, japacker_pack_pages() can pack several images at the same time.
+
 
 ***********************************************************************************************************************
 
@@ -122,6 +131,9 @@ for (int i = 0; i < num_rectangles_to_pack; i++) {
     // 13. Draw the image, checking for rotation. When rotated, the rect->input.width and rect->input.height
     //     remain unchanged. It's up to you to actually rotate the image to the destination buffer
     draw_to_image(dst_image, get_single_image(i), rect->output.x, rect->output.y, rect->output.rotated);
+
+    //     Or let japacker copy the pixels, rotating them if needed
+    japacker_blit(&packer, rect, get_single_image(i)->pixels, 0, dst_image->pixels, 0, sizeof(pixel));
 }
 
 // 14. Once the packer is used, free it
@@ -168,9 +180,42 @@ according to the terms below:
 #define JAPACKER_H
 
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+/**
+ * If you want the functions that can pack in parallel, such as japacker_pack_best(), to actually use multiple threads,
+ * define JAPACKER_THREADS before including this header in the file where the functions are defined.
+ * 
+ * Threads are created using the Win32 API on Windows and pthreads everywhere else, so you may need to link against
+ * your platform's thread library. If JAPACKER_THREADS is not defined, those functions still work, but run serially.
+ */
+#if defined (JAPACKER_THREADS) && !defined (JAPACKER_IMPORT)
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#endif
+
+/**
+ * When options.search_by is set to JAPACKER_SEARCH_SCAN, the empty areas are scanned using SSE2 instructions whenever
+ * the compiler targets them, which is always the case on x86-64. Define JAPACKER_NO_SIMD to always use the plain C scan
+ * instead, which gives the exact same results.
+ */
+#if !defined (JAPACKER_NO_SIMD) && !defined (JAPACKER_IMPORT) && \
+    (defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2))
+#define JAPACKER_SSE2
+#include <emmintrin.h>
+#endif
+
+/**
+ * If you want to know where the packer spends its time, define JAPACKER_STATS before including this header in the file
+ * where the functions are defined. The packer will then count its work, which you can read with japacker_get_stats().
+ * Without JAPACKER_STATS, the counters are compiled away and cost nothing.
+ */
+
 /**
  * If you want to use this library in multiple places in your code, define JAPACKER_EXPORT before including this header
  * in the file where you want the functions to be defined, then define JAPACKER_IMPORT in the files where you want to
@@ -187,6 +232,25 @@ according to the terms below:
 #define JAPACKER_DECL static
 #endif
 
+/**
+ * All memory used by the packer is allocated with JAPACKER_MALLOC() and JAPACKER_REALLOC() and released with
+ * JAPACKER_FREE(). If you want to use your own allocator, define all three before including this header in the file
+ * where the functions are defined.
+ * 
+ * Alternatively, use japacker_init_with_memory() to have a packer live entirely inside a memory block that you provide.
+ */
+#ifndef JAPACKER_MALLOC
+#define JAPACKER_MALLOC(size) malloc(size)
+#endif
+
+#ifndef JAPACKER_REALLOC
+#define JAPACKER_REALLOC(pointer, size) realloc(pointer, size)
+#endif
+
+#ifndef JAPACKER_FREE
+#define JAPACKER_FREE(pointer) free(pointer)
+#endif
+
 /* Do not name mangle */
 #ifdef __cplusplus
 extern "C" {
@@ -225,6 +289,81 @@ typedef enum {
     JAPACKER_SORT_BY_WIDTH     = 3
 } japacker_sort_type;
 
+/**
+ * @brief Sets the algorithm that decides where each rectangle is placed
+ * 
+ * The options are:
+ * JAPACKER_ALGORITHM_GUILLOTINE - Keeps track of every empty area of the image, splitting them as rectangles are placed
+ *                                 and merging them whenever possible, and places each rectangle in the smallest empty
+ *                                 area where it fits. This is the default and gives the densest packing
+ * JAPACKER_ALGORITHM_SKYLINE    - Only keeps track of how far down each column of the image is taken, as a list of
+ *                                 segments from left to right, and places each rectangle on top of the skyline where
+ *                                 its bottom edge stays closest to the top of the image. This state is never larger
+ *                                 than the width of the image, so packing is much faster, at the cost of losing the
+ *                                 space under rectangles that rest on taller neighbours. options.search_by and
+ *                                 options.group_identical_rects are ignored, and japacker_remove_rect() doesn't give
+ *                                 the space of removed rects back
+ */
+typedef enum {
+    JAPACKER_ALGORITHM_GUILLOTINE = 0,
+    JAPACKER_ALGORITHM_SKYLINE    = 1
+} japacker_algorithm;
+
+/**
+ * @brief Sets how the packer looks for the empty area where each rectangle will be placed
+ * 
+ * Regardless of the option, the chosen empty area is always the first one, in sorted order, where the rectangle fits.
+ * Since empty areas that compare equal are always sorted the same way, every option gives the exact same layout.
+ * 
+ * The options are:
+ * JAPACKER_SEARCH_LIST - Walks the sorted list of empty areas until a large enough area is found. This is the default
+ *                        and is usually the fastest option when there aren't many rectangles to pack
+ * JAPACKER_SEARCH_TREE - Also keeps the empty areas in a balanced search tree, where each node knows the largest width
+ *                        and height of its subtree. Both finding an empty area and sorting a new one take logarithmic
+ *                        time, which is much faster when packing many thousands of rectangles
+ * JAPACKER_SEARCH_SCAN - Keeps the width, height and comparator of the empty areas in separate, contiguous arrays and
+ *                        scans all of them, several at a time, for the fitting empty area with the smallest comparator.
+ *                        The empty areas don't need to be sorted at all. Finding an empty area takes linear time, but
+ *                        with very little work per empty area, so it's usually faster than walking the list when a lot
+ *                        of rectangles don't fit in the first few empty areas
+ */
+typedef enum {
+    JAPACKER_SEARCH_LIST = 0,
+    JAPACKER_SEARCH_TREE = 1,
+    JAPACKER_SEARCH_SCAN = 2
+} japacker_search_type;
+
+/**
+ * @brief Sets which of the empty areas where a rectangle fits it's placed in
+ * 
+ * Except with JAPACKER_PLACE_FIRST_FIT, the first empty area where the rectangle fits, in sorted order, and the
+ * options.placement_window empty areas that follow it are looked at, and the rectangle goes to the one that scores
+ * best. Ties are resolved by the sorted order, so every options.search_by still gives the exact same layout. Since
+ * options.sort_by then only decides the order of the rectangles and where the search starts, placing each rectangle
+ * where it leaves the least unusable space around it often needs fewer images.
+ * 
+ * The options are:
+ * JAPACKER_PLACE_FIRST_FIT       - Places the rectangle in the first empty area where it fits, without looking any
+ *                                  further. This is the default and the fastest option
+ * JAPACKER_PLACE_BEST_SHORT_SIDE - Places the rectangle where the shortest side left around it is the shortest, then
+ *                                  where the longest side left is the shortest
+ * JAPACKER_PLACE_BEST_LONG_SIDE  - Places the rectangle where the longest side left around it is the shortest, then
+ *                                  where the shortest side left is the shortest
+ * JAPACKER_PLACE_BEST_AREA       - Places the rectangle in the smallest empty area, then where the shortest side left
+ *                                  around it is the shortest
+ * JAPACKER_PLACE_CONTACT_POINT   - Places the rectangle where most of its borders touch the borders of the empty area,
+ *                                  then where the shortest side left around it is the shortest. The borders of an
+ *                                  empty area are mostly placed rectangles and the borders of the image, so the
+ *                                  rectangles are kept close to each other
+ */
+typedef enum {
+    JAPACKER_PLACE_FIRST_FIT       = 0,
+    JAPACKER_PLACE_BEST_SHORT_SIDE = 1,
+    JAPACKER_PLACE_BEST_LONG_SIDE  = 2,
+    JAPACKER_PLACE_BEST_AREA       = 3,
+    JAPACKER_PLACE_CONTACT_POINT   = 4
+} japacker_placement_type;
+
 /**
  * @brief The errors that the public functions may return
  * 
@@ -232,19 +371,145 @@ typedef enum {
  * JAPACKER_OK                     - No errors
  * JAPACKER_ERROR_WRONG_PARAMETERS - This usually means japacker_init() was not called before japacker_pack()
  * JAPACKER_ERROR_NO_MEMORY        - This means the computer ran out of memory while executing the code
+ * JAPACKER_PACK_IN_PROGRESS       - Not an error: japacker_pack_step() ran out of budget before packing was done
+ * 
+ * JAPACKER_PACK_IN_PROGRESS is negative like the errors, since the positive results are the number of packed rects,
+ * so a check for results below JAPACKER_OK treats it as a failure. Only japacker_pack_step() returns it, so such
+ * checks still work for every other function, but code that handles every japacker_error_type value, such as a
+ * switch whose default case reports an error, must handle JAPACKER_PACK_IN_PROGRESS too.
  */
 typedef enum {
     JAPACKER_OK                     =  0,
     JAPACKER_ERROR_WRONG_PARAMETERS = -1,
-    JAPACKER_ERROR_NO_MEMORY        = -2
+    JAPACKER_ERROR_NO_MEMORY        = -2,
+    JAPACKER_PACK_IN_PROGRESS       = -3
 } japacker_error_type;
 
+/**
+ * @brief Counters of the work done by the packer, which help finding out why some sets of rectangles take much longer
+ * to pack than others, and which options suit them best.
+ * 
+ * The counters are only collected if JAPACKER_STATS is defined where the functions are defined. They are reset when
+ * japacker_pack(), japacker_pack_best() or japacker_pack_pages() start, and japacker_add_rect() and
+ * japacker_remove_rect() keep adding to them.
+ */
+typedef struct japacker_stats {
+
+    unsigned long long searches;                /**< The number of searches for an empty area where a rect fits.
+                                                     A rect that is retried rotated is searched for twice. */
+
+    unsigned long long empty_areas_visited;     /**< The number of empty areas looked at in all searches. These are
+                                                     tree nodes with JAPACKER_SEARCH_TREE and array slots with
+                                                     JAPACKER_SEARCH_SCAN. */
+
+    unsigned long long max_empty_areas_visited; /**< The most empty areas looked at in a single search. */
+
+    unsigned long long rotation_retries;        /**< The number of rects that were retried rotated because they didn't
+                                                     fit anywhere. */
+
+    unsigned long long merge_attempts;          /**< The number of times an empty area looked for adjacent empty areas
+                                                     to merge with. */
+
+    unsigned long long merges;                  /**< The number of empty areas that were merged into another one. */
+
+    unsigned long long max_merges;              /**< The most empty areas merged into another one in a single attempt.
+                                                     Each merge makes the empty area larger, which may make it adjacent
+                                                     to more empty areas. */
+
+    unsigned long long sort_steps;              /**< The number of empty areas walked through to find the place of new
+                                                     empty areas in the sorted list. Only used with
+                                                     JAPACKER_SEARCH_LIST. */
+
+    unsigned long long repacks;                 /**< The number of times all rects of an image were packed again from
+                                                     scratch, which is mostly done to reduce the last image's size. */
+
+    unsigned long long max_empty_area_index;    /**< The highest index of the empty area array that was used, so at
+                                                     most this many empty areas, plus one, existed at the same time. */
+
+} japacker_stats;
+
+/**
+ * The value of japacker_layout_header.magic, which reads "JAPL" in memory on little-endian machines.
+ */
+#define JAPACKER_LAYOUT_MAGIC 0x4C50414Au
+
+/**
+ * The version of the layout format written by japacker_save_layout(). It changes whenever the format does.
+ */
+#define JAPACKER_LAYOUT_VERSION 2
+
+/**
+ * @brief The start of a layout saved by japacker_save_layout().
+ * 
+ * A saved layout is this header, followed by one japacker_layout_entry for each rect, in the same order as
+ * packer->rects, then by one japacker_layout_image_size for each image if the images don't all have the size of the
+ * destination image, such as after japacker_pack_bins(). Every field is 32 bits wide and in the byte order of the
+ * machine that saved it, so a layout that was loaded or mapped to memory can be read in place, with no parsing, once
+ * japacker_get_layout_header() checks it.
+ */
+typedef struct japacker_layout_header {
+
+    uint32_t magic;             /**< Always JAPACKER_LAYOUT_MAGIC. */
+
+    uint32_t version;           /**< Always JAPACKER_LAYOUT_VERSION. */
+
+    uint32_t num_rects;         /**< The number of entries after the header. */
+
+    uint32_t images_needed;     /**< The result.images_needed of the packer. */
+
+    uint32_t image_width;       /**< The width of the destination image. */
+
+    uint32_t image_height;      /**< The height of the destination image. */
+
+    uint32_t last_image_width;  /**< The result.last_image_width of the packer. */
+
+    uint32_t last_image_height; /**< The result.last_image_height of the packer. */
+
+    uint32_t input_hash_low;    /**< The lowest 32 bits of the japacker_get_input_hash() of the packer. */
+
+    uint32_t input_hash_high;   /**< The highest 32 bits of the japacker_get_input_hash() of the packer. */
+
+    uint32_t num_image_sizes;   /**< The number of japacker_layout_image_size after the entries, which is either
+                                     images_needed or 0 if every image has the size of the destination image, other
+                                     than a reduced last image. */
+
+} japacker_layout_header;
+
+/**
+ * @brief Where a rect was packed, as saved by japacker_save_layout().
+ */
+typedef struct japacker_layout_entry {
+
+    uint32_t x;                 /**< The output.x of the rect. */
+
+    uint32_t y;                 /**< The output.y of the rect. */
+
+    int32_t image_index;        /**< The output.image_index of the rect. */
+
+    uint32_t flags;             /**< 1 if the rect was packed, plus 2 if it was rotated. */
+
+} japacker_layout_entry;
+
+/**
+ * @brief The size of an image, as saved by japacker_save_layout() for images that don't have the size of the
+ * destination image.
+ */
+typedef struct japacker_layout_image_size {
+
+    uint32_t width;             /**< The width of the image. */
+
+    uint32_t height;            /**< The height of the image. If the last image was reduced, its reduced size is
+                                     the last_image_width and last_image_height of the header. */
+
+} japacker_layout_image_size;
+
 /**
  * @brief The base rectangle structure
  * 
  * japacker works by feeding an array of japacker_rect's, each one representing
  * an image that needs to be packed into a larger one
- * Only width and height should be provided by the user and will not be changed by the algorithm.
+ * Only width and height should be provided by the user and will not be changed by the algorithm, along with
+ * sort_key if options.sort_by_key is set.
  * The rest of the variables will be filled by the algorithm and should be considered read-only.
  */
 typedef struct japacker_rect {
@@ -256,6 +521,9 @@ typedef struct japacker_rect {
         
         unsigned int height; /**< The height of the rectangle to be packed. */
 
+        unsigned long long sort_key; /**< The key to sort the rectangle by, largest first. Only used when
+                                          options.sort_by_key is set to 1. */
+
     } input;
 
     /** Output variables that are the result of running the algorithm. */
@@ -320,9 +588,146 @@ typedef struct japacker_t {
                                                 Defaults to JAPACKER_SORT_BY_PERIMETER.
                                                 Please refer to japacker_sort_type for details. */
 
+        japacker_algorithm algorithm;      /**< The algorithm that decides where each rect is placed.
+                                                Defaults to JAPACKER_ALGORITHM_GUILLOTINE.
+                                                Please refer to japacker_algorithm for details. */
+
+        int sort_by_key;                   /**< Whether to sort the rects by the input.sort_key of each rect, largest
+                                                first, instead of by options.sort_by. The empty areas are still
+                                                sorted according to options.sort_by.
+                                                Defaults to 0.
+                                                This lets you use your own order, or reuse keys you already have,
+                                                while still letting japacker sort the rects. */
+
         japacker_fail_policy fail_policy;  /**< What to do when an image doesn't fit.
                                                 Defaults to JAPACKER_STOP.
                                                 Please refer to japacker_fail_policy for details. */
+
+        japacker_search_type search_by;    /**< How to search for the empty area where a rect will be placed.
+                                                Defaults to JAPACKER_SEARCH_LIST.
+                                                Please refer to japacker_search_type for details. */
+
+        int group_identical_rects;         /**< Whether japacker_pack() places rects with the same size, which are
+                                                next to each other in sorted order, together as a grid.
+                                                Defaults to 0.
+                                                The grid is placed in the empty area where the first of those rects
+                                                would be placed, so the empty areas are searched and split once per
+                                                grid instead of once per rect, which is much faster for inputs with
+                                                many identical rects, such as tiles or icons. The resulting layout is
+                                                not the same as without grouping. Rects that don't fit in a grid are
+                                                still packed one by one, with rotation if it's allowed. The repacks
+                                                done to reduce the image size don't group rects.
+                                                When japacker_pack() sorts the rects, identical rects are always next
+                                                to each other, but if options.rects_are_sorted is set to 1, only the
+                                                identical rects that you placed next to each other are grouped. */
+
+        unsigned int reduce_candidates;    /**< How many candidate sizes to try at the same time when
+                                                options.reduce_image_size is set to 1.
+                                                Defaults to 0, which, just like 1, uses a serial search that halves
+                                                the size difference after each attempt.
+                                                Higher values split the remaining search window into that many
+                                                sizes, which are packed in parallel on up to options.num_threads
+                                                threads, then narrow the window around the smallest size that fits.
+                                                The result doesn't depend on the number of threads. */
+
+        int reduce_to_power_of_two;        /**< Whether options.reduce_image_size only tries sizes that are powers of
+                                                two, such as those needed by some GPUs, for the width and the height.
+                                                Defaults to 0.
+                                                The size of the destination image can always be the result, even if
+                                                it's not a power of two. */
+
+        unsigned int reduce_size_multiple; /**< The number the width and height tried by options.reduce_image_size
+                                                must be multiples of, such as 4 for block compressed textures.
+                                                Defaults to 0, which, just like 1, allows any size.
+                                                It's ignored if options.reduce_to_power_of_two is set to 1. */
+
+        int reduce_separately;             /**< Whether options.reduce_image_size searches the width and the height
+                                                separately instead of keeping the aspect ratio of the destination
+                                                image. The smallest width is found with the full height, then the
+                                                smallest height is found with that width.
+                                                Defaults to 0.
+                                                Setting this, options.reduce_to_power_of_two or
+                                                options.reduce_size_multiple always uses the search of
+                                                options.reduce_candidates, with a single candidate if it's lower
+                                                than 2. */
+
+        unsigned int repack_below_density; /**< The lowest percentage of the current image that can be covered by
+                                                rects after japacker_resize_rect() before every rect is repacked.
+                                                Defaults to 0, which never repacks. */
+
+        int online;                        /**< Whether japacker_add_rect() and japacker_resize_rect() place rects
+                                                with a heuristic meant for rects that arrive one at a time in no
+                                                particular order, such as the glyphs of a font cache, instead of the
+                                                one japacker_pack() uses for rects sorted from largest to smallest.
+                                                Defaults to 0.
+                                                Each rect goes, among the first empty area where it fits and the
+                                                JAPACKER_ONLINE_SEARCH_WINDOW empty areas that follow it, to the one
+                                                that leaves the shortest side around it. The images started by
+                                                japacker_add_rect() keep their empty areas sorted by area in the
+                                                search tree of JAPACKER_SEARCH_TREE, whatever options.sort_by and
+                                                options.search_by are, so the time to place a rect only grows
+                                                logarithmically with the number of empty areas. options.placement
+                                                is ignored for those rects.
+                                                Ignored with JAPACKER_ALGORITHM_SKYLINE. */
+
+        int deterministic;                 /**< Whether packing fails with JAPACKER_ERROR_NO_MEMORY when there isn't
+                                                enough memory for the search that was asked for, instead of falling
+                                                back to one that needs less memory but may give another layout, such
+                                                as the serial search of options.reduce_candidates, or packing the
+                                                images of japacker_pack_pages() one after the other.
+                                                Defaults to 0.
+                                                The layout never depends on the number of threads, on
+                                                options.search_by or on whether SIMD is used, so with this set, the
+                                                same inputs always give the same layout or an error. */
+
+        unsigned int padding;              /**< The number of pixels left empty between rects.
+                                                Defaults to 0.
+                                                Rects can still touch the borders of the image. If options.align_x
+                                                or options.align_y are set, the padding is rounded up to a multiple
+                                                of them in that direction. */
+
+        unsigned int extrude;              /**< The number of pixels reserved all around each rect, which
+                                                japacker_blit() fills by repeating the pixels at the borders of the
+                                                rect, so that texture filtering never reads the pixels of another
+                                                rect.
+                                                Defaults to 0.
+                                                Unlike options.padding, the space is also reserved at the borders of
+                                                the image. output.x and output.y are still the position of the rect
+                                                itself. */
+
+        unsigned int align_x;              /**< The number the x position of every rect, minus options.extrude, must
+                                                be a multiple of, such as 4 for block compressed textures.
+                                                Defaults to 0, which, just like 1, allows any position.
+                                                The width each rect takes, with its extrusion, is rounded up to a
+                                                multiple of it as well, so the empty areas always start at aligned
+                                                positions and can still be merged. If the width of the image isn't a
+                                                multiple of it, the pixels after the last multiple are left unused. */
+
+        unsigned int align_y;              /**< The number the y position of every rect, minus options.extrude, must
+                                                be a multiple of.
+                                                Defaults to 0, which, just like 1, allows any position.
+                                                Please refer to options.align_x for details. */
+
+        japacker_placement_type placement; /**< Which of the empty areas where a rect fits it's placed in.
+                                                Defaults to JAPACKER_PLACE_FIRST_FIT.
+                                                Please refer to japacker_placement_type for details.
+                                                Ignored with JAPACKER_ALGORITHM_SKYLINE, and by japacker_add_rect()
+                                                and japacker_resize_rect() if options.online is set to 1. With
+                                                JAPACKER_SEARCH_SCAN, which doesn't sort the empty areas, the
+                                                empty areas are searched with JAPACKER_SEARCH_TREE instead. */
+
+        unsigned int placement_window;     /**< How many empty areas after the first one where a rect fits are also
+                                                looked at by options.placement.
+                                                Defaults to 0, which uses JAPACKER_PLACEMENT_WINDOW.
+                                                Each rect looks at no more than this many extra empty areas, so the
+                                                extra time taken by each search is bounded. */
+
+        unsigned int num_threads;          /**< The maximum number of threads to use in the functions that can pack
+                                                in parallel, such as japacker_pack_best(), japacker_pack_pages() or
+                                                the image size reduction when options.reduce_candidates is higher
+                                                than 1.
+                                                Defaults to 0, which, just like 1, means no extra threads are used.
+                                                Requires defining JAPACKER_THREADS, otherwise it's ignored. */
     } options;
 
     /**
@@ -353,6 +758,115 @@ typedef struct japacker_t {
                                                        See below for details */
 } japacker_t;
 
+/**
+ * The options and the results of a packer, as types of their own, so they can also be kept outside of a japacker_t.
+ */
+#ifdef __cplusplus
+typedef struct japacker_t::options japacker_options;
+typedef struct japacker_t::result japacker_result;
+#else
+typedef struct options japacker_options;
+typedef struct result japacker_result;
+#endif
+
+/**
+ * @brief A set of rectangles packed by japacker_pack_batch(), independently of the other jobs.
+ * 
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_job {
+
+    japacker_rect *rects;       /**< The rects to pack, which belong to you. Only their input is read, and their
+                                     output is written just like japacker_pack() does. */
+
+    unsigned int num_rects;     /**< The number of rects. */
+
+    unsigned int width;         /**< The width of the destination image. */
+
+    unsigned int height;        /**< The height of the destination image. */
+
+    japacker_options options;   /**< The options to pack the rects with. Set them to 0 for the defaults.
+                                     options.always_repack and options.rects_are_sorted are ignored, since the rects
+                                     are always sorted and packed from scratch, and so is options.num_threads, since
+                                     each job runs on a single thread. */
+
+    japacker_result result;     /**< The results of the packer, set once the job is packed. */
+
+    int packed_rects;           /**< What japacker_pack() returned for this job: the number of packed rects, or one of
+                                     japacker_error_type values on error. */
+
+} japacker_job;
+
+/**
+ * @brief A rect moved by japacker_compact(), with where it was and where it is now.
+ * 
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_relocation {
+
+    unsigned int index;         /**< The index of the rect in packer->rects. */
+
+    unsigned int old_x;         /**< The output.x of the rect before it was moved. */
+
+    unsigned int old_y;         /**< The output.y of the rect before it was moved. */
+
+    unsigned int new_x;         /**< The output.x of the rect after it was moved. */
+
+    unsigned int new_y;         /**< The output.y of the rect after it was moved. */
+
+} japacker_relocation;
+
+/**
+ * @brief The bounds found by japacker_estimate(), without packing the rects.
+ * 
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_bounds {
+
+    unsigned int num_fitting_rects;     /**< The number of rects with an area that fit in an empty image. The other
+                                             rects are never packed, so they are left out of every bound below. */
+
+    unsigned int min_images;            /**< No packing can use fewer images. This is the larger of the area of the
+                                             rects divided by the area of an image, and the number of rects larger than
+                                             half an image both horizontally and vertically, since no two of them can
+                                             share an image. */
+
+    unsigned int max_images;            /**< The images needed by a simple shelf packing, which places the rects in
+                                             rows from the tallest down. The packer usually needs as many or fewer, but
+                                             this isn't guaranteed. */
+
+    unsigned int min_width;             /**< No image, including a reduced last image, can be narrower than the widest
+                                             rect, or the widest of their shortest sides if rects can be rotated. */
+
+    unsigned int min_height;            /**< No image can be shorter than the tallest rect, in the same way. */
+
+    unsigned long long min_area;        /**< The total area taken by the rects, including their extrusion and
+                                             alignment, which no set of images can be smaller than. */
+
+    unsigned int max_last_image_width;  /**< The width used in the last image of the shelf packing. If
+                                             options.reduce_image_size is 1, the reduced last image is usually no wider
+                                             than this. */
+
+    unsigned int max_last_image_height; /**< The height used in the last image of the shelf packing. */
+
+} japacker_bounds;
+
+/**
+ * @brief A size of destination image that japacker_pack_bins() can use.
+ * 
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_bin {
+
+    unsigned int width;         /**< The width of the image. */
+
+    unsigned int height;        /**< The height of the image. */
+
+    unsigned long long cost;    /**< What using an image of this size costs, such as its memory in bytes, or 0 to use
+                                     its area. */
+
+} japacker_bin;
+
 
 /*
  * Forward declarations of public functions
@@ -363,6 +877,9 @@ typedef struct japacker_t {
  * 
  * Don't use any other japacker_* function on a japacker_t without calling japacker_init() first.
  * 
+ * The number of rectangles can be 0 if they will only be added later with japacker_add_rect(), such as when setting
+ * options.online to 1. The memory then grows as rectangles are added.
+ * 
  * @param packer The packer to init.
  * @param num_rectangles The total number of rectangles that need to be packed.
  * @param width The width of the destination rectangle.
@@ -372,6 +889,58 @@ typedef struct japacker_t {
 JAPACKER_DECL int japacker_init(japacker_t *packer, unsigned int num_rectangles,
     unsigned int width, unsigned int height);
 
+/**
+ * @brief Gets the size of the memory block needed by japacker_init_with_memory().
+ * 
+ * @param num_rectangles The total number of rectangles that need to be packed.
+ * @return The number of bytes needed.
+*/
+JAPACKER_DECL size_t japacker_required_memory(unsigned int num_rectangles);
+
+/**
+ * @brief Initiates a japacker_t object inside a memory block provided by the user, without allocating any memory.
+ * 
+ * All the internal buffers, and packer->rects itself, are placed inside the memory block, so japacker_pack() never
+ * allocates memory. You own the memory block: japacker_free() doesn't release it, and you can reuse it for another
+ * packer after calling japacker_free(), or by simply calling this function again.
+ * 
+ * Since the block's size is fixed, japacker_add_rect() fails with JAPACKER_ERROR_NO_MEMORY if it needs more room, and
+ * japacker_compact() may move fewer rects than it could.
+ * japacker_pack_best() and the parallel image size reduction still allocate their private copies of the packer with
+ * JAPACKER_MALLOC().
+ * 
+ * @param packer The packer to init.
+ * @param num_rectangles The total number of rectangles that need to be packed.
+ * @param width The width of the destination rectangle.
+ * @param height The height of the destination rectangle.
+ * @param memory The memory block to use. It doesn't need to be aligned.
+ * @param memory_size The size of the memory block, which must be at least japacker_required_memory(num_rectangles).
+ * @return JAPACKER_OK on success, or another japacker_error_type result on error.
+*/
+JAPACKER_DECL int japacker_init_with_memory(japacker_t *packer, unsigned int num_rectangles,
+    unsigned int width, unsigned int height, void *memory, size_t memory_size);
+
+/**
+ * @brief Initiates a japacker_t object that packs an array of rects owned by the user, without copying it.
+ * 
+ * packer->rects is set to rects, so the packer reads the input of each rect and writes its output directly to your
+ * array, and you don't need to copy the sizes in and the results out of the packer on every pack. The output of every
+ * rect is cleared, just like japacker_init() does, but the input is kept. You own the array: japacker_free() doesn't
+ * release it, and it must stay valid until then.
+ * 
+ * Since the array belongs to you, japacker_add_rect() fails with JAPACKER_ERROR_NO_MEMORY once it needs more rects
+ * than num_rectangles, unless rects were removed before.
+ * 
+ * @param packer The packer to init.
+ * @param rects The rects to pack.
+ * @param num_rectangles The number of rects in the array.
+ * @param width The width of the destination rectangle.
+ * @param height The height of the destination rectangle.
+ * @return JAPACKER_OK on success, or another japacker_error_type result on error.
+*/
+JAPACKER_DECL int japacker_init_with_rects(japacker_t *packer, japacker_rect *rects, unsigned int num_rectangles,
+    unsigned int width, unsigned int height);
+
 /**
  * @brief Resizes the destination image. Note that this won't automatically repack any rect already packed.
  * 
@@ -395,882 +964,6266 @@ JAPACKER_DECL void japacker_resize_image(japacker_t *packer, unsigned int image_
  * This is useful if you want to manually pack to many destination images.
  * 
  * @param packer The japacker_t struct to pack.
- * @return One of japacker_error_type values on error, or the number of packed rects on success.
+ * @return One of japacker_error_type values on error, or the number of packed rects on success. It never returns
+ *         JAPACKER_PACK_IN_PROGRESS, so a result below JAPACKER_OK is always an error.
 */
 JAPACKER_DECL int japacker_pack(japacker_t *packer);
 
 /**
- * @brief Gets the offset of the x/y coordinates of a pixel of the destination image,
- * based on the x/y coordinates of a pixel of the source rect.
+ * @brief Does part of the work of japacker_pack(), so that packing can be spread over several calls.
  * 
- * This is a helper function that does the x/y translation based on the rect's position on the image.
- * It also properly translates rotation.
- * If rotation is enabled, the destination pixel is retrieved assuming a counter-clockwise rotation.
- * If multiple images were needed, the offset will be calculated for the proper image.
- * While this function is helpful, it is also slower than direct pixel manipulation. Therefore only use this convenience
- * function if performance is not an issue.
+ * This is meant for programs that can't stall for the whole pack, such as games that build an atlas while drawing
+ * frames. Each call goes through at most about max_rects rects, counting every rect that each attempt to reduce the
+ * last image size repacks, then returns JAPACKER_PACK_IN_PROGRESS if there's work left. Calling it again picks up
+ * where the last call stopped. Once packing is done, it returns the same result as japacker_pack() would, and the
+ * next call starts a new pack.
  * 
- * @param packer The packer in use.
- * @param rect The rectangle to calculate the offset from.
- * @param x The x offset of the rectangle.
- * @param y The y offset of the rectangle.
- * @return An offset, assuming the destination image is in the format image[height][width] (or image[height * width]).
+ * The work is only checked between rects and between attempts to reduce the last image size, so a call may go a bit
+ * over max_rects. Each round of the parallel reduction is done in a single call.
+ * 
+ * Don't change the rects or the options, and don't call any other japacker function on the packer, other than
+ * japacker_cancel_pack(), while packing is in progress. The rects packed so far are already written to their output.
+ * 
+ * @param packer The japacker_t struct to pack.
+ * @param max_rects The number of rects to go through before returning, or 0 to pack everything at once.
+ * @return JAPACKER_PACK_IN_PROGRESS if there's work left, one of japacker_error_type values on error, or the number
+ *         of packed rects once packing is done. JAPACKER_PACK_IN_PROGRESS is below JAPACKER_OK, so check for it
+ *         before treating a result below JAPACKER_OK as an error.
 */
-JAPACKER_DECL unsigned int japacker_get_dst_offset(const japacker_t *packer, const japacker_rect *rect,
-    unsigned int x, unsigned int y);
+JAPACKER_DECL int japacker_pack_step(japacker_t *packer, unsigned int max_rects);
 
 /**
- * @brief Frees the memory associated with a japacker_t object.
- * @param packer The object to free.
+ * @brief Stops a pack started by japacker_pack_step(), so that the next call starts a new pack.
+ * 
+ * The rects keep the output they had when packing stopped, so the ones that were packed keep their place, but
+ * result.last_image_width and result.last_image_height may not be set for the image being packed. Calling it when no
+ * pack is in progress does nothing.
+ * 
+ * @param packer The packer whose pack should be stopped.
 */
-JAPACKER_DECL void japacker_free(japacker_t *packer);
-
-
-
-/***********************************************************************************************************************
- * Internal area below
- **********************************************************************************************************************/
-
-#ifndef JAPACKER_IMPORT
+JAPACKER_DECL void japacker_cancel_pack(japacker_t *packer);
 
 /**
- * Percentage difference between the area of all the rectangles and the area of the destination image in which the
- * packer stops trying to shrink the destination image when options.reduce_image_size is set to 1.
- */
-#define JAPACKER_TOLERABLE_AREA_DIFFERENCE_PERCENTAGE 2
+ * @brief Adds a new rectangle and immediately packs it into the free space of the current image.
+ * 
+ * This is meant for atlases that change over time, such as font caches, where repacking everything for every new
+ * rectangle would be too slow. The rect is placed using the same rules as japacker_pack(), with the current options.
+ * 
+ * The current image is the last image that was packed. If nothing was packed yet, a new image is started.
+ * If the rect doesn't fit and options.fail_policy is JAPACKER_NEW_IMAGE, a new image is started and becomes the current
+ * one. Otherwise, the rect is added but left unpacked.
+ * 
+ * The slots of rects removed with japacker_remove_rect() are reused, so the index of the new rect may be lower than
+ * the number of rects. If there are no free slots, packer->rects grows, which means it can move in memory, so don't
+ * keep pointers to it across calls.
+ * 
+ * Adding a rect makes the internal rect order unsorted, so options.rects_are_sorted is set to 0.
+ * 
+ * @param packer The packer to add the rect to.
+ * @param width The width of the rectangle.
+ * @param height The height of the rectangle.
+ * @return The index of the new rect in packer->rects, or one of japacker_error_type values on error.
+ *         Check the rect's output.packed to know whether it was packed.
+*/
+JAPACKER_DECL int japacker_add_rect(japacker_t *packer, unsigned int width, unsigned int height);
 
 /**
- * @brief A structure that defines an empty area inside the destination rectangle.
+ * @brief Removes a rectangle, giving its space back to the current image.
  * 
- * Please refer to each variable's documentation for their meaning.
- */
-typedef struct japacker_empty_area {
+ * The space is merged with the adjacent empty areas, so it can be used by rects added later with japacker_add_rect().
+ * Only the space of rects in the current image can be reused, since the empty areas of older images aren't kept.
+ * 
+ * The removed rect gets a width and height of 0 and is no longer packed. Rects with a width or height of 0 are
+ * ignored by japacker_pack(). Its index will be reused by the next call to japacker_add_rect().
+ * 
+ * @param packer The packer to remove the rect from.
+ * @param index The index of the rect in packer->rects.
+ * @return JAPACKER_OK on success, or another japacker_error_type result on error.
+*/
+JAPACKER_DECL int japacker_remove_rect(japacker_t *packer, unsigned int index);
 
-    unsigned int x, y;                       /**< x and y position of the empty area. */
+/**
+ * @brief Changes the size of a rectangle, keeping every other rect where it is.
+ * 
+ * This is meant for atlases where a few images change between builds, so that they don't need a full repack and most
+ * of the atlas stays the same. A rect that gets smaller, in both dimensions, keeps its place, and the space it no
+ * longer uses is given back to the current image. A rect that gets larger is placed again in the free space of the
+ * current image, just like japacker_add_rect() would, after giving back its old space if it was in the current image.
+ * 
+ * If options.repack_below_density is set and either the rect no longer fits, or the rects of the current image cover
+ * less than that percentage of it, every rect is repacked with japacker_pack(), as if options.always_repack was set to
+ * 1.
+ * 
+ * Changing the size of a rect makes the internal rect order unsorted, so options.rects_are_sorted is set to 0.
+ * 
+ * @param packer The packer the rect belongs to.
+ * @param index The index of the rect in packer->rects.
+ * @param width The new width of the rectangle.
+ * @param height The new height of the rectangle.
+ * @return JAPACKER_OK if only the rect was changed, 1 if every rect was repacked, or one of japacker_error_type values
+ *         on error. Check the rect's output.packed to know whether it was packed.
+*/
+JAPACKER_DECL int japacker_resize_rect(japacker_t *packer, unsigned int index, unsigned int width, unsigned int height);
 
-    unsigned int width, height;              /**< Width and height of the empty area. */
-
-    unsigned int comparator;                 /**< The value upon which empty areas are sorted.
-                                                  Please refer to the japacker_sort_type struct
-                                                  or options.sort_by for details.
-                                                  Precalculating the comparison factor upon creation
-                                                  of the empty areas improves performance when sorting
-                                                  through them, which is done a lot. */
-
-    struct japacker_empty_area *prev, *next; /**< Pointer to the previous and next empty areas
-                                                  in the sorted list. */
-} japacker_empty_area;
+/**
+ * @brief Moves some rects of the current image closer to its top left corner, so that its free space merges back into
+ * larger empty areas.
+ * 
+ * This is meant for atlases that live for a long time, where removing and resizing rects slowly leaves holes between
+ * them. Starting with the rect closest to the bottom right corner, each rect is moved to the free space closest to the
+ * top left corner where it fits, if that space is above the rect, or at the same height but to its left. The space the
+ * rect leaves is then merged with the adjacent empty areas. No rect is moved twice and rects keep their rotation.
+ * 
+ * Since at most max_relocations rects are moved, the pixels of those rects can simply be copied to their new place in
+ * the atlas, instead of drawing the whole atlas again.
+ * 
+ * Only the rects of the current image are moved. With JAPACKER_ALGORITHM_SKYLINE, which doesn't keep track of the
+ * free space between rects, nothing is moved.
+ * 
+ * @param packer The packer in use.
+ * @param relocations Where to store the moves. They must be applied in order, since a rect may be moved to the space
+ *                    that another one just left. If options.extrude is set, the margin of each rect moves with it.
+ * @param max_relocations The maximum number of rects to move. relocations must have room for that many moves.
+ * @return The number of rects moved, or one of japacker_error_type values on error. If there's no memory left for the
+ *         empty areas once some rects were moved, compacting stops there and the number of rects moved so far is
+ *         returned, so every move made is always reported.
+*/
+JAPACKER_DECL int japacker_compact(japacker_t *packer, japacker_relocation *relocations, unsigned int max_relocations);
 
 /**
- * @brief A structure that holds the internal data of the packer.
- *
- * Please refer to each variable's documentation for their meaning.
- */
-typedef struct japacker_internal_data {
-
-    japacker_rect **sorted_rects; /**< An array of pointers to the rects provided by the user. This array can be sorted
-                                       internally without changing the sort order provided by the user, allowing him to
-                                       keep his own references to the rectangle array. */
-
-    unsigned int num_rects;       /**< The total number of rectangles to pack */
-
-    unsigned int image_width;     /**< The width of the destination image */
-
-    unsigned int image_height;    /**< The height of the destination image */
+ * @brief Packs the rectangles with every sorting strategy, keeping the one with the best result.
+ * 
+ * The rectangles are packed once for each japacker_sort_type, both with and without rotation if
+ * options.allow_rotation is set to 1, as if options.always_repack was set to 1. All the other options are kept.
+ * 
+ * Each strategy is packed on its own internal copy of the packer, on up to options.num_threads threads at the same
+ * time. Only the placements of the best strategy are written to the rects. The best strategy is the one that packs
+ * the most rects, then the one needing the fewest images, then the one with the smallest last image. Ties are resolved
+ * by the order of japacker_sort_type, without rotation first, so the result never depends on the number of threads.
+ * 
+ * When the strategies are packed on a single thread, options.reduce_image_size isn't 1 and options.fail_policy isn't
+ * JAPACKER_STOP, the remaining strategies are skipped as soon as one packs every rect that fits in the number of
+ * images japacker_estimate() gives as the lower bound, which none of them could beat.
+ * 
+ * After returning, options.sort_by and options.allow_rotation are set to the values of the winning strategy.
+ * 
+ * @param packer The japacker_t struct to pack.
+ * @return One of japacker_error_type values on error, or the number of packed rects on success.
+*/
+JAPACKER_DECL int japacker_pack_best(japacker_t *packer);
 
-    /**
-     * @brief Structure that holds all the empty areas of the destination image.
-     *
-     * Please refer to each variable's documentation for their meaning.
-     */
-    struct empty_areas {
+/**
+ * @brief Packs the rectangles to as many images as needed, packing several images at the same time.
+ * 
+ * This works as if options.fail_policy was set to JAPACKER_NEW_IMAGE and options.always_repack was set to 1, but
+ * instead of filling one image after the other, the rects are first spread over the number of images their total area
+ * would fill, assuming each image is filled up to JAPACKER_PAGE_FILL_PERCENTAGE, but never over more images than there
+ * are rects. Each of those images is packed on its own, on up to options.num_threads threads at the same time. The
+ * rects that didn't fit in their image are then tried, in sorted order, in the free space of the other images, and any
+ * rects still left are packed to new images.
+ * 
+ * The last of the spread images is never used for the rects that didn't fit, so that its size can still be reduced if
+ * options.reduce_image_size is set to 1. Rects that are larger than the destination image are never packed.
+ * 
+ * When all rects fit in a single image, or if there's not enough memory, this simply calls japacker_pack().
+ * 
+ * The result never depends on the number of threads. However, it's usually not the same as japacker_pack()'s and may
+ * use a few more images, so only use this function when packing time matters more than the number of images.
+ * 
+ * @param packer The japacker_t struct to pack.
+ * @return One of japacker_error_type values on error, or the number of packed rects on success.
+*/
+JAPACKER_DECL int japacker_pack_pages(japacker_t *packer);
 
-        struct japacker_empty_area *first;                 /**< Pointer to the first (smallest) empty area. */
+/**
+ * @brief Estimates how many images the rects need and how large the last one is, without packing them.
+ * 
+ * This only takes O(n) time: the rects are sorted by height with a radix sort and placed in rows on the images, like a
+ * simple shelf packer would. It's meant to answer how many images or how large an image will be needed before calling
+ * japacker_pack(), or to decide whether packing is worth it at all.
+ * 
+ * The lower bounds are always right. The upper bounds come from the shelf packing, which the packer almost always
+ * matches or beats, but it's a different algorithm, so a few more images may be needed in rare cases.
+ * 
+ * The rects, options.allow_rotation, options.padding, options.extrude, options.align_x and options.align_y are used,
+ * just as japacker_pack() would. Nothing in the packer is changed.
+ * 
+ * @param packer The packer whose rects are estimated.
+ * @param bounds Where to store the bounds.
+ * @return JAPACKER_OK on success, or one of japacker_error_type values on error.
+*/
+JAPACKER_DECL int japacker_estimate(const japacker_t *packer, japacker_bounds *bounds);
 
-        struct japacker_empty_area *last;                  /**< Pointer to the last (largest) empty area. */
+/**
+ * @brief Packs the rectangles to as many images as needed, choosing the size of each image among several bin sizes.
+ * 
+ * The images are filled one after the other, just like with options.fail_policy set to JAPACKER_NEW_IMAGE. Before
+ * each image, the bins are tried from the cheapest up, and the first one that holds every remaining rect is used, which
+ * ends the packing. If none does, the image uses the largest bin where the largest remaining rect fits, and is filled
+ * with as many rects as possible. So a large main atlas is filled first, and the rects left over go to the cheapest
+ * overflow bin that can hold them.
+ * 
+ * The size set in japacker_init() isn't used. options.fail_policy and options.always_repack are ignored, since all
+ * rects are always packed from scratch. Rects that don't fit in any bin are never packed. If options.reduce_image_size
+ * is set to 1, the size of the last image is reduced as usual.
+ * 
+ * The size of each image is that of its bin, which japacker_blit() and japacker_get_dst_offset() take into account.
+ * japacker_save_layout() saves the size of every image, and japacker_load_layout() restores them.
+ * 
+ * @param packer The japacker_t struct to pack.
+ * @param bins The sizes the images can have.
+ * @param num_bins The number of bins.
+ * @param image_bins Where to store the index in bins of the size of each image.
+ * @param max_images The maximum number of images to use. image_bins must have room for that many indexes. The rects
+ *                   that don't fit in them are left unpacked.
+ * @return One of japacker_error_type values on error, or the number of packed rects on success.
+*/
+JAPACKER_DECL int japacker_pack_bins(japacker_t *packer, const japacker_bin *bins, unsigned int num_bins,
+    unsigned int *image_bins, unsigned int max_images);
 
-        struct japacker_empty_area *list;                  /**< The actual unordered array where the empty areas are
-                                                                stored. */
+/**
+ * @brief Packs many independent sets of rectangles, such as one atlas for each character of a game, in a single call.
+ * 
+ * Each job is packed just like japacker_pack() would, but the jobs are spread over up to num_threads threads, which
+ * take the next job as soon as they finish the previous one. Every thread keeps a single memory block for all the jobs
+ * it packs, which only grows when a job has more rects than any job before, so most jobs don't allocate at all.
+ * 
+ * @param jobs The jobs to pack. The result of each one is written to its result and packed_rects.
+ * @param num_jobs The number of jobs.
+ * @param num_threads The maximum number of threads to use. Requires defining JAPACKER_THREADS, otherwise it's
+ *                    ignored.
+ * @return JAPACKER_OK on success, or JAPACKER_ERROR_WRONG_PARAMETERS if there are no jobs. The errors of each job are
+ *         set in its packed_rects.
+*/
+JAPACKER_DECL int japacker_pack_batch(japacker_job *jobs, unsigned int num_jobs, unsigned int num_threads);
 
-        int index;                                         /**< The highest index of the empty area array in use. */
+/**
+ * @brief Gets the counters of the work done by the packer. Please refer to japacker_stats for details.
+ * 
+ * @param packer The packer in use.
+ * @param stats Where to store the counters. If JAPACKER_STATS isn't defined, they're all set to 0.
+ * @return JAPACKER_OK on success, or JAPACKER_ERROR_WRONG_PARAMETERS if JAPACKER_STATS isn't defined.
+*/
+JAPACKER_DECL int japacker_get_stats(const japacker_t *packer, japacker_stats *stats);
 
-        int size;                                          /**< The number of elements the array can hold. */
+/**
+ * @brief Gets the offset of the x/y coordinates of a pixel of the destination image,
+ * based on the x/y coordinates of a pixel of the source rect.
+ * 
+ * This is a helper function that does the x/y translation based on the rect's position on the image.
+ * It also properly translates rotation.
+ * If rotation is enabled, the destination pixel is retrieved assuming a counter-clockwise rotation.
+ * If multiple images were needed, the offset will be calculated for the proper image.
+ * While this function is helpful, it is also slower than direct pixel manipulation. Therefore only use this convenience
+ * function if performance is not an issue. To copy whole images, japacker_blit() is much faster.
+ * 
+ * @param packer The packer in use.
+ * @param rect The rectangle to calculate the offset from.
+ * @param x The x offset of the rectangle.
+ * @param y The y offset of the rectangle.
+ * @return An offset, assuming the destination image is in the format image[height][width] (or image[height * width]).
+*/
+JAPACKER_DECL unsigned int japacker_get_dst_offset(const japacker_t *packer, const japacker_rect *rect,
+    unsigned int x, unsigned int y);
 
-        void (*set_comparator)(japacker_empty_area *area); /**< A pointer to the function that sets the values which
-                                                                are used to compare the empty areas to sort them.
+/**
+ * @brief Copies the pixels of a source image to where its rect was packed in the destination image.
+ * 
+ * Just like japacker_get_dst_offset(), rotated rects are rotated counter-clockwise, and the destination image of the
+ * last image is result.last_image_width wide if it was reduced. Each row of a rect that isn't rotated is copied with a
+ * single memcpy(), while rotated rects are copied in small tiles, so that neither image leaves the cache. With SSE2,
+ * rotated four byte pixels are moved in blocks of 4x4.
+ * 
+ * If the rects were packed with options.extrude set, the pixels at the borders of the rect are then repeated over the
+ * margin reserved around it.
+ * 
+ * @param packer The packer in use.
+ * @param rect The packed rect whose pixels are copied.
+ * @param src The pixels of the source image, which is rect->input.width x rect->input.height pixels large.
+ * @param src_stride The number of bytes between two rows of the source image, or 0 if the rows are tightly packed.
+ * @param dst The pixels of the destination image the rect was packed to.
+ * @param dst_stride The number of bytes between two rows of the destination image, or 0 if the rows are tightly
+ *                   packed.
+ * @param bytes_per_pixel The size of each pixel, which must be the same in both images.
+ * @return JAPACKER_OK on success, or JAPACKER_ERROR_WRONG_PARAMETERS if the rect isn't packed or any parameter is
+ *         missing.
+*/
+JAPACKER_DECL int japacker_blit(const japacker_t *packer, const japacker_rect *rect, const void *src,
+    size_t src_stride, void *dst, size_t dst_stride, unsigned int bytes_per_pixel);
 
-                                                                The function can be one of the following:
-                                                                - japacker_empty_area_set_perimeter_comparator()
-                                                                - japacker_empty_area_set_area_comparator()
-                                                                - japacker_empty_area_set_width_comparator()
-                                                                - japacker_empty_area_set_height_comparator() */
+/**
+ * @brief Copies the pixels of every rect packed to a destination image, using japacker_blit().
+ * 
+ * The rects are copied on up to options.num_threads threads at the same time. Since packed rects never overlap, every
+ * thread writes to its own part of the destination image.
+ * 
+ * @param packer The packer in use.
+ * @param image_index The index of the destination image.
+ * @param sources The pixels of the source image of each rect, in the same order as packer->rects. Rects with a null
+ *                source are skipped.
+ * @param source_strides The number of bytes between two rows of each source image, in the same order as
+ *                       packer->rects, or 0 if there's no array, in which case every source has tightly packed rows.
+ * @param dst The pixels of the destination image.
+ * @param dst_stride The number of bytes between two rows of the destination image, or 0 if the rows are tightly
+ *                   packed.
+ * @param bytes_per_pixel The size of each pixel, which must be the same in every image.
+ * @return JAPACKER_OK on success, or JAPACKER_ERROR_WRONG_PARAMETERS if any parameter is missing.
+*/
+JAPACKER_DECL int japacker_blit_image(const japacker_t *packer, int image_index, const void *const *sources,
+    const size_t *source_strides, void *dst, size_t dst_stride, unsigned int bytes_per_pixel);
 
-    } empty_areas;
+/**
+ * @brief Gets a hash of everything that decides where the rects are packed.
+ * 
+ * This covers the size of the destination image, the number of rects, the size of each rect, its input.sort_key if
+ * options.sort_by_key is set to 1, and the options that change the layout, including whether the rects are packed in
+ * their own order because options.rects_are_sorted was set to 1. Two packers with the same hash give the same layout,
+ * so a layout saved by japacker_save_layout() can be loaded instead of packing again.
+ * 
+ * @param packer The packer in use.
+ * @return The 64-bit FNV-1a hash of the inputs.
+*/
+JAPACKER_DECL unsigned long long japacker_get_input_hash(const japacker_t *packer);
 
-} japacker_internal_data;
+/**
+ * @brief Gets the number of bytes needed by japacker_save_layout().
+ * 
+ * @param packer The packer in use.
+ * @return The size of the layout.
+*/
+JAPACKER_DECL size_t japacker_get_layout_size(const japacker_t *packer);
 
+/**
+ * @brief Saves where every rect was packed, along with the results and the hash of the inputs, to a memory buffer.
+ * 
+ * Please refer to japacker_layout_header for the format. The buffer can then be written to a file as it is.
+ * 
+ * @param packer The packer to save the layout of.
+ * @param buffer Where to save the layout. It must be aligned to 4 bytes.
+ * @param size The size of the buffer, which must be at least japacker_get_layout_size().
+ * @return JAPACKER_OK on success, or JAPACKER_ERROR_WRONG_PARAMETERS if the buffer is too small.
+*/
+JAPACKER_DECL int japacker_save_layout(const japacker_t *packer, void *buffer, size_t size);
 
-/*
- * Sorting related functions
- */
+/**
+ * @brief Checks whether a buffer holds a valid layout, without copying it.
+ * 
+ * The entries that follow the header are at (const japacker_layout_entry *) (header + 1), and the sizes of the images,
+ * if header->num_image_sizes isn't 0, are at (const japacker_layout_image_size *) (entries + header->num_rects).
+ * 
+ * @param buffer The layout, which is usually a file mapped to memory. It must be aligned to 4 bytes.
+ * @param size The size of the buffer.
+ * @return The header of the layout, or 0 if the buffer is too small, isn't a layout, has a different version or was
+ *         saved on a machine with a different byte order.
+*/
+JAPACKER_DECL const japacker_layout_header *japacker_get_layout_header(const void *buffer, size_t size);
 
 /**
- * @brief Internal function to compare two rects by perimeter.
+ * @brief Loads a layout saved by japacker_save_layout(), so that the rects don't have to be packed again.
+ * 
+ * The layout is only loaded if it's valid, every packed rect is inside its image, and it was saved for the same inputs,
+ * according to japacker_get_input_hash(). Otherwise, nothing is changed and the rects must be packed with
+ * japacker_pack().
+ * 
+ * The empty areas of the last image aren't saved, so japacker_add_rect() starts a new image after loading a layout.
+ * 
+ * The sizes of the images saved after japacker_pack_bins() are restored as well, in memory allocated with
+ * JAPACKER_MALLOC(), even for packers created with japacker_init_with_memory().
  * 
- * @param a The first rect.
- * @param b The second rect.
- * @return A positive number if the second rect is larger than the first, 0 if equal, a negative number otherwise.
+ * @param packer The packer to load the layout to, with the inputs of all its rects already set.
+ * @param buffer The layout. It must be aligned to 4 bytes.
+ * @param size The size of the buffer.
+ * @return JAPACKER_OK on success, JAPACKER_ERROR_WRONG_PARAMETERS if the layout is invalid or the inputs changed, or
+ *         JAPACKER_ERROR_NO_MEMORY if there's no memory for the sizes of the images.
 */
-JAPACKER_DECL int japacker_compare_rect_perimeters(const void *a, const void *b)
-{
-    // Since we're just comparing perimeters and don't actually need the values,
-    // we don't need to actually calculate them. Check documentation for qsort to see how this works
-    return (*(japacker_rect **) b)->input.height + (*(japacker_rect **) b)->input.width -
-           (*(japacker_rect **) a)->input.height - (*(japacker_rect **) a)->input.width;
-}
+JAPACKER_DECL int japacker_load_layout(japacker_t *packer, const void *buffer, size_t size);
 
 /**
- * @brief Internal function to compare two rects by area.
- *
- * @param a The first rect.
- * @param b The second rect.
- * @return A positive number if the second rect is larger than the first, 0 if equal, a negative number otherwise.
+ * @brief Frees the memory associated with a japacker_t object, including packer->rects.
+ * 
+ * If the packer was created with japacker_init_with_memory(), nothing is freed, since the memory block is yours.
+ * 
+ * @param packer The object to free.
 */
-JAPACKER_DECL int japacker_compare_rect_areas(const void *a, const void *b)
-{
-    return (*(japacker_rect **) b)->input.height * (*(japacker_rect **) b)->input.width -
-           (*(japacker_rect **) a)->input.height * (*(japacker_rect **) a)->input.width;
-}
+JAPACKER_DECL void japacker_free(japacker_t *packer);
+
+
+
+/***********************************************************************************************************************
+ * Internal area below
+ **********************************************************************************************************************/
+
+#ifndef JAPACKER_IMPORT
 
 /**
- * @brief Internal function to compare two rects by height.
- *
- * @param a The first rect.
- * @param b The second rect.
- * @return A positive number if the second rect is larger than the first, 0 if equal, a negative number otherwise.
+ * Percentage difference between the area of all the rectangles and the area of the destination image in which the
+ * packer stops trying to shrink the destination image when options.reduce_image_size is set to 1.
  */
-JAPACKER_DECL int japacker_compare_rect_heights(const void *a, const void *b)
-{
-    return (*(japacker_rect **) b)->input.height - (*(japacker_rect **) a)->input.height;
-}
+#define JAPACKER_TOLERABLE_AREA_DIFFERENCE_PERCENTAGE 2
 
 /**
- * @brief Internal function to compare two rects by width.
- *
- * @param a The first rect.
- * @param b The second rect.
- * @return A positive number if the second rect is larger than the first, 0 if equal, a negative number otherwise.
+ * The number of empty areas that are checked at the same time when options.search_by is set to JAPACKER_SEARCH_SCAN.
  */
-JAPACKER_DECL int japacker_compare_rect_widths(const void *a, const void *b)
-{
-    return (*(japacker_rect **) b)->input.width - (*(japacker_rect **) a)->input.width;
-}
+#define JAPACKER_SCAN_BLOCK 4
 
 /**
- * @brief Internal function to create the empty area's comparator based on a perimeter sort.
- *
- * @param area The area to calculate the comparator for.
+ * The number of empty area slots added at a time when the empty areas need to grow while rects are added one by one.
+ * It must be a multiple of JAPACKER_SCAN_BLOCK.
  */
-JAPACKER_DECL void japacker_empty_area_set_perimeter_comparator(japacker_empty_area *area)
-{
-    area->comparator = area->height + area->width;
-}
+#define JAPACKER_EMPTY_AREA_CHUNK 1024
 
 /**
- * @brief Internal function to create the empty area's comparator based on an area sort.
- *
- * @param area The area to calculate the comparator for.
+ * The number of empty areas after the first one where a rect fits that are also checked by japacker_add_rect() when
+ * options.online is set to 1.
  */
-JAPACKER_DECL void japacker_empty_area_set_area_comparator(japacker_empty_area *area)
-{
-    area->comparator = area->height * area->width;
-}
+#define JAPACKER_ONLINE_SEARCH_WINDOW 16
 
 /**
- * @brief Internal function to create the empty area's comparator based on a width sort.
- *
- * @param area The area to calculate the comparator for.
+ * The number of empty areas after the first one where a rect fits that are also looked at by options.placement, when
+ * options.placement_window is 0.
  */
-JAPACKER_DECL void japacker_empty_area_set_width_comparator(japacker_empty_area *area)
-{
-    area->comparator = area->width;
-}
+#define JAPACKER_PLACEMENT_WINDOW 16
 
 /**
- * @brief Internal function to create the empty area's comparator based on a height sort.
- *
- * @param area The area to calculate the comparator for.
+ * Runs a statement, or sets a counter to a value if the value is higher, only if JAPACKER_STATS is defined.
  */
-JAPACKER_DECL void japacker_empty_area_set_height_comparator(japacker_empty_area *area)
-{
-    area->comparator = area->height;
-}
+#ifdef JAPACKER_STATS
+#define JAPACKER_STAT(statement) statement
+#define JAPACKER_STAT_MAX(counter, value) if ((value) > (counter)) { (counter) = (value); }
+#else
+#define JAPACKER_STAT(statement)
+#define JAPACKER_STAT_MAX(counter, value)
+#endif
 
 /**
- * @brief Sorts the rectangles.
+ * The type used for areas and for the values the empty areas are sorted by.
  * 
- * The sorting used is based on options.sort_by. If options.rects_are_sorted is set, no sorting will occur.
- * However, the internal japacker_rects** will still be created and populated, since that's what's used internally.
+ * The area of the empty areas and of the rects placed in an image are kept in 32 bits, which is enough as long as no
+ * image is larger than 65535x65535. If you want to pack very large virtual atlases, define JAPACKER_64BIT_AREAS before
+ * including this header in the file where the functions are defined to keep them in 64 bits instead.
  * 
- * @param packer The packer whose rects should be sorted.
- * @return 0 on error, 1 on success.
+ * This makes each empty area a bit larger, and the SSE2 scan can then only check the width and height of the empty
+ * areas several at a time, so packing is slightly slower.
  */
-JAPACKER_DECL int japacker_sort_rects(japacker_t *packer)
-{
-    japacker_internal_data *data = packer->internal_data;
-    
-    // To prevent changing the array of rects that the user provided,
-    // we work with our own array of pointers to the user's rects, which we can then sort freely
-    // without the user losing his own image index order
-    data->sorted_rects = (japacker_rect **) malloc(data->num_rects * sizeof(japacker_rect *));
+#ifdef JAPACKER_64BIT_AREAS
+typedef unsigned long long japacker_area;
+#else
+typedef unsigned int japacker_area;
+#endif
 
-    if (!data->sorted_rects) {
-        return 0;
-    }
+/**
+ * @brief A structure that defines an empty area inside the destination rectangle.
+ * 
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_empty_area {
 
-    for (unsigned int i = 0; i < data->num_rects; i++) {
-        data->sorted_rects[i] = &packer->rects[i];
-    }
+    unsigned int x, y;                       /**< x and y position of the empty area. */
 
-    // Sort the rectangles if they aren't already sorted
-    if (packer->options.rects_are_sorted != 1) {
-        // Sort according to the type the user selected
-        // The sort is always performed in descending order
-        // By default, rectangles are sorted by their perimeter
-        int (*sort_by)(const void *, const void *);
-
-        switch (packer->options.sort_by) {
-            case JAPACKER_SORT_BY_AREA:
-                sort_by = japacker_compare_rect_areas;
-                data->empty_areas.set_comparator = japacker_empty_area_set_area_comparator;
-                break;
-            case JAPACKER_SORT_BY_HEIGHT:
-                sort_by = japacker_compare_rect_heights;
-                data->empty_areas.set_comparator = japacker_empty_area_set_height_comparator;
-                break;
-            case JAPACKER_SORT_BY_WIDTH:
-                sort_by = japacker_compare_rect_widths;
-                data->empty_areas.set_comparator = japacker_empty_area_set_width_comparator;
-                break;
-            case JAPACKER_SORT_BY_PERIMETER:
-            default:
-                sort_by = japacker_compare_rect_perimeters;
-                data->empty_areas.set_comparator = japacker_empty_area_set_perimeter_comparator;
-                break;
-        }
+    unsigned int width, height;              /**< Width and height of the empty area. */
 
-        qsort(data->sorted_rects, data->num_rects, sizeof(japacker_rect *), sort_by);
-        packer->options.rects_are_sorted = 1;
-    }
+    japacker_area comparator;                /**< The value upon which empty areas are sorted.
+                                                  Please refer to the japacker_sort_type struct
+                                                  or options.sort_by for details.
+                                                  Precalculating the comparison factor upon creation
+                                                  of the empty areas improves performance when sorting
+                                                  through them, which is done a lot. */
 
-    return 1;
-}
+    unsigned int slot;                       /**< The index of the slot of the empty area, which never changes while
+                                                  the slot is in use, even when the array of empty areas grows. */
+
+    struct japacker_empty_area *prev, *next; /**< Pointer to the previous and next empty areas
+                                                  in the sorted list. */
 
+    struct japacker_empty_area *edge_next[4]; /**< Pointer to the next empty area in the same bucket of each of the
+                                                   edge indexes. See japacker_edge_type for details. */
 
-/*
- * Empty areas related functions
- */
+    /**
+     * @brief The node of the empty area in the search tree. Only used with JAPACKER_SEARCH_TREE.
+     *
+     * Please refer to each variable's documentation for their meaning.
+     */
+    struct tree {
+
+        struct japacker_empty_area *parent, *left, *right; /**< The parent and children nodes. */
+
+        unsigned int priority;                             /**< The heap priority of the node. It's derived from the
+                                                                position of the empty area in the array, so the tree
+                                                                shape is always the same for the same input. */
+
+        unsigned int max_width, max_height;                /**< The largest width and the largest height of any empty
+                                                                area in this subtree, including this one. */
+
+        unsigned int max_short_side;                       /**< The largest short side of any empty area in this
+                                                                subtree. The largest width and height may belong to
+                                                                different, thin empty areas, so this and max_area
+                                                                allow skipping many more subtrees when searching. */
+
+        double max_area;                                   /**< The largest area of any empty area in this subtree. */
+
+    } tree;
+} japacker_empty_area;
 
 /**
- * @brief Resets the empty areas, moving back to a single empty area the size of the entire image.
- * 
- * @param data The internal packer data to work with.
- * @param width The width of the new original empty area.
- * @param height The height of the new original empty area.
+ * @brief The edges of an empty area that are indexed to quickly find adjacent empty areas.
+ *
+ * Each edge is identified by the position of the edge line and by its length, so two empty areas can only be merged
+ * when the right edge of one has the exact same key as the left edge of the other (or the bottom edge of one has the
+ * same key as the top edge of the other).
+ *
+ * The keys are:
+ * JAPACKER_EDGE_LEFT   - (x, y, height)
+ * JAPACKER_EDGE_RIGHT  - (x + width, y, height)
+ * JAPACKER_EDGE_TOP    - (x, y, width)
+ * JAPACKER_EDGE_BOTTOM - (x, y + height, width)
  */
-JAPACKER_DECL void japacker_reset_empty_areas(japacker_internal_data *data, unsigned int width, unsigned int height)
-{
-    memset(data->empty_areas.list, 0, sizeof(japacker_empty_area) * data->empty_areas.size);
-
-    data->empty_areas.index = 0;
+typedef enum {
+    JAPACKER_EDGE_LEFT   = 0,
+    JAPACKER_EDGE_RIGHT  = 1,
+    JAPACKER_EDGE_TOP    = 2,
+    JAPACKER_EDGE_BOTTOM = 3
+} japacker_edge_type;
 
-    // The first empty space is always the entire area of the image
-    data->empty_areas.first = &data->empty_areas.list[0];
-    data->empty_areas.last = &data->empty_areas.list[0];
-    data->empty_areas.first->width = width;
-    data->empty_areas.first->height = height;
-}
+/**
+ * @brief What japacker_pack_step() is doing.
+ */
+typedef enum {
+    JAPACKER_PHASE_IDLE            = 0,
+    JAPACKER_PHASE_PACK            = 1,
+    JAPACKER_PHASE_REDUCE          = 2,
+    JAPACKER_PHASE_REDUCE_PARALLEL = 3
+} japacker_pack_phase;
 
 /**
- * @brief Sorts a newly created empty area in the list of empty areas.
+ * @brief Which dimensions the k-ary search for the smallest last image size is searching.
+ */
+typedef enum {
+    JAPACKER_REDUCE_BOTH   = 0,
+    JAPACKER_REDUCE_WIDTH  = 1,
+    JAPACKER_REDUCE_HEIGHT = 2
+} japacker_reduce_dimension;
+
+/**
+ * @brief The progress of a pack, which lets japacker_pack_step() stop at any rect and carry on later.
+ *
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_pack_state {
+
+    japacker_pack_phase phase;             /**< What the pack is doing. JAPACKER_PHASE_IDLE means no pack is in
+                                                progress. */
+
+    japacker_rect **rects;                 /**< The rects to go through for the current image. The first image goes
+                                                through all the sorted rects, but each new image only goes through
+                                                the rects that didn't fit in the previous one. */
+
+    unsigned int num_rects;                /**< The number of rects in rects. */
+
+    unsigned int index;                    /**< The index of the next rect to go through in rects. */
+
+    unsigned int num_pending_rects;        /**< The number of rects that didn't fit in the current image. */
+
+    int request_new_image;                 /**< Whether the pending rects need to be packed to a new image. */
+
+    int skip_packed;                       /**< Whether the rects that were already packed are skipped. */
+
+    unsigned int identical_rects_end;      /**< The end of the last run of identical rects in rects. */
+
+    unsigned int packed_rects;             /**< The total number of rects packed so far. */
+
+    japacker_area area_used_in_last_image; /**< The area of the rects placed in the current image. */
+
+    int result;                            /**< What japacker_pack() returns, set once the rects are packed. */
+
+    japacker_area rects_area;              /**< The area of the rects in the last image, used by the reduction. */
+
+    unsigned int num_image_rects;          /**< The number of rects in the last image, which is the work done by each
+                                                attempt of the reduction. */
+
+    unsigned int min_width;                /**< The smallest width that can fit the largest rect of the last image. */
+
+    unsigned int min_height;               /**< The smallest height that can fit the largest rect of the last
+                                                image. */
+
+    unsigned int delta_width;              /**< The width to add or remove in the next attempt of the serial
+                                                reduction, or the number of widths the parallel one can try after
+                                                needed_width. */
+
+    unsigned int delta_height;             /**< Same as delta_width, but for the height instead. */
+
+    unsigned int last_successful_width;    /**< The width of the last attempt of the serial reduction that fit. */
+
+    unsigned int last_successful_height;   /**< The height of the last attempt of the serial reduction that fit. */
+
+    unsigned int needed_width;             /**< The smallest width the parallel reduction can try. */
+
+    unsigned int needed_height;            /**< The smallest height the parallel reduction can try. */
+
+    japacker_reduce_dimension searched_dimension; /**< Which dimensions the parallel reduction is searching. */
+
+    unsigned int steps;                    /**< The number of steps of the search window of the parallel reduction. */
+
+    long long failed_step;                 /**< The highest step of the parallel reduction that is known to fail. */
+
+    unsigned int fitting_step;             /**< The lowest step of the parallel reduction that is known to fit. */
+
+    struct japacker_size_candidate *candidates; /**< The candidates of the parallel reduction. */
+
+    unsigned int num_candidates;           /**< The number of candidates. */
+
+} japacker_pack_state;
+
+/**
+ * @brief A structure that holds the internal data of the packer.
+ *
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_internal_data {
+
+    japacker_rect **sorted_rects; /**< An array of pointers to the rects provided by the user. This array can be sorted
+                                       internally without changing the sort order provided by the user, allowing him to
+                                       keep his own references to the rectangle array. */
+
+    unsigned int num_rects;       /**< The total number of rectangles to pack */
+
+    japacker_rect **pending_rects; /**< The rects that didn't fit in the image being packed and still need to be
+                                        packed to a new image, in sorted order. Only used with JAPACKER_NEW_IMAGE */
+
+    unsigned int rects_capacity;  /**< The number of rectangles the rect array can hold before it needs to grow.
+                                       sorted_rects, pending_rects and free_rects can hold the same number of rects */
+
+    unsigned int num_sorted_rects; /**< The number of rects in sorted_rects. If it's not the same as num_rects, the
+                                        sorted list must be rebuilt before packing */
+
+    int sorted_by_packer;         /**< Whether sorted_rects was sorted by japacker_sort_rects(), rather than kept in
+                                       the order of the rects because options.rects_are_sorted was set to 1 */
+
+    unsigned long long *sort_keys; /**< Room for the keys used to sort the rects. Its size is twice rects_capacity,
+                                        since the sort moves the keys between the two halves */
+
+    int owns_memory;              /**< Whether the memory was allocated by japacker and can grow or be freed. It's 0
+                                       for packers created with japacker_init_with_memory() */
+
+    int owns_rects;               /**< Whether packer->rects was allocated by japacker and can grow or be freed. It's
+                                       0 for packers created with japacker_init_with_memory() or
+                                       japacker_init_with_rects() */
+
+    unsigned int *free_rects;     /**< The indexes of the rects removed with japacker_remove_rect(), which are
+                                       reused by japacker_add_rect(). Its size is rects_capacity */
+
+    unsigned int num_free_rects;  /**< The number of indexes in free_rects */
+
+    int current_image;            /**< The index of the image the empty areas currently belong to, or -1 if the empty
+                                       areas were never set. japacker_add_rect() and japacker_remove_rect() work on
+                                       this image */
+
+    unsigned int image_width;     /**< The width of the destination image */
+
+    unsigned int image_height;    /**< The height of the destination image */
+
+    unsigned int *image_sizes;    /**< The width and height of each image packed by japacker_pack_bins(), or loaded
+                                       from a layout it saved, which may not be image_width and image_height. It's
+                                       always allocated with JAPACKER_MALLOC(), even for packers created with
+                                       japacker_init_with_memory() */
+
+    unsigned int num_image_sizes; /**< The number of images in image_sizes. The images after those have the size of
+                                       the destination image */
+
+#ifdef JAPACKER_STATS
+    japacker_stats stats;         /**< The counters returned by japacker_get_stats() */
+#endif
+
+    /**
+     * @brief Structure that holds all the empty areas of the destination image.
+     *
+     * Please refer to each variable's documentation for their meaning.
+     */
+    struct empty_areas {
+
+        struct japacker_empty_area *first;                 /**< Pointer to the first (smallest) empty area. */
+
+        struct japacker_empty_area *last;                  /**< Pointer to the last (largest) empty area. */
+
+        struct japacker_empty_area *list;                  /**< The actual unordered array where the empty areas are
+                                                                stored. Its first list_size slots are in this block,
+                                                                and the following ones are in chunks. */
+
+        struct japacker_empty_area **chunks;               /**< The blocks of JAPACKER_EMPTY_AREA_CHUNK slots that
+                                                                follow the slots of list. They are added as the array
+                                                                grows while rects are added one by one, so that the
+                                                                slots in use never move and growing never has to go
+                                                                through them. The segments of a skyline are always in
+                                                                list, since they must be contiguous. */
+
+        unsigned int num_chunks;                           /**< The number of chunks. */
+
+        unsigned int chunks_capacity;                      /**< The number of chunks the chunks array can hold. */
+
+        int list_size;                                     /**< The number of slots in list. */
+
+        int index;                                         /**< The highest index of the empty area array in use. */
+
+        struct japacker_empty_area *free;                  /**< The first of the empty area slots below index that are
+                                                                no longer in use and can be reused. The slots are
+                                                                linked using their next pointer. */
+
+        int size;                                          /**< The number of elements the array can hold, which
+                                                                includes the slots of the chunks. */
+
+        struct japacker_empty_area *root;                  /**< The root of the search tree of empty areas. Only used
+                                                                when search_by is set to JAPACKER_SEARCH_TREE. */
+
+        japacker_search_type search_by;                    /**< The search method in use, copied from options.search_by
+                                                                when packing starts. */
+
+        japacker_algorithm algorithm;                      /**< The algorithm in use, copied from options.algorithm
+                                                                when packing starts.
+
+                                                                With JAPACKER_ALGORITHM_SKYLINE, the first index + 1
+                                                                empty areas of list are the segments of the skyline,
+                                                                from left to right. Each one covers width columns
+                                                                starting at x, which are taken above y and free for
+                                                                the following height rows. */
+
+        japacker_sort_type sort_by;                        /**< How the empty areas are compared to sort them,
+                                                                copied from options.sort_by when packing starts.
+                                                                Please refer to japacker_empty_area_set_comparator()
+                                                                for details. */
+
+        japacker_placement_type placement;                 /**< How the empty area of each rect is chosen among
+                                                                the ones that are checked, copied from
+                                                                options.placement when packing starts, unless
+                                                                japacker_add_rect() is placing a rect with
+                                                                options.online set to 1. */
+
+        unsigned int search_window;                        /**< How many empty areas after the first one where a
+                                                                rect fits are also checked, to choose among them
+                                                                with placement. It's 0, which only checks the first
+                                                                one, with JAPACKER_PLACE_FIRST_FIT. */
+
+        /**
+         * @brief The sizes and comparators of the empty areas, stored as a structure of arrays that can be scanned
+         * several empty areas at a time. Only used when search_by is set to JAPACKER_SEARCH_SCAN.
+         *
+         * Each array has one element per slot of the empty area array. Slots that are not in the list have a width
+         * and a height of 0, so no rect fits in them. The three arrays share a single memory block, which starts at
+         * width.
+         */
+        struct scan {
+
+            unsigned int *width;         /**< The width of the empty area in each slot. */
+
+            unsigned int *height;        /**< The height of the empty area in each slot. */
+
+            japacker_area *comparator;   /**< The comparator of the empty area in each slot. */
+
+            unsigned int size;           /**< The number of elements of each array, which is the number of empty area
+                                              slots rounded up to a multiple of JAPACKER_SCAN_BLOCK. */
+
+        } scan;
+
+    } empty_areas;
+
+    /**
+     * @brief A hash index of the edges of the empty areas that are in the sorted list.
+     *
+     * Since empty areas never overlap, no two listed empty areas can share the same edge key, which means that finding
+     * the empty area adjacent to a given side of another empty area is a single hash lookup instead of a walk through
+     * the whole list of empty areas.
+     * Each bucket is a singly linked list that uses japacker_empty_area.edge_next.
+     *
+     * Please refer to each variable's documentation for their meaning.
+     */
+    struct edge_index {
+
+        struct japacker_empty_area **buckets; /**< The bucket heads. There are four consecutive blocks of mask + 1
+                                                   buckets, one for each japacker_edge_type. */
+
+        unsigned int mask;                    /**< The number of buckets for each edge type minus one. The number of
+                                                   buckets is always a power of two. */
+
+    } edge_index;
+
+    /**
+     * @brief The space taken around each rect, set from options.padding, options.extrude, options.align_x and
+     * options.align_y when packing starts.
+     *
+     * Please refer to each variable's documentation for their meaning.
+     */
+    struct spacing {
+
+        unsigned int margin;    /**< The pixels reserved on each side of a rect, from options.extrude. */
+
+        unsigned int align_x;   /**< The alignment of the space each rect takes horizontally, at least 1. */
+
+        unsigned int align_y;   /**< The alignment of the space each rect takes vertically, at least 1. */
+
+        unsigned int padding_x; /**< The pixels left empty at the right of each rect, which is options.padding
+                                     rounded up to a multiple of align_x. The empty image is that much wider, so
+                                     that rects can touch its right border. */
+
+        unsigned int padding_y; /**< The pixels left empty below each rect, which is options.padding rounded up
+                                     to a multiple of align_y. */
+
+    } spacing;
+
+    japacker_pack_state pack_state; /**< The progress of the pack being done by japacker_pack_step(). */
+
+} japacker_internal_data;
+
+
+/*
+ * Sorting related functions
+ */
+
+/**
+ * @brief A function that calculates the key a rect is sorted by. Rects with larger keys are packed first.
+ */
+typedef unsigned long long (*japacker_rect_key_function)(const japacker_rect *rect);
+
+/**
+ * @brief Internal function to get the key of a rect when sorting by perimeter.
+ *
+ * @param rect The rect.
+ * @return Half of the rect's perimeter.
+ */
+JAPACKER_DECL unsigned long long japacker_get_rect_perimeter_key(const japacker_rect *rect)
+{
+    // Since we're just comparing perimeters, we don't need the whole perimeter, half of it sorts the same way
+    return (unsigned long long) rect->input.width + rect->input.height;
+}
+
+/**
+ * @brief Internal function to get the key of a rect when sorting by area.
+ *
+ * @param rect The rect.
+ * @return The rect's area.
+ */
+JAPACKER_DECL unsigned long long japacker_get_rect_area_key(const japacker_rect *rect)
+{
+    return (unsigned long long) rect->input.width * rect->input.height;
+}
+
+/**
+ * @brief Internal function to get the key of a rect when sorting by height.
+ *
+ * @param rect The rect.
+ * @return The rect's height.
+ */
+JAPACKER_DECL unsigned long long japacker_get_rect_height_key(const japacker_rect *rect)
+{
+    return rect->input.height;
+}
+
+/**
+ * @brief Internal function to get the key of a rect when sorting by width.
+ *
+ * @param rect The rect.
+ * @return The rect's width.
+ */
+JAPACKER_DECL unsigned long long japacker_get_rect_width_key(const japacker_rect *rect)
+{
+    return rect->input.width;
+}
+
+/**
+ * @brief Internal function to get the key of a rect when options.sort_by_key is set.
+ *
+ * @param rect The rect.
+ * @return The key the user provided for the rect.
+ */
+JAPACKER_DECL unsigned long long japacker_get_rect_user_key(const japacker_rect *rect)
+{
+    return rect->input.sort_key;
+}
+
+/**
+ * @brief Internal function to create the empty area's comparator based on a perimeter sort.
+ *
+ * @param area The area to calculate the comparator for.
+ */
+JAPACKER_DECL void japacker_empty_area_set_perimeter_comparator(japacker_empty_area *area)
+{
+    area->comparator = (japacker_area) area->height + area->width;
+}
+
+/**
+ * @brief Internal function to create the empty area's comparator based on an area sort.
+ *
+ * @param area The area to calculate the comparator for.
+ */
+JAPACKER_DECL void japacker_empty_area_set_area_comparator(japacker_empty_area *area)
+{
+    area->comparator = (japacker_area) area->height * area->width;
+}
+
+/**
+ * @brief Internal function to create the empty area's comparator based on a width sort.
+ *
+ * @param area The area to calculate the comparator for.
+ */
+JAPACKER_DECL void japacker_empty_area_set_width_comparator(japacker_empty_area *area)
+{
+    area->comparator = area->width;
+}
+
+/**
+ * @brief Internal function to create the empty area's comparator based on a height sort.
+ *
+ * @param area The area to calculate the comparator for.
+ */
+JAPACKER_DECL void japacker_empty_area_set_height_comparator(japacker_empty_area *area)
+{
+    area->comparator = area->height;
+}
+
+/**
+ * @brief Internal function to set the value used to compare an empty area to the others, based on the sort type.
+ *
+ * This is a switch rather than a pointer to the function of each sort type, so that the compiler can inline the
+ * comparator into the code that splits, merges and sorts the empty areas, which runs for every packed rect.
+ *
+ * @param data The internal data whose empty areas are being sorted.
+ * @param area The area to calculate the comparator for.
+ */
+JAPACKER_DECL void japacker_empty_area_set_comparator(const japacker_internal_data *data, japacker_empty_area *area)
+{
+    switch (data->empty_areas.sort_by) {
+        case JAPACKER_SORT_BY_AREA:
+            japacker_empty_area_set_area_comparator(area);
+            break;
+        case JAPACKER_SORT_BY_HEIGHT:
+            japacker_empty_area_set_height_comparator(area);
+            break;
+        case JAPACKER_SORT_BY_WIDTH:
+            japacker_empty_area_set_width_comparator(area);
+            break;
+        case JAPACKER_SORT_BY_PERIMETER:
+        default:
+            japacker_empty_area_set_perimeter_comparator(area);
+            break;
+    }
+}
+
+/**
+ * @brief Checks whether an empty area comes before another one in sorted order.
+ *
+ * Empty areas with the same comparator are ordered by their slot, so that the order is always the same, no matter in
+ * which order the empty areas were created. This is also the order in which the scan of JAPACKER_SEARCH_SCAN picks
+ * between empty areas, so every search method finds the same empty area.
+ *
+ * @param area The empty area to check.
+ * @param other The empty area to compare it to.
+ * @return 1 if area comes first, 0 otherwise.
+ */
+JAPACKER_DECL int japacker_empty_area_precedes(const japacker_empty_area *area, const japacker_empty_area *other)
+{
+    return area->comparator < other->comparator || (area->comparator == other->comparator && area->slot < other->slot);
+}
+
+/**
+ * @brief Selects the functions used to sort the rects and compare the empty areas, based on options.sort_by.
  * 
- * This internal sorting goes backwards, going from largest to smallest, starting with current and
- * stopping when there are no smaller empty areas. The rationale is, since empty areas are created from larger ones,
- * then a new empty area can't be larger than the area of its parent.
- * This assumption (which, except for merges, is always true), prevents needing to cycle through the entire list, which
- * improves performance.
+ * By default, rectangles are sorted by their perimeter. If options.sort_by_key is set, the rects are sorted by the
+ * key the user provided instead, but the empty areas are still compared according to options.sort_by.
  * 
- * @param data The internal packer data to work with.
- * @param area The empty area to sort.
- * @param current The empty area on which to start searching to sort.
+ * @param packer The packer whose comparison functions should be set.
+ * @return The function that calculates the key of each rect.
  */
-JAPACKER_DECL void japacker_sort_empty_area(japacker_internal_data *data, japacker_empty_area *area,
-    japacker_empty_area *current)
+JAPACKER_DECL japacker_rect_key_function japacker_select_comparators(japacker_t *packer)
 {
-    // If there are no empty areas, then this becomes the only one
-    if (!data->empty_areas.first) {
-        data->empty_areas.first = area;
-        data->empty_areas.last = area;
+    japacker_internal_data *data = packer->internal_data;
+    japacker_rect_key_function get_key;
+    data->empty_areas.sort_by = packer->options.sort_by;
+
+    switch (packer->options.sort_by) {
+        case JAPACKER_SORT_BY_AREA:
+            get_key = japacker_get_rect_area_key;
+            break;
+        case JAPACKER_SORT_BY_HEIGHT:
+            get_key = japacker_get_rect_height_key;
+            break;
+        case JAPACKER_SORT_BY_WIDTH:
+            get_key = japacker_get_rect_width_key;
+            break;
+        case JAPACKER_SORT_BY_PERIMETER:
+        default:
+            get_key = japacker_get_rect_perimeter_key;
+            break;
+    }
+
+    return packer->options.sort_by_key == 1 ? japacker_get_rect_user_key : get_key;
+}
+
+/**
+ * @brief Internal function to sort rects by their keys, in ascending order.
+ *
+ * This is a least significant digit radix sort that goes through the keys one byte at a time. Since each pass is
+ * stable, rects with the same key keep the order they had before sorting. The passes for the bytes that are the same
+ * in every key are skipped, so keys that fit in a couple of bytes, like most widths and heights, only need a pass or
+ * two over the rects.
+ *
+ * @param rects The rects to sort.
+ * @param keys The key of each rect. Their order is undefined after sorting.
+ * @param temp_rects Room for num_rects rects, used while sorting.
+ * @param temp_keys Room for num_rects keys, used while sorting.
+ * @param num_rects The number of rects to sort.
+ */
+JAPACKER_DECL void japacker_radix_sort_rects(japacker_rect **rects, unsigned long long *keys,
+    japacker_rect **temp_rects, unsigned long long *temp_keys, unsigned int num_rects)
+{
+    if (!num_rects) {
         return;
     }
 
-    // We sort empty areas by comparator, with smaller comparatos first.
-    // By sorting the empty areas by ascending comparison and the rects by descending comparison,
-    // we make sure the largest rectangles search the smallest empty spaces first,
-    // only stopping when they find the smallest possible empty space they will fit.
+    // Bytes above the highest set bit of every key are zero for all of them, so there's no need to go through them
+    unsigned long long all_bits = 0;
+    for (unsigned int i = 0; i < num_rects; i++) {
+        all_bits |= keys[i];
+    }
+
+    japacker_rect **source_rects = rects;
+    unsigned long long *source_keys = keys;
+    japacker_rect **target_rects = temp_rects;
+    unsigned long long *target_keys = temp_keys;
+    unsigned int offsets[256];
+
+    for (unsigned int shift = 0; shift < 64 && (all_bits >> shift); shift += 8) {
+        memset(offsets, 0, sizeof(offsets));
+        for (unsigned int i = 0; i < num_rects; i++) {
+            offsets[(source_keys[i] >> shift) & 0xff]++;
+        }
+
+        // If every key has the same byte, this pass wouldn't move anything
+        if (offsets[(source_keys[0] >> shift) & 0xff] == num_rects) {
+            continue;
+        }
+
+        // Turn the counts into the position where the first rect with each byte goes
+        unsigned int offset = 0;
+        for (unsigned int digit = 0; digit < 256; digit++) {
+            unsigned int count = offsets[digit];
+            offsets[digit] = offset;
+            offset += count;
+        }
+
+        for (unsigned int i = 0; i < num_rects; i++) {
+            unsigned int position = offsets[(source_keys[i] >> shift) & 0xff]++;
+            target_keys[position] = source_keys[i];
+            target_rects[position] = source_rects[i];
+        }
+
+        japacker_rect **swap_rects = source_rects;
+        source_rects = target_rects;
+        target_rects = swap_rects;
+        unsigned long long *swap_keys = source_keys;
+        source_keys = target_keys;
+        target_keys = swap_keys;
+    }
+
+    if (source_rects != rects) {
+        memcpy(rects, source_rects, num_rects * sizeof(japacker_rect *));
+    }
+}
+
+/**
+ * @brief Sorts the rectangles.
+ * 
+ * The sorting used is based on options.sort_by. If options.rects_are_sorted is set, no sorting will occur.
+ * However, the internal japacker_rects** will still be populated, since that's what's used internally.
+ * 
+ * @param packer The packer whose rects should be sorted.
+ */
+JAPACKER_DECL void japacker_sort_rects(japacker_t *packer)
+{
+    japacker_internal_data *data = packer->internal_data;
+    
+    // To prevent changing the array of rects that the user provided,
+    // we work with our own array of pointers to the user's rects, which we can then sort freely
+    // without the user losing his own image index order
+    // The array is allocated along with the rects, so sorting again never needs new memory
+    for (unsigned int i = 0; i < data->num_rects; i++) {
+        data->sorted_rects[i] = &packer->rects[i];
+    }
+    data->num_sorted_rects = data->num_rects;
+    data->sorted_by_packer = packer->options.rects_are_sorted != 1;
+
+    // The empty areas are always sorted according to the type the user selected, even if the rects were sorted
+    // by the user
+    japacker_rect_key_function get_key = japacker_select_comparators(packer);
+
+    // Sort the rectangles if they aren't already sorted
+    // The sort is always performed in descending order, and rects with the same key keep their index order
+    if (packer->options.rects_are_sorted != 1) {
+        unsigned long long *keys = data->sort_keys;
+
+        // When grouping identical rects, rects with the same key must also be sorted by size so that the identical
+        // ones end up next to each other. Since the sort is stable, it's enough to sort by size first. The skyline
+        // never groups rects, so it keeps the same order as without grouping
+        if (packer->options.group_identical_rects == 1 && packer->options.algorithm != JAPACKER_ALGORITHM_SKYLINE) {
+            for (unsigned int i = 0; i < data->num_rects; i++) {
+                keys[i] = (unsigned long long) data->sorted_rects[i]->input.width << 32 |
+                    data->sorted_rects[i]->input.height;
+            }
+            japacker_radix_sort_rects(data->sorted_rects, keys, data->pending_rects, keys + data->rects_capacity,
+                data->num_rects);
+        }
+
+        // Each key is calculated only once. The radix sort is ascending, so the keys are flipped by subtracting
+        // them from the largest one, which keeps them as small as possible
+        unsigned long long max_key = 0;
+        for (unsigned int i = 0; i < data->num_rects; i++) {
+            keys[i] = get_key(data->sorted_rects[i]);
+            if (keys[i] > max_key) {
+                max_key = keys[i];
+            }
+        }
+        for (unsigned int i = 0; i < data->num_rects; i++) {
+            keys[i] = max_key - keys[i];
+        }
+
+        // The pending rects aren't in use while sorting, so they hold the rects being moved
+        japacker_radix_sort_rects(data->sorted_rects, keys, data->pending_rects, keys + data->rects_capacity,
+            data->num_rects);
+        packer->options.rects_are_sorted = 1;
+    }
+}
+
+
+/*
+ * Empty areas related functions
+ */
+
+/**
+ * @brief Calculates the hash of a key made of three values.
+ *
+ * @param a The first value of the key.
+ * @param b The second value of the key.
+ * @param c The third value of the key.
+ * @return The hash of the key.
+ */
+JAPACKER_DECL unsigned int japacker_hash(unsigned int a, unsigned int b, unsigned int c)
+{
+    unsigned int hash = a * 0x9E3779B1u ^ b * 0x85EBCA77u ^ c * 0xC2B2AE3Du;
+    hash ^= hash >> 15;
+    hash *= 0x2C1B3C6Du;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+/**
+ * @brief Gets the key of one of the edges of an empty area.
+ *
+ * @param area The empty area to get the edge key from.
+ * @param type The edge to get the key of.
+ * @param key The array of three values where the key will be stored.
+ */
+JAPACKER_DECL void japacker_get_edge_key(const japacker_empty_area *area, japacker_edge_type type, unsigned int *key)
+{
+    switch (type) {
+        case JAPACKER_EDGE_LEFT:
+            key[0] = area->x;
+            key[1] = area->y;
+            key[2] = area->height;
+            break;
+        case JAPACKER_EDGE_RIGHT:
+            key[0] = area->x + area->width;
+            key[1] = area->y;
+            key[2] = area->height;
+            break;
+        case JAPACKER_EDGE_TOP:
+            key[0] = area->x;
+            key[1] = area->y;
+            key[2] = area->width;
+            break;
+        case JAPACKER_EDGE_BOTTOM:
+        default:
+            key[0] = area->x;
+            key[1] = area->y + area->height;
+            key[2] = area->width;
+            break;
+    }
+}
+
+/**
+ * @brief Gets the bucket where an edge with the provided key is stored.
+ *
+ * @param data The internal packer data to work with.
+ * @param type The type of the edge.
+ * @param key The key of the edge.
+ * @return A pointer to the head of the bucket.
+ */
+JAPACKER_DECL japacker_empty_area **japacker_get_edge_bucket(japacker_internal_data *data, japacker_edge_type type,
+    const unsigned int *key)
+{
+    unsigned int bucket = japacker_hash(key[0], key[1], key[2]) & data->edge_index.mask;
+    return &data->edge_index.buckets[type * (data->edge_index.mask + 1) + bucket];
+}
+
+/**
+ * @brief Adds all the edges of an empty area to the edge index.
+ *
+ * @param data The internal packer data to work with.
+ * @param area The empty area whose edges should be indexed.
+ */
+JAPACKER_DECL void japacker_index_empty_area_edges(japacker_internal_data *data, japacker_empty_area *area)
+{
+    for (int type = JAPACKER_EDGE_LEFT; type <= JAPACKER_EDGE_BOTTOM; type++) {
+        unsigned int key[3];
+        japacker_get_edge_key(area, (japacker_edge_type) type, key);
+        japacker_empty_area **bucket = japacker_get_edge_bucket(data, (japacker_edge_type) type, key);
+        area->edge_next[type] = *bucket;
+        *bucket = area;
+    }
+}
+
+/**
+ * @brief Removes all the edges of an empty area from the edge index.
+ *
+ * This must be called before the position or the dimensions of the empty area change, otherwise its edges won't be
+ * found in the index.
+ *
+ * @param data The internal packer data to work with.
+ * @param area The empty area whose edges should be removed from the index.
+ */
+JAPACKER_DECL void japacker_unindex_empty_area_edges(japacker_internal_data *data, japacker_empty_area *area)
+{
+    for (int type = JAPACKER_EDGE_LEFT; type <= JAPACKER_EDGE_BOTTOM; type++) {
+        unsigned int key[3];
+        japacker_get_edge_key(area, (japacker_edge_type) type, key);
+        japacker_empty_area **link = japacker_get_edge_bucket(data, (japacker_edge_type) type, key);
+        // Buckets are very short, so walking them to find the area is cheap
+        while (*link && *link != area) {
+            link = &(*link)->edge_next[type];
+        }
+        if (*link) {
+            *link = area->edge_next[type];
+        }
+        area->edge_next[type] = 0;
+    }
+}
+
+/**
+ * @brief Finds the listed empty area that has an edge with the provided key.
+ *
+ * @param data The internal packer data to work with.
+ * @param type The type of the edge to look for.
+ * @param a The first value of the key.
+ * @param b The second value of the key.
+ * @param c The third value of the key.
+ * @return The empty area with that edge, or 0 if there's none.
+ */
+JAPACKER_DECL japacker_empty_area *japacker_find_empty_area_edge(japacker_internal_data *data, japacker_edge_type type,
+    unsigned int a, unsigned int b, unsigned int c)
+{
+    unsigned int key[3] = { a, b, c };
+    japacker_empty_area *current = *japacker_get_edge_bucket(data, type, key);
+    while (current) {
+        unsigned int current_key[3];
+        japacker_get_edge_key(current, type, current_key);
+        if (current_key[0] == a && current_key[1] == b && current_key[2] == c) {
+            return current;
+        }
+        current = current->edge_next[type];
+    }
+    return 0;
+}
+
+/**
+ * @brief Recalculates the largest width and height of a tree node's subtree and adopts the node's children.
+ *
+ * @param node The node to update.
+ */
+JAPACKER_DECL void japacker_tree_update_node(japacker_empty_area *node)
+{
+    node->tree.max_width = node->width;
+    node->tree.max_height = node->height;
+    node->tree.max_short_side = node->width < node->height ? node->width : node->height;
+    node->tree.max_area = (double) node->width * node->height;
+
+    japacker_empty_area *children[2] = { node->tree.left, node->tree.right };
+
+    for (int i = 0; i < 2; i++) {
+        japacker_empty_area *child = children[i];
+        if (!child) {
+            continue;
+        }
+        child->tree.parent = node;
+        if (child->tree.max_width > node->tree.max_width) {
+            node->tree.max_width = child->tree.max_width;
+        }
+        if (child->tree.max_height > node->tree.max_height) {
+            node->tree.max_height = child->tree.max_height;
+        }
+        if (child->tree.max_short_side > node->tree.max_short_side) {
+            node->tree.max_short_side = child->tree.max_short_side;
+        }
+        if (child->tree.max_area > node->tree.max_area) {
+            node->tree.max_area = child->tree.max_area;
+        }
+    }
+}
+
+/**
+ * @brief Splits a tree in two, one with the nodes that come before the provided empty area and the other with the
+ * remaining nodes.
+ *
+ * @param node The root of the tree to split.
+ * @param area The empty area used to split the tree, according to japacker_empty_area_precedes().
+ * @param left Where the root of the tree with the smaller nodes will be stored.
+ * @param right Where the root of the tree with the remaining nodes will be stored.
+ */
+JAPACKER_DECL void japacker_tree_split(japacker_empty_area *node, const japacker_empty_area *area,
+    japacker_empty_area **left, japacker_empty_area **right)
+{
+    if (!node) {
+        *left = 0;
+        *right = 0;
+        return;
+    }
+    if (japacker_empty_area_precedes(node, area)) {
+        japacker_tree_split(node->tree.right, area, &node->tree.right, right);
+        *left = node;
+    } else {
+        japacker_tree_split(node->tree.left, area, left, &node->tree.left);
+        *right = node;
+    }
+    japacker_tree_update_node(node);
+}
+
+/**
+ * @brief Joins two trees, where every node of the left tree comes before every node of the right tree.
+ *
+ * @param left The root of the left tree.
+ * @param right The root of the right tree.
+ * @return The root of the joined tree.
+ */
+JAPACKER_DECL japacker_empty_area *japacker_tree_join(japacker_empty_area *left, japacker_empty_area *right)
+{
+    if (!left) {
+        return right;
+    }
+    if (!right) {
+        return left;
+    }
+    if (left->tree.priority > right->tree.priority) {
+        left->tree.right = japacker_tree_join(left->tree.right, right);
+        japacker_tree_update_node(left);
+        return left;
+    }
+    right->tree.left = japacker_tree_join(left, right->tree.left);
+    japacker_tree_update_node(right);
+    return right;
+}
+
+/**
+ * @brief Inserts an empty area in the search tree and links it to its neighbours in the sorted list.
+ *
+ * Just like when sorting the list, the new empty area is placed after all empty areas that come before it.
+ *
+ * @param data The internal packer data to work with.
+ * @param area The empty area to insert.
+ */
+JAPACKER_DECL void japacker_tree_insert(japacker_internal_data *data, japacker_empty_area *area)
+{
+    japacker_empty_area *left, *right;
+    japacker_tree_split(data->empty_areas.root, area, &left, &right);
+
+    area->tree.priority = japacker_hash(area->slot, 0, 0);
+    area->tree.parent = 0;
+    area->tree.left = 0;
+    area->tree.right = 0;
+    japacker_tree_update_node(area);
+
+    // The neighbours in the sorted list are the rightmost node of the left tree and the leftmost node of the right tree
+    area->prev = left;
+    while (area->prev && area->prev->tree.right) {
+        area->prev = area->prev->tree.right;
+    }
+    area->next = right;
+    while (area->next && area->next->tree.left) {
+        area->next = area->next->tree.left;
+    }
+    if (area->prev) {
+        area->prev->next = area;
+    } else {
+        data->empty_areas.first = area;
+    }
+    if (area->next) {
+        area->next->prev = area;
+    } else {
+        data->empty_areas.last = area;
+    }
+
+    data->empty_areas.root = japacker_tree_join(japacker_tree_join(left, area), right);
+    data->empty_areas.root->tree.parent = 0;
+}
+
+/**
+ * @brief Removes an empty area from the search tree.
+ *
+ * @param data The internal packer data to work with.
+ * @param area The empty area to remove.
+ */
+JAPACKER_DECL void japacker_tree_remove(japacker_internal_data *data, japacker_empty_area *area)
+{
+    japacker_empty_area *parent = area->tree.parent;
+    japacker_empty_area *replacement = japacker_tree_join(area->tree.left, area->tree.right);
+
+    if (replacement) {
+        replacement->tree.parent = parent;
+    }
+    if (!parent) {
+        data->empty_areas.root = replacement;
+    } else if (parent->tree.left == area) {
+        parent->tree.left = replacement;
+    } else {
+        parent->tree.right = replacement;
+    }
+
+    // The largest width and height of every ancestor may have changed
+    while (parent) {
+        japacker_tree_update_node(parent);
+        parent = parent->tree.parent;
+    }
+
+    area->tree.parent = 0;
+    area->tree.left = 0;
+    area->tree.right = 0;
+}
+
+/**
+ * @brief Finds the first empty area of a subtree, in sorted order, where a rectangle fits.
+ *
+ * Subtrees whose largest width or height is too small for the rectangle are skipped entirely.
+ *
+ * @param data The internal packer data to work with.
+ * @param node The root of the subtree to search.
+ * @param width The width of the rectangle.
+ * @param height The height of the rectangle.
+ * @param short_side The smallest of the rectangle's width and height.
+ * @param area The area of the rectangle.
+ * @return The empty area where the rectangle fits, or 0 if there's none.
+ */
+JAPACKER_DECL japacker_empty_area *japacker_tree_find(japacker_internal_data *data, japacker_empty_area *node,
+    unsigned int width, unsigned int height, unsigned int short_side, double area)
+{
+    if (!node) {
+        return 0;
+    }
+    JAPACKER_STAT(data->stats.empty_areas_visited++);
+    if (width > node->tree.max_width || height > node->tree.max_height ||
+        short_side > node->tree.max_short_side || area > node->tree.max_area) {
+        return 0;
+    }
+    japacker_empty_area *found = japacker_tree_find(data, node->tree.left, width, height, short_side, area);
+    if (found) {
+        return found;
+    }
+    if (width <= node->width && height <= node->height) {
+        return node;
+    }
+    return japacker_tree_find(data, node->tree.right, width, height, short_side, area);
+}
+
+/**
+ * @brief Sorts a newly created empty area in the list of empty areas.
+ * 
+ * This internal sorting goes backwards, going from largest to smallest, starting with current and
+ * stopping when there are no smaller empty areas. The rationale is, since empty areas are created from larger ones,
+ * then a new empty area can't be larger than the area of its parent.
+ * This assumption (which, except for merges, is always true), prevents needing to cycle through the entire list, which
+ * improves performance.
+ * 
+ * @param data The internal packer data to work with.
+ * @param area The empty area to sort.
+ * @param current The empty area on which to start searching to sort.
+ */
+JAPACKER_DECL void japacker_sort_empty_area(japacker_internal_data *data, japacker_empty_area *area,
+    japacker_empty_area *current)
+{
+    // Listed empty areas can be merged with, so they must be findable through their edges
+    japacker_index_empty_area_edges(data, area);
+
+    // The search tree finds the proper place of the empty area by itself
+    if (data->empty_areas.search_by == JAPACKER_SEARCH_TREE) {
+        japacker_tree_insert(data, area);
+        return;
+    }
+
+    // When scanning, the list doesn't need to be sorted, so the empty area is simply placed first
+    if (data->empty_areas.search_by == JAPACKER_SEARCH_SCAN) {
+        unsigned int slot = area->slot;
+        data->empty_areas.scan.width[slot] = area->width;
+        data->empty_areas.scan.height[slot] = area->height;
+        data->empty_areas.scan.comparator[slot] = area->comparator;
+        area->prev = 0;
+        area->next = data->empty_areas.first;
+        if (area->next) {
+            area->next->prev = area;
+        } else {
+            data->empty_areas.last = area;
+        }
+        data->empty_areas.first = area;
+        return;
+    }
+
+    // If there are no empty areas, then this becomes the only one
+    if (!data->empty_areas.first) {
+        data->empty_areas.first = area;
+        data->empty_areas.last = area;
+        return;
+    }
+
+    // We sort empty areas by comparator, with smaller comparatos first.
+    // By sorting the empty areas by ascending comparison and the rects by descending comparison,
+    // we make sure the largest rectangles search the smallest empty spaces first,
+    // only stopping when they find the smallest possible empty space they will fit.
+
+    // If the assumption above doesn't hold, which only happens when merging or when empty areas have the same
+    // comparator, the empty areas that come before the new one are skipped first, so that the list is always sorted
+    japacker_empty_area *next = current ? current->next : data->empty_areas.first;
+    while (next && japacker_empty_area_precedes(next, area)) {
+        JAPACKER_STAT(data->stats.sort_steps++);
+        current = next;
+        next = next->next;
+    }
+
+    // Check for the first empty space that has a lower perimeter than the current one
+    while (current) {
+        JAPACKER_STAT(data->stats.sort_steps++);
+        // If we find a smaller empty space on the list, we place the new one right after it
+        if (japacker_empty_area_precedes(current, area)) {
+            // If the found smaller empty area was actually the last, then the new empty area becomes the last instead
+            if (current == data->empty_areas.last) {
+                data->empty_areas.last = area;
+            // Otherwise we just update the list linking references
+            } else {
+                area->next = current->next;
+                area->next->prev = area;
+            }
+            area->prev = current;
+            current->next = area;
+            return;
+        }
+        current = current->prev;
+    }
+
+    // If no other empty area is larger than this one, then this area becomes the first empty area
+    data->empty_areas.first->prev = area;
+    area->next = data->empty_areas.first;
+    data->empty_areas.first = area;
+}
+
+/**
+ * @brief Removes an empty area from the sorted list.
+ * 
+ * This also removes the empty area from the edge index, so it must be called before changing the area's position or
+ * dimensions.
+ * 
+ * @param data The internal packer data to work with.
+ * @param area The empty area to remove from the list.
+ */
+JAPACKER_DECL void japacker_delist_empty_area(japacker_internal_data *data, japacker_empty_area* area)
+{
+    japacker_unindex_empty_area_edges(data, area);
+
+    if (data->empty_areas.search_by == JAPACKER_SEARCH_TREE) {
+        japacker_tree_remove(data, area);
+    }
+
+    // Make sure no rect will be placed in the slot when scanning
+    if (data->empty_areas.search_by == JAPACKER_SEARCH_SCAN) {
+        unsigned int slot = area->slot;
+        data->empty_areas.scan.width[slot] = 0;
+        data->empty_areas.scan.height[slot] = 0;
+    }
+
+    // If the area being removed from the list was the first, then the next area becomes the first
+    if (area == data->empty_areas.first) {
+        data->empty_areas.first = area->next;
+    }
+    // If the area being removed from the list was the last, then the previous area becomes the last
+    if (area == data->empty_areas.last) {
+        data->empty_areas.last = area->prev;
+    }
+    // Update list linking references
+    if (area->prev) {
+        area->prev->next = area->next;
+    }
+    if (area->next) {
+        area->next->prev = area->prev;
+    }
+    area->prev = 0;
+    area->next = 0;
+}
+
+/**
+ * @brief Gets the number of buckets for each edge type of an edge index, which is the smallest power of two that is not
+ * lower than the maximum number of empty areas.
+ *
+ * @param size The maximum number of empty areas.
+ * @return The number of buckets.
+ */
+JAPACKER_DECL unsigned int japacker_get_num_edge_buckets(unsigned int size)
+{
+    unsigned int buckets = 1;
+    while (buckets < size) {
+        buckets <<= 1;
+    }
+    return buckets;
+}
+
+/**
+ * @brief Gets the number of elements of each of the scan arrays.
+ *
+ * @param size The maximum number of empty areas.
+ * @return The number of elements, which is a multiple of JAPACKER_SCAN_BLOCK.
+ */
+JAPACKER_DECL unsigned int japacker_get_scan_size(unsigned int size)
+{
+    return (size + JAPACKER_SCAN_BLOCK - 1) / JAPACKER_SCAN_BLOCK * JAPACKER_SCAN_BLOCK;
+}
+
+/**
+ * @brief Gets the size of the memory block that holds the three scan arrays.
+ *
+ * @param scan_size The number of elements of each array.
+ * @return The size of the block, in bytes.
+ */
+JAPACKER_DECL size_t japacker_get_scan_arrays_size(unsigned int scan_size)
+{
+    return scan_size * (2 * sizeof(unsigned int) + sizeof(japacker_area));
+}
+
+/**
+ * @brief Sets the scan arrays to point to a memory block with room for the three of them.
+ *
+ * The comparators go last, so that they stay aligned when they are 64 bits wide.
+ *
+ * @param data The internal packer data to work with.
+ * @param block The memory block, with the size given by japacker_get_scan_arrays_size().
+ * @param scan_size The number of elements of each array.
+ */
+JAPACKER_DECL void japacker_set_scan_arrays(japacker_internal_data *data, void *block, unsigned int scan_size)
+{
+    data->empty_areas.scan.width = (unsigned int *) block;
+    data->empty_areas.scan.height = data->empty_areas.scan.width + scan_size;
+    data->empty_areas.scan.comparator = (japacker_area *) (data->empty_areas.scan.width + scan_size * 2);
+    data->empty_areas.scan.size = scan_size;
+}
+
+/**
+ * @brief Allocates the memory for the empty areas and their edge index.
+ *
+ * @param data The internal packer data to work with.
+ * @param size The maximum number of empty areas.
+ * @return 1 on success, 0 if out of memory.
+ */
+JAPACKER_DECL int japacker_allocate_empty_areas(japacker_internal_data *data, unsigned int size)
+{
+    data->empty_areas.list = (japacker_empty_area *) JAPACKER_MALLOC(size * sizeof(japacker_empty_area));
+    if (!data->empty_areas.list) {
+        return 0;
+    }
+    memset(data->empty_areas.list, 0, size * sizeof(japacker_empty_area));
+    data->empty_areas.size = size;
+    data->empty_areas.list_size = size;
+
+    // Create the edge index, with at least as many buckets per edge type as there can be empty areas
+    unsigned int buckets = japacker_get_num_edge_buckets(size);
+    data->edge_index.buckets = (japacker_empty_area **) JAPACKER_MALLOC(4 * buckets * sizeof(japacker_empty_area *));
+    if (!data->edge_index.buckets) {
+        return 0;
+    }
+    data->edge_index.mask = buckets - 1;
+
+    // Create the scan arrays
+    unsigned int scan_size = japacker_get_scan_size(size);
+    void *scan = JAPACKER_MALLOC(japacker_get_scan_arrays_size(scan_size));
+    if (!scan) {
+        return 0;
+    }
+    memset(scan, 0, japacker_get_scan_arrays_size(scan_size));
+    japacker_set_scan_arrays(data, scan, scan_size);
+
+    return 1;
+}
+
+/**
+ * @brief Frees the memory for the empty areas and their edge index.
+ *
+ * @param data The internal packer data to work with.
+ */
+JAPACKER_DECL void japacker_free_empty_areas(japacker_internal_data *data)
+{
+    for (unsigned int i = 0; i < data->empty_areas.num_chunks; i++) {
+        JAPACKER_FREE(data->empty_areas.chunks[i]);
+    }
+    JAPACKER_FREE(data->empty_areas.chunks);
+    JAPACKER_FREE(data->empty_areas.list);
+    JAPACKER_FREE(data->edge_index.buckets);
+    JAPACKER_FREE(data->empty_areas.scan.width);
+    data->empty_areas.chunks = 0;
+    data->empty_areas.num_chunks = 0;
+    data->empty_areas.chunks_capacity = 0;
+    data->empty_areas.list = 0;
+    data->edge_index.buckets = 0;
+    data->empty_areas.scan.width = 0;
+}
+
+/**
+ * @brief Gets the empty area in a slot, which is either in list or in one of the chunks.
+ *
+ * @param data The internal packer data to work with.
+ * @param slot The index of the slot.
+ * @return The empty area in the slot.
+ */
+JAPACKER_DECL japacker_empty_area *japacker_get_empty_area(const japacker_internal_data *data, unsigned int slot)
+{
+    if (slot < (unsigned int) data->empty_areas.list_size) {
+        return &data->empty_areas.list[slot];
+    }
+    slot -= data->empty_areas.list_size;
+    return &data->empty_areas.chunks[slot / JAPACKER_EMPTY_AREA_CHUNK][slot % JAPACKER_EMPTY_AREA_CHUNK];
+}
+
+/**
+ * @brief Gets an unused empty area slot, preferring slots that were released over new ones.
+ *
+ * There must be room for the new empty area, which japacker_reserve_empty_areas() guarantees.
+ *
+ * @param data The internal packer data to work with.
+ * @return The new empty area, with all its values set to 0.
+ */
+JAPACKER_DECL japacker_empty_area *japacker_new_empty_area(japacker_internal_data *data)
+{
+    japacker_empty_area *area = data->empty_areas.free;
+    unsigned int slot;
+    if (area) {
+        data->empty_areas.free = area->next;
+        slot = area->slot;
+    } else {
+        slot = (unsigned int) ++data->empty_areas.index;
+        area = japacker_get_empty_area(data, slot);
+        JAPACKER_STAT_MAX(data->stats.max_empty_area_index, (unsigned long long) data->empty_areas.index);
+    }
+    memset(area, 0, sizeof(japacker_empty_area));
+    area->slot = slot;
+    return area;
+}
+
+/**
+ * @brief Marks the slot of an empty area that is no longer in the list as unused, so it can be reused.
+ *
+ * @param data The internal packer data to work with.
+ * @param area The empty area to release.
+ */
+JAPACKER_DECL void japacker_release_empty_area(japacker_internal_data *data, japacker_empty_area *area)
+{
+    area->next = data->empty_areas.free;
+    data->empty_areas.free = area;
+}
+
+/**
+ * @brief Rebuilds the edge index from the empty areas in the sorted list.
+ *
+ * @param data The internal packer data to work with.
+ */
+JAPACKER_DECL void japacker_rebuild_edge_index(japacker_internal_data *data)
+{
+    memset(data->edge_index.buckets, 0, sizeof(japacker_empty_area *) * 4 * (data->edge_index.mask + 1));
+    for (japacker_empty_area *area = data->empty_areas.first; area; area = area->next) {
+        japacker_index_empty_area_edges(data, area);
+    }
+}
+
+/**
+ * @brief Grows the scan arrays so they have an element for every slot of the empty area array.
+ *
+ * The arrays at least double their size, so that copying them doesn't happen often.
+ *
+ * @param data The internal packer data to work with.
+ * @param size The number of slots of the empty area array.
+ * @return 1 on success, 0 if out of memory.
+ */
+JAPACKER_DECL int japacker_grow_scan_arrays(japacker_internal_data *data, unsigned int size)
+{
+    unsigned int old_scan_size = data->empty_areas.scan.size;
+    unsigned int scan_size = japacker_get_scan_size(size);
+    if (scan_size <= old_scan_size) {
+        return 1;
+    }
+    if (scan_size < old_scan_size * 2) {
+        scan_size = old_scan_size * 2;
+    }
+
+    // The scan arrays keep their contents, with the new slots unused
+    void *scan = JAPACKER_MALLOC(japacker_get_scan_arrays_size(scan_size));
+    if (!scan) {
+        return 0;
+    }
+    memset(scan, 0, japacker_get_scan_arrays_size(scan_size));
+    unsigned int *old_width = data->empty_areas.scan.width;
+    unsigned int *old_height = data->empty_areas.scan.height;
+    japacker_area *old_comparator = data->empty_areas.scan.comparator;
+    japacker_set_scan_arrays(data, scan, scan_size);
+    memcpy(data->empty_areas.scan.width, old_width, old_scan_size * sizeof(unsigned int));
+    memcpy(data->empty_areas.scan.height, old_height, old_scan_size * sizeof(unsigned int));
+    memcpy(data->empty_areas.scan.comparator, old_comparator, old_scan_size * sizeof(japacker_area));
+    JAPACKER_FREE(old_width);
+
+    return 1;
+}
+
+/**
+ * @brief Gives the edge index at least as many buckets as there are slots in the empty area array.
+ *
+ * If there's no memory for more buckets, the old ones still work, just a little slower.
+ *
+ * @param data The internal packer data to work with.
+ * @param size The number of slots of the empty area array.
+ * @return 1 if the buckets were replaced, and the edge index must be rebuilt, 0 otherwise.
+ */
+JAPACKER_DECL int japacker_grow_edge_index(japacker_internal_data *data, unsigned int size)
+{
+    unsigned int buckets = japacker_get_num_edge_buckets(size);
+    if (buckets <= data->edge_index.mask + 1) {
+        return 0;
+    }
+    japacker_empty_area **bucket_list =
+        (japacker_empty_area **) JAPACKER_MALLOC(4 * buckets * sizeof(japacker_empty_area *));
+    if (!bucket_list) {
+        return 0;
+    }
+    JAPACKER_FREE(data->edge_index.buckets);
+    data->edge_index.buckets = bucket_list;
+    data->edge_index.mask = buckets - 1;
+    return 1;
+}
+
+/**
+ * @brief Adds chunks of empty area slots until the array has a number of slots.
+ *
+ * The slots in use don't move, so unlike growing list, the empty areas aren't copied and no pointer to them changes.
+ *
+ * @param data The internal packer data to work with.
+ * @param needed The number of slots needed.
+ * @return 1 on success, 0 if out of memory.
+ */
+JAPACKER_DECL int japacker_add_empty_area_chunks(japacker_internal_data *data, unsigned int needed)
+{
+    unsigned int num_chunks = data->empty_areas.num_chunks +
+        (needed - data->empty_areas.size + JAPACKER_EMPTY_AREA_CHUNK - 1) / JAPACKER_EMPTY_AREA_CHUNK;
+    unsigned int size = data->empty_areas.list_size + num_chunks * JAPACKER_EMPTY_AREA_CHUNK;
+
+    // Every slot must have its scan array elements before it can be used
+    if (!japacker_grow_scan_arrays(data, size)) {
+        return 0;
+    }
+
+    if (num_chunks > data->empty_areas.chunks_capacity) {
+        unsigned int capacity = data->empty_areas.chunks_capacity ? data->empty_areas.chunks_capacity * 2 : 8;
+        if (capacity < num_chunks) {
+            capacity = num_chunks;
+        }
+        japacker_empty_area **chunks = (japacker_empty_area **) JAPACKER_REALLOC(data->empty_areas.chunks,
+            capacity * sizeof(japacker_empty_area *));
+        if (!chunks) {
+            return 0;
+        }
+        data->empty_areas.chunks = chunks;
+        data->empty_areas.chunks_capacity = capacity;
+    }
+
+    // The new slots don't need to be cleared, since japacker_new_empty_area() clears each slot before using it
+    while (data->empty_areas.num_chunks < num_chunks) {
+        japacker_empty_area *chunk =
+            (japacker_empty_area *) JAPACKER_MALLOC(JAPACKER_EMPTY_AREA_CHUNK * sizeof(japacker_empty_area));
+        if (!chunk) {
+            return 0;
+        }
+        data->empty_areas.chunks[data->empty_areas.num_chunks++] = chunk;
+        data->empty_areas.size += JAPACKER_EMPTY_AREA_CHUNK;
+    }
+
+    if (japacker_grow_edge_index(data, size)) {
+        japacker_rebuild_edge_index(data);
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Makes sure the array of empty areas has a number of slots, growing it if needed.
+ *
+ * The array grows by adding chunks of slots, except for the segments of a skyline, which must stay contiguous. In that
+ * case list itself grows, and since the empty areas point to each other, every pointer to the old list is moved to
+ * the new one.
+ *
+ * @param data The internal packer data to work with.
+ * @param needed The number of slots needed.
+ * @return 1 on success, 0 if out of memory.
+ */
+JAPACKER_DECL int japacker_grow_empty_areas(japacker_internal_data *data, unsigned int needed)
+{
+    int contiguous = data->empty_areas.algorithm == JAPACKER_ALGORITHM_SKYLINE;
+    if (needed <= (unsigned int) (contiguous ? data->empty_areas.list_size : data->empty_areas.size)) {
+        return 1;
+    }
+
+    // The memory provided by the user can't grow
+    if (!data->owns_memory) {
+        return 0;
+    }
+
+    if (!contiguous) {
+        return japacker_add_empty_area_chunks(data, needed);
+    }
+
+    // A skyline never has chunks, since japacker_set_empty_areas_algorithm() joins them, so list is the whole array
+    unsigned int size = data->empty_areas.list_size * 2;
+    if (size < needed) {
+        size = needed;
+    }
+
+    if (!japacker_grow_scan_arrays(data, size)) {
+        return 0;
+    }
+
+    japacker_empty_area *old_list = data->empty_areas.list;
+    japacker_empty_area *list = (japacker_empty_area *) JAPACKER_MALLOC(size * sizeof(japacker_empty_area));
+    if (!list) {
+        return 0;
+    }
+    memset(list, 0, size * sizeof(japacker_empty_area));
+    memcpy(list, old_list, (data->empty_areas.index + 1) * sizeof(japacker_empty_area));
+
+#define JAPACKER_REBASE(pointer) if (pointer) { pointer = list + (pointer - old_list); }
+    for (int i = 0; i <= data->empty_areas.index; i++) {
+        japacker_empty_area *area = &list[i];
+        JAPACKER_REBASE(area->prev);
+        JAPACKER_REBASE(area->next);
+        JAPACKER_REBASE(area->tree.parent);
+        JAPACKER_REBASE(area->tree.left);
+        JAPACKER_REBASE(area->tree.right);
+    }
+    JAPACKER_REBASE(data->empty_areas.first);
+    JAPACKER_REBASE(data->empty_areas.last);
+    JAPACKER_REBASE(data->empty_areas.root);
+    JAPACKER_REBASE(data->empty_areas.free);
+#undef JAPACKER_REBASE
+
+    JAPACKER_FREE(old_list);
+    data->empty_areas.list = list;
+    data->empty_areas.list_size = size;
+    data->empty_areas.size = size;
+
+    japacker_grow_edge_index(data, size);
+    japacker_rebuild_edge_index(data);
+
+    return 1;
+}
+
+/**
+ * @brief Makes sure there are enough slots for new empty areas, growing the array if needed.
+ *
+ * @param data The internal packer data to work with.
+ * @param count The number of empty areas that may be created.
+ * @return 1 on success, 0 if out of memory.
+ */
+JAPACKER_DECL int japacker_reserve_empty_areas(japacker_internal_data *data, unsigned int count)
+{
+    return japacker_grow_empty_areas(data, data->empty_areas.index + 1 + count);
+}
+
+/**
+ * @brief Sets the algorithm the empty areas are used with. It must be followed by japacker_reset_empty_areas().
+ *
+ * The segments of a skyline must be contiguous, so if the array of empty areas grew in chunks, all of its slots are
+ * moved to a single block first. The empty areas themselves are lost, since they're about to be reset anyway, so the
+ * current image is unset until then.
+ *
+ * @param data The internal packer data to work with.
+ * @param algorithm The algorithm to use.
+ * @return 1 on success, 0 if out of memory, in which case nothing changes.
+ */
+JAPACKER_DECL int japacker_set_empty_areas_algorithm(japacker_internal_data *data, japacker_algorithm algorithm)
+{
+    if (algorithm == JAPACKER_ALGORITHM_SKYLINE && data->empty_areas.num_chunks) {
+        japacker_empty_area *list =
+            (japacker_empty_area *) JAPACKER_MALLOC(data->empty_areas.size * sizeof(japacker_empty_area));
+        if (!list) {
+            return 0;
+        }
+        memset(list, 0, data->empty_areas.size * sizeof(japacker_empty_area));
+        for (unsigned int i = 0; i < data->empty_areas.num_chunks; i++) {
+            JAPACKER_FREE(data->empty_areas.chunks[i]);
+        }
+        data->empty_areas.num_chunks = 0;
+        JAPACKER_FREE(data->empty_areas.list);
+        data->current_image = -1;
+        data->empty_areas.list = list;
+        data->empty_areas.list_size = data->empty_areas.size;
+        data->empty_areas.index = 0;
+        data->empty_areas.first = 0;
+        data->empty_areas.last = 0;
+        data->empty_areas.root = 0;
+        data->empty_areas.free = 0;
+    }
+    data->empty_areas.algorithm = algorithm;
+    return 1;
+}
+
+/**
+ * @brief Resets the empty areas, moving back to a single empty area the size of the entire image.
+ * 
+ * @param data The internal packer data to work with.
+ * @param width The width of the new original empty area.
+ * @param height The height of the new original empty area.
+ */
+JAPACKER_DECL void japacker_reset_empty_areas(japacker_internal_data *data, unsigned int width, unsigned int height)
+{
+    memset(data->empty_areas.list, 0, sizeof(japacker_empty_area) * data->empty_areas.list_size);
+    for (unsigned int i = 0; i < data->empty_areas.num_chunks; i++) {
+        memset(data->empty_areas.chunks[i], 0, sizeof(japacker_empty_area) * JAPACKER_EMPTY_AREA_CHUNK);
+    }
+
+    memset(data->edge_index.buckets, 0, sizeof(japacker_empty_area *) * 4 * (data->edge_index.mask + 1));
+
+    memset(data->empty_areas.scan.width, 0, japacker_get_scan_arrays_size(data->empty_areas.scan.size));
+
+    data->empty_areas.index = 0;
+    data->empty_areas.first = 0;
+    data->empty_areas.last = 0;
+    data->empty_areas.root = 0;
+    data->empty_areas.free = 0;
+
+    // The first empty space is always the entire area of the image, with room for the padding of the rects that
+    // touch its right and bottom borders
+    data->empty_areas.list[0].width = width + data->spacing.padding_x;
+    data->empty_areas.list[0].height = height + data->spacing.padding_y;
+
+    // For a skyline, that's also its only segment, and it isn't sorted anywhere
+    if (data->empty_areas.algorithm == JAPACKER_ALGORITHM_SKYLINE) {
+        return;
+    }
+
+    japacker_sort_empty_area(data, &data->empty_areas.list[0], 0);
+}
+
+/**
+ * @brief Merges an empty area with adjacent empty areas.
+ * 
+ * This optimizes the empty area by making sure that areas that are directly on top or at the side of each other get
+ * merged to a single, bigger empty area. This also improves performance as there are less empty areas to sort through.
+ *
+ * The adjacent empty areas are found using the edge index, so each merge attempt takes constant time, regardless of
+ * the number of empty areas. The area passed must not be in the sorted list.
+ * 
+ * @param data The internal packer data to work with.
+ * @param area The empty area to which others should merge.
+ * @return 1 if the empty area merged with adjacent empty areas, 0 otherwise.
+*/
+JAPACKER_DECL int japacker_merge_adjacent_empty_areas(japacker_internal_data *data, japacker_empty_area *area)
+{
+    int merged = 0;
+    JAPACKER_STAT(data->stats.merge_attempts++);
+
+    // Every merge makes the area larger, which may make it adjacent to other areas, so we keep merging until
+    // there are no more adjacent areas with a matching edge
+    while (1) {
+        japacker_empty_area *current;
+
+        // Adjacent area to the left: its right edge is our left edge
+        if ((current = japacker_find_empty_area_edge(data, JAPACKER_EDGE_RIGHT, area->x, area->y, area->height))) {
+            area->x = current->x;
+            area->width += current->width;
+        // Adjacent area to the right: its left edge is our right edge
+        } else if ((current = japacker_find_empty_area_edge(data, JAPACKER_EDGE_LEFT,
+            area->x + area->width, area->y, area->height))) {
+            area->width += current->width;
+        // Adjacent area to the top: its bottom edge is our top edge
+        } else if ((current = japacker_find_empty_area_edge(data, JAPACKER_EDGE_BOTTOM,
+            area->x, area->y, area->width))) {
+            area->y = current->y;
+            area->height += current->height;
+        // Adjacent area to the bottom: its top edge is our bottom edge
+        } else if ((current = japacker_find_empty_area_edge(data, JAPACKER_EDGE_TOP,
+            area->x, area->y + area->height, area->width))) {
+            area->height += current->height;
+        } else {
+            JAPACKER_STAT_MAX(data->stats.max_merges, (unsigned long long) merged);
+            return merged > 0;
+        }
+        japacker_delist_empty_area(data, current);
+        japacker_release_empty_area(data, current);
+        JAPACKER_STAT(data->stats.merges++);
+        merged++;
+    }
+}
+
+/**
+ * @brief Splits an empty area into two smaller empty areas.
+ * 
+ * An empty area is split into two when a rectangle is created inside it. The creation of the rectangle takes a part of
+ * the original empty area, and two new empty areas are created, one below and one to the side of the new rectangle.
+ * 
+ * @param data The internal packer data to work with.
+ * @param area The empty area to split into two.
+ * @param width The width of the rectangle that caused the split.
+ * @param height The height of the rectangle that caused the split.
+*/
+JAPACKER_DECL void japacker_split_empty_area(japacker_internal_data *data, japacker_empty_area *area,
+    unsigned int width, unsigned int height)
+{
+    japacker_empty_area *new_area = japacker_new_empty_area(data);
+
+    // The area must leave the list before changing its dimensions, so that its edges are properly removed from the index
+    japacker_empty_area *original_prev = area->prev;
+    japacker_delist_empty_area(data, area);
+
+    // First we check what's the remaining dimensions both to the right and below the new rectangle
+    int remaining_width = area->width - width;
+    int remaining_height = area->height - height;
+
+    // If the empty area to the side of the new rectangle is larger than the one below,
+    // one empty area will have the space directly below of the new rectangle,
+    // and the other one will have all the space to the side
+    // Do note that to save memory space, we change the old empty area's data to become one of the new empty areas
+    if (remaining_width > remaining_height) {
+        new_area->x = area->x;
+        new_area->y = area->y + height;
+        new_area->width = width;
+        new_area->height = area->height - height;
+        area->x += width;
+        area->width -= width;
+
+    // If the empty area below new rectangle is larger than the one to the side,
+    // one empty area will have the space directly to the side of the new rectangle,
+    // and the other one will have all the space below
+    } else {
+        new_area->x = area->x + width;
+        new_area->y = area->y;
+        new_area->width = area->width - width;
+        new_area->height = height;
+        area->y += height;
+        area->height -= height;
+    }
+
+    // Merge the empty areas with adjacent empty ones
+    int merged = japacker_merge_adjacent_empty_areas(data, area) + japacker_merge_adjacent_empty_areas(data, new_area);
+
+    // We can only set the comparator after merging, because the empty areas may be larger
+    japacker_empty_area_set_comparator(data, area);
+    japacker_empty_area_set_comparator(data, new_area);
+
+    // If we aren't merging the new empty areas, we must still sort them, but we can optimize sorting due to the
+    // following assumptions (which are always true):
+    // - The new empty areas are smaller than the original empty area (which now has a rectangle)
+    // - The newly created empty area is smaller than the repurposed empty area (we make sure of this)
+    // Therefore we sort the new empty areas taking into account that the larger created area cannot be sorted
+    // any higher than before, and the smaller created area cannot be sorted any higher than the larger created area.
+    if (!merged) {
+        japacker_sort_empty_area(data, area, original_prev);
+        japacker_sort_empty_area(data, new_area, area->prev);
+    } else {
+
+        // If we're merging both new empty areas, we can't really optimize their sorting save for the fact that we can
+        // limit the search for the smallest of the merged empty areas to start at the largest of the empty areas
+        if (japacker_empty_area_precedes(new_area, area)) {
+            japacker_sort_empty_area(data, area, data->empty_areas.last);
+            japacker_sort_empty_area(data, new_area, area->prev);
+        } else {
+            japacker_sort_empty_area(data, new_area, data->empty_areas.last);
+            japacker_sort_empty_area(data, area, new_area->prev);
+        }
+    }
+}
+
+
+/*
+ * Skyline related functions
+ */
+
+/**
+ * @brief Finds where a rectangle is placed on the skyline.
+ *
+ * The rectangle starts at the left edge of a segment and rests on the lowest point of all the segments below it.
+ * The chosen segment is the one where the bottom of the rectangle would be closest to the top of the image, and the
+ * leftmost one on ties.
+ *
+ * @param data The internal packer data to work with.
+ * @param width The width of the rectangle.
+ * @param height The height of the rectangle.
+ * @param y Where to store the y position of the rectangle, which is set to 0 if it doesn't fit.
+ * @return The index of the segment where the rectangle starts, or the number of segments if it doesn't fit.
+ */
+JAPACKER_DECL unsigned int japacker_skyline_find(japacker_internal_data *data, unsigned int width, unsigned int height,
+    unsigned int *y)
+{
+    const japacker_empty_area *segments = data->empty_areas.list;
+    unsigned int num_segments = data->empty_areas.index + 1;
+    unsigned int image_width = segments[num_segments - 1].x + segments[num_segments - 1].width;
+    unsigned int best = num_segments;
+    unsigned int best_bottom = 0;
+    *y = 0;
+
+    for (unsigned int i = 0; i < num_segments && image_width - segments[i].x >= width; i++) {
+        // The rectangle rests on the lowest of the segments it spans, and must still fit below all of them
+        unsigned int top = segments[i].y;
+        unsigned int free_height = segments[i].height;
+        unsigned int covered = 0;
+        for (unsigned int j = i; covered < width; j++) {
+            JAPACKER_STAT(data->stats.empty_areas_visited++);
+            if (segments[j].y > top) {
+                top = segments[j].y;
+                free_height = segments[j].height;
+            }
+            covered += segments[j].width;
+        }
+
+        if (height <= free_height && (best == num_segments || top + height < best_bottom)) {
+            best = i;
+            best_bottom = top + height;
+            *y = top;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * @brief Raises the skyline over a rectangle that was placed on it.
+ *
+ * @param data The internal packer data to work with.
+ * @param index The index of the segment where the rectangle starts.
+ * @param y The y position of the rectangle.
+ * @param width The width of the rectangle.
+ * @param height The height of the rectangle.
+ */
+JAPACKER_DECL void japacker_skyline_place(japacker_internal_data *data, unsigned int index, unsigned int y,
+    unsigned int width, unsigned int height)
+{
+    japacker_empty_area *segments = data->empty_areas.list;
+    unsigned int num_segments = data->empty_areas.index + 1;
+    unsigned int x = segments[index].x;
+    unsigned int end = x + width;
+    unsigned int bottom = y + height;
+    unsigned int image_height = segments[index].y + segments[index].height;
+
+    // The segments fully covered by the rectangle are replaced by a single one, and the last one that's partially
+    // covered loses the part below the rectangle
+    unsigned int last = index;
+    while (last < num_segments && segments[last].x + segments[last].width <= end) {
+        last++;
+    }
+    if (last < num_segments && segments[last].x < end) {
+        segments[last].width -= end - segments[last].x;
+        segments[last].x = end;
+    }
+
+    // If no segment was fully covered, the rectangle needs a new one, otherwise the other covered ones are removed
+    if (last == index) {
+        memmove(&segments[index + 1], &segments[index], (num_segments - index) * sizeof(japacker_empty_area));
+        num_segments++;
+    } else if (last > index + 1) {
+        memmove(&segments[index + 1], &segments[last], (num_segments - last) * sizeof(japacker_empty_area));
+        num_segments -= last - index - 1;
+    }
+    segments[index].x = x;
+    segments[index].y = bottom;
+    segments[index].width = width;
+    segments[index].height = image_height - bottom;
+
+    // Segments at the same height as their neighbours are joined, which keeps the skyline short
+    if (index + 1 < num_segments && segments[index + 1].y == bottom) {
+        segments[index].width += segments[index + 1].width;
+        memmove(&segments[index + 1], &segments[index + 2], (num_segments - index - 2) * sizeof(japacker_empty_area));
+        num_segments--;
+    }
+    if (index > 0 && segments[index - 1].y == bottom) {
+        segments[index - 1].width += segments[index].width;
+        memmove(&segments[index], &segments[index + 1], (num_segments - index - 1) * sizeof(japacker_empty_area));
+        num_segments--;
+    }
+
+    // Just like new empty areas, a new segment needs room, which japacker_reserve_empty_areas() guarantees
+    data->empty_areas.index = num_segments - 1;
+    JAPACKER_STAT_MAX(data->stats.max_empty_area_index, (unsigned long long) data->empty_areas.index);
+}
+
+/**
+ * @brief Checks whether nothing was placed in the current image yet.
+ *
+ * @param data The internal packer data to work with.
+ * @return 1 if the image is empty, 0 otherwise.
+ */
+JAPACKER_DECL int japacker_is_image_empty(const japacker_internal_data *data)
+{
+    if (data->empty_areas.algorithm == JAPACKER_ALGORITHM_SKYLINE) {
+        return data->empty_areas.index == 0 && data->empty_areas.list[0].y == 0;
+    }
+    return data->empty_areas.first &&
+        data->empty_areas.first->width == data->image_width + data->spacing.padding_x &&
+        data->empty_areas.first->height == data->image_height + data->spacing.padding_y;
+}
+
+
+/*
+ * Packing related functions
+ */
+
+/**
+ * @brief Scans the empty area arrays for the fitting empty area with the smallest comparator.
+ *
+ * Since slots that aren't in use have a width and height of 0, every slot up to the highest one in use can be checked
+ * without looking at the empty areas themselves. When several fitting empty areas have the same comparator, the one in
+ * the lowest slot is used.
+ *
+ * With SSE2, JAPACKER_SCAN_BLOCK slots are checked at once, and only the blocks which have an empty area that fits and
+ * is smaller than the best one found so far are looked at individually.
+ *
+ * @param data The internal packer data to work with.
+ * @param width The width of the rectangle.
+ * @param height The height of the rectangle.
+ * @return The empty area where the rectangle fits, or 0 if the rectangle doesn't fit anywhere.
+ */
+JAPACKER_DECL japacker_empty_area *japacker_scan_empty_areas(japacker_internal_data *data, unsigned int width,
+    unsigned int height)
+{
+    const unsigned int *widths = data->empty_areas.scan.width;
+    const unsigned int *heights = data->empty_areas.scan.height;
+    const japacker_area *comparators = data->empty_areas.scan.comparator;
+    unsigned int count = japacker_get_scan_size(data->empty_areas.index + 1);
+    JAPACKER_STAT(data->stats.empty_areas_visited += count);
+
+    // Only empty areas whose comparator is not above the limit can be better than the best one found so far
+    int best = -1;
+    japacker_area limit = (japacker_area) -1;
+
+#ifdef JAPACKER_SSE2
+    // SSE2 can only compare signed integers, so flipping the sign bit of both sides gives the unsigned comparison
+    const __m128i sign = _mm_set1_epi32((int) 0x80000000);
+    const __m128i rect_width = _mm_xor_si128(_mm_set1_epi32((int) width), sign);
+    const __m128i rect_height = _mm_xor_si128(_mm_set1_epi32((int) height), sign);
+#ifndef JAPACKER_64BIT_AREAS
+    __m128i rect_limit = _mm_xor_si128(_mm_set1_epi32((int) limit), sign);
+#endif
+
+    for (unsigned int i = 0; i < count; i += JAPACKER_SCAN_BLOCK) {
+        __m128i area_width = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (widths + i)), sign);
+        __m128i area_height = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (heights + i)), sign);
+
+#ifdef JAPACKER_64BIT_AREAS
+        // SSE2 can't compare 64 bit integers, so the comparators are only checked for the lanes that fit
+        __m128i rejected = _mm_or_si128(_mm_cmpgt_epi32(rect_width, area_width),
+            _mm_cmpgt_epi32(rect_height, area_height));
+#else
+        __m128i area_comparator = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (comparators + i)), sign);
+
+        // A lane is rejected if the rect is wider or taller than the area, or if its comparator is above the limit
+        __m128i rejected = _mm_or_si128(_mm_cmpgt_epi32(rect_width, area_width),
+            _mm_or_si128(_mm_cmpgt_epi32(rect_height, area_height), _mm_cmpgt_epi32(area_comparator, rect_limit)));
+#endif
+        int candidates = ~_mm_movemask_ps(_mm_castsi128_ps(rejected)) & 0xf;
+        if (!candidates) {
+            continue;
+        }
+
+        // The lanes are checked in order, since the limit goes down with each better empty area
+        for (unsigned int lane = 0; lane < JAPACKER_SCAN_BLOCK; lane++) {
+            if ((candidates & (1 << lane)) && comparators[i + lane] <= limit) {
+                best = (int) (i + lane);
+                if (!comparators[best]) {
+                    return japacker_get_empty_area(data, (unsigned int) best);
+                }
+                limit = comparators[best] - 1;
+            }
+        }
+#ifndef JAPACKER_64BIT_AREAS
+        rect_limit = _mm_xor_si128(_mm_set1_epi32((int) limit), sign);
+#endif
+    }
+#else
+    for (unsigned int i = 0; i < count; i++) {
+        if (width <= widths[i] && height <= heights[i] && comparators[i] <= limit) {
+            best = (int) i;
+            // No empty area can be smaller than this one
+            if (!comparators[i]) {
+                break;
+            }
+            limit = comparators[i] - 1;
+        }
+    }
+#endif
+
+    return best >= 0 ? japacker_get_empty_area(data, (unsigned int) best) : 0;
+}
+
+/**
+ * @brief Scores how well a rectangle fits in an empty area, according to empty_areas.placement.
+ *
+ * @param data The internal packer data to work with.
+ * @param area The empty area, where the rectangle must fit.
+ * @param width The width of the rectangle.
+ * @param height The height of the rectangle.
+ * @param score Where to store the score, as two values where lower is better. The second one breaks ties.
+ */
+JAPACKER_DECL void japacker_get_placement_score(const japacker_internal_data *data, const japacker_empty_area *area,
+    unsigned int width, unsigned int height, unsigned long long score[2])
+{
+    unsigned int short_side = area->width - width;
+    unsigned int long_side = area->height - height;
+    if (short_side > long_side) {
+        unsigned int side = short_side;
+        short_side = long_side;
+        long_side = side;
+    }
+
+    switch (data->empty_areas.placement) {
+        case JAPACKER_PLACE_BEST_LONG_SIDE:
+            score[0] = long_side;
+            score[1] = short_side;
+            break;
+        case JAPACKER_PLACE_BEST_AREA:
+            score[0] = (unsigned long long) area->width * area->height - (unsigned long long) width * height;
+            score[1] = short_side;
+            break;
+        case JAPACKER_PLACE_CONTACT_POINT:
+            // The rectangle is placed at the top left corner, so it always touches the top and left borders. Instead
+            // of the length that touches, the length that doesn't is scored, so that lower is still better
+            score[0] = (width == area->width ? 0 : height) + (height == area->height ? 0 : width);
+            score[1] = short_side;
+            break;
+        default:
+            score[0] = short_side;
+            score[1] = long_side;
+            break;
+    }
+}
+
+/**
+ * @brief Picks the empty area where a rectangle fits best, according to empty_areas.placement, among the first empty
+ * area where the rectangle fits and the empty_areas.search_window empty areas that follow it in the list.
+ *
+ * Ties are resolved by the order of the list. This works better than the first fitting empty area when the rects are
+ * not sorted, since a rect that arrives later may be larger than the current one, so the space left around each rect
+ * is kept as usable as possible.
+ *
+ * @param data The internal packer data to work with.
+ * @param first The first empty area where the rectangle fits.
+ * @param width The width of the rectangle.
+ * @param height The height of the rectangle.
+ * @return The empty area where the rectangle is placed.
+ */
+JAPACKER_DECL japacker_empty_area *japacker_find_best_fit(japacker_internal_data *data, japacker_empty_area *first,
+    unsigned int width, unsigned int height)
+{
+    japacker_empty_area *best = first;
+    unsigned long long best_score[2];
+    japacker_get_placement_score(data, first, width, height, best_score);
+
+    japacker_empty_area *area = first->next;
+    for (unsigned int i = 0; i < data->empty_areas.search_window && area; i++, area = area->next) {
+        JAPACKER_STAT(data->stats.empty_areas_visited++);
+        if (width > area->width || height > area->height) {
+            continue;
+        }
+        unsigned long long score[2];
+        japacker_get_placement_score(data, area, width, height, score);
+        if (score[0] < best_score[0] || (score[0] == best_score[0] && score[1] < best_score[1])) {
+            best = area;
+            best_score[0] = score[0];
+            best_score[1] = score[1];
+        }
+    }
+
+    return best;
+}
+
+/**
+ * @brief Finds the smallest empty area, in sorted order, where a rectangle fits.
+ *
+ * @param data The internal packer data to work with.
+ * @param width The width of the rectangle.
+ * @param height The height of the rectangle.
+ * @return The empty area where the rectangle fits, or 0 if the rectangle doesn't fit anywhere.
+ */
+JAPACKER_DECL japacker_empty_area *japacker_find_empty_area(japacker_internal_data *data, unsigned int width,
+    unsigned int height)
+{
+    japacker_empty_area *area;
+    if (data->empty_areas.search_by == JAPACKER_SEARCH_TREE) {
+        area = japacker_tree_find(data, data->empty_areas.root, width, height, width < height ? width : height,
+            (double) width * height);
+    } else if (data->empty_areas.search_by == JAPACKER_SEARCH_SCAN) {
+        area = japacker_scan_empty_areas(data, width, height);
+    } else {
+        for (area = data->empty_areas.first; area; area = area->next) {
+            JAPACKER_STAT(data->stats.empty_areas_visited++);
+            // If the rectangle is larger than the current empty area, we must look for a larger empty area
+            if (height <= area->height && width <= area->width) {
+                break;
+            }
+        }
+    }
+
+    // The empty areas that follow may leave less space around the rectangle
+    if (area && data->empty_areas.search_window) {
+        area = japacker_find_best_fit(data, area, width, height);
+    }
+    return area;
+}
+
+/**
+ * @brief Internal function to take the space of a rectangle from the top left corner of an empty area.
+ *
+ * @param data The internal data.
+ * @param area The empty area where the rectangle is placed. The rectangle must fit in it.
+ * @param width The width of the rectangle.
+ * @param height The height of the rectangle.
+ */
+JAPACKER_DECL void japacker_place_in_empty_area(japacker_internal_data *data, japacker_empty_area *area,
+    unsigned int width, unsigned int height)
+{
+    // If the rectangle has the same dimensions as the empty area, we simply remove the empty area
+    if (height == area->height && width == area->width) {
+        japacker_delist_empty_area(data, area);
+        japacker_release_empty_area(data, area);
+        return;
+    }
+
+    // If the rectangle has the same height but lower width,
+    // we reduce the empty area's width and offset it to start to the right of the new rectangle
+    if (height == area->height) {
+        japacker_empty_area *prev = area->prev;
+        japacker_delist_empty_area(data, area);
+        area->x += width;
+        area->width -= width;
+        if (japacker_merge_adjacent_empty_areas(data, area)) {
+            prev = data->empty_areas.last;
+        }
+        japacker_empty_area_set_comparator(data, area);
+        japacker_sort_empty_area(data, area, prev);
+        return;
+    }
+
+    // If the rectangle has the same width but lower height,
+    // we reduce the empty area's height and offset it to start below the new rectangle
+    if (width == area->width) {
+        japacker_empty_area *prev = area->prev;
+        japacker_delist_empty_area(data, area);
+        area->y += height;
+        area->height -= height;
+        if (japacker_merge_adjacent_empty_areas(data, area)) {
+            prev = data->empty_areas.last;
+        }
+        japacker_empty_area_set_comparator(data, area);
+        japacker_sort_empty_area(data, area, prev);
+        return;
+    }
+
+    // If the new rectangle has both a lower width and height than the empty area,
+    // we split the empty area into two new empty areas, one at the right and one below the new rectangle
+    japacker_split_empty_area(data, area, width, height);
+}
+
+/**
+ * @brief Copies the options that decide how the empty area of each rect is found to the internal data.
+ *
+ * @param data The internal packer data to set.
+ * @param packer The packer whose options are used.
+ */
+JAPACKER_DECL void japacker_set_search(japacker_internal_data *data, const japacker_t *packer)
+{
+    data->empty_areas.search_by = packer->options.search_by;
+    data->empty_areas.placement = packer->options.placement;
+    data->empty_areas.search_window = 0;
+
+    if (packer->options.placement != JAPACKER_PLACE_FIRST_FIT) {
+        data->empty_areas.search_window = packer->options.placement_window ? packer->options.placement_window :
+            JAPACKER_PLACEMENT_WINDOW;
+        // The empty areas that follow the first one are found through the list, which isn't sorted when scanning
+        if (data->empty_areas.search_by == JAPACKER_SEARCH_SCAN) {
+            data->empty_areas.search_by = JAPACKER_SEARCH_TREE;
+        }
+    }
+}
+
+/**
+ * @brief Copies the options that decide the space taken around each rect to the internal data.
+ *
+ * @param data The internal packer data to set.
+ * @param packer The packer whose options are used.
+ */
+JAPACKER_DECL void japacker_set_spacing(japacker_internal_data *data, const japacker_t *packer)
+{
+    unsigned int align_x = packer->options.align_x ? packer->options.align_x : 1;
+    unsigned int align_y = packer->options.align_y ? packer->options.align_y : 1;
+
+    data->spacing.margin = packer->options.extrude;
+    data->spacing.align_x = align_x;
+    data->spacing.align_y = align_y;
+    data->spacing.padding_x = (packer->options.padding + align_x - 1) / align_x * align_x;
+    data->spacing.padding_y = (packer->options.padding + align_y - 1) / align_y * align_y;
+}
+
+/**
+ * @brief Gets the space a rect takes in the empty areas, which includes its extrusion and padding.
+ *
+ * The space is rounded up to the alignment, so that the empty areas left next to it stay aligned.
+ *
+ * @param data The internal packer data to work with.
+ * @param width The width of the rect, as it's placed.
+ * @param height The height of the rect, as it's placed.
+ * @param footprint_width Where to store the width of the space.
+ * @param footprint_height Where to store the height of the space.
+ */
+JAPACKER_DECL void japacker_get_footprint(const japacker_internal_data *data, unsigned int width, unsigned int height,
+    unsigned int *footprint_width, unsigned int *footprint_height)
+{
+    width += 2 * data->spacing.margin;
+    height += 2 * data->spacing.margin;
+
+    // Avoid the divisions in the usual case where nothing is aligned
+    if (data->spacing.align_x > 1) {
+        width = (width + data->spacing.align_x - 1) / data->spacing.align_x * data->spacing.align_x;
+    }
+    if (data->spacing.align_y > 1) {
+        height = (height + data->spacing.align_y - 1) / data->spacing.align_y * data->spacing.align_y;
+    }
+
+    *footprint_width = width + data->spacing.padding_x;
+    *footprint_height = height + data->spacing.padding_y;
+}
+
+/**
+ * @brief Checks whether a rect fits in an empty image.
+ *
+ * @param data The internal packer data to work with.
+ * @param width The width of the rect.
+ * @param height The height of the rect.
+ * @param image_width The width of the image.
+ * @param image_height The height of the image.
+ * @param allow_rotation Whether the rect can be rotated to fit.
+ * @return 1 if the rect fits, 0 otherwise.
+ */
+JAPACKER_DECL int japacker_fits_empty_image(const japacker_internal_data *data, unsigned int width,
+    unsigned int height, unsigned int image_width, unsigned int image_height, int allow_rotation)
+{
+    unsigned int footprint_width, footprint_height;
+    japacker_get_footprint(data, width, height, &footprint_width, &footprint_height);
+    if (footprint_width <= image_width + data->spacing.padding_x &&
+        footprint_height <= image_height + data->spacing.padding_y) {
+        return 1;
+    }
+    if (!allow_rotation) {
+        return 0;
+    }
+    japacker_get_footprint(data, height, width, &footprint_width, &footprint_height);
+    return footprint_width <= image_width + data->spacing.padding_x &&
+        footprint_height <= image_height + data->spacing.padding_y;
+}
+
+/**
+ * @brief Packs a single rect.
+ * 
+ * If allow_rotation is 1 and the packer can't fit the rectangle, it'll attempt to rotate the rectangle and place it.
+ * 
+ * @param data The internal packer data to work with.
+ * @param rect The rectangle to pack.
+ * @param allow_rotation Whether to allow the rect to be rotated if it doesn't originally fit.
+ * @return 1 if the rectangle was packed, 0 otherwise.
+*/
+
+JAPACKER_DECL int japacker_pack_rect(japacker_internal_data *data, japacker_rect *rect, int allow_rotation)
+{
+    unsigned int width, height;
+    if (!rect->output.rotated) {
+        japacker_get_footprint(data, rect->input.width, rect->input.height, &width, &height);
+    } else {
+        japacker_get_footprint(data, rect->input.height, rect->input.width, &width, &height);
+    }
+    JAPACKER_STAT(unsigned long long visited = data->stats.empty_areas_visited);
+    JAPACKER_STAT(data->stats.searches++);
+
+    if (data->empty_areas.algorithm == JAPACKER_ALGORITHM_SKYLINE) {
+        unsigned int y;
+        unsigned int index = japacker_skyline_find(data, width, height, &y);
+        JAPACKER_STAT_MAX(data->stats.max_empty_areas_visited, data->stats.empty_areas_visited - visited);
+
+        if (index <= (unsigned int) data->empty_areas.index) {
+            rect->output.x = data->empty_areas.list[index].x + data->spacing.margin;
+            rect->output.y = y + data->spacing.margin;
+            rect->output.packed = 1;
+            japacker_skyline_place(data, index, y, width, height);
+            return 1;
+        }
+    } else {
+        japacker_empty_area *area = japacker_find_empty_area(data, width, height);
+        JAPACKER_STAT_MAX(data->stats.max_empty_areas_visited, data->stats.empty_areas_visited - visited);
+
+        if (area) {
+            // If the rectangle fits in this empty area, we place it here
+            rect->output.x = area->x + data->spacing.margin;
+            rect->output.y = area->y + data->spacing.margin;
+            rect->output.packed = 1;
+            japacker_place_in_empty_area(data, area, width, height);
+            return 1;
+        }
+    }
+
+    // If the rectangle didn't fit anywhere and rotation is allowed, we try rotating the rectangle
+    if (allow_rotation) {
+        JAPACKER_STAT(data->stats.rotation_retries++);
+        rect->output.rotated = 1;
+        return japacker_pack_rect(data, rect, 0);
+    }
+    // We might have failed to pack a rotated rectangle, so we move it back to the original position
+    // just in case it'll be packed to a new image
+    rect->output.rotated = 0;
+    return 0;
+}
+
+/**
+ * @brief Counts how many rects, starting at the first one, have the same size and need packing.
+ *
+ * @param rects The rects to check.
+ * @param num_rects The number of rects in the list.
+ * @param skip_packed Whether rects that are already packed are skipped, which ends the run of identical rects.
+ * @return The number of identical rects, at least 1.
+ */
+JAPACKER_DECL unsigned int japacker_count_identical_rects(japacker_rect **rects, unsigned int num_rects,
+    int skip_packed)
+{
+    unsigned int count = 1;
+    while (count < num_rects && rects[count]->input.width == rects[0]->input.width &&
+        rects[count]->input.height == rects[0]->input.height && !(skip_packed && rects[count]->output.packed)) {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Packs rects that all have the same size, placing as many of them as possible in each empty area.
+ * 
+ * The empty area is the one where a single rect would be placed. Instead of going through the search and the split of
+ * the empty area for every rect, the rects fill whole rows of a grid at the top left of the empty area, and the grid
+ * then takes the space of the empty area as if it was a single rect. This is repeated until all rects are packed or
+ * until the rects no longer fit anywhere. The rects are never rotated.
+ * 
+ * @param data The internal packer data to work with.
+ * @param rects The rects to pack, which must all have the same size.
+ * @param num_rects The number of rects.
+ * @return The number of rects packed, which are always the first ones of the list.
+*/
+JAPACKER_DECL unsigned int japacker_pack_identical_rects(japacker_internal_data *data, japacker_rect **rects,
+    unsigned int num_rects)
+{
+    unsigned int width, height;
+    japacker_get_footprint(data, rects[0]->input.width, rects[0]->input.height, &width, &height);
+    unsigned int packed = 0;
+
+    while (packed < num_rects) {
+        JAPACKER_STAT(unsigned long long visited = data->stats.empty_areas_visited);
+        japacker_empty_area *area = japacker_find_empty_area(data, width, height);
+        JAPACKER_STAT(data->stats.searches++);
+        JAPACKER_STAT_MAX(data->stats.max_empty_areas_visited, data->stats.empty_areas_visited - visited);
+
+        if (!area) {
+            break;
+        }
+
+        // Only whole rows are used, so that the space taken from the empty area stays a rectangle
+        unsigned int remaining = num_rects - packed;
+        unsigned int columns = area->width / width;
+        if (columns > remaining) {
+            columns = remaining;
+        }
+        unsigned int rows = area->height / height;
+        if (rows > remaining / columns) {
+            rows = remaining / columns;
+        }
+
+        for (unsigned int row = 0; row < rows; row++) {
+            for (unsigned int column = 0; column < columns; column++) {
+                japacker_rect *rect = rects[packed++];
+                rect->output.x = area->x + column * width + data->spacing.margin;
+                rect->output.y = area->y + row * height + data->spacing.margin;
+                rect->output.rotated = 0;
+                rect->output.packed = 1;
+            }
+        }
+
+        japacker_place_in_empty_area(data, area, columns * width, rows * height);
+    }
+
+    return packed;
+}
+
+
+/*
+ * Threading related functions
+ */
+
+/**
+ * @brief A function that runs a single task of the many that japacker_run_tasks() runs.
+ *
+ * @param context The context shared by all tasks.
+ * @param task The index of the task to run.
+ */
+typedef void (*japacker_task_function)(void *context, unsigned int task);
+
+/**
+ * @brief The state shared by all the threads running the tasks from japacker_run_tasks().
+ *
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_task_queue {
+
+    japacker_task_function function; /**< The function that runs each task. */
+
+    void *context;                   /**< The context to pass to the function. */
+
+    unsigned int num_tasks;          /**< The total number of tasks. */
+
+    unsigned int next_task;          /**< The index of the next task that no thread has taken yet. */
+
+    int has_lock;                    /**< Whether lock was created and must be taken to read next_task. */
+
+#ifdef JAPACKER_THREADS
+#ifdef _WIN32
+    CRITICAL_SECTION lock;           /**< Guards next_task. */
+#else
+    pthread_mutex_t lock;            /**< Guards next_task. */
+#endif
+#endif
+
+} japacker_task_queue;
+
+/**
+ * @brief Creates the lock of a task queue, so that several threads can take tasks from it.
+ *
+ * @param queue The task queue.
+ * @return 1 if the lock was created, 0 if it couldn't be, in which case only one thread may take tasks from the queue.
+ */
+JAPACKER_DECL int japacker_init_task_lock(japacker_task_queue *queue)
+{
+    queue->has_lock = 0;
+
+#ifdef JAPACKER_THREADS
+#ifdef _WIN32
+    InitializeCriticalSection(&queue->lock);
+    queue->has_lock = 1;
+#else
+    queue->has_lock = pthread_mutex_init(&queue->lock, 0) == 0;
+#endif
+#endif
+
+    return queue->has_lock;
+}
+
+/**
+ * @brief Destroys the lock of a task queue, if japacker_init_task_lock() created one.
+ *
+ * @param queue The task queue.
+ */
+JAPACKER_DECL void japacker_destroy_task_lock(japacker_task_queue *queue)
+{
+#ifdef JAPACKER_THREADS
+    if (queue->has_lock) {
+#ifdef _WIN32
+        DeleteCriticalSection(&queue->lock);
+#else
+        pthread_mutex_destroy(&queue->lock);
+#endif
+    }
+#endif
+
+    queue->has_lock = 0;
+}
+
+/**
+ * @brief Takes the next available task from the queue.
+ *
+ * @param queue The task queue.
+ * @param task Where to store the index of the task that was taken.
+ * @return 1 if a task was taken, 0 if there are no more tasks.
+ */
+JAPACKER_DECL int japacker_take_task(japacker_task_queue *queue, unsigned int *task)
+{
+#ifdef JAPACKER_THREADS
+    if (queue->has_lock) {
+#ifdef _WIN32
+        EnterCriticalSection(&queue->lock);
+#else
+        pthread_mutex_lock(&queue->lock);
+#endif
+    }
+#endif
+
+    int has_task = queue->next_task < queue->num_tasks;
+    if (has_task) {
+        *task = queue->next_task++;
+    }
+
+#ifdef JAPACKER_THREADS
+    if (queue->has_lock) {
+#ifdef _WIN32
+        LeaveCriticalSection(&queue->lock);
+#else
+        pthread_mutex_unlock(&queue->lock);
+#endif
+    }
+#endif
+
+    return has_task;
+}
+
+/**
+ * @brief Keeps running tasks from the queue until there are none left.
+ *
+ * @param queue The task queue.
+ */
+JAPACKER_DECL void japacker_work_on_tasks(japacker_task_queue *queue)
+{
+    unsigned int task;
+    while (japacker_take_task(queue, &task)) {
+        queue->function(queue->context, task);
+    }
+}
+
+#ifdef JAPACKER_THREADS
+#ifdef _WIN32
+JAPACKER_DECL DWORD WINAPI japacker_task_thread(LPVOID queue)
+{
+    japacker_work_on_tasks((japacker_task_queue *) queue);
+    return 0;
+}
+#else
+JAPACKER_DECL void *japacker_task_thread(void *queue)
+{
+    japacker_work_on_tasks((japacker_task_queue *) queue);
+    return 0;
+}
+#endif
+#endif
+
+/**
+ * @brief Runs a number of independent tasks, using up to the provided number of threads.
+ *
+ * The calling thread also runs tasks, so at most num_threads - 1 new threads are created. Threads take the next
+ * available task as soon as they finish the previous one, so uneven tasks are spread evenly. If JAPACKER_THREADS is not
+ * defined or a thread can't be created, the remaining tasks are simply run by the calling thread.
+ *
+ * Tasks must not depend on the order in which they run, and each one should write only to its own results.
+ *
+ * @param function The function that runs each task.
+ * @param context The context to pass to the function.
+ * @param num_tasks The number of tasks to run.
+ * @param num_threads The maximum number of threads to use.
+ */
+JAPACKER_DECL void japacker_run_tasks(japacker_task_function function, void *context, unsigned int num_tasks,
+    unsigned int num_threads)
+{
+    japacker_task_queue queue;
+    queue.function = function;
+    queue.context = context;
+    queue.num_tasks = num_tasks;
+    queue.next_task = 0;
+    queue.has_lock = 0;
+
+#ifdef JAPACKER_THREADS
+    // There's no point in having more threads than tasks
+    if (num_threads > num_tasks) {
+        num_threads = num_tasks;
+    }
+    // Hard cap to keep the thread handles on the stack
+    if (num_threads > 64) {
+        num_threads = 64;
+    }
+
+    // Without a lock the tasks can't be shared, so they are all run by the calling thread
+    if (num_threads > 1 && !japacker_init_task_lock(&queue)) {
+        num_threads = 1;
+    }
+
+#ifdef _WIN32
+    HANDLE threads[64];
+#else
+    pthread_t threads[64];
+#endif
+
+    unsigned int num_created = 0;
+    while (num_created + 1 < num_threads) {
+#ifdef _WIN32
+        threads[num_created] = CreateThread(0, 0, japacker_task_thread, &queue, 0, 0);
+        if (!threads[num_created]) {
+            break;
+        }
+#else
+        if (pthread_create(&threads[num_created], 0, japacker_task_thread, &queue) != 0) {
+            break;
+        }
+#endif
+        num_created++;
+    }
+
+    japacker_work_on_tasks(&queue);
+
+    for (unsigned int i = 0; i < num_created; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], 0);
+#endif
+    }
+
+    japacker_destroy_task_lock(&queue);
+
+#else
+    (void) num_threads;
+    japacker_work_on_tasks(&queue);
+#endif
+}
+
+
+/*
+ * Stats related functions
+ */
+
+#ifdef JAPACKER_STATS
+/**
+ * @brief Adds the counters of work done on private empty areas, such as those of a parallel task, to other counters.
+ *
+ * @param stats The counters to add to.
+ * @param other The counters to add.
+ */
+JAPACKER_DECL void japacker_add_stats(japacker_stats *stats, const japacker_stats *other)
+{
+    stats->searches += other->searches;
+    stats->empty_areas_visited += other->empty_areas_visited;
+    JAPACKER_STAT_MAX(stats->max_empty_areas_visited, other->max_empty_areas_visited);
+    stats->rotation_retries += other->rotation_retries;
+    stats->merge_attempts += other->merge_attempts;
+    stats->merges += other->merges;
+    JAPACKER_STAT_MAX(stats->max_merges, other->max_merges);
+    stats->sort_steps += other->sort_steps;
+    stats->repacks += other->repacks;
+    JAPACKER_STAT_MAX(stats->max_empty_area_index, other->max_empty_area_index);
+}
+#endif
+
+
+/*
+ * Image size reduction related functions
+ */
+
+/**
+ * @brief Checks whether an image is so close to the area of its rects that it's not worth trying to make it smaller.
+ *
+ * The areas are compared as doubles, so that the percentage can't overflow, no matter how large the image is.
+ *
+ * @param width The width of the image.
+ * @param height The height of the image.
+ * @param rects_area The area of the rects in the image.
+ * @return 1 if the image is less than JAPACKER_TOLERABLE_AREA_DIFFERENCE_PERCENTAGE larger than its rects, 0 otherwise.
+ */
+JAPACKER_DECL int japacker_is_area_difference_tolerable(unsigned int width, unsigned int height,
+    japacker_area rects_area)
+{
+    return (double) width * height * 100 < (double) rects_area * (100 + JAPACKER_TOLERABLE_AREA_DIFFERENCE_PERCENTAGE);
+}
+
+/**
+ * @brief Checks whether an image is smaller than the area of its rects, so they can't possibly fit in it.
+ *
+ * @param width The width of the image.
+ * @param height The height of the image.
+ * @param rects_area The area of the rects in the image.
+ * @return 1 if the image is too small, 0 otherwise.
+ */
+JAPACKER_DECL int japacker_is_area_too_small(unsigned int width, unsigned int height, japacker_area rects_area)
+{
+    return (double) width * height < (double) rects_area;
+}
+
+/**
+ * @brief Repacks all the rects of an image into a new, empty, image with the provided size.
+ *
+ * Every rect starts unrotated, so repacking the same rects into the same size always gives the same result.
+ *
+ * @param data The internal packer data to work with.
+ * @param rects The sorted list of rects.
+ * @param num_rects The number of rects in the list.
+ * @param image_index Only rects with this image index are repacked.
+ * @param width The width of the image.
+ * @param height The height of the image.
+ * @param allow_rotation Whether to allow the rects to be rotated if they don't originally fit.
+ * @return 1 if all rects were packed, 0 otherwise.
+ */
+JAPACKER_DECL int japacker_repack_image(japacker_internal_data *data, japacker_rect **rects, unsigned int num_rects,
+    unsigned int image_index, unsigned int width, unsigned int height, int allow_rotation)
+{
+    JAPACKER_STAT(data->stats.repacks++);
+    japacker_reset_empty_areas(data, width, height);
+
+    for (unsigned int i = 0; i < num_rects; i++) {
+        japacker_rect *rect = rects[i];
+
+        // Only repack the rects for the requested image
+        if (rect->output.image_index != (int) image_index) {
+            continue;
+        }
+
+        rect->output.rotated = 0;
+
+        // Pack the rectangle. If packing fails, the image is too small
+        if (!japacker_pack_rect(data, rect, allow_rotation)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief A candidate size tried by the parallel image size reduction.
+ *
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_size_candidate {
+
+    unsigned int step;             /**< The position of the candidate in the search window. */
+
+    unsigned int width, height;    /**< The size of the candidate image. */
+
+    int fits;                      /**< Whether all the rects fit in this size. */
+
+    japacker_internal_data data;   /**< The private empty areas used to pack this candidate. */
+
+    japacker_rect *rects;          /**< A private copy of the rects of the image. */
+
+    japacker_rect **sorted_rects;  /**< Pointers to the private copy of the rects, in sorted order. */
+
+} japacker_size_candidate;
+
+/**
+ * @brief The context shared by the tasks of the parallel image size reduction.
+ *
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_reduce_context {
+
+    japacker_size_candidate *candidates; /**< The candidates of the current round. */
+
+    unsigned int num_rects;              /**< The number of rects in the image. */
+
+    int allow_rotation;                  /**< Whether to allow the rects to be rotated. */
+
+    japacker_area rects_area;            /**< The area of the rects in the image, which smaller sizes can't hold. */
+
+} japacker_reduce_context;
+
+/**
+ * @brief Checks whether the rects fit in a candidate size.
+ *
+ * @param context The japacker_reduce_context.
+ * @param task The index of the candidate to try.
+ */
+JAPACKER_DECL void japacker_try_size_candidate(void *context, unsigned int task)
+{
+    japacker_reduce_context *reduce_context = (japacker_reduce_context *) context;
+    japacker_size_candidate *candidate = &reduce_context->candidates[task];
+
+    // A size with less area than the rects can't fit them, so it isn't even tried
+    candidate->fits = !japacker_is_area_too_small(candidate->width, candidate->height, reduce_context->rects_area) &&
+        japacker_repack_image(&candidate->data, candidate->sorted_rects, reduce_context->num_rects,
+        candidate->rects[0].output.image_index, candidate->width, candidate->height, reduce_context->allow_rotation);
+}
+
+/**
+ * @brief Frees the candidates of the parallel image size reduction, if there are any.
+ *
+ * @param data The internal packer data to work with.
+ */
+JAPACKER_DECL void japacker_free_size_candidates(japacker_internal_data *data)
+{
+    japacker_pack_state *state = &data->pack_state;
+
+    if (!state->candidates) {
+        return;
+    }
+    for (unsigned int i = 0; i < state->num_candidates; i++) {
+        JAPACKER_STAT(japacker_add_stats(&data->stats, &state->candidates[i].data.stats));
+        japacker_free_empty_areas(&state->candidates[i].data);
+        JAPACKER_FREE(state->candidates[i].rects);
+        JAPACKER_FREE(state->candidates[i].sorted_rects);
+    }
+    JAPACKER_FREE(state->candidates);
+    state->candidates = 0;
+}
+
+/**
+ * @brief Rounds a size tried by the image size reduction up to the next size allowed by the options.
+ *
+ * With options.reduce_to_power_of_two set to 1, the allowed sizes are the powers of two. Otherwise, with
+ * options.reduce_size_multiple higher than 1, they are its multiples, and any size is allowed if it's 0 or 1.
+ * The size of the destination image is always allowed, so no size is ever rounded past it.
+ *
+ * @param packer The packer in use.
+ * @param size The size to round.
+ * @param max_size The size of the destination image in the same dimension.
+ * @return The rounded size.
+ */
+JAPACKER_DECL unsigned int japacker_round_reduced_size(const japacker_t *packer, unsigned int size,
+    unsigned int max_size)
+{
+    unsigned long long rounded = size;
+
+    if (packer->options.reduce_to_power_of_two == 1) {
+        rounded = 1;
+        while (rounded < size) {
+            rounded <<= 1;
+        }
+    } else if (packer->options.reduce_size_multiple > 1) {
+        unsigned long long multiple = packer->options.reduce_size_multiple;
+        rounded = (rounded + multiple - 1) / multiple * multiple;
+    }
+
+    return rounded < max_size ? (unsigned int) rounded : max_size;
+}
+
+/**
+ * @brief Gets one of the sizes the image size reduction can try, starting from the smallest one.
+ *
+ * @param packer The packer in use.
+ * @param first_size The smallest size that can be tried, already rounded by japacker_round_reduced_size().
+ * @param max_size The size of the destination image in the same dimension.
+ * @param index Which allowed size to get, where 0 is first_size.
+ * @return The size.
+ */
+JAPACKER_DECL unsigned int japacker_get_reduced_size(const japacker_t *packer, unsigned int first_size,
+    unsigned int max_size, unsigned int index)
+{
+    unsigned long long size;
+
+    if (packer->options.reduce_to_power_of_two == 1) {
+        size = index < 32 ? (unsigned long long) first_size << index : max_size;
+    } else if (packer->options.reduce_size_multiple > 1) {
+        size = first_size + (unsigned long long) index * packer->options.reduce_size_multiple;
+    } else {
+        size = (unsigned long long) first_size + index;
+    }
+
+    return size < max_size ? (unsigned int) size : max_size;
+}
+
+/**
+ * @brief Counts the sizes the image size reduction can try after the smallest one.
+ *
+ * @param packer The packer in use.
+ * @param first_size The smallest size that can be tried, already rounded by japacker_round_reduced_size().
+ * @param max_size The size of the destination image in the same dimension.
+ * @return The number of allowed sizes higher than first_size, the last one being max_size.
+ */
+JAPACKER_DECL unsigned int japacker_count_reduced_sizes(const japacker_t *packer, unsigned int first_size,
+    unsigned int max_size)
+{
+    unsigned int count = 0;
+
+    if (first_size >= max_size) {
+        return 0;
+    }
+    if (packer->options.reduce_to_power_of_two == 1) {
+        for (unsigned long long size = first_size; size < max_size; size <<= 1) {
+            count++;
+        }
+    } else {
+        unsigned int multiple = packer->options.reduce_size_multiple > 1 ? packer->options.reduce_size_multiple : 1;
+        count = (max_size - first_size + multiple - 1) / multiple;
+    }
+    return count;
+}
+
+/**
+ * @brief Gets the image size tried by a step of the k-ary search for the smallest last image size.
+ *
+ * Step 0 is the smallest size that can be tried and the last step is the size of the destination image. In between,
+ * both dimensions grow together, each going through its own allowed sizes, so the aspect ratio is roughly kept.
+ * When a single dimension is searched, the other one has no allowed sizes after its first one, so it stays fixed.
+ *
+ * @param packer The packer in use.
+ * @param step The step of the search.
+ * @param width Where to store the width.
+ * @param height Where to store the height.
+ */
+JAPACKER_DECL void japacker_get_reduction_step_size(const japacker_t *packer, unsigned int step,
+    unsigned int *width, unsigned int *height)
+{
+    const japacker_internal_data *data = packer->internal_data;
+    const japacker_pack_state *state = &data->pack_state;
+    unsigned int width_index = 0;
+    unsigned int height_index = 0;
+
+    if (state->steps) {
+        width_index = (unsigned int) ((unsigned long long) state->delta_width * step / state->steps);
+        height_index = (unsigned int) ((unsigned long long) state->delta_height * step / state->steps);
+    }
+    *width = japacker_get_reduced_size(packer, state->needed_width, data->image_width, width_index);
+    *height = japacker_get_reduced_size(packer, state->needed_height, data->image_height, height_index);
+}
+
+/**
+ * @brief Sets the search window of the k-ary search for the smallest last image size.
+ *
+ * @param packer The packer in use.
+ * @param first_width The smallest width that can be tried.
+ * @param first_height The smallest height that can be tried.
+ */
+JAPACKER_DECL void japacker_set_reduction_window(japacker_t *packer, unsigned int first_width,
+    unsigned int first_height)
+{
+    japacker_internal_data *data = packer->internal_data;
+    japacker_pack_state *state = &data->pack_state;
+
+    state->needed_width = japacker_round_reduced_size(packer, first_width, data->image_width);
+    state->needed_height = japacker_round_reduced_size(packer, first_height, data->image_height);
+    state->delta_width = japacker_count_reduced_sizes(packer, state->needed_width, data->image_width);
+    state->delta_height = japacker_count_reduced_sizes(packer, state->needed_height, data->image_height);
+    state->steps = state->delta_width > state->delta_height ? state->delta_width : state->delta_height;
+
+    // The lowest step that is known to fail, which starts out as an imaginary step before the smallest size,
+    // and the lowest step that is known to fit
+    state->failed_step = -1;
+    state->fitting_step = state->steps;
+}
+
+/**
+ * @brief Starts a k-ary search for the smallest last image size, trying several candidate sizes at the same time.
+ *
+ * The search window goes from the smallest size that can be tried, which will almost certainly fail, to the size of
+ * the destination image, which is known to work. Each round splits the window into options.reduce_candidates evenly
+ * spaced steps, or a single one if it's lower than 2, packs all of them in parallel, each with its own empty areas,
+ * and narrows the window to the gap between the largest failed step and the smallest step that fit.
+ *
+ * Only the sizes allowed by options.reduce_to_power_of_two and options.reduce_size_multiple are tried. If
+ * options.reduce_separately is set to 1, the width is searched first, with the height of the destination image, then
+ * the height is searched with the width that was found.
+ *
+ * Each call to japacker_run_parallel_reduction_round() then runs one round of the search.
+ *
+ * @param packer The packer in use.
+ * @param needed_width The smallest width that can be tried when both dimensions are searched together.
+ * @param needed_height The smallest height that can be tried when both dimensions are searched together.
+ * @return 1 if the search was started, 0 if there was not enough memory, in which case nothing was changed.
+ */
+JAPACKER_DECL int japacker_start_parallel_reduction(japacker_t *packer, unsigned int needed_width,
+    unsigned int needed_height)
+{
+    japacker_internal_data *data = packer->internal_data;
+    japacker_pack_state *state = &data->pack_state;
+    unsigned int image_index = packer->result.images_needed - 1;
+    unsigned int num_candidates = packer->options.reduce_candidates > 1 ? packer->options.reduce_candidates : 1;
+    unsigned int num_rects = state->num_image_rects;
+
+    japacker_size_candidate *candidates =
+        (japacker_size_candidate *) JAPACKER_MALLOC(num_candidates * sizeof(japacker_size_candidate));
+    if (!candidates) {
+        return 0;
+    }
+    memset(candidates, 0, num_candidates * sizeof(japacker_size_candidate));
+    state->candidates = candidates;
+    state->num_candidates = num_candidates;
+
+    for (unsigned int i = 0; i < num_candidates; i++) {
+        japacker_size_candidate *candidate = &candidates[i];
+        candidate->data.empty_areas.sort_by = data->empty_areas.sort_by;
+        candidate->data.empty_areas.search_by = data->empty_areas.search_by;
+        candidate->data.empty_areas.placement = data->empty_areas.placement;
+        candidate->data.empty_areas.search_window = data->empty_areas.search_window;
+        candidate->data.empty_areas.algorithm = data->empty_areas.algorithm;
+        candidate->data.spacing = data->spacing;
+        candidate->rects = (japacker_rect *) JAPACKER_MALLOC(num_rects * sizeof(japacker_rect));
+        candidate->sorted_rects = (japacker_rect **) JAPACKER_MALLOC(num_rects * sizeof(japacker_rect *));
+
+        if (!candidate->rects || !candidate->sorted_rects ||
+            !japacker_allocate_empty_areas(&candidate->data, num_rects + 1)) {
+            japacker_free_size_candidates(data);
+            return 0;
+        }
+
+        // Since the rects are copied in sorted order, the sorted list of the copy is simply sequential
+        unsigned int index = 0;
+        for (unsigned int j = 0; j < data->num_rects; j++) {
+            if (data->sorted_rects[j]->output.image_index == (int) image_index) {
+                candidate->rects[index] = *data->sorted_rects[j];
+                candidate->sorted_rects[index] = &candidate->rects[index];
+                index++;
+            }
+        }
+    }
+
+    if (packer->options.reduce_separately == 1) {
+        // The width can't be lower than the one that gives the area of the rects with the full image height
+        unsigned int area_width = (unsigned int) ((state->rects_area + data->image_height - 1ULL) / data->image_height);
+        japacker_set_reduction_window(packer, area_width > state->min_width ? area_width : state->min_width,
+            data->image_height);
+        state->searched_dimension = JAPACKER_REDUCE_WIDTH;
+    } else {
+        japacker_set_reduction_window(packer, needed_width, needed_height);
+        state->searched_dimension = JAPACKER_REDUCE_BOTH;
+    }
+
+    state->phase = JAPACKER_PHASE_REDUCE_PARALLEL;
+    return 1;
+}
+
+/**
+ * @brief Runs one round of the k-ary search for the smallest last image size, or ends the search.
+ *
+ * When the search ends, the real rects are repacked with the best size found and the candidates are freed.
+ *
+ * @param packer The packer in use.
+ * @return The number of rects packed in this round, counting those of every candidate.
+ */
+JAPACKER_DECL unsigned int japacker_run_parallel_reduction_round(japacker_t *packer)
+{
+    japacker_internal_data *data = packer->internal_data;
+    japacker_pack_state *state = &data->pack_state;
+    japacker_size_candidate *candidates = state->candidates;
+    unsigned int round_candidates = 0;
+    unsigned int fitting_width;
+    unsigned int fitting_height;
+
+    japacker_get_reduction_step_size(packer, state->fitting_step, &fitting_width, &fitting_height);
+
+    // Don't look further if the difference between the rects' area and the image area is low enough
+    if (state->fitting_step - state->failed_step > 1 &&
+        !japacker_is_area_difference_tolerable(fitting_width, fitting_height, state->rects_area)) {
+        // Evenly spread the candidates inside the window, skipping repeated steps when the window is small
+        for (unsigned int i = 0; i < state->num_candidates; i++) {
+            unsigned int step = (unsigned int) (state->failed_step +
+                (state->fitting_step - state->failed_step) * (long long) (i + 1) / (state->num_candidates + 1));
+            if (step <= state->failed_step || step >= state->fitting_step ||
+                (round_candidates && candidates[round_candidates - 1].step == step)) {
+                continue;
+            }
+            japacker_size_candidate *candidate = &candidates[round_candidates++];
+            candidate->step = step;
+            japacker_get_reduction_step_size(packer, step, &candidate->width, &candidate->height);
+        }
+    }
+
+    if (!round_candidates) {
+        // Once the width is found, the height is searched with it
+        if (state->searched_dimension == JAPACKER_REDUCE_WIDTH) {
+            unsigned int area_height = (unsigned int) ((state->rects_area + fitting_width - 1ULL) / fitting_width);
+            japacker_set_reduction_window(packer, fitting_width,
+                area_height > state->min_height ? area_height : state->min_height);
+            state->searched_dimension = JAPACKER_REDUCE_HEIGHT;
+
+            // The width stays where it is, so the last step is still the size that's known to fit
+            state->delta_width = 0;
+            state->steps = state->delta_height;
+            state->fitting_step = state->steps;
+            return 0;
+        }
+
+        // The search is over, so repack the real rects with the best size found, which is guaranteed to give the
+        // same result as the candidate, so the empty areas are left matching the last image
+        unsigned int work = 0;
+        if (fitting_width != data->image_width || fitting_height != data->image_height) {
+            packer->result.last_image_width = fitting_width;
+            packer->result.last_image_height = fitting_height;
+            japacker_repack_image(data, data->sorted_rects, data->num_rects, packer->result.images_needed - 1,
+                packer->result.last_image_width, packer->result.last_image_height, packer->options.allow_rotation);
+            work = state->num_image_rects;
+        }
+        japacker_free_size_candidates(data);
+        state->phase = JAPACKER_PHASE_IDLE;
+        return work;
+    }
+
+    japacker_reduce_context context;
+    context.candidates = candidates;
+    context.num_rects = state->num_image_rects;
+    context.allow_rotation = packer->options.allow_rotation;
+    context.rects_area = state->rects_area;
+    japacker_run_tasks(japacker_try_size_candidate, &context, round_candidates, packer->options.num_threads);
+
+    // The window now ends at the smallest fitting candidate and starts at the largest failed one below it
+    for (unsigned int i = 0; i < round_candidates; i++) {
+        if (candidates[i].fits) {
+            state->fitting_step = candidates[i].step;
+            break;
+        }
+        state->failed_step = candidates[i].step;
+    }
+
+    return round_candidates * state->num_image_rects;
+}
+
+/**
+ * @brief Starts reducing the size of the last created image.
+ *
+ * This is a convenience function designed to improve the efficiency of packing, by preventing an image from being too
+ * large for the number of rectangles it has.
+ *
+ * This code works by finding the minimum possible area of the destination image (which is the sum of the areas of all
+ * its rects), the area of the destination image set by the user, then, keep dividing the difference by two and
+ * attempting to pack in a loop. The difference is divided by two for each pass of the loop.
+ *
+ * If packing is successful, the current difference is subtracted to the width and height of the destination rectangle.
+ * If it's unsuccessful, the difference is added.
+ *
+ * This keeps happening until either the difference is smaller than 1 or there's a successful packing with a difference
+ * of less than JAPACKER_TOLERABLE_AREA_DIFFERENCE_PERCENTAGE.
+ *
+ * No size smaller than the largest rect is tried: the width and height are at least those of the widest and the
+ * tallest rect, or, if rects can be rotated, the largest of their shortest sides.
+ *
+ * If options.reduce_candidates is higher than 1, or if any option restricts the sizes that can be tried or searches
+ * the width and height separately, japacker_start_parallel_reduction() is used instead.
+ *
+ * Each pass is then run by japacker_run_reduction_step(). If there's nothing to reduce, the pack state is left idle.
+ *
+ * @param packer The packer in use.
+ * @param rects_area The minimum possible area the destination image can have.
+ * @return JAPACKER_OK on success, or JAPACKER_ERROR_NO_MEMORY if options.deterministic is set and there isn't enough
+ *         memory for the search that was asked for.
+*/
+JAPACKER_DECL int japacker_start_reduction(japacker_t *packer, japacker_area rects_area)
+{
+    japacker_internal_data *data = packer->internal_data;
+    japacker_pack_state *state = &data->pack_state;
+    state->phase = JAPACKER_PHASE_IDLE;
+
+    // Don't look further if the difference between the rects' area and the image area is low enough
+    if (japacker_is_area_difference_tolerable(data->image_width, data->image_height, rects_area)) {
+        return JAPACKER_OK;
+    }
+    state->rects_area = rects_area;
+
+    // Each pass repacks the rects of the last image, which is how the work done is measured, and no image can be
+    // smaller than the largest of them
+    state->num_image_rects = 0;
+    state->min_width = 0;
+    state->min_height = 0;
+    for (unsigned int i = 0; i < data->num_rects; i++) {
+        const japacker_rect *rect = data->sorted_rects[i];
+        if (rect->output.image_index != (int) packer->result.images_needed - 1) {
+            continue;
+        }
+        state->num_image_rects++;
+
+        unsigned int min_width = rect->input.width;
+        unsigned int min_height = rect->input.height;
+        if (packer->options.allow_rotation) {
+            min_width = min_width < min_height ? min_width : min_height;
+            min_height = min_width;
+        }
+        state->min_width = min_width > state->min_width ? min_width : state->min_width;
+        state->min_height = min_height > state->min_height ? min_height : state->min_height;
+    }
+
+    // Get the proportional width and height for the used area
+    float image_ratio = data->image_width / (float) data->image_height;
+    unsigned int needed_width = (unsigned int) sqrt((double) rects_area * image_ratio) + 1;
+    unsigned int needed_height = (unsigned int) sqrt((double) rects_area / image_ratio) + 1;
+    needed_width = needed_width > state->min_width ? needed_width : state->min_width;
+    needed_height = needed_height > state->min_height ? needed_height : state->min_height;
+    needed_width = needed_width < data->image_width ? needed_width : data->image_width;
+    needed_height = needed_height < data->image_height ? needed_height : data->image_height;
+
+    // Try many sizes at the same time if asked to, using the serial search only if there's not enough memory.
+    // The serial search can't restrict the sizes it tries, so if it was asked to, the image isn't reduced at all
+    int restricted_sizes = packer->options.reduce_to_power_of_two == 1 || packer->options.reduce_size_multiple > 1 ||
+        packer->options.reduce_separately == 1;
+    if (packer->options.reduce_candidates > 1 || restricted_sizes) {
+        if (japacker_start_parallel_reduction(packer, needed_width, needed_height)) {
+            return JAPACKER_OK;
+        }
+        // The serial search may find another size, so it isn't used if the layout must always be the same
+        if (packer->options.deterministic == 1) {
+            return JAPACKER_ERROR_NO_MEMORY;
+        }
+        if (restricted_sizes) {
+            return JAPACKER_OK;
+        }
+    }
+
+    // To get the best rectangle, we find the difference between the requested image's width and height and the
+    // rect area's proportional width and height. We start our work from the middle of that difference
+    state->delta_width = (data->image_width - needed_width) / 2;
+    state->delta_height = (data->image_height - needed_height) / 2;
+
+    // Use the last successful width and height as a measure for the best packing
+    state->last_successful_width = data->image_width;
+    state->last_successful_height = data->image_height;
+
+    state->phase = JAPACKER_PHASE_REDUCE;
+    return JAPACKER_OK;
+}
+
+/**
+ * @brief Runs one pass of the reduction of the size of the last image, or ends it.
+ *
+ * Please refer to japacker_start_reduction() for details.
+ *
+ * @param packer The packer in use.
+ * @return The number of rects packed in this pass.
+ */
+JAPACKER_DECL unsigned int japacker_run_reduction_step(japacker_t *packer)
+{
+    japacker_internal_data *data = packer->internal_data;
+    japacker_pack_state *state = &data->pack_state;
+
+    if (state->phase == JAPACKER_PHASE_REDUCE_PARALLEL) {
+        return japacker_run_parallel_reduction_round(packer);
+    }
+
+    // The image index to be used is the one for the last image
+    unsigned int image_index = packer->result.images_needed - 1;
+
+    if (!state->delta_width || !state->delta_height) {
+        state->phase = JAPACKER_PHASE_IDLE;
+
+        // Reset to the latest successful packing if the final attempts failed
+        if (state->last_successful_width != packer->result.last_image_width) {
+            packer->result.last_image_width = state->last_successful_width;
+            packer->result.last_image_height = state->last_successful_height;
+
+            // Since repacking always starts with unrotated rects, this gives the same result as the successful attempt
+            japacker_repack_image(data, data->sorted_rects, data->num_rects, image_index,
+                packer->result.last_image_width, packer->result.last_image_height, packer->options.allow_rotation);
+            return state->num_image_rects;
+        }
+        return 0;
+    }
+
+    // If the last packing was a failure, we increase the image size, otherwise we decrease it
+    if (state->last_successful_width == packer->result.last_image_width) {
+        packer->result.last_image_width -= state->delta_width;
+        packer->result.last_image_height -= state->delta_height;
+    } else {
+        packer->result.last_image_width += state->delta_width;
+        packer->result.last_image_height += state->delta_height;
+    }
+
+    // If packing fails, we must increase the image size. A size with less area than the rects can't fit them, so it
+    // isn't even tried
+    int failed_to_pack = japacker_is_area_too_small(packer->result.last_image_width,
+        packer->result.last_image_height, state->rects_area) || !japacker_repack_image(data, data->sorted_rects,
+        data->num_rects, image_index, packer->result.last_image_width, packer->result.last_image_height,
+        packer->options.allow_rotation);
+
+    // Set the latest successful size
+    if (!failed_to_pack) {
+        state->last_successful_width = packer->result.last_image_width;
+        state->last_successful_height = packer->result.last_image_height;
+
+        // Don't look further if the difference between the rects' area and the image area is low enough
+        if (japacker_is_area_difference_tolerable(state->last_successful_width, state->last_successful_height,
+            state->rects_area)) {
+            state->phase = JAPACKER_PHASE_IDLE;
+            return state->num_image_rects;
+        }
+    }
+
+    // Reduce the deltas
+    state->delta_width /= 2;
+    state->delta_height /= 2;
+
+    return state->num_image_rects;
+}
+
+/**
+ * @brief Reduces the size of the last created image, all at once.
+ *
+ * Please refer to japacker_start_reduction() for details.
+ *
+ * @param packer The packer in use.
+ * @param rects_area The minimum possible area the destination image can have.
+ * @return JAPACKER_OK on success, or JAPACKER_ERROR_NO_MEMORY if the reduction couldn't start.
+ */
+JAPACKER_DECL int japacker_reduce_last_image_size(japacker_t *packer, japacker_area rects_area)
+{
+    int result = japacker_start_reduction(packer, rects_area);
+    while (packer->internal_data->pack_state.phase != JAPACKER_PHASE_IDLE) {
+        japacker_run_reduction_step(packer);
+    }
+    return result;
+}
+
+
+/*
+ * Step packing related functions
+ */
+
+/**
+ * @brief Starts packing a new image, where the whole image is a single empty area.
+ *
+ * @param packer The packer in use.
+ * @param rects The rects to go through for this image.
+ * @param num_rects The number of rects to go through.
+ */
+JAPACKER_DECL void japacker_start_image(japacker_t *packer, japacker_rect **rects, unsigned int num_rects)
+{
+    japacker_internal_data *data = packer->internal_data;
+    japacker_pack_state *state = &data->pack_state;
+
+    japacker_reset_empty_areas(data, data->image_width, data->image_height);
+    data->current_image = packer->result.images_needed;
+
+    state->rects = rects;
+    state->num_rects = num_rects;
+    state->index = 0;
+    state->request_new_image = 0;
+    state->area_used_in_last_image = 0;
+
+    // From the second image on, the rects that fail overwrite the list being read, which is safe since there are
+    // never more of them than the rects already read
+    state->num_pending_rects = 0;
+
+    // Whether the rects that were already packed are skipped
+    state->skip_packed = packer->options.always_repack != 1 || packer->result.images_needed != 0;
+
+    // The end of the last run of identical rects, which are only grouped once
+    state->identical_rects_end = 0;
+}
+
+/**
+ * @brief Checks the packer and gets everything ready for japacker_pack_next_rects().
+ *
+ * @param packer The packer in use.
+ * @return JAPACKER_OK on success, or another japacker_error_type result on error.
+ */
+JAPACKER_DECL int japacker_start_pack(japacker_t *packer)
+{
+    japacker_internal_data *data = packer->internal_data;
+    japacker_pack_state *state = &data->pack_state;
+
+    // Make sure the struct was properly initialized
+    if (!data->num_rects || !data->image_width || !data->image_height || !packer->rects) {
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
+    }
+
+    JAPACKER_STAT(memset(&data->stats, 0, sizeof(japacker_stats)));
+
+    // Sort the rects if needed
+    if (packer->options.rects_are_sorted != 1 || data->num_sorted_rects != data->num_rects) {
+        japacker_sort_rects(packer);
+    }
+
+    // The search method can only change between packs, since the empty areas are rebuilt for every image
+    japacker_set_search(data, packer);
+    japacker_set_spacing(data, packer);
+
+    // A rect creates, at most, one new empty area, plus the original one of the image. Rects added one by one only
+    // reserved the empty areas they needed
+    if (!japacker_set_empty_areas_algorithm(data, packer->options.algorithm) ||
+        !japacker_grow_empty_areas(data, data->num_rects + 1)) {
+        return JAPACKER_ERROR_NO_MEMORY;
+    }
+
+    // If we are forcing a full repack, we're effectively starting over, so we can't have existing images with rects
+    if (packer->options.always_repack) {
+        packer->result.images_needed = 0;
+    }
+    // The images from japacker_pack_bins() that are kept still have the size of their bin
+    if (!packer->result.images_needed) {
+        data->num_image_sizes = 0;
+    }
+
+    // The total number of rects we already packed
+    state->packed_rects = 0;
+
+    // The first image goes through all the sorted rects, but each new image only needs to go through the rects that
+    // didn't fit in the previous one
+    japacker_start_image(packer, data->sorted_rects, data->num_rects);
+
+    state->phase = JAPACKER_PHASE_PACK;
+    return JAPACKER_OK;
+}
+
+/**
+ * @brief Ends the image being packed, either moving on to a new image for the rects that didn't fit, or setting the
+ * size of the last image and starting its reduction.
+ *
+ * @param packer The packer in use.
+ */
+JAPACKER_DECL void japacker_finish_image(japacker_t *packer)
+{
+    japacker_internal_data *data = packer->internal_data;
+    japacker_pack_state *state = &data->pack_state;
+
+    // We used a new image, so we increase its count
+    packer->result.images_needed++;
+
+    // If a new image was requested, we go through the rects that didn't fit
+    if (state->request_new_image) {
+        japacker_start_image(packer, data->pending_rects, state->num_pending_rects);
+        return;
+    }
+
+    state->result = (int) state->packed_rects;
+
+    // Set the last image's width and height to the size of the destination image as default
+    // These values can be changed if japacker_reduce_last_image_size() is called
+    packer->result.last_image_width = data->image_width;
+    packer->result.last_image_height = data->image_height;
+
+    // Try to reduce the last image's size if asked to
+    if (packer->options.reduce_image_size == 1) {
+        if (japacker_start_reduction(packer, state->area_used_in_last_image) != JAPACKER_OK) {
+            state->result = JAPACKER_ERROR_NO_MEMORY;
+        }
+    } else {
+        state->phase = JAPACKER_PHASE_IDLE;
+    }
+}
+
+/**
+ * @brief Packs the next rect of the image being packed, or the next group of identical rects.
+ *
+ * When there are no rects left for the image, the image is finished with japacker_finish_image(). When packing has to
+ * stop, the pack state is left idle with its result set.
+ *
+ * @param packer The packer in use.
+ * @return The number of rects that were gone through.
+ */
+JAPACKER_DECL unsigned int japacker_pack_next_rects(japacker_t *packer)
+{
+    japacker_internal_data *data = packer->internal_data;
+    japacker_pack_state *state = &data->pack_state;
+
+    if (state->index >= state->num_rects) {
+        japacker_finish_image(packer);
+        return 0;
+    }
+
+    japacker_rect **rects = state->rects;
+    unsigned int i = state->index++;
+    japacker_rect *rect = rects[i];
+
+    // We may have already processed some rects in previous images,
+    // therefore we only pack the rects that haven't been packed yet
+    if (rect->output.packed && state->skip_packed) {
+        return 1;
+    }
+
+    // If we didn't skip a packed rect (likely because always_repack was set),
+    // then we must unset that it's packed
+    rect->output.packed = 0;
+
+    // Rects without an area, such as those removed with japacker_remove_rect(), don't need packing
+    if (!rect->input.width || !rect->input.height) {
+        return 1;
+    }
+
+    // Place the rects with the same size as this one together. The ones that don't fit are packed one by one
+    if (packer->options.group_identical_rects == 1 && i >= state->identical_rects_end &&
+        data->empty_areas.algorithm != JAPACKER_ALGORITHM_SKYLINE) {
+        unsigned int num_identical_rects = japacker_count_identical_rects(rects + i, state->num_rects - i,
+            state->skip_packed);
+        state->identical_rects_end = i + num_identical_rects;
+        if (num_identical_rects > 1) {
+            unsigned int grouped = japacker_pack_identical_rects(data, rects + i, num_identical_rects);
+            for (unsigned int j = 0; j < grouped; j++) {
+                rects[i + j]->output.image_index = packer->result.images_needed;
+            }
+            state->area_used_in_last_image += (japacker_area) grouped * rect->input.width * rect->input.height;
+            state->packed_rects += grouped;
+            if (grouped) {
+                state->index = i + grouped;
+                return grouped;
+            }
+        }
+    }
+
+    // Pack the rectangle. If packing fails, what happens depends on what setting the user chose
+    if (!japacker_pack_rect(data, rect, packer->options.allow_rotation)) {
+        // We can try to continue packing smaller rectangles to this image
+        if (packer->options.fail_policy == JAPACKER_CONTINUE) {
+            return 1;
+        // We can also keep packing, but pack the ones that didn't fit to a new image
+        } else if (packer->options.fail_policy == JAPACKER_NEW_IMAGE) {
+            state->request_new_image = 1;
+            data->pending_rects[state->num_pending_rects++] = rect;
+        // Or, by default, we can immediately stop packing
+        } else {
+            state->result = (int) i;
+            state->phase = JAPACKER_PHASE_IDLE;
+            return 1;
+        }
+
+        // If this is a new image and the rectangle doesn't fit, it won't fit anywhere so we need to quit
+        if (japacker_is_image_empty(data)) {
+            packer->result.images_needed--;
+            state->result = (int) state->packed_rects;
+            state->phase = JAPACKER_PHASE_IDLE;
+        }
+    } else {
+        rect->output.image_index = packer->result.images_needed;
+        rect->output.packed = 1;
+        state->area_used_in_last_image += (japacker_area) rect->input.width * rect->input.height;
+        state->packed_rects++;
+    }
+
+    return 1;
+}
+
+
+/*
+ * Best strategy packing related functions
+ */
+
+/**
+ * @brief The number of strategies tried by japacker_pack_best(): every japacker_sort_type, with and without rotation.
+ */
+#define JAPACKER_NUM_STRATEGIES 8
+
+/**
+ * @brief A single packing strategy tried by japacker_pack_best() and its results.
+ *
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_strategy {
+
+    japacker_sort_type sort_by;     /**< The sort method of this strategy. */
+
+    int allow_rotation;             /**< Whether rotation is allowed in this strategy. */
+
+    int enabled;                    /**< Whether this strategy should be tried at all. */
+
+    int packed_rects;               /**< The value returned by japacker_pack() for this strategy. */
+
+    unsigned int images_needed;     /**< The resulting result.images_needed. */
+
+    unsigned int last_image_width;  /**< The resulting result.last_image_width. */
+
+    unsigned int last_image_height; /**< The resulting result.last_image_height. */
+
+    japacker_rect *rects;           /**< A copy of the packed rects. */
+
+    japacker_stats stats;           /**< The counters of the work done by this strategy. */
+
+} japacker_strategy;
+
+/**
+ * @brief The context shared by all strategy packing tasks.
+ *
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_strategy_context {
+
+    const japacker_t *packer;       /**< The packer whose rects and options are used as the base for every strategy. */
+
+    japacker_strategy *strategies;  /**< The list of strategies, as large as JAPACKER_NUM_STRATEGIES. */
+
+} japacker_strategy_context;
+
+/**
+ * @brief Packs the rects using a single strategy, on a private copy of the packer.
+ *
+ * @param context The japacker_strategy_context.
+ * @param task The index of the strategy to use.
+ */
+JAPACKER_DECL void japacker_pack_strategy(void *context, unsigned int task)
+{
+    japacker_strategy_context *strategy_context = (japacker_strategy_context *) context;
+    japacker_strategy *strategy = &strategy_context->strategies[task];
+    const japacker_t *packer = strategy_context->packer;
+    unsigned int num_rects = packer->internal_data->num_rects;
+
+    if (!strategy->enabled) {
+        return;
+    }
+
+    strategy->rects = (japacker_rect *) JAPACKER_MALLOC(num_rects * sizeof(japacker_rect));
+    if (!strategy->rects) {
+        strategy->packed_rects = JAPACKER_ERROR_NO_MEMORY;
+        return;
+    }
+
+    japacker_t worker;
+    strategy->packed_rects = japacker_init(&worker, num_rects,
+        packer->internal_data->image_width, packer->internal_data->image_height);
+
+    if (strategy->packed_rects == JAPACKER_OK) {
+        worker.options = packer->options;
+        worker.options.sort_by = strategy->sort_by;
+        worker.options.allow_rotation = strategy->allow_rotation;
+        worker.options.always_repack = 1;
+        worker.options.rects_are_sorted = 0;
+
+        for (unsigned int i = 0; i < num_rects; i++) {
+            worker.rects[i].input = packer->rects[i].input;
+        }
+
+        strategy->packed_rects = japacker_pack(&worker);
+        strategy->images_needed = worker.result.images_needed;
+        strategy->last_image_width = worker.result.last_image_width;
+        strategy->last_image_height = worker.result.last_image_height;
+
+        memcpy(strategy->rects, worker.rects, num_rects * sizeof(japacker_rect));
+        japacker_get_stats(&worker, &strategy->stats);
+    }
+
+    if (worker.internal_data) {
+        japacker_free(&worker);
+    }
+}
+
+/**
+ * @brief Checks whether the results of a strategy are better than the results of another strategy.
+ *
+ * @param strategy The strategy to check.
+ * @param best The best strategy so far.
+ * @return 1 if strategy has better results than best, 0 otherwise.
+ */
+JAPACKER_DECL int japacker_is_better_strategy(const japacker_strategy *strategy, const japacker_strategy *best)
+{
+    if (strategy->packed_rects != best->packed_rects) {
+        return strategy->packed_rects > best->packed_rects;
+    }
+    if (strategy->images_needed != best->images_needed) {
+        return strategy->images_needed < best->images_needed;
+    }
+    return (double) strategy->last_image_width * strategy->last_image_height <
+        (double) best->last_image_width * best->last_image_height;
+}
+
+
+/*
+ * Multiple image packing related functions
+ */
+
+/**
+ * How much of each image japacker_pack_pages() expects to fill when spreading the rects, as a percentage. Packing is
+ * never perfect, so spreading the rects as if the images could be completely filled would leave many rects that don't
+ * fit in their image, which then need to be packed one image after the other.
+ */
+#define JAPACKER_PAGE_FILL_PERCENTAGE 95
+
+/**
+ * @brief An image packed by japacker_pack_pages().
+ *
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_page {
+
+    japacker_internal_data data;   /**< The private empty areas of the image. */
+
+    japacker_rect **rects;         /**< The rects that were spread to this image, in sorted order. */
+
+    unsigned int num_rects;        /**< The number of rects that were spread to this image. */
+
+    unsigned int failed_width;     /**< The width of the smallest rect that didn't fit in the free space of this image
+                                        after it was packed, or 0 if all rects fit so far. Placing rects only makes the
+                                        free space smaller, so no rect that is at least as wide and as tall will fit. */
+
+    unsigned int failed_height;    /**< The height of that same rect. */
+
+} japacker_page;
+
+/**
+ * @brief The context shared by all image packing tasks.
+ *
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_page_context {
+
+    japacker_page *pages;          /**< The list of images. */
+
+    unsigned int image_width;      /**< The width of each image. */
+
+    unsigned int image_height;     /**< The height of each image. */
+
+    int allow_rotation;            /**< Whether to allow the rects to be rotated. */
+
+} japacker_page_context;
+
+/**
+ * @brief Packs the rects that were spread to an image, on that image's private empty areas.
+ *
+ * Each image only writes to the output of its own rects, so all images can be packed at the same time.
+ *
+ * @param context The japacker_page_context.
+ * @param task The index of the image.
+ */
+JAPACKER_DECL void japacker_pack_page(void *context, unsigned int task)
+{
+    japacker_page_context *page_context = (japacker_page_context *) context;
+    japacker_page *page = &page_context->pages[task];
+
+    japacker_reset_empty_areas(&page->data, page_context->image_width, page_context->image_height);
+
+    for (unsigned int i = 0; i < page->num_rects; i++) {
+        japacker_rect *rect = page->rects[i];
+        if (japacker_pack_rect(&page->data, rect, page_context->allow_rotation)) {
+            rect->output.image_index = (int) task;
+            rect->output.packed = 1;
+        }
+    }
+}
+
+/**
+ * @brief Checks whether any of the rects spread to an image were packed in it.
+ *
+ * @param page The image.
+ * @return 1 if at least one rect was packed, 0 otherwise.
+ */
+JAPACKER_DECL int japacker_page_has_packed_rects(const japacker_page *page)
+{
+    for (unsigned int i = 0; i < page->num_rects; i++) {
+        if (page->rects[i]->output.packed) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Packs to as many images as needed with japacker_pack(), keeping the user's options untouched.
+ *
+ * @param packer The packer to use.
+ * @return The result of japacker_pack().
+ */
+JAPACKER_DECL int japacker_pack_pages_serially(japacker_t *packer)
+{
+    japacker_fail_policy fail_policy = packer->options.fail_policy;
+    int always_repack = packer->options.always_repack;
+
+    packer->options.fail_policy = JAPACKER_NEW_IMAGE;
+    packer->options.always_repack = 1;
+    int result = japacker_pack(packer);
+
+    packer->options.fail_policy = fail_policy;
+    packer->options.always_repack = always_repack;
+    return result;
+}
+
+/**
+ * @brief Frees the images used by japacker_pack_pages().
+ *
+ * @param pages The list of images.
+ * @param num_pages The number of images in the list.
+ */
+JAPACKER_DECL void japacker_free_pages(japacker_page *pages, unsigned int num_pages)
+{
+    if (!pages) {
+        return;
+    }
+    for (unsigned int i = 0; i < num_pages; i++) {
+        japacker_free_empty_areas(&pages[i].data);
+    }
+    JAPACKER_FREE(pages);
+}
+
+
+/*
+ * Bin packing related functions
+ */
+
+/**
+ * @brief Gets what an image of a bin's size costs for japacker_pack_bins().
+ *
+ * @param bin The bin.
+ * @return bin->cost, or the area of the bin if it's 0.
+ */
+JAPACKER_DECL unsigned long long japacker_get_bin_cost(const japacker_bin *bin)
+{
+    return bin->cost ? bin->cost : (unsigned long long) bin->width * bin->height;
+}
+
+/**
+ * @brief Packs rects, in order, to a new image with the size of a bin.
+ *
+ * Every rect is unpacked and unrotated first, so the rects placed by a previous attempt are dropped.
+ *
+ * @param data The internal packer data to work with.
+ * @param rects The rects to pack, in sorted order.
+ * @param num_rects The number of rects.
+ * @param bin The size of the image.
+ * @param image_index The index of the image.
+ * @param allow_rotation Whether to allow the rects to be rotated if they don't originally fit.
+ * @param stop_on_failure Whether to stop at the first rect that doesn't fit, instead of trying the following ones.
+ * @return The number of rects packed.
+ */
+JAPACKER_DECL unsigned int japacker_pack_bin_image(japacker_internal_data *data, japacker_rect **rects,
+    unsigned int num_rects, const japacker_bin *bin, unsigned int image_index, int allow_rotation, int stop_on_failure)
+{
+    for (unsigned int i = 0; i < num_rects; i++) {
+        rects[i]->output.packed = 0;
+        rects[i]->output.rotated = 0;
+        rects[i]->output.image_index = -1;
+    }
+
+    japacker_reset_empty_areas(data, bin->width, bin->height);
+
+    unsigned int packed = 0;
+    for (unsigned int i = 0; i < num_rects; i++) {
+        japacker_rect *rect = rects[i];
+        if (japacker_pack_rect(data, rect, allow_rotation)) {
+            rect->output.image_index = (int) image_index;
+            packed++;
+        } else if (stop_on_failure) {
+            break;
+        }
+    }
+    return packed;
+}
+
+
+/*
+ * Dynamic packing related functions
+ */
+
+/**
+ * @brief Gives part of the current image back as a new empty area, merged with any adjacent areas.
+ *
+ * The empty areas must have room for one more area.
+ *
+ * @param data The internal packer data to work with.
+ * @param x The x position of the space.
+ * @param y The y position of the space.
+ * @param width The width of the space.
+ * @param height The height of the space.
+ */
+JAPACKER_DECL void japacker_give_back_space(japacker_internal_data *data, unsigned int x, unsigned int y,
+    unsigned int width, unsigned int height)
+{
+    if (!width || !height) {
+        return;
+    }
+    japacker_empty_area *area = japacker_new_empty_area(data);
+    area->x = x;
+    area->y = y;
+    area->width = width;
+    area->height = height;
+    japacker_merge_adjacent_empty_areas(data, area);
+    japacker_empty_area_set_comparator(data, area);
+    japacker_sort_empty_area(data, area, data->empty_areas.last);
+}
+
+/**
+ * @brief Places a rect in the free space of the current image, starting a new image first if there's none yet.
+ *
+ * If the rect doesn't fit and options.fail_policy is JAPACKER_NEW_IMAGE, a new image is started and becomes the
+ * current one. Otherwise, the rect is left unpacked.
+ *
+ * The empty areas must have room for one more area.
+ *
+ * @param packer The packer in use.
+ * @param rect The rect to place, which must not be packed.
+ * @return 1 if the rect was placed, 0 otherwise.
+ */
+JAPACKER_DECL int japacker_place_in_current_image(japacker_t *packer, japacker_rect *rect)
+{
+    japacker_internal_data *data = packer->internal_data;
+    unsigned int width = rect->input.width;
+    unsigned int height = rect->input.height;
+
+    // If there are no empty areas yet, the rect goes to a new image
+    int start_new_image = data->current_image < 0;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (start_new_image) {
+            if (!japacker_set_empty_areas_algorithm(data, packer->options.algorithm)) {
+                break;
+            }
+            japacker_select_comparators(packer);
+            japacker_set_search(data, packer);
+            japacker_set_spacing(data, packer);
+            // Rects that arrive in no particular order are placed best by area, and the tree keeps each search short
+            if (packer->options.online == 1) {
+                data->empty_areas.sort_by = JAPACKER_SORT_BY_AREA;
+                data->empty_areas.search_by = JAPACKER_SEARCH_TREE;
+            }
+            data->current_image = data->current_image < 0 ? (int) packer->result.images_needed :
+                data->current_image + 1;
+            japacker_reset_empty_areas(data, data->image_width, data->image_height);
+            packer->result.images_needed = data->current_image + 1;
+            packer->result.last_image_width = data->image_width;
+            packer->result.last_image_height = data->image_height;
+        }
+
+        // Rects that arrive one at a time go where they leave the shortest side, whatever options.placement is
+        japacker_placement_type placement = data->empty_areas.placement;
+        unsigned int search_window = data->empty_areas.search_window;
+        if (packer->options.online == 1) {
+            data->empty_areas.placement = JAPACKER_PLACE_BEST_SHORT_SIDE;
+            data->empty_areas.search_window = JAPACKER_ONLINE_SEARCH_WINDOW;
+        }
+        int packed = japacker_pack_rect(data, rect, packer->options.allow_rotation);
+        data->empty_areas.placement = placement;
+        data->empty_areas.search_window = search_window;
+
+        if (packed) {
+            rect->output.image_index = data->current_image;
+            // A japacker_pack() that stopped early may not have counted the current image yet
+            if (packer->result.images_needed < (unsigned int) data->current_image + 1) {
+                packer->result.images_needed = data->current_image + 1;
+            }
+            return 1;
+        }
+
+        // Only start a new image if the rect would actually fit in an empty one
+        int fits_new_image = japacker_fits_empty_image(data, width, height, data->image_width, data->image_height,
+            packer->options.allow_rotation);
+
+        if (start_new_image || packer->options.fail_policy != JAPACKER_NEW_IMAGE || !fits_new_image) {
+            break;
+        }
+        start_new_image = 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Gets the percentage of the current image that is covered by its rects.
+ *
+ * @param packer The packer in use.
+ * @return The percentage, or 100 if there's no current image.
+ */
+JAPACKER_DECL unsigned int japacker_get_current_image_density(const japacker_t *packer)
+{
+    const japacker_internal_data *data = packer->internal_data;
+
+    if (data->current_image < 0) {
+        return 100;
+    }
+
+    unsigned long long used_area = 0;
+    for (unsigned int i = 0; i < data->num_rects; i++) {
+        const japacker_rect *rect = &packer->rects[i];
+        if (rect->output.packed && rect->output.image_index == data->current_image) {
+            used_area += (unsigned long long) rect->input.width * rect->input.height;
+        }
+    }
+
+    return (unsigned int) (used_area * 100 / ((unsigned long long) data->image_width * data->image_height));
+}
+
+/**
+ * @brief Finds the empty area closest to the top left corner of the image where a rect fits, if it's closer than the
+ * rect itself.
+ *
+ * Every listed empty area is checked, whatever the search method, since they are sorted by size and not by position.
+ *
+ * @param data The internal packer data to work with.
+ * @param width The width of the space the rect takes.
+ * @param height The height of the space the rect takes.
+ * @param x The x position of the space the rect takes.
+ * @param y The y position of the space the rect takes.
+ * @return The closest empty area where the rect fits, or 0 if no empty area above the rect, or at the same height
+ *         and to its left, has room for it.
+ */
+JAPACKER_DECL japacker_empty_area *japacker_find_closer_empty_area(const japacker_internal_data *data,
+    unsigned int width, unsigned int height, unsigned int x, unsigned int y)
+{
+    japacker_empty_area *best = 0;
+
+    for (japacker_empty_area *area = data->empty_areas.first; area; area = area->next) {
+        if (width > area->width || height > area->height || area->y > y || (area->y == y && area->x >= x)) {
+            continue;
+        }
+        if (!best || area->y < best->y || (area->y == best->y && area->x < best->x)) {
+            best = area;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * @brief Moves a rect down a heap of rects until none of its children should be moved before it by
+ * japacker_compact(), which moves the rect with the highest key first, then the one with the lowest index.
+ *
+ * @param rects The heap of rects.
+ * @param keys The key of each rect, which is the position of its bottom right corner.
+ * @param index The index in the heap of the rect to move down.
+ * @param num_rects The number of rects in the heap.
+ */
+JAPACKER_DECL void japacker_sift_down_rect(japacker_rect **rects, unsigned long long *keys, unsigned int index,
+    unsigned int num_rects)
+{
+    for (;;) {
+        unsigned int first = index;
+        for (unsigned int child = index * 2 + 1; child <= index * 2 + 2 && child < num_rects; child++) {
+            if (keys[child] > keys[first] || (keys[child] == keys[first] && rects[child] < rects[first])) {
+                first = child;
+            }
+        }
+        if (first == index) {
+            return;
+        }
+
+        japacker_rect *rect = rects[index];
+        rects[index] = rects[first];
+        rects[first] = rect;
+        unsigned long long key = keys[index];
+        keys[index] = keys[first];
+        keys[first] = key;
+        index = first;
+    }
+}
+
+
+/*
+ * Blitting related functions
+ */
+
+/**
+ * The width and height of the tiles in which japacker_blit() rotates the pixels of a rect, so that both the rows being
+ * read and the rows being written stay in the cache.
+ */
+#define JAPACKER_BLIT_TILE 16
+
+/**
+ * @brief Gets the width of a destination image.
+ *
+ * @param packer The packer in use.
+ * @param image_index The index of the image.
+ * @return The width of the image, which is result.last_image_width for the last image if it was reduced.
+ */
+JAPACKER_DECL unsigned int japacker_get_image_width(const japacker_t *packer, int image_index)
+{
+    if (packer->options.reduce_image_size == 1 && image_index == (int) packer->result.images_needed - 1) {
+        return packer->result.last_image_width;
+    }
+    if (image_index >= 0 && (unsigned int) image_index < packer->internal_data->num_image_sizes) {
+        return packer->internal_data->image_sizes[image_index * 2];
+    }
+    return packer->internal_data->image_width;
+}
+
+/**
+ * @brief Copies a column of pixels of the source image to a row of the destination image.
+ *
+ * @param dst The first pixel of the destination row.
+ * @param src The first pixel of the source column.
+ * @param src_stride The number of bytes between two rows of the source image.
+ * @param count The number of pixels to copy.
+ * @param bytes_per_pixel The size of each pixel.
+ */
+JAPACKER_DECL void japacker_copy_column(unsigned char *dst, const unsigned char *src, size_t src_stride,
+    unsigned int count, unsigned int bytes_per_pixel)
+{
+    // Fixed sizes let the compiler turn each copy into a single move
+    switch (bytes_per_pixel) {
+        case 1:
+            for (unsigned int i = 0; i < count; i++) {
+                dst[i] = src[i * src_stride];
+            }
+            break;
+        case 2:
+            for (unsigned int i = 0; i < count; i++) {
+                memcpy(dst + i * 2, src + i * src_stride, 2);
+            }
+            break;
+        case 4:
+            for (unsigned int i = 0; i < count; i++) {
+                memcpy(dst + i * 4, src + i * src_stride, 4);
+            }
+            break;
+        default:
+            for (unsigned int i = 0; i < count; i++) {
+                memcpy(dst + (size_t) i * bytes_per_pixel, src + i * src_stride, bytes_per_pixel);
+            }
+            break;
+    }
+}
+
+/**
+ * @brief Copies a tile of a source image to the destination image, rotated counter-clockwise.
+ *
+ * The source pixel at x, y goes to the destination pixel at y, width - 1 - x, relative to the rect, which is the same
+ * rotation used by japacker_get_dst_offset().
+ *
+ * @param src The first pixel of the source image.
+ * @param src_stride The number of bytes between two rows of the source image.
+ * @param dst The destination pixel at the top left corner of the rect.
+ * @param dst_stride The number of bytes between two rows of the destination image.
+ * @param width The width of the source image.
+ * @param x The x position of the tile in the source image.
+ * @param y The y position of the tile in the source image.
+ * @param tile_width The width of the tile.
+ * @param tile_height The height of the tile.
+ * @param bytes_per_pixel The size of each pixel.
+ */
+JAPACKER_DECL void japacker_blit_rotated_tile(const unsigned char *src, size_t src_stride, unsigned char *dst,
+    size_t dst_stride, unsigned int width, unsigned int x, unsigned int y, unsigned int tile_width,
+    unsigned int tile_height, unsigned int bytes_per_pixel)
+{
+    unsigned int column = 0;
+
+#ifdef JAPACKER_SSE2
+    // With four byte pixels, each block of 4x4 pixels is transposed in registers: every source column becomes a
+    // vector, which is a destination row
+    if (bytes_per_pixel == 4) {
+        for (; column + 4 <= tile_width; column += 4) {
+            const unsigned char *block_src = src + y * src_stride + (size_t) (x + column) * 4;
+            unsigned char *block_dst = dst + (size_t) (width - 1 - x - column) * dst_stride + (size_t) y * 4;
+            unsigned int row = 0;
+
+            for (; row + 4 <= tile_height; row += 4) {
+                const unsigned char *rows = block_src + row * src_stride;
+                __m128i a = _mm_loadu_si128((const __m128i *) rows);
+                __m128i b = _mm_loadu_si128((const __m128i *) (rows + src_stride));
+                __m128i c = _mm_loadu_si128((const __m128i *) (rows + 2 * src_stride));
+                __m128i d = _mm_loadu_si128((const __m128i *) (rows + 3 * src_stride));
+                __m128i ab_low = _mm_unpacklo_epi32(a, b);
+                __m128i cd_low = _mm_unpacklo_epi32(c, d);
+                __m128i ab_high = _mm_unpackhi_epi32(a, b);
+                __m128i cd_high = _mm_unpackhi_epi32(c, d);
+                unsigned char *out = block_dst + (size_t) row * 4;
+                _mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi64(ab_low, cd_low));
+                _mm_storeu_si128((__m128i *) (out - dst_stride), _mm_unpackhi_epi64(ab_low, cd_low));
+                _mm_storeu_si128((__m128i *) (out - 2 * dst_stride), _mm_unpacklo_epi64(ab_high, cd_high));
+                _mm_storeu_si128((__m128i *) (out - 3 * dst_stride), _mm_unpackhi_epi64(ab_high, cd_high));
+            }
+
+            // The rows below the last full block
+            for (unsigned int i = 0; i < 4 && row < tile_height; i++) {
+                japacker_copy_column(block_dst - i * dst_stride + (size_t) row * 4,
+                    block_src + row * src_stride + i * 4, src_stride, tile_height - row, 4);
+            }
+        }
+    }
+#endif
+
+    for (; column < tile_width; column++) {
+        japacker_copy_column(dst + (size_t) (width - 1 - x - column) * dst_stride + (size_t) y * bytes_per_pixel,
+            src + y * src_stride + (size_t) (x + column) * bytes_per_pixel, src_stride, tile_height, bytes_per_pixel);
+    }
+}
+
+/**
+ * @brief Fills the margin around a rect that was copied to the destination image with the pixels at its borders.
+ *
+ * @param pixels The destination pixel at the top left corner of the rect.
+ * @param stride The number of bytes between two rows of the destination image.
+ * @param width The width of the rect in the destination image.
+ * @param height The height of the rect in the destination image.
+ * @param margin The number of pixels to fill on each side of the rect.
+ * @param bytes_per_pixel The size of each pixel.
+ */
+JAPACKER_DECL void japacker_extrude_rect(unsigned char *pixels, size_t stride, unsigned int width, unsigned int height,
+    unsigned int margin, unsigned int bytes_per_pixel)
+{
+    // Each row is extended to both sides first, so that repeating the first and last rows also fills the corners
+    for (unsigned int y = 0; y < height; y++) {
+        unsigned char *first = pixels + y * stride;
+        unsigned char *last = first + (size_t) (width - 1) * bytes_per_pixel;
+        for (unsigned int i = 1; i <= margin; i++) {
+            memcpy(first - (size_t) i * bytes_per_pixel, first, bytes_per_pixel);
+            memcpy(last + (size_t) i * bytes_per_pixel, last, bytes_per_pixel);
+        }
+    }
+
+    size_t row_size = (size_t) (width + 2 * margin) * bytes_per_pixel;
+    unsigned char *top = pixels - (size_t) margin * bytes_per_pixel;
+    unsigned char *bottom = top + (height - 1) * stride;
+    for (unsigned int i = 1; i <= margin; i++) {
+        memcpy(top - i * stride, top, row_size);
+        memcpy(bottom + i * stride, bottom, row_size);
+    }
+}
+
+/**
+ * @brief The context shared by the tasks of japacker_blit_image().
+ *
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_blit_context {
+
+    const japacker_t *packer;          /**< The packer in use. */
+
+    int image_index;                   /**< The image being drawn. */
+
+    const void *const *sources;        /**< The source image of each rect. */
+
+    const size_t *source_strides;      /**< The stride of each source image, or 0 to use tightly packed rows. */
+
+    void *dst;                         /**< The destination image. */
+
+    size_t dst_stride;                 /**< The number of bytes between two rows of the destination image. */
+
+    unsigned int bytes_per_pixel;      /**< The size of each pixel. */
+
+} japacker_blit_context;
+
+/**
+ * @brief Draws a single rect of the image, if it belongs to it.
+ *
+ * @param context The japacker_blit_context.
+ * @param task The index of the rect.
+ */
+JAPACKER_DECL void japacker_blit_task(void *context, unsigned int task)
+{
+    const japacker_blit_context *blit_context = (const japacker_blit_context *) context;
+    const japacker_rect *rect = &blit_context->packer->rects[task];
+
+    if (!rect->output.packed || rect->output.image_index != blit_context->image_index ||
+        !blit_context->sources[task]) {
+        return;
+    }
+    japacker_blit(blit_context->packer, rect, blit_context->sources[task],
+        blit_context->source_strides ? blit_context->source_strides[task] : 0, blit_context->dst,
+        blit_context->dst_stride, blit_context->bytes_per_pixel);
+}
+
+
+/*
+ * Layout related functions
+ */
+
+/**
+ * The offset basis of the 64-bit FNV-1a hash used by japacker_get_input_hash().
+ */
+#define JAPACKER_HASH_BASIS 14695981039346656037ULL
+
+/**
+ * The prime of the 64-bit FNV-1a hash used by japacker_get_input_hash().
+ */
+#define JAPACKER_HASH_PRIME 1099511628211ULL
+
+/**
+ * @brief Adds a value to a 64-bit FNV-1a hash, one byte at a time, lowest byte first.
+ *
+ * Since the bytes are taken from the value instead of from memory, the hash is the same on every machine.
+ *
+ * @param hash The hash so far.
+ * @param value The value to add.
+ * @return The new hash.
+ */
+JAPACKER_DECL unsigned long long japacker_hash_value(unsigned long long hash, unsigned long long value)
+{
+    for (int i = 0; i < 8; i++) {
+        hash ^= (value >> (i * 8)) & 0xff;
+        hash *= JAPACKER_HASH_PRIME;
+    }
+    return hash;
+}
+
+
+/*
+ * Memory related functions
+ */
+
+/**
+ * The alignment of each buffer inside the memory block used by japacker_init_with_memory().
+ */
+#define JAPACKER_MEMORY_ALIGNMENT 16
+
+/**
+ * @brief Where each of the packer's buffers is placed inside the memory block used by japacker_init_with_memory().
+ *
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_memory_layout {
+
+    size_t internal_data;          /**< The offset of the japacker_internal_data struct. */
+
+    size_t rects;                  /**< The offset of the array of rects. */
+
+    size_t sorted_rects;           /**< The offset of the array of sorted rects. */
+
+    size_t pending_rects;          /**< The offset of the array of pending rects. */
+
+    size_t sort_keys;              /**< The offset of the array of sort keys. */
+
+    size_t free_rects;             /**< The offset of the array of free rect indexes. */
+
+    size_t empty_areas;            /**< The offset of the array of empty areas. */
+
+    size_t edge_buckets;           /**< The offset of the buckets of the edge index. */
+
+    size_t scan;                   /**< The offset of the scan arrays. */
+
+    size_t total;                  /**< The total size of the block, without the room needed to align it. */
+
+    unsigned int rects_capacity;   /**< The number of rects each rect array can hold. */
+
+    unsigned int num_edge_buckets; /**< The number of buckets for each edge type. */
+
+    unsigned int scan_size;        /**< The number of elements of each scan array. */
+
+} japacker_memory_layout;
+
+/**
+ * @brief Rounds a size up to JAPACKER_MEMORY_ALIGNMENT.
+ *
+ * @param size The size to align.
+ * @return The aligned size.
+ */
+JAPACKER_DECL size_t japacker_align_size(size_t size)
+{
+    return (size + JAPACKER_MEMORY_ALIGNMENT - 1) / JAPACKER_MEMORY_ALIGNMENT * JAPACKER_MEMORY_ALIGNMENT;
+}
+
+/**
+ * @brief Calculates where each of the packer's buffers is placed inside a single memory block.
+ *
+ * @param num_rects The number of rects to pack.
+ * @param layout Where to store the layout.
+ */
+JAPACKER_DECL void japacker_get_memory_layout(unsigned int num_rects, japacker_memory_layout *layout)
+{
+    layout->rects_capacity = num_rects ? num_rects : 1;
+    layout->num_edge_buckets = japacker_get_num_edge_buckets(num_rects + 1);
+    layout->scan_size = japacker_get_scan_size(num_rects + 1);
+
+    size_t offset = 0;
+    layout->internal_data = offset;
+    offset += japacker_align_size(sizeof(japacker_internal_data));
+    layout->rects = offset;
+    offset += japacker_align_size(layout->rects_capacity * sizeof(japacker_rect));
+    layout->sorted_rects = offset;
+    offset += japacker_align_size(layout->rects_capacity * sizeof(japacker_rect *));
+    layout->pending_rects = offset;
+    offset += japacker_align_size(layout->rects_capacity * sizeof(japacker_rect *));
+    layout->sort_keys = offset;
+    offset += japacker_align_size(2 * layout->rects_capacity * sizeof(unsigned long long));
+    layout->free_rects = offset;
+    offset += japacker_align_size(layout->rects_capacity * sizeof(unsigned int));
+    layout->empty_areas = offset;
+    offset += japacker_align_size((num_rects + 1) * sizeof(japacker_empty_area));
+    layout->edge_buckets = offset;
+    offset += japacker_align_size(4 * layout->num_edge_buckets * sizeof(japacker_empty_area *));
+    layout->scan = offset;
+    offset += japacker_align_size(japacker_get_scan_arrays_size(layout->scan_size));
+    layout->total = offset;
+}
+
+
+/**
+ * @brief Allocates the internal data of a packer and, unless the user provided them, its rects.
+ *
+ * @param packer The packer to init.
+ * @param rects The rects owned by the user, or 0 to allocate them.
+ * @param num_rectangles The number of rects to pack.
+ * @param width The width of the destination image.
+ * @param height The height of the destination image.
+ * @return JAPACKER_OK on success, or another japacker_error_type result on error.
+ */
+JAPACKER_DECL int japacker_allocate_packer(japacker_t *packer, japacker_rect *rects, unsigned int num_rectangles,
+    unsigned int width, unsigned int height)
+{
+    // Clear all memory
+    memset(packer, 0, sizeof(japacker_t));
+
+    // Create the internal data
+    japacker_internal_data *data = (japacker_internal_data *) JAPACKER_MALLOC(sizeof(japacker_internal_data));
+
+    if (!data) {
+        return JAPACKER_ERROR_NO_MEMORY;
+    }
+
+    memset(data, 0, sizeof(japacker_internal_data));
+    packer->internal_data = data;
+    data->owns_memory = 1;
+    data->owns_rects = !rects;
+
+    // Create the structures with the rectangles, making sure they're never empty so that they can grow later
+    unsigned int capacity = num_rectangles ? num_rectangles : 1;
+    packer->rects = rects ? rects : (japacker_rect *) JAPACKER_MALLOC(sizeof(japacker_rect) * capacity);
+    data->sorted_rects = (japacker_rect **) JAPACKER_MALLOC(sizeof(japacker_rect *) * capacity);
+    data->pending_rects = (japacker_rect **) JAPACKER_MALLOC(sizeof(japacker_rect *) * capacity);
+    data->sort_keys = (unsigned long long *) JAPACKER_MALLOC(sizeof(unsigned long long) * capacity * 2);
+    data->free_rects = (unsigned int *) JAPACKER_MALLOC(sizeof(unsigned int) * capacity);
+    if (!packer->rects || !data->sorted_rects || !data->pending_rects || !data->sort_keys || !data->free_rects) {
+        return JAPACKER_ERROR_NO_MEMORY;
+    }
+    if (rects) {
+        // The sizes are the user's, but the results of a previous packer must not make the rects look packed
+        for (unsigned int i = 0; i < num_rectangles; i++) {
+            memset(&rects[i].output, 0, sizeof(rects[i].output));
+        }
+    } else {
+        memset(packer->rects, 0, sizeof(japacker_rect) * capacity);
+    }
+    data->num_rects = num_rectangles;
+    data->rects_capacity = capacity;
+    data->current_image = -1;
+    data->image_width = width;
+    data->image_height = height;
+
+    // Create the structure with the empty areas
+    // Since a rect creates, at most, one new empty area, then the maximum possible number of empty areas
+    // is equal to the number of rects, plus one for the original image
+    if (!japacker_allocate_empty_areas(data, data->num_rects + 1)) {
+        return JAPACKER_ERROR_NO_MEMORY;
+    }
+
+    return JAPACKER_OK;
+}
+
+/**
+ * @brief Internal function to init a packer inside a memory block, used by japacker_init_with_memory().
+ *
+ * @param packer The packer to init.
+ * @param rects The rects to pack in place, which belong to the caller, or 0 to use the rects inside the block.
+ * @param num_rectangles The number of rects.
+ * @param width The width of the destination image.
+ * @param height The height of the destination image.
+ * @param memory The memory block, of at least japacker_required_memory(num_rectangles) bytes.
+ * @param memory_size The size of the memory block.
+ * @return JAPACKER_OK on success, or JAPACKER_ERROR_NO_MEMORY if the block is too small.
+ */
+JAPACKER_DECL int japacker_place_packer(japacker_t *packer, japacker_rect *rects, unsigned int num_rectangles,
+    unsigned int width, unsigned int height, void *memory, size_t memory_size)
+{
+    // Clear all memory
+    memset(packer, 0, sizeof(japacker_t));
+
+    if (!memory || memory_size < japacker_required_memory(num_rectangles)) {
+        return JAPACKER_ERROR_NO_MEMORY;
+    }
+
+    japacker_memory_layout layout;
+    japacker_get_memory_layout(num_rectangles, &layout);
+
+    // Align the start of the block, so that every buffer inside it is also aligned
+    size_t misalignment = (size_t) memory % JAPACKER_MEMORY_ALIGNMENT;
+    unsigned char *block = (unsigned char *) memory +
+        (misalignment ? JAPACKER_MEMORY_ALIGNMENT - misalignment : 0);
+    memset(block, 0, layout.total);
+
+    japacker_internal_data *data = (japacker_internal_data *) (block + layout.internal_data);
+    packer->internal_data = data;
+    packer->rects = rects ? rects : (japacker_rect *) (block + layout.rects);
+    if (rects) {
+        // The sizes are the user's, but the results of a previous packer must not make the rects look packed
+        for (unsigned int i = 0; i < num_rectangles; i++) {
+            memset(&rects[i].output, 0, sizeof(rects[i].output));
+        }
+    }
+    data->sorted_rects = (japacker_rect **) (block + layout.sorted_rects);
+    data->pending_rects = (japacker_rect **) (block + layout.pending_rects);
+    data->sort_keys = (unsigned long long *) (block + layout.sort_keys);
+    data->free_rects = (unsigned int *) (block + layout.free_rects);
+    data->num_rects = num_rectangles;
+    data->rects_capacity = layout.rects_capacity;
+    data->current_image = -1;
+    data->image_width = width;
+    data->image_height = height;
+
+    data->empty_areas.list = (japacker_empty_area *) (block + layout.empty_areas);
+    data->empty_areas.size = num_rectangles + 1;
+    data->empty_areas.list_size = num_rectangles + 1;
+    data->edge_index.buckets = (japacker_empty_area **) (block + layout.edge_buckets);
+    data->edge_index.mask = layout.num_edge_buckets - 1;
+    japacker_set_scan_arrays(data, block + layout.scan, layout.scan_size);
+
+    return JAPACKER_OK;
+}
+
+
+/*
+ * Batch packing related functions
+ */
+
+/**
+ * @brief The state shared by the workers of japacker_pack_batch().
+ *
+ * Please refer to each variable's documentation for their meaning.
+ */
+typedef struct japacker_batch_context {
+
+    japacker_job *jobs;        /**< The jobs to pack. */
+
+    japacker_task_queue queue; /**< The queue the workers take the jobs from. Its function isn't used. */
+
+} japacker_batch_context;
+
+/**
+ * @brief Packs a single job, using the memory block of the worker.
+ *
+ * @param job The job to pack.
+ * @param memory The memory block of the worker, which is replaced by a larger one if needed.
+ * @param memory_size The size of the memory block.
+ */
+JAPACKER_DECL void japacker_pack_job(japacker_job *job, void **memory, size_t *memory_size)
+{
+    if (!job->rects || !job->num_rects) {
+        job->packed_rects = JAPACKER_ERROR_WRONG_PARAMETERS;
+        return;
+    }
+
+    size_t required = japacker_required_memory(job->num_rects);
+    if (*memory_size < required) {
+        JAPACKER_FREE(*memory);
+        *memory = JAPACKER_MALLOC(required);
+        *memory_size = *memory ? required : 0;
+        if (!*memory) {
+            job->packed_rects = JAPACKER_ERROR_NO_MEMORY;
+            return;
+        }
+    }
+
+    // The rects of the job are packed in place, so only the sorting and empty areas use the memory of the worker
+    japacker_t packer;
+    job->packed_rects = japacker_place_packer(&packer, job->rects, job->num_rects, job->width, job->height, *memory,
+        *memory_size);
+    if (job->packed_rects != JAPACKER_OK) {
+        return;
+    }
+
+    packer.options = job->options;
+    packer.options.always_repack = 0;
+    packer.options.rects_are_sorted = 0;
+    packer.options.num_threads = 1;
+
+    job->packed_rects = japacker_pack(&packer);
+    job->result = packer.result;
+
+    japacker_free(&packer);
+}
+
+/**
+ * @brief Keeps packing the jobs of the batch until there are none left.
+ *
+ * @param context The japacker_batch_context.
+ * @param task The index of the worker, which isn't used.
+ */
+JAPACKER_DECL void japacker_batch_worker(void *context, unsigned int task)
+{
+    japacker_batch_context *batch_context = (japacker_batch_context *) context;
+    void *memory = 0;
+    size_t memory_size = 0;
+    unsigned int job;
+
+    (void) task;
+
+    while (japacker_take_task(&batch_context->queue, &job)) {
+        japacker_pack_job(&batch_context->jobs[job], &memory, &memory_size);
+    }
+
+    JAPACKER_FREE(memory);
+}
+
+
+/***********************************************************************************************************************
+ * Public functions' implementation
+ **********************************************************************************************************************/
+
+JAPACKER_DECL int japacker_init(japacker_t *packer, unsigned int num_rectangles,
+    unsigned int width, unsigned int height)
+{
+    return japacker_allocate_packer(packer, 0, num_rectangles, width, height);
+}
+
+JAPACKER_DECL int japacker_init_with_rects(japacker_t *packer, japacker_rect *rects, unsigned int num_rectangles,
+    unsigned int width, unsigned int height)
+{
+    if (!rects || !num_rectangles) {
+        memset(packer, 0, sizeof(japacker_t));
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
+    }
+
+    return japacker_allocate_packer(packer, rects, num_rectangles, width, height);
+}
+
+JAPACKER_DECL size_t japacker_required_memory(unsigned int num_rectangles)
+{
+    japacker_memory_layout layout;
+    japacker_get_memory_layout(num_rectangles, &layout);
+
+    // Add room to align the start of the block
+    return layout.total + JAPACKER_MEMORY_ALIGNMENT - 1;
+}
+
+JAPACKER_DECL int japacker_init_with_memory(japacker_t *packer, unsigned int num_rectangles,
+    unsigned int width, unsigned int height, void *memory, size_t memory_size)
+{
+    return japacker_place_packer(packer, 0, num_rectangles, width, height, memory, memory_size);
+}
+
+JAPACKER_DECL void japacker_resize_image(japacker_t *packer, unsigned int image_width, unsigned int image_height)
+{
+    japacker_cancel_pack(packer);
+    packer->internal_data->image_width = image_width;
+    packer->internal_data->image_height = image_height;
+}
+
+JAPACKER_DECL int japacker_pack(japacker_t *packer)
+{
+    // A pack left halfway by japacker_pack_step() is dropped, so this always packs everything from the start
+    japacker_cancel_pack(packer);
+
+    return japacker_pack_step(packer, 0);
+}
+
+JAPACKER_DECL int japacker_pack_step(japacker_t *packer, unsigned int max_rects)
+{
+    japacker_internal_data *data = packer->internal_data;
+    japacker_pack_state *state = &data->pack_state;
+
+    if (state->phase == JAPACKER_PHASE_IDLE) {
+        int error = japacker_start_pack(packer);
+        if (error != JAPACKER_OK) {
+            return error;
+        }
+    }
+
+    unsigned int work = 0;
+
+    while (state->phase != JAPACKER_PHASE_IDLE) {
+        if (max_rects && work >= max_rects) {
+            return JAPACKER_PACK_IN_PROGRESS;
+        }
+        if (state->phase == JAPACKER_PHASE_PACK) {
+            work += japacker_pack_next_rects(packer);
+        } else {
+            work += japacker_run_reduction_step(packer);
+        }
+    }
+
+    return state->result;
+}
+
+JAPACKER_DECL void japacker_cancel_pack(japacker_t *packer)
+{
+    japacker_internal_data *data = packer->internal_data;
+
+    if (!data) {
+        return;
+    }
+    japacker_free_size_candidates(data);
+    data->pack_state.phase = JAPACKER_PHASE_IDLE;
+}
+
+JAPACKER_DECL int japacker_add_rect(japacker_t *packer, unsigned int width, unsigned int height)
+{
+    japacker_internal_data *data = packer->internal_data;
+
+    if (!data || !width || !height || !data->image_width || !data->image_height) {
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
+    }
+
+    // The rects of a pack left halfway by japacker_pack_step() could move, so it can't go on
+    japacker_cancel_pack(packer);
+
+    // Packing the rect can create at most one new empty area, and starting a new image needs none
+    if (!japacker_reserve_empty_areas(data, 1)) {
+        return JAPACKER_ERROR_NO_MEMORY;
+    }
+
+    // Get a slot for the rect, reusing the slot of a removed rect if possible
+    unsigned int index;
+    if (data->num_free_rects) {
+        index = data->free_rects[--data->num_free_rects];
+    } else {
+        if (data->num_rects == data->rects_capacity) {
+            if (!data->owns_memory || !data->owns_rects) {
+                return JAPACKER_ERROR_NO_MEMORY;
+            }
+
+            unsigned int capacity = data->rects_capacity * 2;
+
+            // Each buffer is only replaced once it's successfully grown, so a failure leaves the packer usable
+            japacker_rect **sorted_rects = (japacker_rect **) JAPACKER_REALLOC(data->sorted_rects,
+                capacity * sizeof(japacker_rect *));
+            if (!sorted_rects) {
+                return JAPACKER_ERROR_NO_MEMORY;
+            }
+            data->sorted_rects = sorted_rects;
+            japacker_rect **pending_rects = (japacker_rect **) JAPACKER_REALLOC(data->pending_rects,
+                capacity * sizeof(japacker_rect *));
+            if (!pending_rects) {
+                return JAPACKER_ERROR_NO_MEMORY;
+            }
+            data->pending_rects = pending_rects;
+            unsigned long long *sort_keys = (unsigned long long *) JAPACKER_REALLOC(data->sort_keys,
+                capacity * 2 * sizeof(unsigned long long));
+            if (!sort_keys) {
+                return JAPACKER_ERROR_NO_MEMORY;
+            }
+            data->sort_keys = sort_keys;
+            unsigned int *free_rects = (unsigned int *) JAPACKER_REALLOC(data->free_rects,
+                capacity * sizeof(unsigned int));
+            if (!free_rects) {
+                return JAPACKER_ERROR_NO_MEMORY;
+            }
+            data->free_rects = free_rects;
+            japacker_rect *rects = (japacker_rect *) JAPACKER_REALLOC(packer->rects, capacity * sizeof(japacker_rect));
+            if (!rects) {
+                return JAPACKER_ERROR_NO_MEMORY;
+            }
+            packer->rects = rects;
+            data->rects_capacity = capacity;
+
+            // The sorted list points to the old rects, so it must be rebuilt on the next japacker_pack()
+            data->num_sorted_rects = 0;
+        }
+        index = data->num_rects++;
+    }
+
+    japacker_rect *rect = &packer->rects[index];
+    memset(rect, 0, sizeof(japacker_rect));
+    rect->input.width = width;
+    rect->input.height = height;
+
+    // The new rect isn't in its sorted place
+    packer->options.rects_are_sorted = 0;
+
+    japacker_place_in_current_image(packer, rect);
+
+    return (int) index;
+}
+
+JAPACKER_DECL int japacker_remove_rect(japacker_t *packer, unsigned int index)
+{
+    japacker_internal_data *data = packer->internal_data;
+
+    if (!data || index >= data->num_rects || !packer->rects[index].input.width) {
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
+    }
+
+    japacker_cancel_pack(packer);
+
+    japacker_rect *rect = &packer->rects[index];
+
+    // Give back the rect's space as a new empty area, merged with any adjacent areas
+    // A skyline has no way to keep track of holes, so the space is only reused when the image is packed again
+    if (rect->output.packed && rect->output.image_index == data->current_image &&
+        data->empty_areas.algorithm != JAPACKER_ALGORITHM_SKYLINE) {
+        if (!japacker_reserve_empty_areas(data, 1)) {
+            return JAPACKER_ERROR_NO_MEMORY;
+        }
+        unsigned int width, height;
+        japacker_get_footprint(data, rect->output.rotated ? rect->input.height : rect->input.width,
+            rect->output.rotated ? rect->input.width : rect->input.height, &width, &height);
+        japacker_give_back_space(data, rect->output.x - data->spacing.margin, rect->output.y - data->spacing.margin,
+            width, height);
+    }
+
+    memset(rect, 0, sizeof(japacker_rect));
+    data->free_rects[data->num_free_rects++] = index;
+
+    return JAPACKER_OK;
+}
+
+JAPACKER_DECL int japacker_resize_rect(japacker_t *packer, unsigned int index, unsigned int width, unsigned int height)
+{
+    japacker_internal_data *data = packer->internal_data;
+
+    if (!data || index >= data->num_rects || !packer->rects[index].input.width || !width || !height) {
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
+    }
+
+    japacker_cancel_pack(packer);
 
-    // Check for the first empty space that has a lower perimeter than the current one
-    while (current) {
-        // If we find a smaller empty space on the list, we place the new one right after it
-        if (current->comparator < area->comparator) {
-            // If the found smaller empty area was actually the last, then the new empty area becomes the last instead
-            if (current == data->empty_areas.last) {
-                data->empty_areas.last = area;
-            // Otherwise we just update the list linking references
-            } else {
-                area->next = current->next;
-                area->next->prev = area;
-            }
-            area->prev = current;
-            current->next = area;
-            return;
+    // Shrinking gives back up to two strips, and placing the rect again can create one more empty area
+    if (!japacker_reserve_empty_areas(data, 2)) {
+        return JAPACKER_ERROR_NO_MEMORY;
+    }
+
+    japacker_rect *rect = &packer->rects[index];
+    int rotated = rect->output.rotated;
+
+    // The sizes are those of the space the rect takes, with its extrusion and padding
+    unsigned int x = rect->output.x - data->spacing.margin;
+    unsigned int y = rect->output.y - data->spacing.margin;
+    unsigned int old_width, old_height, new_width, new_height;
+    japacker_get_footprint(data, rotated ? rect->input.height : rect->input.width,
+        rotated ? rect->input.width : rect->input.height, &old_width, &old_height);
+    japacker_get_footprint(data, rotated ? height : width, rotated ? width : height, &new_width, &new_height);
+
+    // The space of the rect can only be given back if the empty areas belong to its image
+    // A skyline has no way to keep track of holes, so the space is only reused when the image is packed again
+    int owns_space = rect->output.packed && rect->output.image_index == data->current_image &&
+        data->empty_areas.algorithm != JAPACKER_ALGORITHM_SKYLINE;
+
+    rect->input.width = width;
+    rect->input.height = height;
+
+    // The rect is no longer in its sorted place
+    packer->options.rects_are_sorted = 0;
+
+    if (rect->output.packed && new_width <= old_width && new_height <= old_height) {
+        // A rect that gets smaller keeps its place, so nothing else in the image changes
+        if (owns_space) {
+            japacker_give_back_space(data, x + new_width, y, old_width - new_width, old_height);
+            japacker_give_back_space(data, x, y + new_height, new_width, old_height - new_height);
         }
-        current = current->prev;
+    } else {
+        // Otherwise it moves to the free space of the current image, which includes its own space if it was there
+        if (owns_space) {
+            japacker_give_back_space(data, x, y, old_width, old_height);
+        }
+        rect->output.packed = 0;
+        rect->output.rotated = 0;
+        japacker_place_in_current_image(packer, rect);
     }
 
-    // If no other empty area is larger than this one, then this area becomes the first empty area
-    data->empty_areas.first->prev = area;
-    area->next = data->empty_areas.first;
-    data->empty_areas.first = area;
+    // Repack everything if the rect no longer fits or if the image has too much free space between its rects
+    if (packer->options.repack_below_density &&
+        (!rect->output.packed || japacker_get_current_image_density(packer) < packer->options.repack_below_density)) {
+        int always_repack = packer->options.always_repack;
+        packer->options.always_repack = 1;
+        int result = japacker_pack(packer);
+        packer->options.always_repack = always_repack;
+        return result < JAPACKER_OK ? result : 1;
+    }
+
+    return JAPACKER_OK;
 }
 
-/**
- * @brief Removes an empty area from the sorted list.
- * 
- * @param data The internal packer data to work with.
- * @param area The empty area to remove from the list.
- */
-JAPACKER_DECL void japacker_delist_empty_area(japacker_internal_data *data, japacker_empty_area* area)
+JAPACKER_DECL int japacker_compact(japacker_t *packer, japacker_relocation *relocations, unsigned int max_relocations)
 {
-    // If the area being removed from the list was the first, then the next area becomes the first
-    if (area == data->empty_areas.first) {
-        data->empty_areas.first = area->next;
+    japacker_internal_data *data = packer->internal_data;
+
+    if (!data || (max_relocations && !relocations)) {
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
     }
-    // If the area being removed from the list was the last, then the previous area becomes the last
-    if (area == data->empty_areas.last) {
-        data->empty_areas.last = area->prev;
+
+    japacker_cancel_pack(packer);
+
+    // A skyline has no way to keep track of holes, so there's nowhere to move the rects to
+    if (data->current_image < 0 || data->empty_areas.algorithm == JAPACKER_ALGORITHM_SKYLINE || !max_relocations) {
+        return 0;
     }
-    // Update list linking references
-    if (area->prev) {
-        area->prev->next = area->next;
+
+    // The rects of the current image are moved starting with the lowest one, then the one most to the right. The
+    // pending rects and the sort keys aren't in use outside of packing and sorting, so they hold a heap of the rects,
+    // which only orders the rects that are actually looked at and needs no extra memory
+    japacker_rect **rects = data->pending_rects;
+    unsigned long long *keys = data->sort_keys;
+    unsigned int num_rects = 0;
+    for (unsigned int i = 0; i < data->num_rects; i++) {
+        japacker_rect *rect = &packer->rects[i];
+        if (!rect->output.packed || rect->output.image_index != data->current_image || !rect->input.width) {
+            continue;
+        }
+        unsigned int width = rect->output.rotated ? rect->input.height : rect->input.width;
+        unsigned int height = rect->output.rotated ? rect->input.width : rect->input.height;
+        rects[num_rects] = rect;
+        keys[num_rects] = (unsigned long long) (rect->output.y + height) << 32 | (rect->output.x + width);
+        num_rects++;
     }
-    if (area->next) {
-        area->next->prev = area->prev;
+    for (unsigned int i = num_rects / 2; i-- > 0;) {
+        japacker_sift_down_rect(rects, keys, i, num_rects);
     }
-    area->prev = 0;
-    area->next = 0;
+
+    int num_relocations = 0;
+    while (num_rects && (unsigned int) num_relocations < max_relocations) {
+        // Placing the rect can split an empty area, and its old space becomes another one. If there's no room for
+        // them, the rects moved so far are kept where they are, so that every move made is returned
+        if (!japacker_reserve_empty_areas(data, 2)) {
+            return num_relocations ? num_relocations : JAPACKER_ERROR_NO_MEMORY;
+        }
+
+        japacker_rect *rect = rects[0];
+        num_rects--;
+        rects[0] = rects[num_rects];
+        keys[0] = keys[num_rects];
+        japacker_sift_down_rect(rects, keys, 0, num_rects);
+
+        unsigned int x = rect->output.x - data->spacing.margin;
+        unsigned int y = rect->output.y - data->spacing.margin;
+        unsigned int width, height;
+        japacker_get_footprint(data, rect->output.rotated ? rect->input.height : rect->input.width,
+            rect->output.rotated ? rect->input.width : rect->input.height, &width, &height);
+
+        japacker_empty_area *area = japacker_find_closer_empty_area(data, width, height, x, y);
+        if (!area) {
+            continue;
+        }
+
+        japacker_relocation *relocation = &relocations[num_relocations++];
+        relocation->index = (unsigned int) (rect - packer->rects);
+        relocation->old_x = rect->output.x;
+        relocation->old_y = rect->output.y;
+        rect->output.x = area->x + data->spacing.margin;
+        rect->output.y = area->y + data->spacing.margin;
+        relocation->new_x = rect->output.x;
+        relocation->new_y = rect->output.y;
+
+        japacker_place_in_empty_area(data, area, width, height);
+        japacker_give_back_space(data, x, y, width, height);
+    }
+
+    return num_relocations;
 }
 
-/**
- * @brief Merges an empty area with adjacent empty areas.
- * 
- * This optimizes the empty area by making sure that areas that are directly on top or at the side of each other get
- * merged to a single, bigger empty area. This also improves performance as there are less empty areas to sort through.
- * 
- * @param data The internal packer data to work with.
- * @param area The empty area to which others should merge.
- * @return 1 if the empty area merged with adjacent empty areas, 0 otherwise.
-*/
-JAPACKER_DECL int japacker_merge_adjacent_empty_areas(japacker_internal_data *data, japacker_empty_area *area)
+JAPACKER_DECL int japacker_pack_best(japacker_t *packer)
 {
-    for (japacker_empty_area *current = data->empty_areas.first; current; current = current->next) {
-        int same_height = current->y == area->y && current->height == area->height;
-        // Adjacent area to the left
-        if (same_height && current->x + current->width == area->x) {
-            area->x = current->x;
-            area->width += current->width;
-            japacker_delist_empty_area(data, current);
-            japacker_merge_adjacent_empty_areas(data, area);
-            return 1;
+    japacker_internal_data *data = packer->internal_data;
+
+    // Make sure the struct was properly initialized
+    if (!data || !data->num_rects || !data->image_width || !data->image_height || !packer->rects) {
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
+    }
+
+    japacker_cancel_pack(packer);
+
+    JAPACKER_STAT(memset(&data->stats, 0, sizeof(japacker_stats)));
+
+    japacker_strategy strategies[JAPACKER_NUM_STRATEGIES];
+    memset(strategies, 0, sizeof(strategies));
+
+    // Strategies are ordered by japacker_sort_type, with the unrotated version first
+    for (int i = 0; i < JAPACKER_NUM_STRATEGIES; i++) {
+        strategies[i].sort_by = (japacker_sort_type) (i / 2);
+        strategies[i].allow_rotation = i % 2;
+        strategies[i].enabled = !strategies[i].allow_rotation || packer->options.allow_rotation;
+    }
+
+    japacker_strategy_context context;
+    context.packer = packer;
+    context.strategies = strategies;
+
+    // When the strategies are packed one after the other, the rest are skipped once one of them packs every rect that
+    // fits in as few images as possible, since no other strategy could then be better. A reduced last image can still
+    // be smaller with another strategy, so this is only done if the size of the last image isn't reduced. With
+    // JAPACKER_STOP, a strategy that fails returns where it stopped instead of the rects it packed, so it's not done
+    // either
+    japacker_bounds bounds;
+    int serial = packer->options.num_threads <= 1;
+#ifndef JAPACKER_THREADS
+    serial = 1;
+#endif
+    if (serial && packer->options.reduce_image_size != 1 && packer->options.fail_policy != JAPACKER_STOP &&
+        japacker_estimate(packer, &bounds) == JAPACKER_OK) {
+        for (int i = 0; i < JAPACKER_NUM_STRATEGIES; i++) {
+            japacker_pack_strategy(&context, i);
+            if (strategies[i].enabled && strategies[i].packed_rects == (int) bounds.num_fitting_rects &&
+                strategies[i].images_needed == bounds.min_images) {
+                for (int j = i + 1; j < JAPACKER_NUM_STRATEGIES; j++) {
+                    strategies[j].enabled = 0;
+                }
+                break;
+            }
         }
-        // Adjacent area to the right
-        if (same_height && area->x + area->width == current->x) {
-            area->width += current->width;
-            japacker_delist_empty_area(data, current);
-            japacker_merge_adjacent_empty_areas(data, area);
-            return 1;
+    } else {
+        japacker_run_tasks(japacker_pack_strategy, &context, JAPACKER_NUM_STRATEGIES, packer->options.num_threads);
+    }
+
+    // Always check the strategies in the same order, so the winner doesn't depend on which thread finished first
+    japacker_strategy *best = 0;
+    int result = JAPACKER_OK;
+
+    for (int i = 0; i < JAPACKER_NUM_STRATEGIES; i++) {
+        japacker_strategy *strategy = &strategies[i];
+        if (!strategy->enabled) {
+            continue;
         }
-        int same_width = current->x == area->x && current->width == area->width;
-        // Adjacent area to the top
-        if (same_width && current->y + current->height == area->y) {
-            area->y = current->y;
-            area->height += current->height;
-            japacker_delist_empty_area(data, current);
-            japacker_merge_adjacent_empty_areas(data, area);
-            return 1;
+        if (strategy->packed_rects < JAPACKER_OK) {
+            result = strategy->packed_rects;
+            continue;
         }
-        // Adjacent area to the bottom
-        if (same_width && area->y + area->height == current->y) {
-            area->height += current->height;
-            japacker_delist_empty_area(data, current);
-            japacker_merge_adjacent_empty_areas(data, area);
-            return 1;
+        if (!best || japacker_is_better_strategy(strategy, best)) {
+            best = strategy;
         }
     }
-    return 0;
+
+    if (best && result == JAPACKER_OK) {
+        for (unsigned int i = 0; i < data->num_rects; i++) {
+            packer->rects[i].output = best->rects[i].output;
+        }
+        packer->options.sort_by = best->sort_by;
+        packer->options.allow_rotation = best->allow_rotation;
+        // The internal sorted rect list may not match the winning sort method anymore
+        packer->options.rects_are_sorted = 0;
+        // The empty areas of the winning strategy weren't kept, so rects can't be added to its last image
+        data->current_image = -1;
+        data->num_image_sizes = 0;
+        packer->result.images_needed = best->images_needed;
+        packer->result.last_image_width = best->last_image_width;
+        packer->result.last_image_height = best->last_image_height;
+        JAPACKER_STAT(data->stats = best->stats);
+        result = best->packed_rects;
+    }
+
+    for (int i = 0; i < JAPACKER_NUM_STRATEGIES; i++) {
+        JAPACKER_FREE(strategies[i].rects);
+    }
+
+    return result;
 }
 
-/**
- * @brief Splits an empty area into two smaller empty areas.
- * 
- * An empty area is split into two when a rectangle is created inside it. The creation of the rectangle takes a part of
- * the original empty area, and two new empty areas are created, one below and one to the side of the new rectangle.
- * 
- * @param data The internal packer data to work with.
- * @param area The empty area to split into two.
- * @param width The width of the rectangle that caused the split.
- * @param height The height of the rectangle that caused the split.
-*/
-JAPACKER_DECL void japacker_split_empty_area(japacker_internal_data *data, japacker_empty_area *area,
-    unsigned int width, unsigned int height)
+JAPACKER_DECL int japacker_pack_pages(japacker_t *packer)
 {
-    japacker_empty_area *new_area = &data->empty_areas.list[++data->empty_areas.index];
+    japacker_internal_data *data = packer->internal_data;
 
-    // First we check what's the remaining dimensions both to the right and below the new rectangle
-    int remaining_width = area->width - width;
-    int remaining_height = area->height - height;
+    // Make sure the struct was properly initialized
+    if (!data || !data->num_rects || !data->image_width || !data->image_height || !packer->rects) {
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
+    }
 
-    // If the empty area to the side of the new rectangle is larger than the one below,
-    // one empty area will have the space directly below of the new rectangle,
-    // and the other one will have all the space to the side
-    // Do note that to save memory space, we change the old empty area's data to become one of the new empty areas
-    if (remaining_width > remaining_height) {
-        new_area->x = area->x;
-        new_area->y = area->y + height;
-        new_area->width = width;
-        new_area->height = area->height - height;
-        area->x += width;
-        area->width -= width;
+    japacker_cancel_pack(packer);
 
-    // If the empty area below new rectangle is larger than the one to the side,
-    // one empty area will have the space directly to the side of the new rectangle,
-    // and the other one will have all the space below
-    } else {
-        new_area->x = area->x + width;
-        new_area->y = area->y;
-        new_area->width = area->width - width;
-        new_area->height = height;
-        area->y += height;
-        area->height -= height;
+    JAPACKER_STAT(memset(&data->stats, 0, sizeof(japacker_stats)));
+
+    // Sort the rects if needed
+    if (packer->options.rects_are_sorted != 1 || data->num_sorted_rects != data->num_rects) {
+        japacker_sort_rects(packer);
     }
+    japacker_set_search(data, packer);
+    japacker_set_spacing(data, packer);
 
-    japacker_empty_area *original_prev = area->prev;
-    japacker_delist_empty_area(data, area);
+    // Just like with japacker_pack(), the images packed here may need an empty area for every rect
+    if (!japacker_set_empty_areas_algorithm(data, packer->options.algorithm) ||
+        !japacker_grow_empty_areas(data, data->num_rects + 1)) {
+        return JAPACKER_ERROR_NO_MEMORY;
+    }
 
-    // Merge the empty areas with adjacent empty ones
-    int merged = japacker_merge_adjacent_empty_areas(data, area) + japacker_merge_adjacent_empty_areas(data, new_area);
+    unsigned int image_width = data->image_width;
+    unsigned int image_height = data->image_height;
+    int allow_rotation = packer->options.allow_rotation;
+    data->num_image_sizes = 0;
 
-    // We can only set the comparator after merging, because the empty areas may be larger
-    data->empty_areas.set_comparator(area);
-    data->empty_areas.set_comparator(new_area);
+    // Every rect starts unpacked. Only the rects that fit in an empty image are spread, so that each new image is
+    // guaranteed to take at least one rect
+    double rects_area = 0;
+    unsigned int num_rects = 0;
+    for (unsigned int i = 0; i < data->num_rects; i++) {
+        japacker_rect *rect = data->sorted_rects[i];
+        rect->output.packed = 0;
+        rect->output.rotated = 0;
+        rect->output.image_index = -1;
+
+        unsigned int width = rect->input.width;
+        unsigned int height = rect->input.height;
+        if (!width || !height ||
+            !japacker_fits_empty_image(data, width, height, image_width, image_height, allow_rotation)) {
+            continue;
+        }
+        data->pending_rects[num_rects++] = rect;
+        rects_area += (double) width * height;
+    }
 
-    // If we aren't merging the new empty areas, we must still sort them, but we can optimize sorting due to the
-    // following assumptions (which are always true):
-    // - The new empty areas are smaller than the original empty area (which now has a rectangle)
-    // - The newly created empty area is smaller than the repurposed empty area (we make sure of this)
-    // Therefore we sort the new empty areas taking into account that the larger created area cannot be sorted
-    // any higher than before, and the smaller created area cannot be sorted any higher than the larger created area.
-    if (!merged) {
-        japacker_sort_empty_area(data, area, original_prev);
-        japacker_sort_empty_area(data, new_area, area->prev);
-    } else {
+    unsigned int num_pages = (unsigned int) ceil(rects_area * 100 /
+        ((double) image_width * image_height * JAPACKER_PAGE_FILL_PERCENTAGE));
+    // Each image must get at least one rect, or it would be left empty
+    if (num_pages > num_rects) {
+        num_pages = num_rects;
+    }
+    if (num_pages < 2) {
+        return japacker_pack_pages_serially(packer);
+    }
 
-        // If we're merging both new empty areas, we can't really optimize their sorting save for the fact that we can
-        // limit the search for the smallest of the merged empty areas to start at the largest of the empty areas
-        if (new_area->comparator < area->comparator) {
-            japacker_sort_empty_area(data, area, data->empty_areas.last);
-            japacker_sort_empty_area(data, new_area, area->prev);
-        } else {
-            japacker_sort_empty_area(data, new_area, data->empty_areas.last);
-            japacker_sort_empty_area(data, area, new_area->prev);
+    japacker_page *pages = (japacker_page *) JAPACKER_MALLOC(num_pages * sizeof(japacker_page));
+    japacker_rect **page_rects = (japacker_rect **) JAPACKER_MALLOC(num_rects * sizeof(japacker_rect *));
+    if (!pages || !page_rects) {
+        JAPACKER_FREE(pages);
+        JAPACKER_FREE(page_rects);
+        return packer->options.deterministic == 1 ? JAPACKER_ERROR_NO_MEMORY : japacker_pack_pages_serially(packer);
+    }
+    memset(pages, 0, num_pages * sizeof(japacker_page));
+
+    // Spread the sorted rects back and forth over the images, so all images get a similar mix of large and small rects
+    // The first pass counts the rects of each image and the second one places them, keeping them in sorted order
+    for (int pass = 0; pass < 2; pass++) {
+        for (unsigned int i = 0; i < num_rects; i++) {
+            unsigned int position = i % num_pages;
+            japacker_page *page = &pages[(i / num_pages) % 2 ? num_pages - 1 - position : position];
+            if (pass) {
+                page->rects[page->num_rects] = data->pending_rects[i];
+            }
+            page->num_rects++;
+        }
+        if (!pass) {
+            unsigned int offset = 0;
+            for (unsigned int i = 0; i < num_pages; i++) {
+                pages[i].rects = page_rects + offset;
+                offset += pages[i].num_rects;
+                pages[i].num_rects = 0;
+            }
         }
     }
-}
 
+    int has_memory = 1;
+    for (unsigned int i = 0; i < num_pages && has_memory; i++) {
+        japacker_page *page = &pages[i];
+        page->data.empty_areas.sort_by = data->empty_areas.sort_by;
+        page->data.empty_areas.search_by = data->empty_areas.search_by;
+        page->data.empty_areas.placement = data->empty_areas.placement;
+        page->data.empty_areas.search_window = data->empty_areas.search_window;
+        page->data.empty_areas.algorithm = data->empty_areas.algorithm;
+        page->data.spacing = data->spacing;
+        // The images may later receive rects that didn't fit elsewhere, so their empty areas must be able to grow
+        page->data.owns_memory = 1;
+        has_memory = japacker_allocate_empty_areas(&page->data, page->rects ? page->num_rects + 1 : 1);
+    }
+    if (!has_memory) {
+        japacker_free_pages(pages, num_pages);
+        JAPACKER_FREE(page_rects);
+        return packer->options.deterministic == 1 ? JAPACKER_ERROR_NO_MEMORY : japacker_pack_pages_serially(packer);
+    }
 
-/*
- * Packing related functions
- */
+    japacker_page_context context;
+    context.pages = pages;
+    context.image_width = image_width;
+    context.image_height = image_height;
+    context.allow_rotation = allow_rotation;
 
-/**
- * @brief Packs a single rect.
- * 
- * If allow_rotation is 1 and the packer can't fit the rectangle, it'll attempt to rotate the rectangle and place it.
- * 
- * @param data The internal packer data to work with.
- * @param rect The rectangle to pack.
- * @param allow_rotation Whether to allow the rect to be rotated if it doesn't originally fit.
- * @return 1 if the rectangle was packed, 0 otherwise.
-*/
+    japacker_run_tasks(japacker_pack_page, &context, num_pages, packer->options.num_threads);
+
+    // The first rect of each image always fits, so no image should be empty, but if the trailing ones are, drop them
+    // so that images_needed and the size of the last image match what was actually packed
+    unsigned int num_spread_pages = num_pages;
+    while (num_pages > 1 && !japacker_page_has_packed_rects(&pages[num_pages - 1])) {
+        num_pages--;
+    }
+
+    // Try the rects that didn't fit in the free space of the other images, leaving the last one untouched so that
+    // its rects can still be repacked to a smaller size. Whatever is left is kept for the new images
+    unsigned int num_pending_rects = 0;
+    for (unsigned int i = 0; i < num_rects; i++) {
+        japacker_rect *rect = data->pending_rects[i];
+        if (rect->output.packed) {
+            continue;
+        }
+        unsigned int width = rect->input.width;
+        unsigned int height = rect->input.height;
+        for (unsigned int j = 0; j < num_pages - 1 && !rect->output.packed; j++) {
+            japacker_page *page = &pages[j];
+            if (page->failed_width && width >= page->failed_width && height >= page->failed_height) {
+                continue;
+            }
+            if (japacker_reserve_empty_areas(&page->data, 1) && japacker_pack_rect(&page->data, rect, allow_rotation)) {
+                rect->output.image_index = (int) j;
+                rect->output.packed = 1;
+            } else if (!page->failed_width ||
+                (double) width * height < (double) page->failed_width * page->failed_height) {
+                page->failed_width = width;
+                page->failed_height = height;
+            }
+        }
+        if (!rect->output.packed) {
+            data->pending_rects[num_pending_rects++] = rect;
+        }
+    }
+
+    for (unsigned int i = 0; i < num_spread_pages; i++) {
+        JAPACKER_STAT(japacker_add_stats(&data->stats, &pages[i].data.stats));
+    }
+    japacker_free_pages(pages, num_spread_pages);
+    JAPACKER_FREE(page_rects);
+
+    packer->result.images_needed = num_pages;
+
+    // Pack the remaining rects to new images, one after the other, just like japacker_pack() does
+    while (num_pending_rects) {
+        japacker_reset_empty_areas(data, image_width, image_height);
+        data->current_image = packer->result.images_needed;
+
+        unsigned int num_failed_rects = 0;
+        for (unsigned int i = 0; i < num_pending_rects; i++) {
+            japacker_rect *rect = data->pending_rects[i];
+            if (japacker_pack_rect(data, rect, allow_rotation)) {
+                rect->output.image_index = (int) packer->result.images_needed;
+                rect->output.packed = 1;
+            } else {
+                data->pending_rects[num_failed_rects++] = rect;
+            }
+        }
+        packer->result.images_needed++;
+        num_pending_rects = num_failed_rects;
+    }
+
+    // If no new images were needed, the empty areas must be rebuilt to match the last image, so rects can be added to
+    // it. Its rects were packed in sorted order on an empty image, so repacking them gives the exact same result
+    unsigned int image_index = packer->result.images_needed - 1;
+    if (image_index == num_pages - 1) {
+        japacker_repack_image(data, data->sorted_rects, data->num_rects, image_index, image_width, image_height,
+            allow_rotation);
+        data->current_image = (int) image_index;
+    }
+
+    int packed_rects = 0;
+    japacker_area area_used_in_last_image = 0;
+    for (unsigned int i = 0; i < data->num_rects; i++) {
+        if (packer->rects[i].output.packed) {
+            packed_rects++;
+            if (packer->rects[i].output.image_index == (int) image_index) {
+                area_used_in_last_image += (japacker_area) packer->rects[i].input.width * packer->rects[i].input.height;
+            }
+        }
+    }
+
+    // Set the last image's width and height to the size of the destination image as default
+    packer->result.last_image_width = image_width;
+    packer->result.last_image_height = image_height;
+
+    // Try to reduce the last image's size if asked to
+    if (packer->options.reduce_image_size == 1 &&
+        japacker_reduce_last_image_size(packer, area_used_in_last_image) != JAPACKER_OK) {
+        return JAPACKER_ERROR_NO_MEMORY;
+    }
 
-JAPACKER_DECL int japacker_pack_rect(japacker_internal_data *data, japacker_rect *rect, int allow_rotation)
+    return packed_rects;
+}
+
+JAPACKER_DECL int japacker_estimate(const japacker_t *packer, japacker_bounds *bounds)
 {
-    unsigned int width, height;
-    if (!rect->output.rotated) {
-        width = rect->input.width;
-        height = rect->input.height;
-    } else {
-        width = rect->input.height;
-        height = rect->input.width;
+    const japacker_internal_data *data = packer->internal_data;
+
+    // Make sure the struct was properly initialized
+    if (!data || !bounds || !data->num_rects || !data->image_width || !data->image_height || !packer->rects) {
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
+    }
+
+    unsigned int num_rects = data->num_rects;
+    unsigned long long *keys = (unsigned long long *) JAPACKER_MALLOC(2 * (size_t) num_rects *
+        sizeof(unsigned long long));
+    japacker_rect **rects = (japacker_rect **) JAPACKER_MALLOC(2 * (size_t) num_rects * sizeof(japacker_rect *));
+    if (!keys || !rects) {
+        JAPACKER_FREE(keys);
+        JAPACKER_FREE(rects);
+        return JAPACKER_ERROR_NO_MEMORY;
     }
-    for (japacker_empty_area *area = data->empty_areas.first; area; area = area->next)
-    {
-        // If the rectangle is larger than the current empty area, we must look for a larger empty area
-        if (height > area->height || width > area->width) {
+
+    // Only the spacing of this copy is set, which is all that japacker_get_footprint() reads
+    japacker_internal_data spacing_data;
+    japacker_set_spacing(&spacing_data, packer);
+    unsigned int padding_x = spacing_data.spacing.padding_x;
+    unsigned int padding_y = spacing_data.spacing.padding_y;
+
+    // Like in japacker_reset_empty_areas(), the padding at the right and the bottom of the image is part of it
+    unsigned int image_width = data->image_width + padding_x;
+    unsigned int image_height = data->image_height + padding_y;
+    int num_orientations = packer->options.allow_rotation ? 2 : 1;
+
+    memset(bounds, 0, sizeof(japacker_bounds));
+    unsigned int num_large_rects = 0;
+    unsigned int max_width = 0;
+    unsigned int max_height = 0;
+    unsigned int num_keys = 0;
+
+    for (unsigned int i = 0; i < num_rects; i++) {
+        const japacker_rect *rect = &packer->rects[i];
+        if (!rect->input.width || !rect->input.height) {
             continue;
         }
 
-        // If the rectangle fits in this empty area, we place it here
-        rect->output.x = area->x;
-        rect->output.y = area->y;
-        rect->output.packed = 1;
+        // The second orientation is the rotated rect, which is only looked at if rects can be rotated
+        unsigned int widths[2], heights[2];
+        japacker_get_footprint(&spacing_data, rect->input.width, rect->input.height, &widths[0], &heights[0]);
+        japacker_get_footprint(&spacing_data, rect->input.height, rect->input.width, &widths[1], &heights[1]);
 
-        // If the rectangle has the same dimensions as the empty area, we simply remove the empty area
-        if (height == area->height && width == area->width) {
-            japacker_delist_empty_area(data, area);
-            return 1;
-        }
+        int chosen = -1;
+        int large = 1;
+        unsigned int min_width = 0, min_height = 0;
+        unsigned long long min_area = 0;
 
-        // If the rectangle has the same height but lower width,
-        // we reduce the empty area's width and offset it to start to the right of the new rectangle
-        if (height == area->height) {
-            area->x += width;
-            area->width -= width;
-            japacker_empty_area *prev = area->prev;
-            japacker_delist_empty_area(data, area);
-            if (japacker_merge_adjacent_empty_areas(data, area)) {
-                prev = data->empty_areas.last;
+        for (int j = 0; j < num_orientations; j++) {
+            if (widths[j] > image_width || heights[j] > image_height) {
+                continue;
             }
-            data->empty_areas.set_comparator(area);
-            japacker_sort_empty_area(data, area, prev);
-            return 1;
-        }
 
-        // If the rectangle has the same width but lower height,
-        // we reduce the empty area's height and offset it to start below the new rectangle
-        if (width == area->width) {
-            area->y += height;
-            area->height -= height;
-            japacker_empty_area *prev = area->prev;
-            japacker_delist_empty_area(data, area);
-            if (japacker_merge_adjacent_empty_areas(data, area)) {
-                prev = data->empty_areas.last;
+            // The padding may go past the border of the image, so it doesn't count for the space the rect needs
+            unsigned int width = widths[j] - padding_x;
+            unsigned int height = heights[j] - padding_y;
+            unsigned long long area = (unsigned long long) width * height;
+            min_width = chosen < 0 || width < min_width ? width : min_width;
+            min_height = chosen < 0 || height < min_height ? height : min_height;
+            min_area = chosen < 0 || area < min_area ? area : min_area;
+
+            // Two rects can't be side by side or one above the other if they are larger than half the image
+            large = large && 2ULL * widths[j] > image_width && 2ULL * heights[j] > image_height;
+
+            // The shelves are lower when the rects lie down
+            if (chosen < 0 || heights[j] < heights[chosen]) {
+                chosen = j;
             }
-            data->empty_areas.set_comparator(area);
-            japacker_sort_empty_area(data, area, prev);
-            return 1;
         }
 
-        // If the new rectangle has both a lower width and height than the empty area,
-        // we split the empty area into two new empty areas, one at the right and one below the new rectangle
-        japacker_split_empty_area(data, area, width, height);
-        return 1;
+        if (chosen < 0) {
+            continue;
+        }
+
+        bounds->num_fitting_rects++;
+        bounds->min_area += min_area;
+        bounds->min_width = min_width > bounds->min_width ? min_width : bounds->min_width;
+        bounds->min_height = min_height > bounds->min_height ? min_height : bounds->min_height;
+        num_large_rects += large;
+
+        // The key keeps the space the rect takes on its shelf, so it's all that's needed once sorted. The rects are
+        // never written to, they are only moved around by the sort
+        keys[num_keys] = (unsigned long long) heights[chosen] << 32 | widths[chosen];
+        rects[num_keys++] = (japacker_rect *) rect;
+        max_width = widths[chosen] > max_width ? widths[chosen] : max_width;
+        max_height = heights[chosen] > max_height ? heights[chosen] : max_height;
     }
 
-    // If the rectangle didn't fit anywhere and rotation is allowed, we try rotating the rectangle
-    if (allow_rotation) {
-        rect->output.rotated = 1;
-        return japacker_pack_rect(data, rect, 0);
+    // Sort from the tallest rect down, and from the widest one down for the same height
+    for (unsigned int i = 0; i < num_keys; i++) {
+        keys[i] = (unsigned long long) (max_height - (unsigned int) (keys[i] >> 32)) << 32 |
+            (max_width - (unsigned int) (keys[i] & 0xffffffff));
     }
-    // We might have failed to pack a rotated rectangle, so we move it back to the original position
-    // just in case it'll be packed to a new image
-    rect->output.rotated = 0;
-    return 0;
+    japacker_radix_sort_rects(rects, keys, rects + num_rects, keys + num_rects, num_keys);
+
+    // Place the rects in rows, starting a new row when a rect doesn't fit at the end of the current one, and a new
+    // image when the new row doesn't fit below the previous ones
+    unsigned int x = 0, y = 0, row_height = 0, used_width = 0;
+    for (unsigned int i = 0; i < num_keys; i++) {
+        unsigned int height = max_height - (unsigned int) (keys[i] >> 32);
+        unsigned int width = max_width - (unsigned int) (keys[i] & 0xffffffff);
+
+        if (bounds->max_images && (unsigned long long) x + width > image_width) {
+            y += row_height;
+            x = 0;
+            row_height = 0;
+        }
+        if (!bounds->max_images || (unsigned long long) y + height > image_height) {
+            bounds->max_images++;
+            x = 0;
+            y = 0;
+            row_height = 0;
+            used_width = 0;
+        }
+
+        x += width;
+        row_height = height > row_height ? height : row_height;
+        used_width = x > used_width ? x : used_width;
+    }
+
+    if (bounds->max_images) {
+        bounds->max_last_image_width = used_width - padding_x;
+        bounds->max_last_image_height = y + row_height - padding_y;
+    }
+
+    unsigned long long image_area = (unsigned long long) data->image_width * data->image_height;
+    bounds->min_images = (unsigned int) (bounds->min_area / image_area + (bounds->min_area % image_area != 0));
+    bounds->min_images = num_large_rects > bounds->min_images ? num_large_rects : bounds->min_images;
+
+    JAPACKER_FREE(keys);
+    JAPACKER_FREE(rects);
+    return JAPACKER_OK;
 }
 
-/**
- * @brief Reduces the size of the last created image.
- * 
- * This is a convenience function designed to improve the efficiency of packing, by preventing an image from being too
- * large for the number of rectangles it has.
- * 
- * This code works by finding the minimum possible area of the destination image (which is the sum of the areas of all
- * its rects), the area of the destination image set by the user, then, keep dividing the difference by two and
- * attempting to pack in a loop. The difference is divided by two for each pass of the loop.
- * 
- * If packing is successful, the current difference is subtracted to the width and height of the destination rectangle.
- * If it's unsuccessful, the difference is added.
- * 
- * This keeps happening until either the difference is smaller than 1 or there's a successful packing with a difference
- * of less than JAPACKER_TOLERABLE_AREA_DIFFERENCE_PERCENTAGE.
- * 
- * @param packer The packer in use.
- * @param rects_area The minimum possible area the destination image can have.
-*/
-JAPACKER_DECL void japacker_reduce_last_image_size(japacker_t *packer, unsigned int rects_area)
+JAPACKER_DECL int japacker_pack_bins(japacker_t *packer, const japacker_bin *bins, unsigned int num_bins,
+    unsigned int *image_bins, unsigned int max_images)
 {
     japacker_internal_data *data = packer->internal_data;
 
-    // We are going to get the difference between the current area and the actual area of the
-    // inserted rects and work from there
-    unsigned int current_area = data->image_width * data->image_height;
+    // Make sure the struct was properly initialized
+    if (!data || !data->num_rects || !packer->rects || !bins || !num_bins || !image_bins || !max_images) {
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
+    }
+    for (unsigned int i = 0; i < num_bins; i++) {
+        if (!bins[i].width || !bins[i].height) {
+            return JAPACKER_ERROR_WRONG_PARAMETERS;
+        }
+    }
+
+    japacker_cancel_pack(packer);
 
-    // Don't look further if the difference between the rects' area and the image area is low enough
-    if (current_area * 100 / rects_area < 100 + JAPACKER_TOLERABLE_AREA_DIFFERENCE_PERCENTAGE) {
-        return;
+    JAPACKER_STAT(memset(&data->stats, 0, sizeof(japacker_stats)));
+
+    // Sort the rects if needed
+    if (packer->options.rects_are_sorted != 1 || data->num_sorted_rects != data->num_rects) {
+        japacker_sort_rects(packer);
     }
+    japacker_set_search(data, packer);
+    japacker_set_spacing(data, packer);
 
-    // The image index to be used is the one for the last image
-    unsigned int image_index = packer->result.images_needed - 1;
+    // Just like with japacker_pack(), the images packed here may need an empty area for every rect
+    if (!japacker_set_empty_areas_algorithm(data, packer->options.algorithm) ||
+        !japacker_grow_empty_areas(data, data->num_rects + 1)) {
+        return JAPACKER_ERROR_NO_MEMORY;
+    }
 
-    // Get the proportional width and height for the used area
-    float image_ratio = data->image_width / (float) data->image_height;
-    unsigned int needed_width = (unsigned int) sqrt(rects_area * image_ratio) + 1;
-    unsigned int needed_height = (unsigned int) sqrt(rects_area / image_ratio) + 1;
+    // The size of every image is kept, so that the images can be drawn and their layout saved
+    JAPACKER_FREE(data->image_sizes);
+    data->num_image_sizes = 0;
+    data->image_sizes = (unsigned int *) JAPACKER_MALLOC(max_images * 2 * sizeof(unsigned int));
+    if (!data->image_sizes) {
+        return JAPACKER_ERROR_NO_MEMORY;
+    }
 
-    // To get the best rectangle, we find the difference between the requested image's width and height and the
-    // rect area's proportional width and height. We start our work from the middle of that difference
-    unsigned int delta_width = (data->image_width - needed_width) / 2;
-    unsigned int delta_height = (data->image_height - needed_height) / 2;
+    int allow_rotation = packer->options.allow_rotation;
 
-    // Use the last successful width and height as a measure for the best packing
-    unsigned int last_successful_width = data->image_width;
-    unsigned int last_successful_height = data->image_height;
-
-    while (delta_width && delta_height) {
-        // If the last packing was a failure, we increase the image size, otherwise we decrease it
-        if (last_successful_width == packer->result.last_image_width) {
-            packer->result.last_image_width -= delta_width;
-            packer->result.last_image_height -= delta_height;
-        } else {
-            packer->result.last_image_width += delta_width;
-            packer->result.last_image_height += delta_height;
+    // Every rect starts unpacked. Only the rects that fit in at least one bin are packed, so that each new image is
+    // guaranteed to take at least one rect
+    double pending_area = 0;
+    unsigned int num_pending_rects = 0;
+    for (unsigned int i = 0; i < data->num_rects; i++) {
+        japacker_rect *rect = data->sorted_rects[i];
+        rect->output.packed = 0;
+        rect->output.rotated = 0;
+        rect->output.image_index = -1;
+
+        unsigned int width = rect->input.width;
+        unsigned int height = rect->input.height;
+        if (!width || !height) {
+            continue;
+        }
+        for (unsigned int j = 0; j < num_bins; j++) {
+            if (japacker_fits_empty_image(data, width, height, bins[j].width, bins[j].height, allow_rotation)) {
+                data->pending_rects[num_pending_rects++] = rect;
+                pending_area += (double) width * height;
+                break;
+            }
         }
+    }
 
-        japacker_reset_empty_areas(data, packer->result.last_image_width, packer->result.last_image_height);
+    packer->result.images_needed = 0;
+    int packed_rects = 0;
 
-        int failed_to_pack = 0;
+    while (num_pending_rects && packer->result.images_needed < max_images) {
+        unsigned int image_index = packer->result.images_needed;
+        const japacker_rect *first = data->pending_rects[0];
 
-        for (unsigned int i = 0; i < data->num_rects; i++) {
-            japacker_rect *rect = data->sorted_rects[i];
+        // If no bin holds all the remaining rects, the largest bin where the first of them fits is filled instead
+        int largest = -1;
+        for (unsigned int j = 0; j < num_bins; j++) {
+            if (japacker_fits_empty_image(data, first->input.width, first->input.height, bins[j].width,
+                bins[j].height, allow_rotation) && (largest < 0 ||
+                (double) bins[j].width * bins[j].height > (double) bins[largest].width * bins[largest].height)) {
+                largest = (int) j;
+            }
+        }
+
+        // Try the bins from the cheapest up, in the order of the list for the same cost. The bins smaller than the
+        // area of the remaining rects can't hold them, so they aren't tried
+        int chosen = -1;
+        int tried = -1;
+        int previous = -1;
+        unsigned int packed = 0;
+        for (unsigned int attempt = 0; attempt < num_bins && chosen < 0; attempt++) {
+            int next = -1;
+            for (unsigned int j = 0; j < num_bins; j++) {
+                unsigned long long cost = japacker_get_bin_cost(&bins[j]);
+                int after_previous = previous < 0 || cost > japacker_get_bin_cost(&bins[previous]) ||
+                    (cost == japacker_get_bin_cost(&bins[previous]) && (int) j > previous);
+                if (after_previous && (next < 0 || cost < japacker_get_bin_cost(&bins[next]))) {
+                    next = (int) j;
+                }
+            }
+            previous = next;
 
-            // Only repack the rects for the last image
-            if (rect->output.image_index != image_index) {
+            if ((double) bins[next].width * bins[next].height < pending_area) {
                 continue;
             }
 
-            // Pack the rectangle. If packing fails, we must increase the image size
-            if (!japacker_pack_rect(data, rect, packer->options.allow_rotation)) {
-                failed_to_pack = 1;
-                break;
+            // The largest bin is filled completely, in case it ends up being used without holding every rect
+            packed = japacker_pack_bin_image(data, data->pending_rects, num_pending_rects, &bins[next], image_index,
+                allow_rotation, next != largest);
+            tried = next;
+            if (packed == num_pending_rects) {
+                chosen = next;
             }
         }
 
-        // Set the latest successful size
-        if (!failed_to_pack) {
-            last_successful_width = packer->result.last_image_width;
-            last_successful_height = packer->result.last_image_height;
-
-            unsigned int area_percentage_difference = last_successful_width * last_successful_height * 100 / rects_area;
-
-            // Don't look further if the difference between the rects' area and the image area is low enough
-            if (area_percentage_difference < 100 + JAPACKER_TOLERABLE_AREA_DIFFERENCE_PERCENTAGE) {
-                return;
+        if (chosen < 0) {
+            chosen = largest;
+            if (tried != largest) {
+                packed = japacker_pack_bin_image(data, data->pending_rects, num_pending_rects, &bins[largest],
+                    image_index, allow_rotation, 0);
             }
         }
 
-        // Reduce the deltas
-        delta_width /= 2;
-        delta_height /= 2;
+        image_bins[image_index] = (unsigned int) chosen;
+        data->image_sizes[image_index * 2] = bins[chosen].width;
+        data->image_sizes[image_index * 2 + 1] = bins[chosen].height;
+        data->num_image_sizes = image_index + 1;
+        packer->result.images_needed++;
+        packed_rects += (int) packed;
+
+        // The rects that didn't fit wait for the next image, still in sorted order
+        unsigned int num_failed_rects = 0;
+        for (unsigned int i = 0; i < num_pending_rects; i++) {
+            japacker_rect *rect = data->pending_rects[i];
+            if (rect->output.packed) {
+                pending_area -= (double) rect->input.width * rect->input.height;
+            } else {
+                data->pending_rects[num_failed_rects++] = rect;
+            }
+        }
+        num_pending_rects = num_failed_rects;
     }
 
-    // Reset to the latest successful packing if the final attempts failed
-    if (last_successful_width != packer->result.last_image_width) {
-        packer->result.last_image_width = last_successful_width;
-        packer->result.last_image_height = last_successful_height;
+    // The empty areas don't have the size set in japacker_init(), so rects can't be added to the last image
+    data->current_image = -1;
 
-        japacker_reset_empty_areas(data, packer->result.last_image_width, packer->result.last_image_height);
+    packer->result.last_image_width = data->image_width;
+    packer->result.last_image_height = data->image_height;
+    if (!packer->result.images_needed) {
+        return packed_rects;
+    }
+
+    unsigned int image_index = packer->result.images_needed - 1;
+    const japacker_bin *last_bin = &bins[image_bins[image_index]];
+    packer->result.last_image_width = last_bin->width;
+    packer->result.last_image_height = last_bin->height;
 
+    // The reduction starts from the size of the destination image, which is the size of the last bin meanwhile
+    if (packer->options.reduce_image_size == 1) {
+        japacker_area area_used_in_last_image = 0;
         for (unsigned int i = 0; i < data->num_rects; i++) {
-            // Only repack the rects for the last image
-            if (data->sorted_rects[i]->output.image_index != image_index) {
-                continue;
+            const japacker_rect *rect = &packer->rects[i];
+            if (rect->output.packed && rect->output.image_index == (int) image_index) {
+                area_used_in_last_image += (japacker_area) rect->input.width * rect->input.height;
             }
-            japacker_pack_rect(data, data->sorted_rects[i], packer->options.allow_rotation);
+        }
+
+        unsigned int image_width = data->image_width;
+        unsigned int image_height = data->image_height;
+        data->image_width = last_bin->width;
+        data->image_height = last_bin->height;
+        int result = japacker_reduce_last_image_size(packer, area_used_in_last_image);
+        data->image_width = image_width;
+        data->image_height = image_height;
+
+        if (result != JAPACKER_OK) {
+            return JAPACKER_ERROR_NO_MEMORY;
         }
     }
+
+    return packed_rects;
 }
 
+JAPACKER_DECL int japacker_pack_batch(japacker_job *jobs, unsigned int num_jobs, unsigned int num_threads)
+{
+    if (!jobs || !num_jobs) {
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
+    }
+
+    japacker_batch_context context;
+    context.jobs = jobs;
+    context.queue.function = 0;
+    context.queue.context = 0;
+    context.queue.num_tasks = num_jobs;
+    context.queue.next_task = 0;
+    context.queue.has_lock = 0;
+
+    // Each task is a worker that takes jobs from the batch queue, so that it can keep its memory between jobs
+    unsigned int num_workers = num_threads > 1 ? num_threads : 1;
+    if (num_workers > num_jobs) {
+        num_workers = num_jobs;
+    }
 
+    // Without a lock the jobs can't be shared, so a single worker packs them all
+    if (num_workers > 1 && !japacker_init_task_lock(&context.queue)) {
+        num_workers = 1;
+    }
 
-/***********************************************************************************************************************
- * Public functions' implementation
- **********************************************************************************************************************/
+    japacker_run_tasks(japacker_batch_worker, &context, num_workers, num_workers);
 
-JAPACKER_DECL int japacker_init(japacker_t *packer, unsigned int num_rectangles,
-    unsigned int width, unsigned int height)
+    japacker_destroy_task_lock(&context.queue);
+
+    return JAPACKER_OK;
+}
+
+JAPACKER_DECL int japacker_get_stats(const japacker_t *packer, japacker_stats *stats)
 {
-    // Clear all memory
-    memset(packer, 0, sizeof(japacker_t));
+#ifdef JAPACKER_STATS
+    *stats = packer->internal_data->stats;
+    return JAPACKER_OK;
+#else
+    (void) packer;
+    memset(stats, 0, sizeof(japacker_stats));
+    return JAPACKER_ERROR_WRONG_PARAMETERS;
+#endif
+}
 
-    // Create the internal data
-    japacker_internal_data *data = (japacker_internal_data *) malloc(sizeof(japacker_internal_data));
+JAPACKER_DECL unsigned int japacker_get_dst_offset(const japacker_t *packer, const japacker_rect *rect,
+    unsigned int x, unsigned int y)
+{
+    int dst_width = (int) japacker_get_image_width(packer, rect->output.image_index);
+    if (rect->output.rotated == 0) {
+        return (y + rect->output.y) * dst_width + rect->output.x + x;
+    } else {
+        return (rect->output.y + rect->input.width - 1) * dst_width + y + rect->output.x - x * dst_width;
+    }
+}
 
-    if (!data) {
-        return JAPACKER_ERROR_NO_MEMORY;
+JAPACKER_DECL unsigned long long japacker_get_input_hash(const japacker_t *packer)
+{
+    const japacker_internal_data *data = packer->internal_data;
+    unsigned long long hash = JAPACKER_HASH_BASIS;
+
+    hash = japacker_hash_value(hash, JAPACKER_LAYOUT_VERSION);
+    hash = japacker_hash_value(hash, data->image_width);
+    hash = japacker_hash_value(hash, data->image_height);
+    hash = japacker_hash_value(hash, data->num_rects);
+
+    // Only the options that can change where the rects go are taken into account
+    hash = japacker_hash_value(hash, packer->options.allow_rotation != 0);
+    // Sorting sets options.rects_are_sorted to 1 so that the same order is used again, so only the order of the rects
+    // themselves, which is used if it was set beforehand, changes the layout
+    hash = japacker_hash_value(hash, packer->options.rects_are_sorted == 1 &&
+        (data->num_sorted_rects != data->num_rects || !data->sorted_by_packer));
+    hash = japacker_hash_value(hash, packer->options.reduce_image_size == 1);
+    hash = japacker_hash_value(hash, packer->options.sort_by);
+    hash = japacker_hash_value(hash, packer->options.algorithm);
+    hash = japacker_hash_value(hash, packer->options.sort_by_key == 1);
+    hash = japacker_hash_value(hash, packer->options.fail_policy);
+    hash = japacker_hash_value(hash, packer->options.group_identical_rects == 1);
+    hash = japacker_hash_value(hash, packer->options.reduce_candidates);
+    hash = japacker_hash_value(hash, packer->options.reduce_to_power_of_two == 1);
+    hash = japacker_hash_value(hash, packer->options.reduce_size_multiple);
+    hash = japacker_hash_value(hash, packer->options.reduce_separately == 1);
+    hash = japacker_hash_value(hash, packer->options.padding);
+    hash = japacker_hash_value(hash, packer->options.extrude);
+    hash = japacker_hash_value(hash, packer->options.align_x > 1 ? packer->options.align_x : 1);
+    hash = japacker_hash_value(hash, packer->options.align_y > 1 ? packer->options.align_y : 1);
+    hash = japacker_hash_value(hash, packer->options.placement);
+    hash = japacker_hash_value(hash, packer->options.placement == JAPACKER_PLACE_FIRST_FIT ? 0 :
+        packer->options.placement_window ? packer->options.placement_window : JAPACKER_PLACEMENT_WINDOW);
+
+    for (unsigned int i = 0; i < data->num_rects; i++) {
+        const japacker_rect *rect = &packer->rects[i];
+        hash = japacker_hash_value(hash, (unsigned long long) rect->input.width << 32 | rect->input.height);
+        if (packer->options.sort_by_key == 1) {
+            hash = japacker_hash_value(hash, rect->input.sort_key);
+        }
     }
 
-    memset(data, 0, sizeof(japacker_internal_data));
-    packer->internal_data = data;
+    return hash;
+}
 
-    // Create the structure with the rectangles
-    packer->rects = (japacker_rect *) malloc(sizeof(japacker_rect) * num_rectangles);
-    if (!packer->rects) {
-        return JAPACKER_ERROR_NO_MEMORY;
+JAPACKER_DECL size_t japacker_get_layout_size(const japacker_t *packer)
+{
+    const japacker_internal_data *data = packer->internal_data;
+    return sizeof(japacker_layout_header) + (size_t) data->num_rects * sizeof(japacker_layout_entry) +
+        (size_t) data->num_image_sizes * sizeof(japacker_layout_image_size);
+}
+
+JAPACKER_DECL int japacker_save_layout(const japacker_t *packer, void *buffer, size_t size)
+{
+    const japacker_internal_data *data = packer->internal_data;
+
+    if (!data || !buffer || size < japacker_get_layout_size(packer)) {
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
     }
-    memset(packer->rects, 0, sizeof(japacker_rect) * num_rectangles);
-    data->num_rects = num_rectangles;
-    data->image_width = width;
-    data->image_height = height;
 
-    // Create the structure with the empty areas
-    // Since a rect creates, at most, one new empty area, then the maximum possible number of empty areas
-    // is equal to the number of rects, plus one for the original image
-    unsigned int size = data->num_rects + 1;
-    data->empty_areas.list = (japacker_empty_area *) malloc(size * sizeof(japacker_empty_area));
-    if (!data->empty_areas.list) {
-        return JAPACKER_ERROR_NO_MEMORY;
+    unsigned long long hash = japacker_get_input_hash(packer);
+    japacker_layout_header *header = (japacker_layout_header *) buffer;
+    header->magic = JAPACKER_LAYOUT_MAGIC;
+    header->version = JAPACKER_LAYOUT_VERSION;
+    header->num_rects = data->num_rects;
+    header->images_needed = packer->result.images_needed;
+    header->image_width = data->image_width;
+    header->image_height = data->image_height;
+    header->last_image_width = packer->result.last_image_width;
+    header->last_image_height = packer->result.last_image_height;
+    header->input_hash_low = (uint32_t) hash;
+    header->input_hash_high = (uint32_t) (hash >> 32);
+    header->num_image_sizes = data->num_image_sizes;
+
+    japacker_layout_entry *entries = (japacker_layout_entry *) (header + 1);
+    for (unsigned int i = 0; i < data->num_rects; i++) {
+        const japacker_rect *rect = &packer->rects[i];
+        entries[i].x = rect->output.x;
+        entries[i].y = rect->output.y;
+        entries[i].image_index = rect->output.image_index;
+        entries[i].flags = (rect->output.packed ? 1 : 0) | (rect->output.rotated ? 2 : 0);
+    }
+
+    japacker_layout_image_size *image_sizes = (japacker_layout_image_size *) (entries + data->num_rects);
+    for (unsigned int i = 0; i < data->num_image_sizes; i++) {
+        image_sizes[i].width = data->image_sizes[i * 2];
+        image_sizes[i].height = data->image_sizes[i * 2 + 1];
     }
-    data->empty_areas.size = size;
 
     return JAPACKER_OK;
 }
 
-JAPACKER_DECL void japacker_resize_image(japacker_t *packer, unsigned int image_width, unsigned int image_height)
+JAPACKER_DECL const japacker_layout_header *japacker_get_layout_header(const void *buffer, size_t size)
 {
-    packer->internal_data->image_width = image_width;
-    packer->internal_data->image_height = image_height;
+    const japacker_layout_header *header = (const japacker_layout_header *) buffer;
+
+    if (!buffer || size < sizeof(japacker_layout_header) || header->magic != JAPACKER_LAYOUT_MAGIC ||
+        header->version != JAPACKER_LAYOUT_VERSION ||
+        (size - sizeof(japacker_layout_header)) / sizeof(japacker_layout_entry) < header->num_rects) {
+        return 0;
+    }
+    size -= sizeof(japacker_layout_header) + (size_t) header->num_rects * sizeof(japacker_layout_entry);
+    if (size / sizeof(japacker_layout_image_size) < header->num_image_sizes) {
+        return 0;
+    }
+    return header;
 }
 
-JAPACKER_DECL int japacker_pack(japacker_t *packer)
+JAPACKER_DECL int japacker_load_layout(japacker_t *packer, const void *buffer, size_t size)
 {
     japacker_internal_data *data = packer->internal_data;
+    const japacker_layout_header *header = japacker_get_layout_header(buffer, size);
 
-    // Make sure the struct was properly initialized
-    if (!data->num_rects || !data->image_width || !data->image_height ||
-        !packer->rects || data->empty_areas.size != data->num_rects + 1) {
+    if (!data || !header || header->num_rects != data->num_rects) {
         return JAPACKER_ERROR_WRONG_PARAMETERS;
     }
 
-    // Sort the rects if needed
-    if (packer->options.rects_are_sorted != 1 || !data->sorted_rects) {
-        if (!japacker_sort_rects(packer)) {
-            return JAPACKER_ERROR_NO_MEMORY;
+    unsigned long long hash = japacker_get_input_hash(packer);
+    if (header->input_hash_low != (uint32_t) hash || header->input_hash_high != (uint32_t) (hash >> 32)) {
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
+    }
+
+    // Every packed rect must be inside its image, so a corrupted layout can't make japacker_blit() write out of bounds
+    const japacker_layout_entry *entries = (const japacker_layout_entry *) (header + 1);
+    const japacker_layout_image_size *image_sizes = (const japacker_layout_image_size *) (entries + header->num_rects);
+    if (header->num_image_sizes && header->num_image_sizes != header->images_needed) {
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
+    }
+    unsigned int last_image = header->images_needed - 1;
+    if (header->images_needed && (header->num_image_sizes ?
+        header->last_image_width > image_sizes[last_image].width ||
+        header->last_image_height > image_sizes[last_image].height :
+        header->last_image_width > data->image_width || header->last_image_height > data->image_height)) {
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
+    }
+    for (unsigned int i = 0; i < data->num_rects; i++) {
+        const japacker_layout_entry *entry = &entries[i];
+        if (!(entry->flags & 1)) {
+            continue;
+        }
+        if (entry->image_index < 0 || (uint32_t) entry->image_index >= header->images_needed) {
+            return JAPACKER_ERROR_WRONG_PARAMETERS;
+        }
+        unsigned long long image_width = data->image_width;
+        unsigned long long image_height = data->image_height;
+        if ((unsigned int) entry->image_index == last_image) {
+            image_width = header->last_image_width;
+            image_height = header->last_image_height;
+        } else if (header->num_image_sizes) {
+            image_width = image_sizes[entry->image_index].width;
+            image_height = image_sizes[entry->image_index].height;
+        }
+        const japacker_rect *rect = &packer->rects[i];
+        unsigned int width = entry->flags & 2 ? rect->input.height : rect->input.width;
+        unsigned int height = entry->flags & 2 ? rect->input.width : rect->input.height;
+        if ((unsigned long long) entry->x + width > image_width ||
+            (unsigned long long) entry->y + height > image_height) {
+            return JAPACKER_ERROR_WRONG_PARAMETERS;
         }
     }
 
-    // If we are forcing a full repack, we're effectively starting over, so we can't have existing images with rects
-    if (packer->options.always_repack) {
-        packer->result.images_needed = 0;
+    unsigned int *loaded_image_sizes = 0;
+    if (header->num_image_sizes) {
+        loaded_image_sizes = (unsigned int *) JAPACKER_MALLOC(header->num_image_sizes * 2 * sizeof(unsigned int));
+        if (!loaded_image_sizes) {
+            return JAPACKER_ERROR_NO_MEMORY;
+        }
+        for (unsigned int i = 0; i < header->num_image_sizes; i++) {
+            loaded_image_sizes[i * 2] = image_sizes[i].width;
+            loaded_image_sizes[i * 2 + 1] = image_sizes[i].height;
+        }
     }
 
-    // Whether we need to pack the remaining rects to a new image
-    int request_new_image;
+    japacker_cancel_pack(packer);
 
-    // The total number of rects we already packed
-    unsigned int packed_rects = 0;
+    for (unsigned int i = 0; i < data->num_rects; i++) {
+        japacker_rect *rect = &packer->rects[i];
+        rect->output.x = entries[i].x;
+        rect->output.y = entries[i].y;
+        rect->output.image_index = entries[i].image_index;
+        rect->output.packed = (entries[i].flags & 1) != 0;
+        rect->output.rotated = (entries[i].flags & 2) != 0;
+    }
+    packer->result.images_needed = header->images_needed;
+    packer->result.last_image_width = header->last_image_width;
+    packer->result.last_image_height = header->last_image_height;
+    JAPACKER_FREE(data->image_sizes);
+    data->image_sizes = loaded_image_sizes;
+    data->num_image_sizes = header->num_image_sizes;
 
-    // The area of the rectangles placed in this image
-    unsigned int area_used_in_last_image;
+    // The empty areas belong to whatever was packed before, so they can't be used with the loaded layout
+    data->current_image = -1;
 
-    do {
-        // When we're on a new image, the whole image is a single empty area
-        japacker_reset_empty_areas(data, data->image_width, data->image_height);
+    return JAPACKER_OK;
+}
 
-        request_new_image = 0;
-        area_used_in_last_image = 0;
+JAPACKER_DECL int japacker_blit(const japacker_t *packer, const japacker_rect *rect, const void *src,
+    size_t src_stride, void *dst, size_t dst_stride, unsigned int bytes_per_pixel)
+{
+    if (!packer->internal_data || !rect->output.packed || !src || !dst || !bytes_per_pixel) {
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
+    }
 
-        for (unsigned int i = 0; i < data->num_rects; i++) {
-            japacker_rect *rect = data->sorted_rects[i];
+    unsigned int width = rect->input.width;
+    unsigned int height = rect->input.height;
 
-            // We may have already processed some rects in previous images,
-            // therefore we only pack the rects that haven't been packed yet
-            if (rect->output.packed && (packer->options.always_repack != 1 || packer->result.images_needed != 0)) {
-                continue;
-            }
+    if (!src_stride) {
+        src_stride = (size_t) width * bytes_per_pixel;
+    }
+    if (!dst_stride) {
+        dst_stride = (size_t) japacker_get_image_width(packer, rect->output.image_index) * bytes_per_pixel;
+    }
 
-            // If we didn't skip a packed rect (likely because always_repack was set),
-            // then we must unset that it's packed
-            rect->output.packed = 0;
-
-            // Pack the rectangle. If packing fails, what happens depends on what setting the user chose
-            if (!japacker_pack_rect(data, rect, packer->options.allow_rotation)) {
-                // We can try to continue packing smaller rectangles to this image
-                if (packer->options.fail_policy == JAPACKER_CONTINUE) {
-                    continue;
-                // We can also keep packing, but pack the ones that didn't fit to a new image
-                } else if (packer->options.fail_policy == JAPACKER_NEW_IMAGE) {
-                    request_new_image = 1;
-                // Or, by default, we can immediately stop packing
-                } else {
-                    return i;
-                }
+    const unsigned char *src_pixels = (const unsigned char *) src;
+    unsigned char *dst_pixels = (unsigned char *) dst + rect->output.y * dst_stride +
+        (size_t) rect->output.x * bytes_per_pixel;
 
-                // If this is a new image and the rectangle doesn't fit, it won't fit anywhere so we need to quit
-                if (data->empty_areas.first->width == data->image_width &&
-                    data->empty_areas.first->height == data->image_height) {
-                    packer->result.images_needed--;
-                    return packed_rects;
-                }
-            } else {
-                rect->output.image_index = packer->result.images_needed;
-                rect->output.packed = 1;
-                area_used_in_last_image += rect->input.width * rect->input.height;
-                packed_rects++;
+    // Without rotation, every row is contiguous in both images
+    if (!rect->output.rotated) {
+        size_t row_size = (size_t) width * bytes_per_pixel;
+        for (unsigned int y = 0; y < height; y++) {
+            memcpy(dst_pixels + y * dst_stride, src_pixels + y * src_stride, row_size);
+        }
+    } else {
+        // Each band of source columns becomes a band of destination rows, which is walked down one tile at a time
+        for (unsigned int x = 0; x < width; x += JAPACKER_BLIT_TILE) {
+            unsigned int tile_width = width - x < JAPACKER_BLIT_TILE ? width - x : JAPACKER_BLIT_TILE;
+            for (unsigned int y = 0; y < height; y += JAPACKER_BLIT_TILE) {
+                unsigned int tile_height = height - y < JAPACKER_BLIT_TILE ? height - y : JAPACKER_BLIT_TILE;
+                japacker_blit_rotated_tile(src_pixels, src_stride, dst_pixels, dst_stride, width, x, y, tile_width,
+                    tile_height, bytes_per_pixel);
             }
         }
+    }
 
-        // We used a new image, so we increase its count
-        packer->result.images_needed++;
-
-    // If a new image was requested, we loop back to the top
-    } while (request_new_image);
-
-    // Set the last image's width and height to the size of the destination image as default
-    // These values can be changed if japacker_reduce_last_image_size() is called
-    packer->result.last_image_width = data->image_width;
-    packer->result.last_image_height = data->image_height;
-
-    // Try to reduce the last image's size if asked to
-    if (packer->options.reduce_image_size == 1) {
-        japacker_reduce_last_image_size(packer, area_used_in_last_image);
+    if (packer->internal_data->spacing.margin) {
+        japacker_extrude_rect(dst_pixels, dst_stride, rect->output.rotated ? height : width,
+            rect->output.rotated ? width : height, packer->internal_data->spacing.margin, bytes_per_pixel);
     }
 
-    return packed_rects;
+    return JAPACKER_OK;
 }
 
-JAPACKER_DECL unsigned int japacker_get_dst_offset(const japacker_t *packer, const japacker_rect *rect,
-    unsigned int x, unsigned int y)
+JAPACKER_DECL int japacker_blit_image(const japacker_t *packer, int image_index, const void *const *sources,
+    const size_t *source_strides, void *dst, size_t dst_stride, unsigned int bytes_per_pixel)
 {
-    int dst_width;
-    if (packer->options.reduce_image_size == 1 && rect->output.image_index == packer->result.images_needed - 1) {
-        dst_width = packer->result.last_image_width;
-    } else {
-        dst_width = packer->internal_data->image_width;
-    }
-    if (rect->output.rotated == 0) {
-        return (y + rect->output.y) * dst_width + rect->output.x + x;
-    } else {
-        return (rect->output.y + rect->input.width - 1) * dst_width + y + rect->output.x - x * dst_width;
+    if (!packer->internal_data || image_index < 0 || !sources || !dst || !bytes_per_pixel) {
+        return JAPACKER_ERROR_WRONG_PARAMETERS;
     }
+
+    japacker_blit_context context;
+    context.packer = packer;
+    context.image_index = image_index;
+    context.sources = sources;
+    context.source_strides = source_strides;
+    context.dst = dst;
+    context.dst_stride = dst_stride ? dst_stride :
+        (size_t) japacker_get_image_width(packer, image_index) * bytes_per_pixel;
+    context.bytes_per_pixel = bytes_per_pixel;
+
+    japacker_run_tasks(japacker_blit_task, &context, packer->internal_data->num_rects, packer->options.num_threads);
+
+    return JAPACKER_OK;
 }
 
 JAPACKER_DECL void japacker_free(japacker_t *packer)
 {
-    free(packer->internal_data->empty_areas.list);
-    free(packer->internal_data->sorted_rects);
-    free(packer->internal_data);
+    japacker_internal_data *data = packer->internal_data;
+
+    japacker_cancel_pack(packer);
+    JAPACKER_FREE(data->image_sizes);
+
+    // The memory given by the user is released by the user
+    if (data->owns_memory) {
+        japacker_free_empty_areas(data);
+        JAPACKER_FREE(data->sorted_rects);
+        JAPACKER_FREE(data->pending_rects);
+        JAPACKER_FREE(data->sort_keys);
+        JAPACKER_FREE(data->free_rects);
+        if (data->owns_rects) {
+            JAPACKER_FREE(packer->rects);
+        }
+        JAPACKER_FREE(data);
+    }
     packer->internal_data = 0;
+    packer->rects = 0;
 }
 
 #ifdef __cplusplus
@@ -0,0 +1,242 @@
+/**********************************************************************************************************************
+
+japacker.hpp - C++ front-end for japacker.h
+
+This is an optional, header-only C++17 wrapper around the C API in japacker.h, which remains the reference
+implementation: every pack still goes through japacker_pack(), so both give the exact same results.
+
+The wrapper takes the sizes of the rects from an array and writes the placements to another one, so the caller never
+needs to deal with japacker_rect. To do so, each pack copies every size into the rects of the C packer and every
+output back into the placements, which is two passes over the rects on top of packing them. If that matters, use
+japacker_init_with_rects() to pack an array of japacker_rect in place instead. The memory used by the packer is kept
+between packs, so packing the same number of rects again doesn't allocate.
+
+***********************************************************************************************************************
+
+Example usage:
+
+// 1. Create the packer, choosing how to sort the rects and whether they can be rotated
+japacker::packer packer(ATLAS_WIDTH, ATLAS_HEIGHT, JAPACKER_SORT_BY_AREA, true);
+
+// 2. Set any other options
+packer.options().fail_policy = JAPACKER_NEW_IMAGE;
+
+// 3. Pack the sizes, getting a placement for each of them, in the same order
+std::vector<japacker::size> sizes = get_all_image_dimensions();
+std::vector<japacker::placement> placements(sizes.size());
+int result = packer.pack(sizes.data(), sizes.size(), placements.data());
+
+// 4. Just like japacker_pack(), pack() returns a number below JAPACKER_OK on error,
+//    or the number of packed rects on success
+if (result < JAPACKER_OK) {
+    printf("There was an error packing the images.\n");
+    return;
+}
+
+// 5. Draw the images
+for (std::size_t i = 0; i < placements.size(); i++) {
+    if (placements[i].packed) {
+        draw_to_image(dst_image, get_single_image(i), placements[i].x, placements[i].y, placements[i].rotated);
+    }
+}
+
+***********************************************************************************************************************
+
+This is free and unencumbered software released into the public domain. Please refer to japacker.h for details.
+
+**********************************************************************************************************************/
+
+#ifndef JAPACKER_HPP
+#define JAPACKER_HPP
+
+#include "japacker.h"
+
+#include <climits>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#if __cplusplus >= 202002L && defined (__has_include)
+#if __has_include(<span>)
+#include <span>
+#define JAPACKER_HAS_SPAN
+#endif
+#endif
+
+namespace japacker {
+
+/**
+ * @brief The size of a rectangle to pack.
+ */
+struct size {
+
+    unsigned int width;  /**< The width of the rectangle to be packed. */
+
+    unsigned int height; /**< The height of the rectangle to be packed. */
+
+};
+
+/**
+ * @brief Where a rectangle was packed.
+ *
+ * Please refer to the output struct of japacker_rect for the meaning of each variable.
+ */
+struct placement {
+
+    unsigned int x;  /**< The x position of the packed rectangle in the target image. */
+
+    unsigned int y;  /**< The y position of the packed rectangle in the target image. */
+
+    int image_index; /**< The index of the image the rectangle was packed to. */
+
+    bool packed;     /**< Whether this rectangle was packed. */
+
+    bool rotated;    /**< Whether the rectangle was rotated to fit. */
+
+};
+
+/**
+ * @brief Packs rectangles using japacker.
+ */
+class packer {
+
+public:
+
+    using options_type = decltype(japacker_t::options); /**< The options of the C packer. */
+
+    using result_type = decltype(japacker_t::result);   /**< The results of the C packer. */
+
+    /**
+     * @brief Creates a packer for images of the given size. No memory is allocated until the first pack.
+     *
+     * @param width The width of the destination image.
+     * @param height The height of the destination image.
+     * @param sort_by How to sort the rects and empty areas, as in options.sort_by.
+     * @param allow_rotation Whether to allow rectangles to be rotated if they don't fit normally.
+     */
+    packer(unsigned int width, unsigned int height, japacker_sort_type sort_by = JAPACKER_SORT_BY_PERIMETER,
+        bool allow_rotation = false) : width_(width), height_(height), options_(), c_packer_()
+    {
+        options_.sort_by = sort_by;
+        options_.allow_rotation = allow_rotation ? 1 : 0;
+    }
+
+    packer(const packer &) = delete;
+    packer &operator=(const packer &) = delete;
+    packer(packer &&) = default;
+    packer &operator=(packer &&) = default;
+
+    /**
+     * @brief The options used by the next pack.
+     *
+     * options.sort_by and options.allow_rotation start with the values given to the constructor, and
+     * options.rects_are_sorted is ignored, since the wrapper always passes the rects in the caller's order.
+     *
+     * @return The options.
+     */
+    options_type &options()
+    {
+        return options_;
+    }
+
+    /**
+     * @brief The results of the last pack, such as the number of images needed.
+     *
+     * @return The results.
+     */
+    const result_type &result() const
+    {
+        return c_packer_.result;
+    }
+
+    /**
+     * @brief Packs the rectangles.
+     *
+     * The sizes are copied into the rects of the C packer, and their outputs are copied to the placements once packed.
+     *
+     * @param sizes The sizes of the rectangles to pack.
+     * @param count The number of rectangles.
+     * @param placements Where to write the placement of each rectangle, in the same order as the sizes. It must have
+     *                   room for count placements.
+     * @return The number of packed rects, or a japacker_error_type value below JAPACKER_OK on error.
+     */
+    int pack(const size *sizes, std::size_t count, placement *placements)
+    {
+        if (!sizes || !placements || !count || count > UINT_MAX) {
+            return JAPACKER_ERROR_WRONG_PARAMETERS;
+        }
+
+        unsigned int num_rects = static_cast<unsigned int>(count);
+        std::size_t required = japacker_required_memory(num_rects);
+        if (memory_.size() < required) {
+            try {
+                memory_.resize(required);
+            } catch (const std::bad_alloc &) {
+                return JAPACKER_ERROR_NO_MEMORY;
+            }
+        }
+
+        int error = japacker_init_with_memory(&c_packer_, num_rects, width_, height_, memory_.data(), memory_.size());
+        if (error != JAPACKER_OK) {
+            return error;
+        }
+
+        c_packer_.options = options_;
+        c_packer_.options.rects_are_sorted = 0;
+
+        for (unsigned int i = 0; i < num_rects; i++) {
+            c_packer_.rects[i].input.width = sizes[i].width;
+            c_packer_.rects[i].input.height = sizes[i].height;
+        }
+
+        int result = japacker_pack(&c_packer_);
+        if (result < JAPACKER_OK) {
+            return result;
+        }
+
+        for (unsigned int i = 0; i < num_rects; i++) {
+            const japacker_rect &rect = c_packer_.rects[i];
+            placements[i].x = rect.output.x;
+            placements[i].y = rect.output.y;
+            placements[i].image_index = rect.output.image_index;
+            placements[i].packed = rect.output.packed != 0;
+            placements[i].rotated = rect.output.rotated != 0;
+        }
+
+        return result;
+    }
+
+#ifdef JAPACKER_HAS_SPAN
+    /**
+     * @brief Packs the rectangles.
+     *
+     * @param sizes The sizes of the rectangles to pack.
+     * @param placements Where to write the placement of each rectangle. It must be at least as large as sizes.
+     * @return The number of packed rects, or a japacker_error_type value below JAPACKER_OK on error.
+     */
+    int pack(std::span<const size> sizes, std::span<placement> placements)
+    {
+        if (placements.size() < sizes.size()) {
+            return JAPACKER_ERROR_WRONG_PARAMETERS;
+        }
+        return pack(sizes.data(), sizes.size(), placements.data());
+    }
+#endif
+
+private:
+
+    unsigned int width_;                /**< The width of the destination image. */
+
+    unsigned int height_;               /**< The height of the destination image. */
+
+    options_type options_;              /**< The options set by the user. */
+
+    japacker_t c_packer_;               /**< The C packer, whose memory is kept in memory_. */
+
+    std::vector<unsigned char> memory_; /**< The memory block used by the C packer, kept between packs. */
+
+};
+
+} // namespace japacker
+
+#endif // JAPACKER_HPP
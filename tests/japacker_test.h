@@ -0,0 +1,222 @@
+/*
+ * Japacker tests
+ *
+ * The helpers shared by every test program. Each program checks the behaviour of a feature and returns 1 if any check
+ * failed, printing where it failed.
+ */
+
+#ifndef JAPACKER_TEST_H
+#define JAPACKER_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "japacker.h"
+
+static unsigned int test_failures;
+
+/**
+ * Checks a condition, printing it and counting a failure if it's false, without stopping the test.
+ */
+#define TEST_CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            test_failures++; \
+        } \
+    } while (0)
+
+/**
+ * @brief A small random number generator, so every test uses the same rects on every platform.
+ */
+typedef struct test_random {
+    unsigned long long state;
+} test_random;
+
+/**
+ * @brief Gets a random number between min and max, both included.
+ */
+static unsigned int test_random_range(test_random *random, unsigned int min, unsigned int max)
+{
+    // splitmix64
+    unsigned long long z = (random->state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return min + (unsigned int) ((z ^ (z >> 31)) >> 32) % (max - min + 1);
+}
+
+/**
+ * @brief Sets the size of every rect of a packer to a random size between min_size and max_size.
+ */
+static void test_fill_rects(japacker_t *packer, unsigned int num_rects, unsigned long long seed, unsigned int min_size,
+    unsigned int max_size)
+{
+    test_random random;
+    random.state = seed;
+    for (unsigned int i = 0; i < num_rects; i++) {
+        packer->rects[i].input.width = test_random_range(&random, min_size, max_size);
+        packer->rects[i].input.height = test_random_range(&random, min_size, max_size);
+    }
+}
+
+/**
+ * @brief Inits a packer with random rects between 1 and 48 pixels wide and high, packed to as many images as needed.
+ *
+ * @return 1 on success, 0 if the packer couldn't be created.
+ */
+static int test_init_random_packer(japacker_t *packer, unsigned int num_rects, unsigned int image_size,
+    unsigned long long seed)
+{
+    if (japacker_init(packer, num_rects, image_size, image_size) != JAPACKER_OK) {
+        return 0;
+    }
+    packer->options.fail_policy = JAPACKER_NEW_IMAGE;
+    test_fill_rects(packer, num_rects, seed, 1, 48);
+    return 1;
+}
+
+/**
+ * @brief Gets the size a packed rect takes in its image, taking rotation into account.
+ */
+static void test_get_packed_size(const japacker_rect *rect, unsigned int *width, unsigned int *height)
+{
+    *width = rect->output.rotated ? rect->input.height : rect->input.width;
+    *height = rect->output.rotated ? rect->input.width : rect->input.height;
+}
+
+/**
+ * @brief Checks that every packed rect is inside its image and that no two packed rects of an image overlap, with
+ * the spacing the options ask for.
+ *
+ * Every rect must leave options.extrude pixels around it, also at the borders of the image, its position minus
+ * options.extrude must be a multiple of options.align_x and options.align_y, and the extruded rects must be at least
+ * options.padding pixels apart, either horizontally or vertically.
+ *
+ * @param packer The packer whose layout is checked.
+ * @param num_rects The number of rects in packer->rects.
+ * @param image_sizes The width and height of each image, or 0 if every image has the size of the destination image
+ *                    and only the last one may be reduced.
+ * @return 1 if the layout is valid, 0 if not.
+ */
+static int test_layout_is_valid(const japacker_t *packer, unsigned int num_rects, const unsigned int *image_sizes)
+{
+    unsigned int extrude = packer->options.extrude;
+    unsigned int padding = packer->options.padding;
+    unsigned int align_x = packer->options.align_x ? packer->options.align_x : 1;
+    unsigned int align_y = packer->options.align_y ? packer->options.align_y : 1;
+
+    for (unsigned int i = 0; i < num_rects; i++) {
+        const japacker_rect *rect = &packer->rects[i];
+        if (!rect->output.packed) {
+            continue;
+        }
+        int image = rect->output.image_index;
+        if (image < 0 || (unsigned int) image >= packer->result.images_needed) {
+            return 0;
+        }
+
+        unsigned int image_width = packer->internal_data->image_width;
+        unsigned int image_height = packer->internal_data->image_height;
+        if (image_sizes) {
+            image_width = image_sizes[image * 2];
+            image_height = image_sizes[image * 2 + 1];
+        } else if (packer->options.reduce_image_size == 1 && (unsigned int) image == packer->result.images_needed - 1) {
+            image_width = packer->result.last_image_width;
+            image_height = packer->result.last_image_height;
+        }
+
+        // The extruded rect, which is what must fit in the image and stay away from the other rects
+        unsigned int width, height;
+        test_get_packed_size(rect, &width, &height);
+        if (rect->output.x < extrude || rect->output.y < extrude) {
+            return 0;
+        }
+        unsigned int x = rect->output.x - extrude;
+        unsigned int y = rect->output.y - extrude;
+        width += 2 * extrude;
+        height += 2 * extrude;
+        if (x + width > image_width || y + height > image_height || x % align_x || y % align_y) {
+            return 0;
+        }
+
+        for (unsigned int j = i + 1; j < num_rects; j++) {
+            const japacker_rect *other = &packer->rects[j];
+            if (!other->output.packed || other->output.image_index != image) {
+                continue;
+            }
+            unsigned int other_width, other_height;
+            test_get_packed_size(other, &other_width, &other_height);
+            if (other->output.x < extrude || other->output.y < extrude) {
+                return 0;
+            }
+            unsigned int other_x = other->output.x - extrude;
+            unsigned int other_y = other->output.y - extrude;
+            other_width += 2 * extrude;
+            other_height += 2 * extrude;
+            if (x < other_x + other_width + padding && other_x < x + width + padding &&
+                y < other_y + other_height + padding && other_y < y + height + padding) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Adds random rects one at a time to an empty packer, checking that each one is packed.
+ */
+static void test_add_random_rects(japacker_t *packer, unsigned int num_rects, int online)
+{
+    TEST_CHECK(japacker_init(packer, 0, 256, 256) == JAPACKER_OK);
+    packer->options.fail_policy = JAPACKER_NEW_IMAGE;
+    packer->options.online = online;
+
+    test_random random;
+    random.state = 10 + online;
+    for (unsigned int i = 0; i < num_rects; i++) {
+        unsigned int width = test_random_range(&random, 1, 40);
+        unsigned int height = test_random_range(&random, 1, 40);
+        int index = japacker_add_rect(packer, width, height);
+        TEST_CHECK(index == (int) i);
+        if (index >= 0) {
+            TEST_CHECK(packer->rects[index].output.packed);
+            TEST_CHECK(packer->rects[index].input.width == width && packer->rects[index].input.height == height);
+        }
+    }
+    TEST_CHECK(test_layout_is_valid(packer, num_rects, 0));
+}
+
+/**
+ * @brief Checks whether two lists of rects have the same output.
+ */
+static int test_same_layout(const japacker_rect *rects, const japacker_rect *other_rects, unsigned int num_rects)
+{
+    for (unsigned int i = 0; i < num_rects; i++) {
+        if (rects[i].output.packed != other_rects[i].output.packed ||
+            (rects[i].output.packed && (rects[i].output.x != other_rects[i].output.x ||
+            rects[i].output.y != other_rects[i].output.y ||
+            rects[i].output.rotated != other_rects[i].output.rotated ||
+            rects[i].output.image_index != other_rects[i].output.image_index))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Prints the result of a test program.
+ *
+ * @return The exit code of the program.
+ */
+static int test_finish(const char *name)
+{
+    if (test_failures) {
+        fprintf(stderr, "%s: %u checks failed\n", name, test_failures);
+        return 1;
+    }
+    printf("%s: all checks passed\n", name);
+    return 0;
+}
+
+#endif // JAPACKER_TEST_H
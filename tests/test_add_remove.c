@@ -0,0 +1,48 @@
+/*
+ * Tests of japacker_add_rect() and japacker_remove_rect().
+ */
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 300
+
+/**
+ * @brief Rects added one at a time are all packed without overlapping, and removed rects give their slot and space
+ * back.
+ */
+static void test_add_and_remove(void)
+{
+    for (int online = 0; online < 2; online++) {
+        japacker_t packer;
+        test_add_random_rects(&packer, TEST_NUM_RECTS, online);
+
+        // Find a rect of the current image, which gets its space back
+        int current_image = (int) packer.result.images_needed - 1;
+        unsigned int index = 0;
+        while (packer.rects[index].output.image_index != current_image) {
+            index++;
+        }
+        japacker_rect removed = packer.rects[index];
+
+        TEST_CHECK(japacker_remove_rect(&packer, index) == JAPACKER_OK);
+        TEST_CHECK(!packer.rects[index].output.packed);
+        TEST_CHECK(packer.rects[index].input.width == 0 && packer.rects[index].input.height == 0);
+        TEST_CHECK(japacker_remove_rect(&packer, TEST_NUM_RECTS) == JAPACKER_ERROR_WRONG_PARAMETERS);
+
+        // The slot is reused, and the same rect fits in the space it left
+        unsigned int images_needed = packer.result.images_needed;
+        TEST_CHECK(japacker_add_rect(&packer, removed.input.width, removed.input.height) == (int) index);
+        TEST_CHECK(packer.rects[index].output.packed);
+        TEST_CHECK(packer.rects[index].output.image_index == current_image);
+        TEST_CHECK(packer.result.images_needed == images_needed);
+        TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, 0));
+
+        japacker_free(&packer);
+    }
+}
+
+int main(void)
+{
+    test_add_and_remove();
+    return test_finish("test_add_remove");
+}
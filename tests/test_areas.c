@@ -0,0 +1,79 @@
+/*
+ * Tests of JAPACKER_64BIT_AREAS, which keeps the areas in 64 bits for images larger than 65535x65535.
+ */
+
+#define JAPACKER_64BIT_AREAS
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 300
+#define TEST_IMAGE_SIZE 100000
+
+static const japacker_search_type test_search_methods[] = {
+    JAPACKER_SEARCH_LIST, JAPACKER_SEARCH_TREE, JAPACKER_SEARCH_SCAN
+};
+
+#define TEST_NUM_SEARCH_METHODS (sizeof(test_search_methods) / sizeof(test_search_methods[0]))
+
+/**
+ * @brief Empty areas larger than 32 bits are sorted by their real area. Once a rect takes the top left quarter, the
+ * next rect goes in the smallest empty area, the one to its right. The one below it is twice as large, but its area
+ * would wrap around in 32 bits and look smaller.
+ */
+static void test_large_areas(void)
+{
+    for (unsigned int method = 0; method < TEST_NUM_SEARCH_METHODS; method++) {
+        japacker_t packer;
+        TEST_CHECK(japacker_init(&packer, 2, TEST_IMAGE_SIZE, TEST_IMAGE_SIZE) == JAPACKER_OK);
+        packer.options.sort_by = JAPACKER_SORT_BY_AREA;
+        packer.options.search_by = test_search_methods[method];
+        packer.rects[0].input.width = TEST_IMAGE_SIZE / 2;
+        packer.rects[0].input.height = TEST_IMAGE_SIZE / 2;
+        packer.rects[1].input.width = 10;
+        packer.rects[1].input.height = 10;
+
+        TEST_CHECK(japacker_pack(&packer) == 2);
+        TEST_CHECK(packer.rects[0].output.x == 0 && packer.rects[0].output.y == 0);
+        TEST_CHECK(packer.rects[1].output.x == TEST_IMAGE_SIZE / 2 && packer.rects[1].output.y == 0);
+        japacker_free(&packer);
+    }
+}
+
+/**
+ * @brief Every search method gives the same valid layout in a large image, with image size reduction on and off.
+ */
+static void test_pack(void)
+{
+    for (int reduce_image_size = 0; reduce_image_size < 2; reduce_image_size++) {
+        japacker_t list;
+        for (unsigned int method = 0; method < TEST_NUM_SEARCH_METHODS; method++) {
+            japacker_t packer;
+            TEST_CHECK(japacker_init(&packer, TEST_NUM_RECTS, TEST_IMAGE_SIZE, TEST_IMAGE_SIZE) == JAPACKER_OK);
+            packer.options.fail_policy = JAPACKER_NEW_IMAGE;
+            packer.options.search_by = test_search_methods[method];
+            packer.options.reduce_image_size = reduce_image_size;
+            packer.options.allow_rotation = 1;
+            test_fill_rects(&packer, TEST_NUM_RECTS, 100, 1, 30000);
+
+            TEST_CHECK(japacker_pack(&packer) == TEST_NUM_RECTS);
+            TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, 0));
+            if (!method) {
+                list = packer;
+                continue;
+            }
+            TEST_CHECK(packer.result.images_needed == list.result.images_needed);
+            TEST_CHECK(packer.result.last_image_width == list.result.last_image_width);
+            TEST_CHECK(packer.result.last_image_height == list.result.last_image_height);
+            TEST_CHECK(test_same_layout(packer.rects, list.rects, TEST_NUM_RECTS));
+            japacker_free(&packer);
+        }
+        japacker_free(&list);
+    }
+}
+
+int main(void)
+{
+    test_large_areas();
+    test_pack();
+    return test_finish("test_areas");
+}
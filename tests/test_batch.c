@@ -0,0 +1,69 @@
+/*
+ * Tests of japacker_pack_batch().
+ */
+
+#include "japacker_test.h"
+
+#define TEST_NUM_JOBS 12
+
+/**
+ * @brief Every job of a batch gets the same layout and results as packing it on its own with japacker_pack().
+ */
+static void test_batch(unsigned int num_threads)
+{
+    japacker_job jobs[TEST_NUM_JOBS];
+    japacker_rect *rects[TEST_NUM_JOBS];
+    memset(jobs, 0, sizeof(jobs));
+
+    for (unsigned int i = 0; i < TEST_NUM_JOBS; i++) {
+        // The jobs grow and shrink, so the memory of each worker is both grown and reused
+        unsigned int num_rects = 20 + (i % 4) * 150;
+        japacker_t packer;
+        TEST_CHECK(japacker_init(&packer, num_rects, 200, 200) == JAPACKER_OK);
+        test_fill_rects(&packer, num_rects, 100 + i, 1, 32);
+
+        rects[i] = (japacker_rect *) malloc(num_rects * sizeof(japacker_rect));
+        memcpy(rects[i], packer.rects, num_rects * sizeof(japacker_rect));
+        jobs[i].rects = rects[i];
+        jobs[i].num_rects = num_rects;
+        jobs[i].width = 200;
+        jobs[i].height = 200;
+        jobs[i].options.fail_policy = JAPACKER_NEW_IMAGE;
+        jobs[i].options.allow_rotation = i % 2;
+        jobs[i].options.reduce_image_size = i % 3 == 0;
+        // Ignored, since the rects are always packed from scratch
+        jobs[i].options.rects_are_sorted = 1;
+        japacker_free(&packer);
+    }
+
+    TEST_CHECK(japacker_pack_batch(jobs, TEST_NUM_JOBS, num_threads) == JAPACKER_OK);
+
+    for (unsigned int i = 0; i < TEST_NUM_JOBS; i++) {
+        japacker_t packer;
+        TEST_CHECK(japacker_init(&packer, jobs[i].num_rects, jobs[i].width, jobs[i].height) == JAPACKER_OK);
+        for (unsigned int j = 0; j < jobs[i].num_rects; j++) {
+            packer.rects[j].input = rects[i][j].input;
+        }
+        packer.options = jobs[i].options;
+        packer.options.rects_are_sorted = 0;
+        int packed = japacker_pack(&packer);
+
+        TEST_CHECK(jobs[i].packed_rects == packed);
+        TEST_CHECK(jobs[i].result.images_needed == packer.result.images_needed);
+        TEST_CHECK(jobs[i].result.last_image_width == packer.result.last_image_width);
+        TEST_CHECK(jobs[i].result.last_image_height == packer.result.last_image_height);
+        TEST_CHECK(test_same_layout(rects[i], packer.rects, jobs[i].num_rects));
+
+        japacker_free(&packer);
+        free(rects[i]);
+    }
+}
+
+int main(void)
+{
+    test_batch(1);
+    test_batch(4);
+
+    TEST_CHECK(japacker_pack_batch(0, 1, 1) == JAPACKER_ERROR_WRONG_PARAMETERS);
+    return test_finish("test_batch");
+}
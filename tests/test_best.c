@@ -0,0 +1,50 @@
+/*
+ * Tests of japacker_pack_best().
+ */
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 500
+
+/**
+ * @brief japacker_pack_best() gives a valid layout that's at least as good as every strategy it tries, and leaves the
+ * options of the winning strategy set.
+ */
+static void test_pack_best(void)
+{
+    for (unsigned int num_threads = 1; num_threads <= 4; num_threads += 3) {
+        japacker_t packer;
+        TEST_CHECK(test_init_random_packer(&packer, TEST_NUM_RECTS, 200, 2));
+        packer.options.allow_rotation = 1;
+        packer.options.num_threads = num_threads;
+
+        int packed = japacker_pack_best(&packer);
+        TEST_CHECK(packed == TEST_NUM_RECTS);
+        TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, 0));
+
+        for (int sort_by = 0; sort_by < 4; sort_by++) {
+            for (int allow_rotation = 0; allow_rotation < 2; allow_rotation++) {
+                japacker_t single;
+                TEST_CHECK(test_init_random_packer(&single, TEST_NUM_RECTS, 200, 2));
+                single.options.sort_by = (japacker_sort_type) sort_by;
+                single.options.allow_rotation = allow_rotation;
+                TEST_CHECK(japacker_pack(&single) <= packed);
+                TEST_CHECK(single.result.images_needed >= packer.result.images_needed);
+
+                // The winning strategy gives the exact same layout on its own
+                if (packer.options.sort_by == single.options.sort_by &&
+                    packer.options.allow_rotation == single.options.allow_rotation) {
+                    TEST_CHECK(test_same_layout(single.rects, packer.rects, TEST_NUM_RECTS));
+                }
+                japacker_free(&single);
+            }
+        }
+        japacker_free(&packer);
+    }
+}
+
+int main(void)
+{
+    test_pack_best();
+    return test_finish("test_best");
+}
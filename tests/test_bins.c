@@ -0,0 +1,133 @@
+/*
+ * Tests of japacker_pack_bins(), which packs each image to the cheapest of several bin sizes.
+ */
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 500
+
+/**
+ * @brief japacker_pack_bins() fills the large bin first, then puts the rest in the cheapest bin that holds it.
+ */
+static void test_pack_bins(void)
+{
+    japacker_bin bins[3] = { { 64, 64, 0 }, { 256, 256, 0 }, { 128, 128, 0 } };
+    unsigned int image_bins[16];
+
+    japacker_t packer;
+    TEST_CHECK(test_init_random_packer(&packer, TEST_NUM_RECTS, 1, 5));
+    // The larger rects don't fit in the smaller bin
+    packer.rects[0].input.width = 100;
+    packer.rects[0].input.height = 100;
+
+    int packed = japacker_pack_bins(&packer, bins, 3, image_bins, 16);
+    TEST_CHECK(packed == TEST_NUM_RECTS);
+    TEST_CHECK(packer.result.images_needed >= 2 && packer.result.images_needed <= 16);
+
+    unsigned int image_sizes[32];
+    for (unsigned int image = 0; image < packer.result.images_needed && image < 16; image++) {
+        TEST_CHECK(image_bins[image] < 3);
+        image_sizes[image * 2] = bins[image_bins[image]].width;
+        image_sizes[image * 2 + 1] = bins[image_bins[image]].height;
+        // Only the last image can be smaller than the largest bin
+        if (image + 1 < packer.result.images_needed) {
+            TEST_CHECK(image_bins[image] == 1);
+        }
+    }
+    TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, image_sizes));
+
+    // The images can be limited, leaving the rects that don't fit unpacked
+    packed = japacker_pack_bins(&packer, bins, 3, image_bins, 1);
+    TEST_CHECK(packed > 0 && packed < TEST_NUM_RECTS);
+    TEST_CHECK(packer.result.images_needed == 1 && image_bins[0] == 1);
+
+    TEST_CHECK(japacker_pack_bins(&packer, 0, 0, image_bins, 16) == JAPACKER_ERROR_WRONG_PARAMETERS);
+    japacker_free(&packer);
+}
+
+/**
+ * @brief The images of every bin leave the spacing the options ask for, up to the borders of each bin.
+ */
+static void test_pack_bins_spacing(void)
+{
+    japacker_bin bins[2] = { { 256, 256, 0 }, { 128, 64, 0 } };
+    unsigned int image_bins[16];
+
+    japacker_t packer;
+    TEST_CHECK(test_init_random_packer(&packer, TEST_NUM_RECTS, 1, 7));
+    packer.options.padding = 2;
+    packer.options.extrude = 1;
+    packer.options.align_x = 4;
+    TEST_CHECK(japacker_pack_bins(&packer, bins, 2, image_bins, 16) == TEST_NUM_RECTS);
+    TEST_CHECK(packer.result.images_needed > 1);
+
+    unsigned int image_sizes[32];
+    for (unsigned int image = 0; image < packer.result.images_needed && image < 16; image++) {
+        image_sizes[image * 2] = bins[image_bins[image]].width;
+        image_sizes[image * 2 + 1] = bins[image_bins[image]].height;
+    }
+    TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, image_sizes));
+    japacker_free(&packer);
+}
+
+/**
+ * @brief The size of every image packed by japacker_pack_bins() is saved with its layout and restored when it's
+ * loaded.
+ */
+static void test_bins_layout(void)
+{
+    japacker_bin bins[2] = { { 200, 200, 0 }, { 80, 60, 0 } };
+    unsigned int image_bins[16];
+
+    japacker_t packer;
+    TEST_CHECK(test_init_random_packer(&packer, TEST_NUM_RECTS, 1, 20));
+    packer.options.allow_rotation = 1;
+    TEST_CHECK(japacker_pack_bins(&packer, bins, 2, image_bins, 16) == TEST_NUM_RECTS);
+    TEST_CHECK(packer.result.images_needed > 1);
+
+    size_t size = japacker_get_layout_size(&packer);
+    uint32_t *buffer = (uint32_t *) malloc(size);
+    TEST_CHECK(japacker_save_layout(&packer, buffer, size) == JAPACKER_OK);
+
+    const japacker_layout_header *header = japacker_get_layout_header(buffer, size);
+    TEST_CHECK(header && header->num_image_sizes == packer.result.images_needed);
+    TEST_CHECK(japacker_get_layout_header(buffer, size - 1) == 0);
+    if (header) {
+        const japacker_layout_entry *entries = (const japacker_layout_entry *) (header + 1);
+        const japacker_layout_image_size *image_sizes = (const japacker_layout_image_size *) (entries + TEST_NUM_RECTS);
+        for (unsigned int i = 0; i < header->num_image_sizes && i < 16; i++) {
+            TEST_CHECK(image_sizes[i].width == bins[image_bins[i]].width);
+            TEST_CHECK(image_sizes[i].height == bins[image_bins[i]].height);
+        }
+    }
+
+    japacker_t loaded;
+    TEST_CHECK(test_init_random_packer(&loaded, TEST_NUM_RECTS, 1, 20));
+    loaded.options.allow_rotation = 1;
+    TEST_CHECK(japacker_load_layout(&loaded, buffer, size) == JAPACKER_OK);
+    TEST_CHECK(loaded.result.images_needed == packer.result.images_needed);
+    TEST_CHECK(test_same_layout(loaded.rects, packer.rects, TEST_NUM_RECTS));
+
+    // The destination offsets depend on the width of each image, so they only match if the sizes were restored
+    for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+        TEST_CHECK(japacker_get_dst_offset(&loaded, &loaded.rects[i], 1, 1) ==
+            japacker_get_dst_offset(&packer, &packer.rects[i], 1, 1));
+    }
+
+    // A layout with the sizes of fewer images than it uses isn't loaded
+    japacker_layout_header *changed_header = (japacker_layout_header *) buffer;
+    changed_header->num_image_sizes--;
+    TEST_CHECK(japacker_load_layout(&loaded, buffer, size) == JAPACKER_ERROR_WRONG_PARAMETERS);
+
+    free(buffer);
+    japacker_free(&packer);
+    japacker_free(&loaded);
+}
+
+int main(void)
+{
+    test_pack_bins();
+    test_pack_bins_spacing();
+    test_bins_layout();
+    return test_finish("test_bins");
+}
@@ -0,0 +1,95 @@
+/*
+ * Tests of japacker_get_dst_offset(), japacker_blit() and japacker_blit_image().
+ */
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 120
+
+/**
+ * @brief Gets the value of a source pixel, which is different for every pixel of every rect.
+ */
+static uint32_t test_get_pixel(unsigned int rect, unsigned int x, unsigned int y)
+{
+    return (uint32_t) (rect + 1) << 16 | y << 8 | x;
+}
+
+/**
+ * @brief Every pixel of every rect is copied to where japacker_get_dst_offset() says it goes, rotated rects included,
+ * and japacker_blit_image() gives the same image as blitting every rect on its own.
+ */
+static void test_blit(unsigned int num_threads)
+{
+    japacker_t packer;
+    TEST_CHECK(japacker_init(&packer, TEST_NUM_RECTS, 128, 128) == JAPACKER_OK);
+    packer.options.fail_policy = JAPACKER_NEW_IMAGE;
+    packer.options.allow_rotation = 1;
+    packer.options.reduce_image_size = 1;
+    packer.options.num_threads = num_threads;
+    test_fill_rects(&packer, TEST_NUM_RECTS, 30, 1, 40);
+    // Long rects, so that some of them are rotated
+    for (unsigned int i = 0; i < TEST_NUM_RECTS; i += 10) {
+        packer.rects[i].input.width = 127;
+        packer.rects[i].input.height = 3;
+    }
+    TEST_CHECK(japacker_pack(&packer) == TEST_NUM_RECTS);
+
+    uint32_t *sources[TEST_NUM_RECTS];
+    unsigned int num_rotated = 0;
+    for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+        const japacker_rect *rect = &packer.rects[i];
+        sources[i] = (uint32_t *) malloc(rect->input.width * rect->input.height * sizeof(uint32_t));
+        for (unsigned int y = 0; y < rect->input.height; y++) {
+            for (unsigned int x = 0; x < rect->input.width; x++) {
+                sources[i][y * rect->input.width + x] = test_get_pixel(i, x, y);
+            }
+        }
+        num_rotated += rect->output.rotated;
+    }
+    TEST_CHECK(num_rotated > 0);
+
+    size_t image_size = 128 * 128 * sizeof(uint32_t);
+    uint32_t *image = (uint32_t *) malloc(image_size);
+    uint32_t *other_image = (uint32_t *) malloc(image_size);
+
+    for (unsigned int image_index = 0; image_index < packer.result.images_needed; image_index++) {
+        memset(image, 0, image_size);
+        memset(other_image, 0, image_size);
+
+        for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+            const japacker_rect *rect = &packer.rects[i];
+            if (rect->output.image_index != (int) image_index) {
+                continue;
+            }
+            TEST_CHECK(japacker_blit(&packer, rect, sources[i], 0, image, 0, sizeof(uint32_t)) == JAPACKER_OK);
+            for (unsigned int y = 0; y < rect->input.height; y++) {
+                for (unsigned int x = 0; x < rect->input.width; x++) {
+                    TEST_CHECK(image[japacker_get_dst_offset(&packer, rect, x, y)] == test_get_pixel(i, x, y));
+                }
+            }
+        }
+
+        TEST_CHECK(japacker_blit_image(&packer, (int) image_index, (const void *const *) sources, 0, other_image, 0,
+            sizeof(uint32_t)) == JAPACKER_OK);
+        TEST_CHECK(!memcmp(image, other_image, image_size));
+    }
+
+    japacker_rect unpacked;
+    memset(&unpacked, 0, sizeof(unpacked));
+    TEST_CHECK(japacker_blit(&packer, &unpacked, sources[0], 0, image, 0, sizeof(uint32_t)) ==
+        JAPACKER_ERROR_WRONG_PARAMETERS);
+
+    for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+        free(sources[i]);
+    }
+    free(image);
+    free(other_image);
+    japacker_free(&packer);
+}
+
+int main(void)
+{
+    test_blit(1);
+    test_blit(4);
+    return test_finish("test_blit");
+}
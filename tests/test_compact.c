@@ -0,0 +1,124 @@
+/*
+ * Tests of japacker_compact(), which moves the rects of a packed atlas into the holes left between them.
+ */
+
+#include <stdlib.h>
+
+static unsigned int test_num_allocations;
+
+static void *test_malloc(size_t size)
+{
+    test_num_allocations++;
+    return malloc(size);
+}
+
+static void *test_realloc(void *pointer, size_t size)
+{
+    test_num_allocations++;
+    return realloc(pointer, size);
+}
+
+// Count the allocations, to check the functions that must not allocate
+#define JAPACKER_MALLOC(size) test_malloc(size)
+#define JAPACKER_REALLOC(pointer, size) test_realloc(pointer, size)
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 300
+
+/**
+ * @brief japacker_compact() moves at most the asked number of rects of the current image up or left, reporting every
+ * move, and keeps the layout valid.
+ */
+static void test_compact(void)
+{
+    japacker_t packer;
+    test_add_random_rects(&packer, TEST_NUM_RECTS, 0);
+
+    // Leave holes in the current image
+    int current_image = (int) packer.result.images_needed - 1;
+    for (unsigned int i = 0; i < TEST_NUM_RECTS; i += 2) {
+        if (packer.rects[i].output.image_index == current_image) {
+            TEST_CHECK(japacker_remove_rect(&packer, i) == JAPACKER_OK);
+        }
+    }
+
+    japacker_rect before[TEST_NUM_RECTS];
+    memcpy(before, packer.rects, sizeof(before));
+
+    japacker_relocation relocations[8];
+    int num_relocations = japacker_compact(&packer, relocations, 8);
+    TEST_CHECK(num_relocations > 0 && num_relocations <= 8);
+    TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, 0));
+
+    unsigned int num_moved = 0;
+    for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+        num_moved += packer.rects[i].output.x != before[i].output.x || packer.rects[i].output.y != before[i].output.y;
+    }
+    TEST_CHECK(num_moved == (unsigned int) num_relocations);
+
+    for (int i = 0; i < num_relocations && i < 8; i++) {
+        const japacker_relocation *relocation = &relocations[i];
+        const japacker_rect *rect = &packer.rects[relocation->index];
+        TEST_CHECK(rect->output.image_index == current_image);
+        TEST_CHECK(rect->output.rotated == before[relocation->index].output.rotated);
+        TEST_CHECK(relocation->old_x == before[relocation->index].output.x);
+        TEST_CHECK(relocation->old_y == before[relocation->index].output.y);
+        TEST_CHECK(relocation->new_x == rect->output.x && relocation->new_y == rect->output.y);
+        TEST_CHECK(relocation->new_y < relocation->old_y ||
+            (relocation->new_y == relocation->old_y && relocation->new_x < relocation->old_x));
+    }
+
+    TEST_CHECK(japacker_compact(&packer, relocations, 0) == 0);
+    japacker_free(&packer);
+}
+
+/**
+ * @brief japacker_compact() doesn't allocate memory, so it works on a packer in a memory block, and it always reports
+ * the moves it made, even when it runs out of room for empty areas.
+ */
+static void test_compact_with_memory(void)
+{
+    size_t memory_size = japacker_required_memory(TEST_NUM_RECTS);
+    void *memory = malloc(memory_size);
+
+    japacker_t packer;
+    TEST_CHECK(japacker_init_with_memory(&packer, TEST_NUM_RECTS, 256, 256, memory, memory_size) == JAPACKER_OK);
+    packer.options.fail_policy = JAPACKER_NEW_IMAGE;
+    test_fill_rects(&packer, TEST_NUM_RECTS, 12, 1, 40);
+    TEST_CHECK(japacker_pack(&packer) == TEST_NUM_RECTS);
+
+    int current_image = (int) packer.result.images_needed - 1;
+    for (unsigned int i = 0; i < TEST_NUM_RECTS; i += 2) {
+        if (packer.rects[i].output.image_index == current_image) {
+            TEST_CHECK(japacker_remove_rect(&packer, i) == JAPACKER_OK);
+        }
+    }
+
+    japacker_rect before[TEST_NUM_RECTS];
+    memcpy(before, packer.rects, sizeof(before));
+
+    unsigned int num_allocations = test_num_allocations;
+    japacker_relocation relocations[TEST_NUM_RECTS];
+    int num_relocations = japacker_compact(&packer, relocations, TEST_NUM_RECTS);
+    TEST_CHECK(test_num_allocations == num_allocations);
+    TEST_CHECK(num_relocations > 0);
+    TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, 0));
+
+    // Every rect that moved was reported, whether or not compacting stopped early
+    unsigned int num_moved = 0;
+    for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+        num_moved += packer.rects[i].output.x != before[i].output.x || packer.rects[i].output.y != before[i].output.y;
+    }
+    TEST_CHECK(num_relocations > 0 && num_moved == (unsigned int) num_relocations);
+
+    japacker_free(&packer);
+    free(memory);
+}
+
+int main(void)
+{
+    test_compact();
+    test_compact_with_memory();
+    return test_finish("test_compact");
+}
@@ -0,0 +1,119 @@
+/*
+ * Tests of japacker_estimate(), which bounds the images the rects need without packing them.
+ */
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 500
+
+/**
+ * @brief The lower bounds of japacker_estimate() are never beaten by the packer.
+ */
+static void test_estimate(void)
+{
+    for (int allow_rotation = 0; allow_rotation < 2; allow_rotation++) {
+        japacker_t packer;
+        TEST_CHECK(test_init_random_packer(&packer, TEST_NUM_RECTS, 160, 4));
+        packer.options.allow_rotation = allow_rotation;
+        packer.options.reduce_image_size = 1;
+
+        // A rect that never fits is left out of the bounds
+        japacker_bounds bounds;
+        unsigned int first_width = packer.rects[0].input.width;
+        packer.rects[0].input.width = 161;
+        TEST_CHECK(japacker_estimate(&packer, &bounds) == JAPACKER_OK);
+        TEST_CHECK(bounds.num_fitting_rects == TEST_NUM_RECTS - 1);
+        packer.rects[0].input.width = first_width;
+
+        TEST_CHECK(japacker_estimate(&packer, &bounds) == JAPACKER_OK);
+        TEST_CHECK(bounds.num_fitting_rects == TEST_NUM_RECTS);
+        TEST_CHECK(bounds.min_images >= 1 && bounds.min_images <= bounds.max_images);
+
+        unsigned long long rects_area = 0;
+        unsigned int max_width = 0;
+        for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+            unsigned int width = packer.rects[i].input.width;
+            unsigned int height = packer.rects[i].input.height;
+            rects_area += (unsigned long long) width * height;
+            unsigned int shortest_side = width < height ? width : height;
+            unsigned int side = allow_rotation ? shortest_side : width;
+            max_width = side > max_width ? side : max_width;
+        }
+        TEST_CHECK(bounds.min_area == rects_area);
+        TEST_CHECK(bounds.min_width == max_width);
+
+        // Nothing in the packer is changed
+        TEST_CHECK(!packer.rects[1].output.packed && packer.result.images_needed == 0);
+
+        TEST_CHECK(japacker_pack(&packer) == TEST_NUM_RECTS);
+        TEST_CHECK(packer.result.images_needed >= bounds.min_images);
+        TEST_CHECK(packer.result.last_image_width >= bounds.min_width);
+        TEST_CHECK(packer.result.last_image_height >= bounds.min_height);
+        japacker_free(&packer);
+    }
+}
+
+/**
+ * @brief The bounds include the extrusion and the alignment of each rect, but not its padding, and still hold.
+ */
+static void test_estimate_spacing(void)
+{
+    japacker_t packer;
+    TEST_CHECK(test_init_random_packer(&packer, TEST_NUM_RECTS, 160, 6));
+    packer.options.padding = 3;
+    packer.options.extrude = 1;
+    packer.options.align_x = 4;
+    packer.options.align_y = 2;
+    packer.options.reduce_image_size = 1;
+
+    japacker_bounds bounds;
+    TEST_CHECK(japacker_estimate(&packer, &bounds) == JAPACKER_OK);
+    TEST_CHECK(bounds.num_fitting_rects == TEST_NUM_RECTS);
+
+    unsigned long long rects_area = 0;
+    unsigned int max_width = 0;
+    unsigned int max_height = 0;
+    for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+        unsigned int width = (packer.rects[i].input.width + 2 + 3) / 4 * 4;
+        unsigned int height = (packer.rects[i].input.height + 2 + 1) / 2 * 2;
+        rects_area += (unsigned long long) width * height;
+        max_width = width > max_width ? width : max_width;
+        max_height = height > max_height ? height : max_height;
+    }
+    TEST_CHECK(bounds.min_area == rects_area);
+    TEST_CHECK(bounds.min_width == max_width && bounds.min_height == max_height);
+
+    TEST_CHECK(japacker_pack(&packer) == TEST_NUM_RECTS);
+    TEST_CHECK(packer.result.images_needed >= bounds.min_images);
+    TEST_CHECK(packer.result.last_image_width >= bounds.min_width);
+    TEST_CHECK(packer.result.last_image_height >= bounds.min_height);
+    japacker_free(&packer);
+}
+
+/**
+ * @brief Rects larger than half the image in both directions need an image each.
+ */
+static void test_estimate_large_rects(void)
+{
+    japacker_t packer;
+    TEST_CHECK(japacker_init(&packer, 4, 100, 100) == JAPACKER_OK);
+    for (unsigned int i = 0; i < 4; i++) {
+        packer.rects[i].input.width = i ? 60 : 10;
+        packer.rects[i].input.height = i ? 60 : 10;
+    }
+
+    japacker_bounds bounds;
+    TEST_CHECK(japacker_estimate(&packer, &bounds) == JAPACKER_OK);
+    TEST_CHECK(bounds.min_images == 3 && bounds.max_images == 3);
+
+    TEST_CHECK(japacker_estimate(&packer, 0) == JAPACKER_ERROR_WRONG_PARAMETERS);
+    japacker_free(&packer);
+}
+
+int main(void)
+{
+    test_estimate();
+    test_estimate_spacing();
+    test_estimate_large_rects();
+    return test_finish("test_estimate");
+}
@@ -0,0 +1,132 @@
+/*
+ * Tests of options.group_identical_rects.
+ */
+
+// Count the searches for empty areas, which grouping does once per grid instead of once per rect
+#define JAPACKER_STATS
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 240
+
+/**
+ * @brief Fills a packer with tiles of two sizes, in the given order, so that the same sizes can be next to each other
+ * or not.
+ */
+static void test_fill_tiles(japacker_t *packer, int interleaved)
+{
+    for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+        int small = interleaved ? i % 2 : i >= TEST_NUM_RECTS / 2;
+        packer->rects[i].input.width = small ? 20 : 32;
+        packer->rects[i].input.height = small ? 12 : 32;
+    }
+}
+
+/**
+ * @brief Packs the tiles, with or without grouping, and gets the number of searches for an empty area.
+ */
+static unsigned long long test_pack_tiles(japacker_t *packer, unsigned int image_size, int group, int allow_rotation,
+    int reduce_image_size, int rects_are_sorted, int interleaved)
+{
+    if (japacker_init(packer, TEST_NUM_RECTS, image_size, image_size) != JAPACKER_OK) {
+        return 0;
+    }
+    packer->options.fail_policy = JAPACKER_NEW_IMAGE;
+    packer->options.group_identical_rects = group;
+    packer->options.allow_rotation = allow_rotation;
+    packer->options.reduce_image_size = reduce_image_size;
+    packer->options.rects_are_sorted = rects_are_sorted;
+    test_fill_tiles(packer, interleaved);
+
+    TEST_CHECK(japacker_pack(packer) == TEST_NUM_RECTS);
+    TEST_CHECK(test_layout_is_valid(packer, TEST_NUM_RECTS, 0));
+
+    japacker_stats stats;
+    TEST_CHECK(japacker_get_stats(packer, &stats) == JAPACKER_OK);
+    return stats.searches;
+}
+
+/**
+ * @brief Grouping packs every rect in a valid layout while searching the empty areas far less often, with rotation
+ * and image size reduction on and off.
+ */
+static void test_group(void)
+{
+    for (int allow_rotation = 0; allow_rotation < 2; allow_rotation++) {
+        for (int reduce_image_size = 0; reduce_image_size < 2; reduce_image_size++) {
+            japacker_t single, grouped;
+            unsigned long long single_searches = test_pack_tiles(&single, 256, 0, allow_rotation, reduce_image_size,
+                0, 1);
+            unsigned long long grouped_searches = test_pack_tiles(&grouped, 256, 1, allow_rotation, reduce_image_size,
+                0, 1);
+            TEST_CHECK(grouped_searches < single_searches);
+            TEST_CHECK(grouped.result.images_needed <= single.result.images_needed + 1);
+
+            // Every full size tile of the first image is on the grid of its size
+            for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+                const japacker_rect *rect = &grouped.rects[i];
+                if (rect->output.image_index == 0 && rect->input.width == 32) {
+                    TEST_CHECK(rect->output.x % 32 == 0 && rect->output.y % 32 == 0);
+                }
+            }
+
+            japacker_free(&single);
+            japacker_free(&grouped);
+        }
+    }
+}
+
+/**
+ * @brief With options.rects_are_sorted set to 1, only the identical rects placed next to each other are grouped. The
+ * image is large enough for all of them, since the rects that don't fit would be next to each other in the next one.
+ */
+static void test_group_sorted_rects(void)
+{
+    japacker_t single, interleaved, together;
+    unsigned long long single_searches = test_pack_tiles(&single, 512, 0, 0, 0, 1, 1);
+    unsigned long long interleaved_searches = test_pack_tiles(&interleaved, 512, 1, 0, 0, 1, 1);
+    unsigned long long together_searches = test_pack_tiles(&together, 512, 1, 0, 0, 1, 0);
+    TEST_CHECK(single.result.images_needed == 1);
+
+    TEST_CHECK(interleaved_searches == single_searches);
+    TEST_CHECK(test_same_layout(interleaved.rects, single.rects, TEST_NUM_RECTS));
+    TEST_CHECK(together_searches < single_searches);
+
+    japacker_free(&single);
+    japacker_free(&interleaved);
+    japacker_free(&together);
+}
+
+/**
+ * @brief Identical rects that don't fit as a grid are still packed one by one, rotated if needed.
+ */
+static void test_group_without_grid(void)
+{
+    japacker_t packer;
+    TEST_CHECK(japacker_init(&packer, 12, 100, 100) == JAPACKER_OK);
+    packer.options.fail_policy = JAPACKER_NEW_IMAGE;
+    packer.options.group_identical_rects = 1;
+    packer.options.allow_rotation = 1;
+    for (unsigned int i = 0; i < 12; i++) {
+        packer.rects[i].input.width = 60;
+        packer.rects[i].input.height = 22;
+    }
+
+    TEST_CHECK(japacker_pack(&packer) == 12);
+    TEST_CHECK(test_layout_is_valid(&packer, 12, 0));
+
+    unsigned int num_rotated = 0;
+    for (unsigned int i = 0; i < 12; i++) {
+        num_rotated += packer.rects[i].output.image_index == 0 && packer.rects[i].output.rotated;
+    }
+    TEST_CHECK(num_rotated > 0);
+    japacker_free(&packer);
+}
+
+int main(void)
+{
+    test_group();
+    test_group_sorted_rects();
+    test_group_without_grid();
+    return test_finish("test_group");
+}
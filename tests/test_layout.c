@@ -0,0 +1,166 @@
+/*
+ * Tests of japacker_get_input_hash(), japacker_save_layout(), japacker_get_layout_header() and japacker_load_layout().
+ */
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 400
+
+/**
+ * @brief Inits a packer with the same random rects and options every time.
+ */
+static int test_init_packer(japacker_t *packer)
+{
+    if (japacker_init(packer, TEST_NUM_RECTS, 180, 180) != JAPACKER_OK) {
+        return 0;
+    }
+    packer->options.fail_policy = JAPACKER_NEW_IMAGE;
+    packer->options.allow_rotation = 1;
+    packer->options.reduce_image_size = 1;
+    test_fill_rects(packer, TEST_NUM_RECTS, 20, 1, 40);
+    return 1;
+}
+
+/**
+ * @brief A saved layout loads back to the same layout and results, without packing.
+ */
+static void test_save_and_load(void)
+{
+    japacker_t packer, loaded;
+    TEST_CHECK(test_init_packer(&packer));
+    TEST_CHECK(test_init_packer(&loaded));
+    TEST_CHECK(japacker_get_input_hash(&packer) == japacker_get_input_hash(&loaded));
+    TEST_CHECK(japacker_pack(&packer) == TEST_NUM_RECTS);
+
+    size_t size = japacker_get_layout_size(&packer);
+    TEST_CHECK(size == sizeof(japacker_layout_header) + TEST_NUM_RECTS * sizeof(japacker_layout_entry));
+    uint32_t *buffer = (uint32_t *) malloc(size);
+    TEST_CHECK(japacker_save_layout(&packer, buffer, size - 1) == JAPACKER_ERROR_WRONG_PARAMETERS);
+    TEST_CHECK(japacker_save_layout(&packer, buffer, size) == JAPACKER_OK);
+
+    const japacker_layout_header *header = japacker_get_layout_header(buffer, size);
+    TEST_CHECK(header != 0);
+    if (header) {
+        TEST_CHECK(header->num_rects == TEST_NUM_RECTS);
+        TEST_CHECK(header->images_needed == packer.result.images_needed);
+        TEST_CHECK(header->last_image_width == packer.result.last_image_width);
+        TEST_CHECK(header->last_image_height == packer.result.last_image_height);
+    }
+    TEST_CHECK(japacker_get_layout_header(buffer, sizeof(japacker_layout_header) - 1) == 0);
+
+    TEST_CHECK(japacker_load_layout(&loaded, buffer, size) == JAPACKER_OK);
+    TEST_CHECK(loaded.result.images_needed == packer.result.images_needed);
+    TEST_CHECK(loaded.result.last_image_width == packer.result.last_image_width);
+    TEST_CHECK(loaded.result.last_image_height == packer.result.last_image_height);
+    TEST_CHECK(test_same_layout(loaded.rects, packer.rects, TEST_NUM_RECTS));
+
+    // A truncated layout is rejected
+    japacker_t truncated;
+    TEST_CHECK(test_init_packer(&truncated));
+    TEST_CHECK(japacker_load_layout(&truncated, buffer, size - sizeof(japacker_layout_entry)) ==
+        JAPACKER_ERROR_WRONG_PARAMETERS);
+    TEST_CHECK(!truncated.rects[0].output.packed);
+    japacker_free(&truncated);
+
+    free(buffer);
+    japacker_free(&packer);
+    japacker_free(&loaded);
+}
+
+/**
+ * @brief Changing the size of a rect or an option that changes the layout changes the hash, so an old layout isn't
+ * loaded.
+ */
+static void test_changed_inputs(void)
+{
+    japacker_t packer;
+    TEST_CHECK(test_init_packer(&packer));
+    TEST_CHECK(japacker_pack(&packer) == TEST_NUM_RECTS);
+    unsigned long long hash = japacker_get_input_hash(&packer);
+
+    size_t size = japacker_get_layout_size(&packer);
+    uint32_t *buffer = (uint32_t *) malloc(size);
+    TEST_CHECK(japacker_save_layout(&packer, buffer, size) == JAPACKER_OK);
+
+    japacker_t changed;
+    TEST_CHECK(test_init_packer(&changed));
+    changed.rects[7].input.width++;
+    TEST_CHECK(japacker_get_input_hash(&changed) != hash);
+    TEST_CHECK(japacker_load_layout(&changed, buffer, size) == JAPACKER_ERROR_WRONG_PARAMETERS);
+    changed.rects[7].input.width--;
+
+    changed.options.sort_by = JAPACKER_SORT_BY_AREA;
+    TEST_CHECK(japacker_get_input_hash(&changed) != hash);
+    TEST_CHECK(japacker_load_layout(&changed, buffer, size) == JAPACKER_ERROR_WRONG_PARAMETERS);
+    changed.options.sort_by = packer.options.sort_by;
+
+    // Rects that are said to be sorted already are packed in another order
+    changed.options.rects_are_sorted = 1;
+    TEST_CHECK(japacker_get_input_hash(&changed) != hash);
+    TEST_CHECK(japacker_load_layout(&changed, buffer, size) == JAPACKER_ERROR_WRONG_PARAMETERS);
+    changed.options.rects_are_sorted = 0;
+
+    japacker_resize_image(&changed, 181, 180);
+    TEST_CHECK(japacker_get_input_hash(&changed) != hash);
+    japacker_resize_image(&changed, 180, 180);
+    TEST_CHECK(japacker_get_input_hash(&changed) == hash);
+
+    free(buffer);
+    japacker_free(&packer);
+    japacker_free(&changed);
+}
+
+/**
+ * @brief A layout with a packed rect outside of its image, or in an image that doesn't exist, isn't loaded.
+ */
+static void test_corrupted_layout(void)
+{
+    japacker_t packer;
+    TEST_CHECK(test_init_packer(&packer));
+    TEST_CHECK(japacker_pack(&packer) == TEST_NUM_RECTS);
+
+    size_t size = japacker_get_layout_size(&packer);
+    uint32_t *buffer = (uint32_t *) malloc(size);
+    TEST_CHECK(japacker_save_layout(&packer, buffer, size) == JAPACKER_OK);
+    japacker_layout_header *header = (japacker_layout_header *) buffer;
+    japacker_layout_entry *entry = (japacker_layout_entry *) (header + 1) + 5;
+
+    japacker_t loaded;
+    TEST_CHECK(test_init_packer(&loaded));
+
+    japacker_layout_entry saved_entry = *entry;
+    entry->image_index = (int32_t) header->images_needed;
+    TEST_CHECK(japacker_load_layout(&loaded, buffer, size) == JAPACKER_ERROR_WRONG_PARAMETERS);
+    entry->image_index = -1;
+    TEST_CHECK(japacker_load_layout(&loaded, buffer, size) == JAPACKER_ERROR_WRONG_PARAMETERS);
+    *entry = saved_entry;
+
+    entry->x = 180;
+    TEST_CHECK(japacker_load_layout(&loaded, buffer, size) == JAPACKER_ERROR_WRONG_PARAMETERS);
+    entry->x = saved_entry.x;
+    entry->y = 0xffffffffu;
+    TEST_CHECK(japacker_load_layout(&loaded, buffer, size) == JAPACKER_ERROR_WRONG_PARAMETERS);
+    *entry = saved_entry;
+
+    // The last image can't be larger than the destination image
+    header->last_image_width = 181;
+    TEST_CHECK(japacker_load_layout(&loaded, buffer, size) == JAPACKER_ERROR_WRONG_PARAMETERS);
+    header->last_image_width = packer.result.last_image_width;
+
+    // Nothing was loaded from the rejected layouts, and the restored one still loads
+    TEST_CHECK(!loaded.rects[5].output.packed);
+    TEST_CHECK(japacker_load_layout(&loaded, buffer, size) == JAPACKER_OK);
+    TEST_CHECK(test_same_layout(loaded.rects, packer.rects, TEST_NUM_RECTS));
+
+    free(buffer);
+    japacker_free(&packer);
+    japacker_free(&loaded);
+}
+
+int main(void)
+{
+    test_save_and_load();
+    test_changed_inputs();
+    test_corrupted_layout();
+    return test_finish("test_layout");
+}
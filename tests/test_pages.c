@@ -0,0 +1,79 @@
+/*
+ * Tests of japacker_pack_pages().
+ */
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 500
+
+/**
+ * @brief japacker_pack_pages() packs every rect that fits, in a valid layout that doesn't depend on the number of
+ * threads, and never leaves an image empty.
+ */
+static void test_pack_pages(void)
+{
+    japacker_t serial, parallel;
+    TEST_CHECK(test_init_random_packer(&serial, TEST_NUM_RECTS, 128, 3));
+    TEST_CHECK(test_init_random_packer(&parallel, TEST_NUM_RECTS, 128, 3));
+    parallel.options.num_threads = 4;
+
+    TEST_CHECK(japacker_pack_pages(&serial) == TEST_NUM_RECTS);
+    TEST_CHECK(japacker_pack_pages(&parallel) == TEST_NUM_RECTS);
+    TEST_CHECK(test_layout_is_valid(&parallel, TEST_NUM_RECTS, 0));
+    TEST_CHECK(parallel.result.images_needed == serial.result.images_needed);
+    TEST_CHECK(test_same_layout(parallel.rects, serial.rects, TEST_NUM_RECTS));
+
+    japacker_bounds bounds;
+    memset(&bounds, 0, sizeof(bounds));
+    TEST_CHECK(japacker_estimate(&parallel, &bounds) == JAPACKER_OK);
+    TEST_CHECK(parallel.result.images_needed >= bounds.min_images);
+
+    for (unsigned int image = 0; image < parallel.result.images_needed; image++) {
+        unsigned int num_image_rects = 0;
+        for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+            num_image_rects += parallel.rects[i].output.image_index == (int) image;
+        }
+        TEST_CHECK(num_image_rects > 0);
+    }
+
+    japacker_free(&serial);
+    japacker_free(&parallel);
+}
+
+/**
+ * @brief Rects that fill whole images never make japacker_pack_pages() spread them over more images than there are
+ * rects, which would leave the last images empty.
+ */
+static void test_pack_pages_full_images(void)
+{
+    for (unsigned int num_rects = 2; num_rects <= 5; num_rects++) {
+        japacker_t packer, single;
+        TEST_CHECK(japacker_init(&packer, num_rects, 100, 100) == JAPACKER_OK);
+        TEST_CHECK(japacker_init(&single, num_rects, 100, 100) == JAPACKER_OK);
+        single.options.fail_policy = JAPACKER_NEW_IMAGE;
+        packer.options.reduce_image_size = 1;
+        single.options.reduce_image_size = 1;
+        for (unsigned int i = 0; i < num_rects; i++) {
+            packer.rects[i].input.width = 100;
+            packer.rects[i].input.height = 100;
+            single.rects[i].input = packer.rects[i].input;
+        }
+
+        TEST_CHECK(japacker_pack_pages(&packer) == (int) num_rects);
+        TEST_CHECK(japacker_pack(&single) == (int) num_rects);
+        TEST_CHECK(packer.result.images_needed == num_rects);
+        TEST_CHECK(packer.result.images_needed == single.result.images_needed);
+        TEST_CHECK(packer.result.last_image_width == 100 && packer.result.last_image_height == 100);
+        TEST_CHECK(test_layout_is_valid(&packer, num_rects, 0));
+
+        japacker_free(&packer);
+        japacker_free(&single);
+    }
+}
+
+int main(void)
+{
+    test_pack_pages();
+    test_pack_pages_full_images();
+    return test_finish("test_pages");
+}
@@ -0,0 +1,147 @@
+/*
+ * Tests of options.placement and options.placement_window, which choose among the empty areas where a rect fits.
+ */
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 400
+#define TEST_NUM_PLACEMENTS 5
+
+static const japacker_search_type test_search_methods[] = {
+    JAPACKER_SEARCH_LIST, JAPACKER_SEARCH_TREE, JAPACKER_SEARCH_SCAN
+};
+
+#define TEST_NUM_SEARCH_METHODS (sizeof(test_search_methods) / sizeof(test_search_methods[0]))
+
+/**
+ * @brief Packs random rects with a placement type, window and sort type.
+ */
+static int test_pack_placement(japacker_t *packer, int placement, unsigned int placement_window,
+    japacker_search_type search_by, int allow_rotation, int sort_by)
+{
+    if (!test_init_random_packer(packer, TEST_NUM_RECTS, 256, 160)) {
+        return JAPACKER_ERROR_NO_MEMORY;
+    }
+    packer->options.sort_by = (japacker_sort_type) sort_by;
+    packer->options.placement = (japacker_placement_type) placement;
+    packer->options.placement_window = placement_window;
+    packer->options.search_by = search_by;
+    packer->options.allow_rotation = allow_rotation;
+    return japacker_pack(packer);
+}
+
+/**
+ * @brief Every placement type gives a valid layout, the same with every search method, and with the default sort type,
+ * every type but JAPACKER_PLACE_FIRST_FIT places the rects differently than it, whatever the window.
+ */
+static void test_pack(void)
+{
+    static const unsigned int windows[] = { 1, 0, 64 };
+
+    for (int allow_rotation = 0; allow_rotation < 2; allow_rotation++) {
+        japacker_t first_fit;
+        TEST_CHECK(test_pack_placement(&first_fit, JAPACKER_PLACE_FIRST_FIT, 0, JAPACKER_SEARCH_LIST,
+            allow_rotation, JAPACKER_SORT_BY_PERIMETER) == TEST_NUM_RECTS);
+
+        for (int placement = 0; placement < TEST_NUM_PLACEMENTS; placement++) {
+            for (unsigned int window = 0; window < sizeof(windows) / sizeof(windows[0]); window++) {
+                japacker_t list;
+                for (unsigned int method = 0; method < TEST_NUM_SEARCH_METHODS; method++) {
+                    japacker_t packer;
+                    TEST_CHECK(test_pack_placement(&packer, placement, windows[window], test_search_methods[method],
+                        allow_rotation, JAPACKER_SORT_BY_PERIMETER) == TEST_NUM_RECTS);
+                    if (!method) {
+                        TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, 0));
+                        TEST_CHECK(test_same_layout(packer.rects, first_fit.rects, TEST_NUM_RECTS) ==
+                            (placement == JAPACKER_PLACE_FIRST_FIT));
+                        list = packer;
+                        continue;
+                    }
+                    TEST_CHECK(packer.result.images_needed == list.result.images_needed);
+                    TEST_CHECK(test_same_layout(packer.rects, list.rects, TEST_NUM_RECTS));
+                    japacker_free(&packer);
+                }
+                japacker_free(&list);
+            }
+        }
+        japacker_free(&first_fit);
+    }
+}
+
+/**
+ * @brief A window of 0 is the same as JAPACKER_PLACEMENT_WINDOW, and the window decides how far the search goes:
+ * looking at more empty areas changes where the rects go, with at least one sort type. Since the empty areas are
+ * sorted like the rects, the first one where a rect fits may already score best, such as the smallest one with
+ * JAPACKER_PLACE_BEST_AREA and JAPACKER_SORT_BY_AREA. Without a placement type, the window is ignored.
+ */
+static void test_placement_window(void)
+{
+    for (int placement = 0; placement < TEST_NUM_PLACEMENTS; placement++) {
+        int window_changes_layout = 0;
+        for (int sort_by = 0; sort_by < 4; sort_by++) {
+            japacker_t narrow, default_window, same_window, wide;
+            TEST_CHECK(test_pack_placement(&narrow, placement, 1, JAPACKER_SEARCH_LIST, 1, sort_by) ==
+                TEST_NUM_RECTS);
+            TEST_CHECK(test_pack_placement(&default_window, placement, 0, JAPACKER_SEARCH_LIST, 1, sort_by) ==
+                TEST_NUM_RECTS);
+            TEST_CHECK(test_pack_placement(&same_window, placement, JAPACKER_PLACEMENT_WINDOW, JAPACKER_SEARCH_LIST,
+                1, sort_by) == TEST_NUM_RECTS);
+            TEST_CHECK(test_pack_placement(&wide, placement, 64, JAPACKER_SEARCH_LIST, 1, sort_by) ==
+                TEST_NUM_RECTS);
+
+            TEST_CHECK(test_same_layout(default_window.rects, same_window.rects, TEST_NUM_RECTS));
+            TEST_CHECK(japacker_get_input_hash(&default_window) == japacker_get_input_hash(&same_window));
+            window_changes_layout |= !test_same_layout(narrow.rects, wide.rects, TEST_NUM_RECTS);
+
+            japacker_free(&narrow);
+            japacker_free(&default_window);
+            japacker_free(&same_window);
+            japacker_free(&wide);
+        }
+        TEST_CHECK(window_changes_layout == (placement != JAPACKER_PLACE_FIRST_FIT));
+    }
+}
+
+/**
+ * @brief Rects added one by one use the placement type, unless options.online is set, which ignores it, and so does
+ * the skyline.
+ */
+static void test_ignored_placement(void)
+{
+    for (int online = 0; online < 2; online++) {
+        japacker_t first_fit, best_area;
+        test_add_random_rects(&first_fit, TEST_NUM_RECTS, online);
+        TEST_CHECK(japacker_init(&best_area, 0, 256, 256) == JAPACKER_OK);
+        best_area.options.fail_policy = JAPACKER_NEW_IMAGE;
+        best_area.options.online = online;
+        best_area.options.placement = JAPACKER_PLACE_BEST_AREA;
+        for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+            TEST_CHECK(japacker_add_rect(&best_area, first_fit.rects[i].input.width,
+                first_fit.rects[i].input.height) == (int) i);
+        }
+        TEST_CHECK(test_layout_is_valid(&best_area, TEST_NUM_RECTS, 0));
+        TEST_CHECK(test_same_layout(best_area.rects, first_fit.rects, TEST_NUM_RECTS) == online);
+        japacker_free(&first_fit);
+        japacker_free(&best_area);
+    }
+
+    japacker_t first_fit, best_area;
+    TEST_CHECK(test_init_random_packer(&first_fit, TEST_NUM_RECTS, 256, 161));
+    TEST_CHECK(test_init_random_packer(&best_area, TEST_NUM_RECTS, 256, 161));
+    first_fit.options.algorithm = JAPACKER_ALGORITHM_SKYLINE;
+    best_area.options.algorithm = JAPACKER_ALGORITHM_SKYLINE;
+    best_area.options.placement = JAPACKER_PLACE_BEST_AREA;
+    TEST_CHECK(japacker_pack(&first_fit) == TEST_NUM_RECTS);
+    TEST_CHECK(japacker_pack(&best_area) == TEST_NUM_RECTS);
+    TEST_CHECK(test_same_layout(best_area.rects, first_fit.rects, TEST_NUM_RECTS));
+    japacker_free(&first_fit);
+    japacker_free(&best_area);
+}
+
+int main(void)
+{
+    test_pack();
+    test_placement_window();
+    test_ignored_placement();
+    return test_finish("test_placement");
+}
@@ -0,0 +1,86 @@
+/*
+ * Tests of japacker_init_with_rects(), which packs an array of rects owned by the caller.
+ */
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 300
+
+/**
+ * @brief Packing the caller's rects in place gives the same layout as packing a copy of them with japacker_init(),
+ * clears the outputs they had, keeps their inputs, and doesn't free the array.
+ */
+static void test_pack_in_place(void)
+{
+    japacker_t packer;
+    TEST_CHECK(test_init_random_packer(&packer, TEST_NUM_RECTS, 200, 80));
+    packer.options.allow_rotation = 1;
+
+    japacker_rect *rects = (japacker_rect *) malloc(TEST_NUM_RECTS * sizeof(japacker_rect));
+    memcpy(rects, packer.rects, TEST_NUM_RECTS * sizeof(japacker_rect));
+    // The outputs left by a previous packer must not make the rects look packed
+    for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+        rects[i].output.packed = 1;
+        rects[i].output.x = 7;
+    }
+
+    japacker_t in_place;
+    TEST_CHECK(japacker_init_with_rects(&in_place, rects, TEST_NUM_RECTS, 200, 200) == JAPACKER_OK);
+    TEST_CHECK(in_place.rects == rects);
+    TEST_CHECK(!rects[0].output.packed && rects[0].output.x == 0);
+    TEST_CHECK(rects[0].input.width == packer.rects[0].input.width);
+    in_place.options = packer.options;
+
+    TEST_CHECK(japacker_pack(&in_place) == japacker_pack(&packer));
+    TEST_CHECK(in_place.result.images_needed == packer.result.images_needed);
+    TEST_CHECK(test_same_layout(rects, packer.rects, TEST_NUM_RECTS));
+    TEST_CHECK(test_layout_is_valid(&in_place, TEST_NUM_RECTS, 0));
+
+    // Repacking writes to the same array
+    in_place.options.always_repack = 1;
+    in_place.options.sort_by = JAPACKER_SORT_BY_AREA;
+    packer.options.always_repack = 1;
+    packer.options.sort_by = JAPACKER_SORT_BY_AREA;
+    TEST_CHECK(japacker_pack(&in_place) == japacker_pack(&packer));
+    TEST_CHECK(test_same_layout(rects, packer.rects, TEST_NUM_RECTS));
+
+    japacker_free(&in_place);
+    japacker_free(&packer);
+
+    // japacker_free() leaves the array to the caller, so freeing it here isn't a double free
+    free(rects);
+}
+
+/**
+ * @brief japacker_add_rect() can only reuse the slots of removed rects, since the array can't grow.
+ */
+static void test_add_to_owned_rects(void)
+{
+    japacker_rect rects[4];
+    memset(rects, 0, sizeof(rects));
+    for (unsigned int i = 0; i < 4; i++) {
+        rects[i].input.width = 10;
+        rects[i].input.height = 10;
+    }
+
+    japacker_t packer;
+    TEST_CHECK(japacker_init_with_rects(&packer, rects, 4, 64, 64) == JAPACKER_OK);
+    TEST_CHECK(japacker_pack(&packer) == 4);
+
+    TEST_CHECK(japacker_add_rect(&packer, 5, 5) == JAPACKER_ERROR_NO_MEMORY);
+    TEST_CHECK(japacker_remove_rect(&packer, 2) == JAPACKER_OK);
+    TEST_CHECK(japacker_add_rect(&packer, 5, 5) == 2);
+    TEST_CHECK(rects[2].output.packed && rects[2].input.width == 5);
+    TEST_CHECK(test_layout_is_valid(&packer, 4, 0));
+    japacker_free(&packer);
+
+    TEST_CHECK(japacker_init_with_rects(&packer, 0, 4, 64, 64) == JAPACKER_ERROR_WRONG_PARAMETERS);
+    TEST_CHECK(japacker_init_with_rects(&packer, rects, 0, 64, 64) == JAPACKER_ERROR_WRONG_PARAMETERS);
+}
+
+int main(void)
+{
+    test_pack_in_place();
+    test_add_to_owned_rects();
+    return test_finish("test_rects");
+}
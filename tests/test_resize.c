@@ -0,0 +1,75 @@
+/*
+ * Tests of japacker_resize_rect(), which changes the size of one rect of a packed atlas.
+ */
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 300
+
+/**
+ * @brief A rect that gets smaller keeps its place, one that gets larger is placed again, and every other rect stays
+ * where it was, whether the rects were added online or not.
+ */
+static void test_resize(int online)
+{
+    japacker_t packer;
+    test_add_random_rects(&packer, TEST_NUM_RECTS, online);
+
+    japacker_rect before[TEST_NUM_RECTS];
+    memcpy(before, packer.rects, sizeof(before));
+
+    unsigned int index = TEST_NUM_RECTS / 2;
+    unsigned int width = packer.rects[index].input.width;
+    unsigned int height = packer.rects[index].input.height;
+    if (width > 1 && height > 1) {
+        TEST_CHECK(japacker_resize_rect(&packer, index, width - 1, height - 1) == JAPACKER_OK);
+        TEST_CHECK(test_same_layout(packer.rects, before, TEST_NUM_RECTS));
+    }
+
+    TEST_CHECK(japacker_resize_rect(&packer, index, 60, 60) == JAPACKER_OK);
+    TEST_CHECK(packer.rects[index].input.width == 60 && packer.rects[index].input.height == 60);
+    TEST_CHECK(packer.rects[index].output.packed);
+    TEST_CHECK(test_same_layout(packer.rects, before, index));
+    TEST_CHECK(test_same_layout(packer.rects + index + 1, before + index + 1, TEST_NUM_RECTS - index - 1));
+    TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, 0));
+
+    // With a density threshold no image can reach, every rect is repacked
+    packer.options.repack_below_density = 101;
+    TEST_CHECK(japacker_resize_rect(&packer, index, 30, 30) == 1);
+    TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, 0));
+
+    TEST_CHECK(japacker_resize_rect(&packer, TEST_NUM_RECTS, 1, 1) == JAPACKER_ERROR_WRONG_PARAMETERS);
+    japacker_free(&packer);
+}
+
+/**
+ * @brief A rect that no longer fits the image is left unpacked, without moving any other rect.
+ */
+static void test_resize_too_large(void)
+{
+    japacker_t packer;
+    test_add_random_rects(&packer, TEST_NUM_RECTS, 0);
+
+    japacker_rect before[TEST_NUM_RECTS];
+    memcpy(before, packer.rects, sizeof(before));
+
+    TEST_CHECK(japacker_resize_rect(&packer, 0, 300, 10) == JAPACKER_OK);
+    TEST_CHECK(!packer.rects[0].output.packed);
+    TEST_CHECK(test_same_layout(packer.rects + 1, before + 1, TEST_NUM_RECTS - 1));
+    TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, 0));
+
+    // Once it fits again, it's placed in the free space of the current image
+    TEST_CHECK(japacker_resize_rect(&packer, 0, 10, 10) == JAPACKER_OK);
+    TEST_CHECK(packer.rects[0].output.packed);
+    TEST_CHECK(packer.rects[0].output.image_index == (int) packer.result.images_needed - 1);
+    TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, 0));
+    japacker_free(&packer);
+}
+
+int main(void)
+{
+    test_resize(0);
+    test_resize(1);
+    test_resize_too_large();
+    return test_finish("test_resize");
+}
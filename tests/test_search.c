@@ -0,0 +1,254 @@
+/*
+ * Tests of the search methods of options.search_by, which find the empty area where each rect goes and must all give
+ * the same layout, and of merging the empty areas back together.
+ */
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 400
+
+static const japacker_search_type test_search_methods[] = {
+    JAPACKER_SEARCH_LIST, JAPACKER_SEARCH_TREE, JAPACKER_SEARCH_SCAN
+};
+
+#define TEST_NUM_SEARCH_METHODS (sizeof(test_search_methods) / sizeof(test_search_methods[0]))
+
+/**
+ * @brief Checks whether two packers gave the same layout and results.
+ */
+static int test_same_results(const japacker_t *packer, const japacker_t *other, unsigned int num_rects)
+{
+    return packer->result.images_needed == other->result.images_needed &&
+        packer->result.last_image_width == other->result.last_image_width &&
+        packer->result.last_image_height == other->result.last_image_height &&
+        test_same_layout(packer->rects, other->rects, num_rects);
+}
+
+/**
+ * @brief Inits a packer with random rects, every 4th one of the same size so that there are identical rects to group.
+ */
+static int test_init_packer(japacker_t *packer, unsigned int num_rects, unsigned long long seed)
+{
+    if (!test_init_random_packer(packer, num_rects, 256, seed)) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < num_rects; i += 4) {
+        packer->rects[i].input.width = 16;
+        packer->rects[i].input.height = 16;
+    }
+    return 1;
+}
+
+/**
+ * @brief Every search method packs every rect in a valid layout, with every sort type and with rotation on and off.
+ */
+static void test_pack(void)
+{
+    for (unsigned int method = 0; method < TEST_NUM_SEARCH_METHODS; method++) {
+        for (int sort_by = 0; sort_by < 4; sort_by++) {
+            for (int allow_rotation = 0; allow_rotation < 2; allow_rotation++) {
+                japacker_t packer;
+                TEST_CHECK(japacker_init(&packer, TEST_NUM_RECTS, 256, 256) == JAPACKER_OK);
+                packer.options.fail_policy = JAPACKER_NEW_IMAGE;
+                packer.options.search_by = test_search_methods[method];
+                packer.options.sort_by = (japacker_sort_type) sort_by;
+                packer.options.allow_rotation = allow_rotation;
+                test_fill_rects(&packer, TEST_NUM_RECTS, 50 + sort_by, 1, 48);
+
+                TEST_CHECK(japacker_pack(&packer) == TEST_NUM_RECTS);
+                TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, 0));
+                japacker_free(&packer);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Every search method keeps finding where rects fit through the many empty areas of a large pack, whose inserts
+ * and removals rebalance the search tree many times and fill many blocks of the scan.
+ */
+static void test_many_rects(void)
+{
+    for (unsigned int method = 0; method < TEST_NUM_SEARCH_METHODS; method++) {
+        japacker_t packer;
+        TEST_CHECK(japacker_init(&packer, 3000, 512, 512) == JAPACKER_OK);
+        packer.options.fail_policy = JAPACKER_NEW_IMAGE;
+        packer.options.search_by = test_search_methods[method];
+        packer.options.allow_rotation = 1;
+        test_fill_rects(&packer, 3000, 70, 1, 24);
+
+        TEST_CHECK(japacker_pack(&packer) == 3000);
+        TEST_CHECK(test_layout_is_valid(&packer, 3000, 0));
+        japacker_free(&packer);
+    }
+}
+
+/**
+ * @brief Removing every rect of an image merges the space they give back into a single empty area again, so a rect
+ * as large as the image fits in it.
+ */
+static void test_merge(void)
+{
+    for (unsigned int method = 0; method < TEST_NUM_SEARCH_METHODS; method++) {
+        for (int online = 0; online < 2; online++) {
+            japacker_t packer;
+            TEST_CHECK(japacker_init(&packer, 0, 256, 256) == JAPACKER_OK);
+            packer.options.fail_policy = JAPACKER_NEW_IMAGE;
+            packer.options.search_by = test_search_methods[method];
+            packer.options.online = online;
+
+            test_random random;
+            random.state = 60;
+            for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+                unsigned int width = test_random_range(&random, 1, 40);
+                unsigned int height = test_random_range(&random, 1, 40);
+                TEST_CHECK(japacker_add_rect(&packer, width, height) == (int) i);
+            }
+
+            int current_image = (int) packer.result.images_needed - 1;
+            for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+                if (packer.rects[i].output.image_index == current_image) {
+                    TEST_CHECK(japacker_remove_rect(&packer, i) == JAPACKER_OK);
+                }
+            }
+
+            unsigned int images_needed = packer.result.images_needed;
+            int index = japacker_add_rect(&packer, 256, 256);
+            TEST_CHECK(index >= 0);
+            if (index >= 0) {
+                TEST_CHECK(packer.rects[index].output.image_index == current_image);
+                TEST_CHECK(packer.rects[index].output.x == 0 && packer.rects[index].output.y == 0);
+            }
+            TEST_CHECK(packer.result.images_needed == images_needed);
+            japacker_free(&packer);
+        }
+    }
+}
+
+/**
+ * @brief Every search method gives exactly the same layout as JAPACKER_SEARCH_LIST, with every sort type, placement
+ * type, rotation, grouping and image size reduction.
+ */
+static void test_same_layouts(void)
+{
+    for (int sort_by = 0; sort_by < 4; sort_by++) {
+        for (int placement = 0; placement < 5; placement++) {
+            for (int options = 0; options < 8; options++) {
+                japacker_t list;
+                for (unsigned int method = 0; method < TEST_NUM_SEARCH_METHODS; method++) {
+                    japacker_t packer;
+                    TEST_CHECK(test_init_packer(&packer, 200, 130 + sort_by));
+                    packer.options.search_by = test_search_methods[method];
+                    packer.options.sort_by = (japacker_sort_type) sort_by;
+                    packer.options.placement = (japacker_placement_type) placement;
+                    packer.options.allow_rotation = options & 1;
+                    packer.options.group_identical_rects = (options >> 1) & 1;
+                    packer.options.reduce_image_size = (options >> 2) & 1;
+
+                    TEST_CHECK(japacker_pack(&packer) == 200);
+                    if (!method) {
+                        TEST_CHECK(test_layout_is_valid(&packer, 200, 0));
+                        list = packer;
+                        continue;
+                    }
+                    TEST_CHECK(test_same_results(&packer, &list, 200));
+                    TEST_CHECK(japacker_get_input_hash(&packer) == japacker_get_input_hash(&list));
+                    japacker_free(&packer);
+                }
+                japacker_free(&list);
+            }
+        }
+    }
+}
+
+/**
+ * @brief The parallel functions give the same layout with every search method, whatever the number of threads, and
+ * options.deterministic doesn't change it when there's enough memory.
+ */
+static void test_same_parallel_layouts(void)
+{
+    japacker_t serial_pages, serial_reduction;
+    TEST_CHECK(test_init_packer(&serial_pages, TEST_NUM_RECTS, 140));
+    TEST_CHECK(test_init_packer(&serial_reduction, TEST_NUM_RECTS, 140));
+    serial_reduction.options.reduce_image_size = 1;
+    serial_reduction.options.reduce_candidates = 4;
+    TEST_CHECK(japacker_pack_pages(&serial_pages) == TEST_NUM_RECTS);
+    TEST_CHECK(japacker_pack(&serial_reduction) == TEST_NUM_RECTS);
+
+    for (unsigned int method = 0; method < TEST_NUM_SEARCH_METHODS; method++) {
+        for (int deterministic = 0; deterministic < 2; deterministic++) {
+            japacker_t pages, reduction;
+            TEST_CHECK(test_init_packer(&pages, TEST_NUM_RECTS, 140));
+            TEST_CHECK(test_init_packer(&reduction, TEST_NUM_RECTS, 140));
+            pages.options.search_by = test_search_methods[method];
+            pages.options.num_threads = 4;
+            pages.options.deterministic = deterministic;
+            reduction.options = pages.options;
+            reduction.options.reduce_image_size = 1;
+            reduction.options.reduce_candidates = 4;
+
+            TEST_CHECK(japacker_pack_pages(&pages) == TEST_NUM_RECTS);
+            TEST_CHECK(test_same_results(&pages, &serial_pages, TEST_NUM_RECTS));
+            TEST_CHECK(japacker_pack(&reduction) == TEST_NUM_RECTS);
+            TEST_CHECK(test_same_results(&reduction, &serial_reduction, TEST_NUM_RECTS));
+            TEST_CHECK(japacker_get_input_hash(&reduction) == japacker_get_input_hash(&serial_reduction));
+
+            japacker_free(&pages);
+            japacker_free(&reduction);
+        }
+    }
+
+    japacker_free(&serial_pages);
+    japacker_free(&serial_reduction);
+}
+
+/**
+ * @brief Every search method gives the same layout when rects are added and removed one by one.
+ */
+static void test_same_dynamic_layouts(void)
+{
+    japacker_t list;
+    for (unsigned int method = 0; method < TEST_NUM_SEARCH_METHODS; method++) {
+        japacker_t packer;
+        TEST_CHECK(japacker_init(&packer, 0, 256, 256) == JAPACKER_OK);
+        packer.options.fail_policy = JAPACKER_NEW_IMAGE;
+        packer.options.search_by = test_search_methods[method];
+
+        // The slots of removed rects are reused, so the rects are found through the index they were given
+        int indices[TEST_NUM_RECTS];
+        test_random random;
+        random.state = 150;
+        for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+            unsigned int width = test_random_range(&random, 1, 40);
+            unsigned int height = test_random_range(&random, 1, 40);
+            indices[i] = japacker_add_rect(&packer, width, height);
+            TEST_CHECK(indices[i] >= 0);
+            // Give some space back to the current image every few rects
+            if (i % 5 == 4 && indices[i - 2] >= 0) {
+                TEST_CHECK(japacker_remove_rect(&packer, (unsigned int) indices[i - 2]) == JAPACKER_OK);
+            }
+        }
+
+        unsigned int num_rects = packer.internal_data->num_rects;
+        if (!method) {
+            TEST_CHECK(test_layout_is_valid(&packer, num_rects, 0));
+            list = packer;
+            continue;
+        }
+        TEST_CHECK(num_rects == list.internal_data->num_rects);
+        TEST_CHECK(test_same_results(&packer, &list, num_rects));
+        japacker_free(&packer);
+    }
+    japacker_free(&list);
+}
+
+int main(void)
+{
+    test_pack();
+    test_many_rects();
+    test_merge();
+    test_same_layouts();
+    test_same_parallel_layouts();
+    test_same_dynamic_layouts();
+    return test_finish("test_search");
+}
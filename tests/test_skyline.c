@@ -0,0 +1,124 @@
+/*
+ * Tests of JAPACKER_ALGORITHM_SKYLINE, which places each rect on top of the ones already placed.
+ */
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 400
+
+/**
+ * @brief Packs random rects in images of 256 by 256 with the skyline.
+ */
+static int test_pack_skyline(japacker_t *packer, int sort_by, int allow_rotation, int reduce_image_size,
+    japacker_search_type search_by, int group_identical_rects)
+{
+    if (japacker_init(packer, TEST_NUM_RECTS, 256, 256) != JAPACKER_OK) {
+        return JAPACKER_ERROR_NO_MEMORY;
+    }
+    packer->options.algorithm = JAPACKER_ALGORITHM_SKYLINE;
+    packer->options.fail_policy = JAPACKER_NEW_IMAGE;
+    packer->options.sort_by = (japacker_sort_type) sort_by;
+    packer->options.allow_rotation = allow_rotation;
+    packer->options.reduce_image_size = reduce_image_size;
+    packer->options.search_by = search_by;
+    packer->options.group_identical_rects = group_identical_rects;
+    // Every 4th rect is the same, so that there are identical rects to group
+    test_fill_rects(packer, TEST_NUM_RECTS, 90 + sort_by, 1, 48);
+    for (unsigned int i = 0; i < TEST_NUM_RECTS; i += 4) {
+        packer->rects[i].input.width = 16;
+        packer->rects[i].input.height = 16;
+    }
+    return japacker_pack(packer);
+}
+
+/**
+ * @brief The skyline packs every rect in a valid layout with every sort type, with rotation and image size reduction
+ * on and off, and ignores options.search_by and options.group_identical_rects.
+ */
+static void test_pack(void)
+{
+    for (int sort_by = 0; sort_by < 4; sort_by++) {
+        for (int allow_rotation = 0; allow_rotation < 2; allow_rotation++) {
+            for (int reduce_image_size = 0; reduce_image_size < 2; reduce_image_size++) {
+                japacker_t packer;
+                TEST_CHECK(test_pack_skyline(&packer, sort_by, allow_rotation, reduce_image_size,
+                    JAPACKER_SEARCH_LIST, 0) == TEST_NUM_RECTS);
+                TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, 0));
+
+                japacker_t other;
+                TEST_CHECK(test_pack_skyline(&other, sort_by, allow_rotation, reduce_image_size,
+                    JAPACKER_SEARCH_SCAN, 1) == TEST_NUM_RECTS);
+                TEST_CHECK(other.result.images_needed == packer.result.images_needed);
+                TEST_CHECK(test_same_layout(other.rects, packer.rects, TEST_NUM_RECTS));
+
+                japacker_free(&packer);
+                japacker_free(&other);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Each rect goes where its bottom edge is closest to the top of the image, on top of the tallest rect under
+ * it.
+ */
+static void test_positions(void)
+{
+    static const unsigned int sizes[4][2] = { { 60, 30 }, { 40, 50 }, { 60, 20 }, { 100, 10 } };
+    static const unsigned int positions[4][2] = { { 0, 0 }, { 60, 0 }, { 0, 30 }, { 0, 50 } };
+
+    japacker_t packer;
+    TEST_CHECK(japacker_init(&packer, 4, 100, 100) == JAPACKER_OK);
+    packer.options.algorithm = JAPACKER_ALGORITHM_SKYLINE;
+    packer.options.rects_are_sorted = 1;
+    for (unsigned int i = 0; i < 4; i++) {
+        packer.rects[i].input.width = sizes[i][0];
+        packer.rects[i].input.height = sizes[i][1];
+    }
+
+    TEST_CHECK(japacker_pack(&packer) == 4);
+    for (unsigned int i = 0; i < 4; i++) {
+        TEST_CHECK(packer.rects[i].output.x == positions[i][0] && packer.rects[i].output.y == positions[i][1]);
+    }
+    japacker_free(&packer);
+}
+
+/**
+ * @brief The space of a removed rect is only reused once the image is packed again, and japacker_compact() moves
+ * nothing.
+ */
+static void test_removed_space(void)
+{
+    japacker_t packer;
+    TEST_CHECK(japacker_init(&packer, 0, 100, 100) == JAPACKER_OK);
+    packer.options.algorithm = JAPACKER_ALGORITHM_SKYLINE;
+    packer.options.fail_policy = JAPACKER_NEW_IMAGE;
+
+    TEST_CHECK(japacker_add_rect(&packer, 100, 100) == 0);
+    TEST_CHECK(japacker_remove_rect(&packer, 0) == JAPACKER_OK);
+    int index = japacker_add_rect(&packer, 10, 10);
+    TEST_CHECK(index >= 0);
+    if (index >= 0) {
+        TEST_CHECK(packer.rects[index].output.image_index == 1);
+    }
+    TEST_CHECK(packer.result.images_needed == 2);
+
+    japacker_relocation relocations[4];
+    TEST_CHECK(japacker_compact(&packer, relocations, 4) == 0);
+
+    packer.options.always_repack = 1;
+    TEST_CHECK(japacker_pack(&packer) == 1);
+    TEST_CHECK(packer.result.images_needed == 1);
+    if (index >= 0) {
+        TEST_CHECK(packer.rects[index].output.image_index == 0);
+    }
+    japacker_free(&packer);
+}
+
+int main(void)
+{
+    test_pack();
+    test_positions();
+    test_removed_space();
+    return test_finish("test_skyline");
+}
@@ -0,0 +1,196 @@
+/*
+ * Tests of the space left around each rect: options.padding, options.extrude, options.align_x and options.align_y.
+ */
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 300
+
+static const japacker_search_type test_search_methods[] = {
+    JAPACKER_SEARCH_LIST, JAPACKER_SEARCH_TREE, JAPACKER_SEARCH_SCAN
+};
+
+#define TEST_NUM_SEARCH_METHODS (sizeof(test_search_methods) / sizeof(test_search_methods[0]))
+
+/**
+ * @brief The padding, extrude, align_x and align_y of each combination that is tested.
+ */
+static const unsigned int test_spacings[][4] = {
+    { 2, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 4, 4 }, { 3, 2, 4, 1 }, { 1, 1, 8, 2 }
+};
+
+#define TEST_NUM_SPACINGS (sizeof(test_spacings) / sizeof(test_spacings[0]))
+
+/**
+ * @brief Sets the spacing options of a packer to one of the tested combinations.
+ */
+static void test_set_spacing(japacker_t *packer, unsigned int spacing)
+{
+    packer->options.padding = test_spacings[spacing][0];
+    packer->options.extrude = test_spacings[spacing][1];
+    packer->options.align_x = test_spacings[spacing][2];
+    packer->options.align_y = test_spacings[spacing][3];
+}
+
+/**
+ * @brief Every search method gives the same layout with each spacing, with rotation and image size reduction on and
+ * off, and the layout leaves the space that was asked for.
+ */
+static void test_pack(void)
+{
+    for (unsigned int spacing = 0; spacing < TEST_NUM_SPACINGS; spacing++) {
+        for (int allow_rotation = 0; allow_rotation < 2; allow_rotation++) {
+            for (int reduce_image_size = 0; reduce_image_size < 2; reduce_image_size++) {
+                japacker_t list;
+                for (unsigned int method = 0; method < TEST_NUM_SEARCH_METHODS; method++) {
+                    japacker_t packer;
+                    TEST_CHECK(test_init_random_packer(&packer, TEST_NUM_RECTS, 256, 110 + spacing));
+                    test_set_spacing(&packer, spacing);
+                    packer.options.search_by = test_search_methods[method];
+                    packer.options.allow_rotation = allow_rotation;
+                    packer.options.reduce_image_size = reduce_image_size;
+
+                    TEST_CHECK(japacker_pack(&packer) == TEST_NUM_RECTS);
+                    TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, 0));
+                    if (!method) {
+                        list = packer;
+                        continue;
+                    }
+                    TEST_CHECK(packer.result.images_needed == list.result.images_needed);
+                    TEST_CHECK(packer.result.last_image_width == list.result.last_image_width);
+                    TEST_CHECK(packer.result.last_image_height == list.result.last_image_height);
+                    TEST_CHECK(test_same_layout(packer.rects, list.rects, TEST_NUM_RECTS));
+                    japacker_free(&packer);
+                }
+                japacker_free(&list);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Rects added, removed, resized and compacted one by one leave the same space around them as packed ones.
+ */
+static void test_dynamic(void)
+{
+    for (unsigned int spacing = 0; spacing < TEST_NUM_SPACINGS; spacing++) {
+        for (int online = 0; online < 2; online++) {
+            japacker_t packer;
+            TEST_CHECK(japacker_init(&packer, 0, 256, 256) == JAPACKER_OK);
+            test_set_spacing(&packer, spacing);
+            packer.options.fail_policy = JAPACKER_NEW_IMAGE;
+            packer.options.online = online;
+
+            test_random random;
+            random.state = 120 + spacing;
+            for (unsigned int i = 0; i < TEST_NUM_RECTS; i++) {
+                unsigned int width = test_random_range(&random, 1, 40);
+                unsigned int height = test_random_range(&random, 1, 40);
+                TEST_CHECK(japacker_add_rect(&packer, width, height) == (int) i);
+            }
+            TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, 0));
+
+            for (unsigned int i = 0; i < TEST_NUM_RECTS; i += 3) {
+                TEST_CHECK(japacker_remove_rect(&packer, i) == JAPACKER_OK);
+            }
+            for (unsigned int i = 1; i < TEST_NUM_RECTS; i += 3) {
+                TEST_CHECK(japacker_resize_rect(&packer, i, 20, 20) == JAPACKER_OK);
+            }
+            TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, 0));
+
+            japacker_relocation relocations[16];
+            TEST_CHECK(japacker_compact(&packer, relocations, 16) >= 0);
+            TEST_CHECK(test_layout_is_valid(&packer, TEST_NUM_RECTS, 0));
+            japacker_free(&packer);
+        }
+    }
+}
+
+/**
+ * @brief Rects can touch the borders of the image with padding, but the extrusion is reserved at the borders too,
+ * and the padding is left between the extruded rects.
+ */
+static void test_borders(void)
+{
+    for (unsigned int extrude = 0; extrude < 2; extrude++) {
+        japacker_t packer;
+        TEST_CHECK(japacker_init(&packer, 2, 64, 64) == JAPACKER_OK);
+        packer.options.padding = 8;
+        packer.options.extrude = extrude;
+        packer.rects[0].input.width = 64 - 2 * extrude;
+        packer.rects[0].input.height = 30;
+        packer.rects[1].input.width = 64 - 2 * extrude;
+        packer.rects[1].input.height = 20;
+
+        TEST_CHECK(japacker_pack(&packer) == 2);
+        TEST_CHECK(packer.rects[0].output.x == extrude && packer.rects[0].output.y == extrude);
+        TEST_CHECK(packer.rects[1].output.x == extrude && packer.rects[1].output.y == 30 + 8 + 3 * extrude);
+        TEST_CHECK(test_layout_is_valid(&packer, 2, 0));
+
+        // A rect as large as the image only fits without extrusion
+        packer.rects[0].input.width = 64;
+        packer.rects[0].input.height = 64;
+        packer.rects[1].input.width = 0;
+        packer.rects[1].input.height = 0;
+        packer.options.always_repack = 1;
+        TEST_CHECK(japacker_pack(&packer) == (extrude ? 0 : 1));
+        japacker_free(&packer);
+    }
+}
+
+/**
+ * @brief test_layout_is_valid() finds rects that are too close to each other, too close to the borders of the
+ * image, or not aligned.
+ */
+static void test_invalid_layouts(void)
+{
+    japacker_t packer;
+    TEST_CHECK(japacker_init(&packer, 2, 64, 64) == JAPACKER_OK);
+    packer.options.padding = 4;
+    packer.options.extrude = 1;
+    packer.options.align_x = 4;
+    for (unsigned int i = 0; i < 2; i++) {
+        packer.rects[i].input.width = 10;
+        packer.rects[i].input.height = 10;
+    }
+    TEST_CHECK(japacker_pack(&packer) == 2);
+    TEST_CHECK(test_layout_is_valid(&packer, 2, 0));
+
+    // Side by side, the extruded rects are 16 pixels apart from the start of one to the start of the other
+    packer.rects[0].output.x = 1;
+    packer.rects[0].output.y = 1;
+    packer.rects[1].output.x = 17;
+    packer.rects[1].output.y = 1;
+    TEST_CHECK(test_layout_is_valid(&packer, 2, 0));
+
+    // The padding between them can't get smaller, and neither can the extrusion at the top of the image
+    packer.rects[1].output.x = 13;
+    TEST_CHECK(!test_layout_is_valid(&packer, 2, 0));
+    packer.rects[1].output.x = 17;
+    packer.rects[0].output.y = 0;
+    TEST_CHECK(!test_layout_is_valid(&packer, 2, 0));
+    packer.rects[0].output.y = 1;
+
+    // Every x minus the extrusion must be aligned, while any y is fine
+    packer.rects[1].output.x = 19;
+    TEST_CHECK(!test_layout_is_valid(&packer, 2, 0));
+    packer.rects[1].output.x = 17;
+    packer.rects[1].output.y = 30;
+    TEST_CHECK(test_layout_is_valid(&packer, 2, 0));
+
+    // The extrusion can't go past the right of the image either
+    packer.rects[1].output.x = 53;
+    TEST_CHECK(test_layout_is_valid(&packer, 2, 0));
+    packer.rects[1].output.x = 57;
+    TEST_CHECK(!test_layout_is_valid(&packer, 2, 0));
+    japacker_free(&packer);
+}
+
+int main(void)
+{
+    test_pack();
+    test_dynamic();
+    test_borders();
+    test_invalid_layouts();
+    return test_finish("test_spacing");
+}
@@ -0,0 +1,79 @@
+/*
+ * Tests of japacker_pack_step(), which spreads a pack over several calls.
+ */
+
+#include "japacker_test.h"
+
+#define TEST_NUM_RECTS 500
+
+/**
+ * @brief Packing in small steps gives the same layout and results as japacker_pack(), with both algorithms and with
+ * image size reduction on and off.
+ */
+static void test_pack_step(void)
+{
+    for (int algorithm = 0; algorithm < 2; algorithm++) {
+        for (int reduce = 0; reduce < 2; reduce++) {
+            japacker_t packer, stepped;
+            TEST_CHECK(test_init_random_packer(&packer, TEST_NUM_RECTS, 256, 1));
+            TEST_CHECK(test_init_random_packer(&stepped, TEST_NUM_RECTS, 256, 1));
+            packer.options.algorithm = (japacker_algorithm) algorithm;
+            stepped.options.algorithm = (japacker_algorithm) algorithm;
+            packer.options.reduce_image_size = reduce;
+            stepped.options.reduce_image_size = reduce;
+
+            int packed = japacker_pack(&packer);
+
+            int result;
+            unsigned int calls = 0;
+            while ((result = japacker_pack_step(&stepped, 7)) == JAPACKER_PACK_IN_PROGRESS) {
+                calls++;
+            }
+            TEST_CHECK(calls > 1);
+            TEST_CHECK(result == packed);
+            TEST_CHECK(stepped.result.images_needed == packer.result.images_needed);
+            TEST_CHECK(stepped.result.last_image_width == packer.result.last_image_width);
+            TEST_CHECK(stepped.result.last_image_height == packer.result.last_image_height);
+            TEST_CHECK(test_same_layout(stepped.rects, packer.rects, TEST_NUM_RECTS));
+
+            // A cancelled pack starts over on the next call
+            TEST_CHECK(japacker_pack_step(&stepped, 7) == JAPACKER_PACK_IN_PROGRESS);
+            japacker_cancel_pack(&stepped);
+            stepped.options.always_repack = 1;
+            TEST_CHECK(japacker_pack_step(&stepped, 0) == packed);
+            TEST_CHECK(test_same_layout(stepped.rects, packer.rects, TEST_NUM_RECTS));
+
+            japacker_free(&packer);
+            japacker_free(&stepped);
+        }
+    }
+}
+
+/**
+ * @brief japacker_pack() cancels a pack in progress and packs everything again.
+ */
+static void test_pack_during_step(void)
+{
+    japacker_t packer, stepped;
+    TEST_CHECK(test_init_random_packer(&packer, TEST_NUM_RECTS, 256, 2));
+    TEST_CHECK(test_init_random_packer(&stepped, TEST_NUM_RECTS, 256, 2));
+    packer.options.reduce_image_size = 1;
+    stepped.options.reduce_image_size = 1;
+    stepped.options.always_repack = 1;
+
+    int packed = japacker_pack(&packer);
+    TEST_CHECK(japacker_pack_step(&stepped, 7) == JAPACKER_PACK_IN_PROGRESS);
+    TEST_CHECK(japacker_pack(&stepped) == packed);
+    TEST_CHECK(stepped.result.images_needed == packer.result.images_needed);
+    TEST_CHECK(test_same_layout(stepped.rects, packer.rects, TEST_NUM_RECTS));
+
+    japacker_free(&packer);
+    japacker_free(&stepped);
+}
+
+int main(void)
+{
+    test_pack_step();
+    test_pack_during_step();
+    return test_finish("test_step");
+}
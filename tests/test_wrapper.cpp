@@ -0,0 +1,132 @@
+/*
+ * Tests of the C++ wrapper in japacker.hpp, which must give the same placements as japacker_pack().
+ */
+
+#include "japacker.hpp"
+
+#include "japacker_test.h"
+
+#include <utility>
+
+#if defined (TEST_REQUIRE_SPAN) && !defined (JAPACKER_HAS_SPAN)
+#error "The std::span overload of japacker::packer::pack() must be built with C++20"
+#endif
+
+/**
+ * @brief Gets random sizes, the same on every platform.
+ */
+static std::vector<japacker::size> test_get_sizes(unsigned int num_rects, unsigned long long seed)
+{
+    std::vector<japacker::size> sizes(num_rects);
+    test_random random;
+    random.state = seed;
+    for (japacker::size &size : sizes) {
+        size.width = test_random_range(&random, 1, 48);
+        size.height = test_random_range(&random, 1, 48);
+    }
+    return sizes;
+}
+
+/**
+ * @brief Checks that the placements are the outputs of japacker_pack() for the same sizes and options.
+ */
+static int test_same_as_c(const std::vector<japacker::size> &sizes, const std::vector<japacker::placement> &placements,
+    const japacker::packer::options_type &options, unsigned int image_size, int packed)
+{
+    unsigned int num_rects = static_cast<unsigned int>(sizes.size());
+    japacker_t packer;
+    if (japacker_init(&packer, num_rects, image_size, image_size) != JAPACKER_OK) {
+        return 0;
+    }
+    packer.options = options;
+    for (unsigned int i = 0; i < num_rects; i++) {
+        packer.rects[i].input.width = sizes[i].width;
+        packer.rects[i].input.height = sizes[i].height;
+    }
+
+    int same = japacker_pack(&packer) == packed;
+    for (unsigned int i = 0; i < num_rects && same; i++) {
+        const japacker_rect &rect = packer.rects[i];
+        same = placements[i].packed == (rect.output.packed != 0) &&
+            (!placements[i].packed || (placements[i].x == rect.output.x && placements[i].y == rect.output.y &&
+            placements[i].image_index == rect.output.image_index &&
+            placements[i].rotated == (rect.output.rotated != 0)));
+    }
+
+    japacker_free(&packer);
+    return same;
+}
+
+/**
+ * @brief The wrapper gives the same placements as japacker_pack() for every sort type, with rotation on and off, and
+ * again when it reuses its memory or is moved.
+ */
+static void test_pack(void)
+{
+    std::vector<japacker::size> sizes = test_get_sizes(400, 40);
+    std::vector<japacker::placement> placements(sizes.size());
+
+    for (int sort_by = 0; sort_by < 4; sort_by++) {
+        for (int allow_rotation = 0; allow_rotation < 2; allow_rotation++) {
+            japacker::packer packer(256, 256, static_cast<japacker_sort_type>(sort_by), allow_rotation != 0);
+            packer.options().fail_policy = JAPACKER_NEW_IMAGE;
+            TEST_CHECK(packer.options().sort_by == sort_by && packer.options().allow_rotation == allow_rotation);
+
+            int packed = packer.pack(sizes.data(), sizes.size(), placements.data());
+            TEST_CHECK(packed == static_cast<int>(sizes.size()));
+            TEST_CHECK(test_same_as_c(sizes, placements, packer.options(), 256, packed));
+
+            // Packing again reuses the memory and gives the same placements
+            std::vector<japacker::placement> again(sizes.size());
+            TEST_CHECK(packer.pack(sizes.data(), sizes.size(), again.data()) == packed);
+            TEST_CHECK(test_same_as_c(sizes, again, packer.options(), 256, packed));
+
+            japacker::packer moved = std::move(packer);
+            TEST_CHECK(moved.pack(sizes.data(), sizes.size(), again.data()) == packed);
+            TEST_CHECK(test_same_as_c(sizes, again, moved.options(), 256, packed));
+            TEST_CHECK(moved.result().images_needed >= 1);
+        }
+    }
+
+    // Fewer rects than before, in an image where not all of them fit
+    sizes = test_get_sizes(100, 41);
+    japacker::packer packer(64, 64);
+    int packed = packer.pack(sizes.data(), sizes.size(), placements.data());
+    TEST_CHECK(packed > 0 && packed < 100);
+    TEST_CHECK(test_same_as_c(sizes, placements, packer.options(), 64, packed));
+
+    japacker::size size = { 1, 1 };
+    TEST_CHECK(packer.pack(&size, 0, placements.data()) == JAPACKER_ERROR_WRONG_PARAMETERS);
+    TEST_CHECK(packer.pack(0, 1, placements.data()) == JAPACKER_ERROR_WRONG_PARAMETERS);
+    TEST_CHECK(packer.pack(&size, 1, 0) == JAPACKER_ERROR_WRONG_PARAMETERS);
+}
+
+#ifdef JAPACKER_HAS_SPAN
+/**
+ * @brief The std::span overload gives the same placements as the pointer one, and rejects a placement span that's too
+ * small.
+ */
+static void test_pack_span(void)
+{
+    std::vector<japacker::size> sizes = test_get_sizes(300, 42);
+    std::vector<japacker::placement> placements(sizes.size());
+    japacker::packer packer(256, 256, JAPACKER_SORT_BY_AREA, true);
+    packer.options().fail_policy = JAPACKER_NEW_IMAGE;
+
+    int packed = packer.pack(std::span<const japacker::size>(sizes), std::span<japacker::placement>(placements));
+    TEST_CHECK(packed == static_cast<int>(sizes.size()));
+    TEST_CHECK(test_same_as_c(sizes, placements, packer.options(), 256, packed));
+
+    std::span<japacker::placement> too_small(placements.data(), placements.size() - 1);
+    TEST_CHECK(packer.pack(std::span<const japacker::size>(sizes), too_small) == JAPACKER_ERROR_WRONG_PARAMETERS);
+}
+#endif
+
+int main(void)
+{
+    test_pack();
+#ifdef JAPACKER_HAS_SPAN
+    test_pack_span();
+#endif
+    return test_finish("test_wrapper");
+}